@@ -90,6 +90,14 @@
 /* timerfd headers available */
 /* #undef USBI_TIMERFD_AVAILABLE */
 
+#ifndef _OSX_
+/* epoll available for event handling */
+#define USBI_EPOLL_AVAILABLE
+
+/* eventfd available for interrupting event handling */
+#define USBI_EVENTFD_AVAILABLE
+#endif /* _OSX_ */
+
 /* Version number of package */
 #define VERSION "1.0.8"
 
@@ -0,0 +1,279 @@
+/*
+ * libusb bulk transfer benchmark
+ * Copyright (C) 2026
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/* Times synchronous bulk IN transfers of 64kb to 1MB through the Linux
+ * backend, against a fake device. Like enumbench.c, the device lives in a
+ * fake sysfs tree; its usbfs node is a FIFO, so that it can be opened and
+ * polled, and the usbfs ioctls are intercepted with the linker's --wrap:
+ *
+ *   D='-DSYSFS_DEVICE_PATH="/tmp/bulkbench/sys" -DUSBFS_PATH="/tmp/bulkbench/usb"'
+ *   gcc -O2 $D -I. -Ilibusb -Ilibusb/os -o bulkbench examples/bulkbench.c \
+ *       libusb/core.c libusb/descriptor.c libusb/io.c libusb/sync.c \
+ *       libusb/os/linux_usbfs.c -Wl,--wrap=ioctl -lpthread -lrt
+ *   ./bulkbench [transfers]
+ *
+ * The fake kernel completes each URB as soon as it is submitted, copying
+ * the data as usbfs would and making one real system call per ioctl, so
+ * the figures are the host side cost of a transfer: URB setup, submission
+ * and reaping. Set LIBUSB_BULK_URB_SIZE=16384 to compare with the URB size
+ * used by kernels before 3.3.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <libusb.h>
+
+#include "linux_usbfs.h"
+
+#if !defined(SYSFS_DEVICE_PATH) || !defined(USBFS_PATH)
+#error "build with -DSYSFS_DEVICE_PATH=... -DUSBFS_PATH=..., see above"
+#endif
+
+#define MAX_TRANSFER	(1024 * 1024)
+#define MAX_URBS	1024
+
+/* the fake kernel: URBs submitted and not yet reaped */
+static struct usbfs_urb *queue[MAX_URBS];
+static int queue_head;
+static int queue_len;
+static unsigned long ioctls;
+static unsigned char device_data[MAX_TRANSFER];
+
+int __real_ioctl(int fd, unsigned long request, ...);
+
+int __wrap_ioctl(int fd, unsigned long request, ...)
+{
+	struct usbfs_urb *urb;
+	va_list ap;
+	void *arg;
+	int n;
+
+	va_start(ap, request);
+	arg = va_arg(ap, void *);
+	va_end(ap);
+
+	/* the cost of entering the kernel */
+	__real_ioctl(fd, FIONREAD, &n);
+	ioctls++;
+
+	switch (request) {
+	case IOCTL_USBFS_GET_CAPABILITIES:
+		*(unsigned int *) arg = USBFS_CAP_ZERO_PACKET
+			| USBFS_CAP_BULK_CONTINUATION | USBFS_CAP_NO_PACKET_SIZE_LIM;
+		return 0;
+	case IOCTL_USBFS_SUBMITURB:
+		urb = arg;
+		if (queue_len == MAX_URBS) {
+			errno = ENOMEM;
+			return -1;
+		}
+		memcpy(urb->buffer, device_data, urb->buffer_length);
+		urb->actual_length = urb->buffer_length;
+		urb->status = 0;
+		queue[(queue_head + queue_len++) % MAX_URBS] = urb;
+		return 0;
+	case IOCTL_USBFS_REAPURB:
+	case IOCTL_USBFS_REAPURBNDELAY:
+		if (queue_len == 0) {
+			errno = EAGAIN;
+			return -1;
+		}
+		*(void **) arg = queue[queue_head];
+		queue_head = (queue_head + 1) % MAX_URBS;
+		queue_len--;
+		return 0;
+	case IOCTL_USBFS_DISCARDURB:
+		errno = EINVAL;
+		return -1;
+	default:
+		return 0;
+	}
+}
+
+static int mkdirs(const char *path)
+{
+	char tmp[256];
+	char *p;
+
+	snprintf(tmp, sizeof(tmp), "%s", path);
+	for (p = tmp + 1; *p; p++) {
+		if (*p != '/')
+			continue;
+		*p = 0;
+		if (mkdir(tmp, 0755) < 0 && errno != EEXIST)
+			return -1;
+		*p = '/';
+	}
+	if (mkdir(tmp, 0755) < 0 && errno != EEXIST)
+		return -1;
+	return 0;
+}
+
+static int write_attr(const char *dir, const char *attr, const void *buf,
+	size_t len)
+{
+	char path[512];
+	int fd;
+	ssize_t r;
+
+	snprintf(path, sizeof(path), "%s/%s", dir, attr);
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		return -1;
+	r = write(fd, buf, len);
+	close(fd);
+	return r == (ssize_t) len ? 0 : -1;
+}
+
+/* an FT2232H on bus 1, address 2 */
+static int add_device(void)
+{
+	static const unsigned char desc[18 + 9 + 9 + 7 + 7] = {
+		/* device */
+		18, 1, 0x00, 0x02, 0, 0, 0, 64, 0x03, 0x04, 0x10, 0x60,
+		0x00, 0x07, 1, 2, 3, 1,
+		/* configuration */
+		9, 2, 32, 0, 1, 1, 0, 0x80, 45,
+		/* interface */
+		9, 4, 0, 0, 2, 0xff, 0xff, 0xff, 2,
+		/* endpoints */
+		7, 5, 0x81, 2, 0x00, 0x02, 0,
+		7, 5, 0x02, 2, 0x00, 0x02, 0,
+	};
+	char dir[256];
+	char path[512];
+
+	snprintf(dir, sizeof(dir), "%s/1-1", SYSFS_DEVICE_PATH);
+	if (mkdirs(dir) < 0)
+		return -1;
+	if (write_attr(dir, "busnum", "1\n", 2) < 0
+			|| write_attr(dir, "devnum", "2\n", 2) < 0
+			|| write_attr(dir, "bConfigurationValue", "1\n", 2) < 0
+			|| write_attr(dir, "descriptors", desc, sizeof(desc)) < 0)
+		return -1;
+
+	snprintf(dir, sizeof(dir), "%s/001", USBFS_PATH);
+	if (mkdirs(dir) < 0)
+		return -1;
+	snprintf(path, sizeof(path), "%s/002", dir);
+	unlink(path);
+	return mkfifo(path, 0644);
+}
+
+static void remove_device(void)
+{
+	static const char *attrs[] = {
+		"busnum", "devnum", "bConfigurationValue", "descriptors", NULL
+	};
+	char path[512];
+	int i;
+
+	for (i = 0; attrs[i]; i++) {
+		snprintf(path, sizeof(path), "%s/1-1/%s", SYSFS_DEVICE_PATH, attrs[i]);
+		unlink(path);
+	}
+	snprintf(path, sizeof(path), "%s/1-1", SYSFS_DEVICE_PATH);
+	rmdir(path);
+	snprintf(path, sizeof(path), "%s/001/002", USBFS_PATH);
+	unlink(path);
+}
+
+static double now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+int main(int argc, char **argv)
+{
+	int transfers = argc > 1 ? atoi(argv[1]) : 2000;
+	static unsigned char buf[MAX_TRANSFER];
+	libusb_device_handle *handle;
+	libusb_context *ctx;
+	int length;
+	int i;
+	int r;
+
+	if (transfers < 1) {
+		fprintf(stderr, "usage: %s [transfers]\n", argv[0]);
+		return 1;
+	}
+
+	if (add_device() < 0) {
+		perror("creating fake tree");
+		return 1;
+	}
+	for (i = 0; i < MAX_TRANSFER; i++)
+		device_data[i] = i * 7;
+
+	r = libusb_init(&ctx);
+	if (r < 0) {
+		fprintf(stderr, "libusb_init failed: %d\n", r);
+		return 1;
+	}
+	handle = libusb_open_device_with_vid_pid(ctx, 0x0403, 0x6010);
+	if (!handle) {
+		fprintf(stderr, "could not open the fake device\n");
+		return 1;
+	}
+
+	for (length = 64 * 1024; length <= MAX_TRANSFER; length *= 2) {
+		unsigned long ioctls0 = ioctls;
+		double t;
+		int transferred;
+
+		t = now_us();
+		for (i = 0; i < transfers; i++) {
+			r = libusb_bulk_transfer(handle, 0x81, buf, length,
+				&transferred, 1000);
+			if (r < 0 || transferred != length) {
+				fprintf(stderr, "transfer %d failed: %d, %d bytes\n", i, r,
+					transferred);
+				return 1;
+			}
+		}
+		t = now_us() - t;
+
+		if (memcmp(buf, device_data, length) != 0) {
+			fprintf(stderr, "%d byte transfers: data mismatch\n", length);
+			return 1;
+		}
+		printf("%5d kb: %7.1f us per transfer, %6.0f MB/s, "
+			"%.0f ioctls per transfer\n", length / 1024, t / transfers,
+			(double) length * transfers / t,
+			(double) (ioctls - ioctls0) / transfers);
+	}
+
+	libusb_close(handle);
+	libusb_exit(ctx);
+	remove_device();
+	return 0;
+}
@@ -0,0 +1,252 @@
+/*
+ * libusb enumeration benchmark
+ * Copyright (C) 2026
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/* Times libusb_get_device_list() against a fake sysfs tree, so that the
+ * enumeration path can be measured without real hardware. The Linux backend
+ * must be built with the same tree, for example:
+ *
+ *   D='-DSYSFS_DEVICE_PATH="/tmp/enumbench/sys" -DUSBFS_PATH="/tmp/enumbench/usb"'
+ *   gcc -O2 $D -I. -Ilibusb -Ilibusb/os -o enumbench examples/enumbench.c \
+ *       libusb/core.c libusb/descriptor.c libusb/io.c libusb/sync.c \
+ *       libusb/os/linux_usbfs.c -lpthread -lrt
+ *   ./enumbench [devices] [scans]
+ *
+ * Each scan frees the previous device list and reads every device
+ * descriptor, as an application filtering on vendor and product ID would.
+ * Halfway through, one device is unplugged and replugged at a new address
+ * to check that the rescan notices it.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <libusb.h>
+
+#if !defined(SYSFS_DEVICE_PATH) || !defined(USBFS_PATH)
+#error "build with -DSYSFS_DEVICE_PATH=... -DUSBFS_PATH=..., see above"
+#endif
+
+static int mkdirs(const char *path)
+{
+	char tmp[256];
+	char *p;
+
+	snprintf(tmp, sizeof(tmp), "%s", path);
+	for (p = tmp + 1; *p; p++) {
+		if (*p != '/')
+			continue;
+		*p = 0;
+		if (mkdir(tmp, 0755) < 0 && errno != EEXIST)
+			return -1;
+		*p = '/';
+	}
+	if (mkdir(tmp, 0755) < 0 && errno != EEXIST)
+		return -1;
+	return 0;
+}
+
+static int write_attr(const char *dir, const char *attr, const void *buf,
+	size_t len)
+{
+	char path[512];
+	int fd;
+	ssize_t r;
+
+	snprintf(path, sizeof(path), "%s/%s", dir, attr);
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		return -1;
+	r = write(fd, buf, len);
+	close(fd);
+	return r == (ssize_t) len ? 0 : -1;
+}
+
+/* create the sysfs directory and usbfs node for one device. port 0 is the
+ * root hub. */
+static int add_device(int port, int devnum)
+{
+	unsigned char desc[18 + 9 + 9 + 7] = {
+		/* device */
+		18, 1, 0x00, 0x02, 0, 0, 0, 64, 0x03, 0x04, 0x01, 0x60,
+		0x00, 0x06, 1, 2, 3, 1,
+		/* configuration */
+		9, 2, 25, 0, 1, 1, 0, 0x80, 45,
+		/* interface */
+		9, 4, 0, 0, 1, 0xff, 0xff, 0xff, 2,
+		/* endpoint */
+		7, 5, 0x81, 2, 64, 0, 0,
+	};
+	char dir[256];
+	char num[16];
+
+	if (port == 0) {
+		snprintf(dir, sizeof(dir), "%s/usb1", SYSFS_DEVICE_PATH);
+		desc[4] = 9;
+	} else {
+		snprintf(dir, sizeof(dir), "%s/1-%d", SYSFS_DEVICE_PATH, port);
+	}
+	if (mkdirs(dir) < 0)
+		return -1;
+
+	if (write_attr(dir, "busnum", "1\n", 2) < 0)
+		return -1;
+	snprintf(num, sizeof(num), "%d\n", devnum);
+	if (write_attr(dir, "devnum", num, strlen(num)) < 0)
+		return -1;
+	if (write_attr(dir, "bConfigurationValue", "1\n", 2) < 0)
+		return -1;
+	if (write_attr(dir, "descriptors", desc, sizeof(desc)) < 0)
+		return -1;
+
+	snprintf(dir, sizeof(dir), "%s/001", USBFS_PATH);
+	if (mkdirs(dir) < 0)
+		return -1;
+	snprintf(num, sizeof(num), "%03d", devnum);
+	return write_attr(dir, num, desc, 18);
+}
+
+static void remove_device(int port, int devnum)
+{
+	static const char *attrs[] = {
+		"busnum", "devnum", "bConfigurationValue", "descriptors", NULL
+	};
+	char dir[256];
+	char path[512];
+	int i;
+
+	if (port == 0)
+		snprintf(dir, sizeof(dir), "%s/usb1", SYSFS_DEVICE_PATH);
+	else
+		snprintf(dir, sizeof(dir), "%s/1-%d", SYSFS_DEVICE_PATH, port);
+
+	for (i = 0; attrs[i]; i++) {
+		snprintf(path, sizeof(path), "%s/%s", dir, attrs[i]);
+		unlink(path);
+	}
+	rmdir(dir);
+	snprintf(path, sizeof(path), "%s/001/%03d", USBFS_PATH, devnum);
+	unlink(path);
+}
+
+static double now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+/* one enumeration as an application would do it. returns the device count,
+ * or a LIBUSB_ERROR code. */
+static ssize_t scan(libusb_context *ctx)
+{
+	libusb_device **list;
+	struct libusb_device_descriptor desc;
+	ssize_t cnt;
+	ssize_t i;
+	int r;
+
+	cnt = libusb_get_device_list(ctx, &list);
+	if (cnt < 0)
+		return cnt;
+
+	for (i = 0; i < cnt; i++) {
+		r = libusb_get_device_descriptor(list[i], &desc);
+		if (r < 0) {
+			cnt = r;
+			break;
+		}
+	}
+
+	libusb_free_device_list(list, 1);
+	return cnt;
+}
+
+int main(int argc, char **argv)
+{
+	int devices = argc > 1 ? atoi(argv[1]) : 64;
+	int scans = argc > 2 ? atoi(argv[2]) : 1000;
+	libusb_context *ctx;
+	double t, first, total = 0, worst = 0;
+	ssize_t cnt;
+	int i;
+	int r;
+
+	if (devices < 1 || devices > 126 || scans < 2) {
+		fprintf(stderr, "usage: %s [devices (1-126)] [scans]\n", argv[0]);
+		return 1;
+	}
+
+	for (i = 0; i <= devices; i++)
+		if (add_device(i, i + 1) < 0) {
+			perror("creating fake tree");
+			return 1;
+		}
+
+	r = libusb_init(&ctx);
+	if (r < 0) {
+		fprintf(stderr, "libusb_init failed: %d\n", r);
+		return 1;
+	}
+
+	t = now_us();
+	cnt = scan(ctx);
+	first = now_us() - t;
+	if (cnt != devices + 1) {
+		fprintf(stderr, "first scan found %zd devices\n", cnt);
+		return 1;
+	}
+
+	for (i = 1; i < scans; i++) {
+		if (i == scans / 2) {
+			/* replug the last device at the next free address */
+			remove_device(devices, devices + 1);
+			add_device(devices, devices + 2);
+		}
+
+		t = now_us();
+		cnt = scan(ctx);
+		t = now_us() - t;
+		if (cnt != devices + 1) {
+			fprintf(stderr, "scan %d found %zd devices\n", i, cnt);
+			return 1;
+		}
+		total += t;
+		if (t > worst)
+			worst = t;
+	}
+
+	libusb_exit(ctx);
+
+	printf("%d devices: first scan %.1f us, rescans %.1f us average, "
+		"%.1f us worst (%d scans)\n", devices + 1, first,
+		total / (scans - 1), worst, scans - 1);
+
+	for (i = 0; i < devices; i++)
+		remove_device(i, i + 1);
+	remove_device(devices, devices + 2);
+	return 0;
+}
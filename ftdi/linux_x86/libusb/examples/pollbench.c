@@ -0,0 +1,170 @@
+/*
+ * libusb event handling benchmark
+ * Copyright (C) 2026
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/* Measures the cost of one libusb_handle_events_timeout() call that finds a
+ * single ready fd, as the number of registered fds grows from 1 to 128. The
+ * fds are pipes standing in for open devices, and this file provides the OS
+ * backend, so it is linked with the core sources instead of
+ * os/linux_usbfs.c:
+ *
+ *   gcc -O2 -I. -Ilibusb -o pollbench examples/pollbench.c \
+ *       libusb/core.c libusb/descriptor.c libusb/io.c libusb/sync.c \
+ *       -lpthread -lrt
+ *   ./pollbench [iterations]
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "libusbi.h"
+
+#define MAX_FDS	128
+
+static int pipes[MAX_FDS][2];
+static unsigned long events_handled;
+
+static int mock_get_device_list(struct libusb_context *ctx,
+	struct discovered_devs **discdevs)
+{
+	return 0;
+}
+
+/* drain every ready pipe, as a real backend would reap every ready device */
+static int mock_handle_events(struct libusb_context *ctx,
+	struct pollfd *fds, nfds_t nfds, int num_ready)
+{
+	unsigned char dummy;
+	nfds_t i;
+
+	for (i = 0; i < nfds && num_ready > 0; i++) {
+		if (!fds[i].revents)
+			continue;
+		num_ready--;
+		if (read(fds[i].fd, &dummy, sizeof(dummy)) == sizeof(dummy))
+			events_handled++;
+	}
+	return 0;
+}
+
+static int mock_clock_gettime(int clk_id, struct timespec *tp)
+{
+	return clock_gettime(clk_id == USBI_CLOCK_MONOTONIC ?
+		CLOCK_MONOTONIC : CLOCK_REALTIME, tp);
+}
+
+#ifdef USBI_TIMERFD_AVAILABLE
+static clockid_t mock_get_timerfd_clockid(void)
+{
+	return CLOCK_MONOTONIC;
+}
+#endif
+
+/* core.c binds to this name on Linux */
+const struct usbi_os_backend linux_usbfs_backend = {
+	.name = "Benchmark mock",
+	.get_device_list = mock_get_device_list,
+	.handle_events = mock_handle_events,
+	.clock_gettime = mock_clock_gettime,
+#ifdef USBI_TIMERFD_AVAILABLE
+	.get_timerfd_clockid = mock_get_timerfd_clockid,
+#endif
+};
+
+static double now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+int main(int argc, char **argv)
+{
+	int iterations = argc > 1 ? atoi(argv[1]) : 100000;
+	struct timeval zero = { 0, 0 };
+	libusb_context *ctx;
+	unsigned char dummy = 1;
+	int registered = 0;
+	int nfds;
+	int i;
+	int r;
+
+	if (iterations < 1) {
+		fprintf(stderr, "usage: %s [iterations]\n", argv[0]);
+		return 1;
+	}
+
+	r = libusb_init(&ctx);
+	if (r < 0) {
+		fprintf(stderr, "libusb_init failed: %d\n", r);
+		return 1;
+	}
+
+	printf("%s\n", usbi_using_epoll(ctx) ? "epoll" : "poll");
+	for (nfds = 1; nfds <= MAX_FDS; nfds *= 2) {
+		double t;
+
+		for (; registered < nfds; registered++) {
+			if (pipe(pipes[registered]) < 0) {
+				perror("pipe");
+				return 1;
+			}
+			r = usbi_add_pollfd(ctx, pipes[registered][0], POLLIN);
+			if (r < 0) {
+				fprintf(stderr, "usbi_add_pollfd failed: %d\n", r);
+				return 1;
+			}
+		}
+
+		events_handled = 0;
+		t = now_us();
+		for (i = 0; i < iterations; i++) {
+			/* spread events across the fds, so each one gets its turn */
+			if (write(pipes[(i * 7) % nfds][1], &dummy, 1) != 1) {
+				perror("write");
+				return 1;
+			}
+			r = libusb_handle_events_timeout(ctx, &zero);
+			if (r < 0) {
+				fprintf(stderr, "handle_events failed: %d\n", r);
+				return 1;
+			}
+		}
+		t = now_us() - t;
+
+		if (events_handled != (unsigned long) iterations) {
+			fprintf(stderr, "%d fds: handled %lu of %d events\n", nfds,
+				events_handled, iterations);
+			return 1;
+		}
+		printf("%4d fds: %.3f us per event\n", nfds, t / iterations);
+	}
+
+	for (i = 0; i < registered; i++) {
+		usbi_remove_pollfd(ctx, pipes[i][0]);
+		close(pipes[i][0]);
+		close(pipes[i][1]);
+	}
+	libusb_exit(ctx);
+	return 0;
+}
@@ -0,0 +1,330 @@
+/*
+ * libusb event handler wakeup benchmark
+ * Copyright (C) 2026
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/* One thread handles events with a long timeout while another submits
+ * bursts of asynchronous transfers to a mock device, which completes each
+ * burst at once. Reports how often the event handler woke up per burst and
+ * how many read/write syscalls each transfer cost, then checks that a short
+ * transfer timeout is honoured while the handler is waiting. Like
+ * pollbench.c, this file provides the OS backend:
+ *
+ *   gcc -O2 -I. -Ilibusb -o wakebench examples/wakebench.c \
+ *       libusb/core.c libusb/descriptor.c libusb/io.c libusb/sync.c \
+ *       -lpthread -lrt
+ *   ./wakebench [bursts]
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "libusbi.h"
+
+struct mock_transfer_priv {
+	struct list_head list;
+	struct usbi_transfer *itransfer;
+	int cancelled;
+};
+
+/* the mock device: submitted transfers wait on this list until a byte is
+ * written to device_pipe, which completes (or cancels) all of them */
+static struct list_head device_queue;
+static pthread_mutex_t device_lock = PTHREAD_MUTEX_INITIALIZER;
+static int device_pipe[2];
+
+/* runs before the context's poll fds are set up; main() registers the pipe */
+static int mock_init(struct libusb_context *ctx)
+{
+	list_init(&device_queue);
+	if (pipe(device_pipe) < 0)
+		return LIBUSB_ERROR_OTHER;
+	return 0;
+}
+
+static void mock_exit(struct libusb_context *ctx)
+{
+	close(device_pipe[0]);
+	close(device_pipe[1]);
+}
+
+static int mock_get_device_list(struct libusb_context *ctx,
+	struct discovered_devs **discdevs)
+{
+	return 0;
+}
+
+static int mock_submit_transfer(struct usbi_transfer *itransfer)
+{
+	struct mock_transfer_priv *tpriv = usbi_transfer_get_os_priv(itransfer);
+
+	tpriv->itransfer = itransfer;
+	tpriv->cancelled = 0;
+	pthread_mutex_lock(&device_lock);
+	list_add_tail(&tpriv->list, &device_queue);
+	pthread_mutex_unlock(&device_lock);
+	return 0;
+}
+
+static int mock_cancel_transfer(struct usbi_transfer *itransfer)
+{
+	struct mock_transfer_priv *tpriv = usbi_transfer_get_os_priv(itransfer);
+	unsigned char dummy = 1;
+
+	tpriv->cancelled = 1;
+	return write(device_pipe[1], &dummy, 1) == 1 ? 0 : LIBUSB_ERROR_IO;
+}
+
+static void mock_clear_transfer_priv(struct usbi_transfer *itransfer)
+{
+}
+
+static int mock_handle_events(struct libusb_context *ctx,
+	struct pollfd *fds, nfds_t nfds, int num_ready)
+{
+	unsigned char buf[64];
+	struct list_head done;
+	struct mock_transfer_priv *tpriv;
+	struct mock_transfer_priv *tmp;
+	nfds_t i;
+
+	for (i = 0; i < nfds; i++)
+		if (fds[i].fd == device_pipe[0] && fds[i].revents)
+			break;
+	if (i == nfds)
+		return 0;
+
+	if (read(device_pipe[0], buf, sizeof(buf)) <= 0)
+		return LIBUSB_ERROR_IO;
+
+	list_init(&done);
+	pthread_mutex_lock(&device_lock);
+	list_for_each_entry_safe(tpriv, tmp, &device_queue, list) {
+		list_del(&tpriv->list);
+		list_add_tail(&tpriv->list, &done);
+	}
+	pthread_mutex_unlock(&device_lock);
+
+	list_for_each_entry_safe(tpriv, tmp, &done, list) {
+		struct usbi_transfer *itransfer = tpriv->itransfer;
+
+		list_del(&tpriv->list);
+		if (tpriv->cancelled) {
+			usbi_handle_transfer_cancellation(itransfer);
+		} else {
+			itransfer->transferred =
+				__USBI_TRANSFER_TO_LIBUSB_TRANSFER(itransfer)->length;
+			usbi_handle_transfer_completion(itransfer,
+				LIBUSB_TRANSFER_COMPLETED);
+		}
+	}
+	return 0;
+}
+
+static int mock_clock_gettime(int clk_id, struct timespec *tp)
+{
+	return clock_gettime(clk_id == USBI_CLOCK_MONOTONIC ?
+		CLOCK_MONOTONIC : CLOCK_REALTIME, tp);
+}
+
+#ifdef USBI_TIMERFD_AVAILABLE
+static clockid_t mock_get_timerfd_clockid(void)
+{
+	return CLOCK_MONOTONIC;
+}
+#endif
+
+/* core.c binds to this name on Linux */
+const struct usbi_os_backend linux_usbfs_backend = {
+	.name = "Benchmark mock",
+	.init = mock_init,
+	.exit = mock_exit,
+	.get_device_list = mock_get_device_list,
+	.submit_transfer = mock_submit_transfer,
+	.cancel_transfer = mock_cancel_transfer,
+	.clear_transfer_priv = mock_clear_transfer_priv,
+	.handle_events = mock_handle_events,
+	.clock_gettime = mock_clock_gettime,
+#ifdef USBI_TIMERFD_AVAILABLE
+	.get_timerfd_clockid = mock_get_timerfd_clockid,
+#endif
+	.transfer_priv_size = sizeof(struct mock_transfer_priv),
+};
+
+static libusb_context *ctx;
+static volatile int stop;
+static volatile unsigned long wakeups;
+
+static pthread_mutex_t done_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t done_cond = PTHREAD_COND_INITIALIZER;
+static int completed;
+static enum libusb_transfer_status last_status;
+
+static void *event_thread(void *arg)
+{
+	struct timeval tv = { 10, 0 };
+
+	while (!stop) {
+		libusb_handle_events_timeout(ctx, &tv);
+		wakeups++;
+	}
+	return NULL;
+}
+
+static void transfer_cb(struct libusb_transfer *transfer)
+{
+	pthread_mutex_lock(&done_lock);
+	completed++;
+	last_status = transfer->status;
+	pthread_cond_signal(&done_cond);
+	pthread_mutex_unlock(&done_lock);
+}
+
+static void wait_completed(int n)
+{
+	pthread_mutex_lock(&done_lock);
+	while (completed < n)
+		pthread_cond_wait(&done_cond, &done_lock);
+	completed = 0;
+	pthread_mutex_unlock(&done_lock);
+}
+
+/* read and write syscalls made by this process so far */
+static unsigned long syscalls(void)
+{
+	char line[64];
+	unsigned long n = 0;
+	unsigned long v;
+	FILE *f = fopen("/proc/self/io", "r");
+
+	if (!f)
+		return 0;
+	while (fgets(line, sizeof(line), f))
+		if (sscanf(line, "syscr: %lu", &v) == 1
+				|| sscanf(line, "syscw: %lu", &v) == 1)
+			n += v;
+	fclose(f);
+	return n;
+}
+
+static double now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+int main(int argc, char **argv)
+{
+	int bursts = argc > 1 ? atoi(argv[1]) : 2000;
+	static const int sizes[] = { 1, 8, 64 };
+	struct libusb_transfer *transfers[64];
+	static unsigned char buf[64];
+	struct libusb_device_handle *handle;
+	struct libusb_device *dev;
+	unsigned char dummy = 1;
+	pthread_t thread;
+	double t;
+	int s, b, i, r;
+
+	if (bursts < 1) {
+		fprintf(stderr, "usage: %s [bursts]\n", argv[0]);
+		return 1;
+	}
+
+	r = libusb_init(&ctx);
+	if (r < 0) {
+		fprintf(stderr, "libusb_init failed: %d\n", r);
+		return 1;
+	}
+
+	r = usbi_add_pollfd(ctx, device_pipe[0], POLLIN);
+	if (r < 0) {
+		fprintf(stderr, "usbi_add_pollfd failed: %d\n", r);
+		return 1;
+	}
+
+	/* a device handle for the transfers to refer to; nothing is opened */
+	dev = usbi_alloc_device(ctx, 1);
+	handle = calloc(1, sizeof(*handle));
+	if (!dev || !handle)
+		return 1;
+	handle->dev = dev;
+
+	for (i = 0; i < 64; i++) {
+		transfers[i] = libusb_alloc_transfer(0);
+		libusb_fill_bulk_transfer(transfers[i], handle, 0x81, buf,
+			sizeof(buf), transfer_cb, NULL, 1000);
+	}
+
+	pthread_create(&thread, NULL, event_thread, NULL);
+	usleep(10000);
+
+	for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+		int n = sizes[s];
+		unsigned long w0 = wakeups;
+		unsigned long c0 = syscalls();
+
+		for (b = 0; b < bursts; b++) {
+			for (i = 0; i < n; i++) {
+				r = libusb_submit_transfer(transfers[i]);
+				if (r < 0) {
+					fprintf(stderr, "submit failed: %d\n", r);
+					return 1;
+				}
+			}
+			/* the device completes the whole burst */
+			if (write(device_pipe[1], &dummy, 1) != 1)
+				return 1;
+			wait_completed(n);
+		}
+
+		printf("burst of %2d: %.2f event handler wakeups per burst, "
+			"%.2f read/write syscalls per transfer\n", n,
+			(double) (wakeups - w0) / bursts,
+			(double) (syscalls() - c0) / ((double) bursts * n));
+	}
+
+	/* a transfer with a short timeout, submitted while the event handler
+	 * is waiting with a long one, must still time out on time */
+	transfers[0]->timeout = 50;
+	usleep(10000);
+	t = now_ms();
+	libusb_submit_transfer(transfers[0]);
+	wait_completed(1);
+	t = now_ms() - t;
+	printf("50 ms timeout while handler waits 10 s: %s after %.1f ms\n",
+		last_status == LIBUSB_TRANSFER_TIMED_OUT ? "timed out" : "completed",
+		t);
+
+	stop = 1;
+	write(device_pipe[1], &dummy, 1);
+	pthread_join(thread, NULL);
+
+	for (i = 0; i < 64; i++)
+		libusb_free_transfer(transfers[i]);
+	free(handle);
+	libusb_unref_device(dev);
+	usbi_remove_pollfd(ctx, device_pipe[0]);
+	libusb_exit(ctx);
+	return 0;
+}
@@ -859,7 +859,6 @@ API_EXPORTED int libusb_open(libusb_device *dev, libusb_device_handle **handle)
 	struct libusb_context *ctx = DEVICE_CTX(dev);
 	struct libusb_device_handle *_handle;
 	size_t priv_size = usbi_backend->device_handle_priv_size;
-	unsigned char dummy = 1;
 	int r;
 	usbi_dbg("open %d.%d", dev->bus_number, dev->device_address);
 
@@ -900,10 +899,9 @@ API_EXPORTED int libusb_open(libusb_device *dev, libusb_device_handle **handle)
 	ctx->pollfd_modify++;
 	pthread_mutex_unlock(&ctx->pollfd_modify_lock);
 
-	/* write some data on control pipe to interrupt event handlers */
-	r = write(ctx->ctrl_pipe[1], &dummy, sizeof(dummy));
-	if (r <= 0) {
-		usbi_warn(ctx, "internal signalling write failed");
+	/* interrupt event handlers through the control pipe */
+	r = usbi_signal_event(ctx);
+	if (r < 0) {
 		pthread_mutex_lock(&ctx->pollfd_modify_lock);
 		ctx->pollfd_modify--;
 		pthread_mutex_unlock(&ctx->pollfd_modify_lock);
@@ -913,10 +911,8 @@ API_EXPORTED int libusb_open(libusb_device *dev, libusb_device_handle **handle)
 	/* take event handling lock */
 	libusb_lock_events(ctx);
 
-	/* read the dummy data */
-	r = read(ctx->ctrl_pipe[0], &dummy, sizeof(dummy));
-	if (r <= 0)
-		usbi_warn(ctx, "internal signalling read failed");
+	/* consume the wakeup, unless the event handler already did */
+	usbi_clear_event(ctx);
 
 	/* we're done with modifying poll fds */
 	pthread_mutex_lock(&ctx->pollfd_modify_lock);
@@ -1006,8 +1002,7 @@ static void do_close(struct libusb_context *ctx,
 API_EXPORTED void libusb_close(libusb_device_handle *dev_handle)
 {
 	struct libusb_context *ctx;
-	unsigned char dummy = 1;
-	ssize_t r;
+	int r;
 
 	if (!dev_handle)
 		return;
@@ -1026,10 +1021,10 @@ API_EXPORTED void libusb_close(libusb_device_handle *dev_handle)
 	ctx->pollfd_modify++;
 	pthread_mutex_unlock(&ctx->pollfd_modify_lock);
 
-	/* write some data on control pipe to interrupt event handlers */
-	r = write(ctx->ctrl_pipe[1], &dummy, sizeof(dummy));
-	if (r <= 0) {
-		usbi_warn(ctx, "internal signalling write failed, closing anyway");
+	/* interrupt event handlers through the control pipe */
+	r = usbi_signal_event(ctx);
+	if (r < 0) {
+		usbi_warn(ctx, "closing anyway");
 		do_close(ctx, dev_handle);
 		pthread_mutex_lock(&ctx->pollfd_modify_lock);
 		ctx->pollfd_modify--;
@@ -1040,10 +1035,8 @@ API_EXPORTED void libusb_close(libusb_device_handle *dev_handle)
 	/* take event handling lock */
 	libusb_lock_events(ctx);
 
-	/* read the dummy data */
-	r = read(ctx->ctrl_pipe[0], &dummy, sizeof(dummy));
-	if (r <= 0)
-		usbi_warn(ctx, "internal signalling read failed, closing anyway");
+	/* consume the wakeup, unless the event handler already did */
+	usbi_clear_event(ctx);
 
 	/* Close the device */
 	do_close(ctx, dev_handle);
@@ -1409,6 +1402,53 @@ API_EXPORTED int libusb_attach_kernel_driver(libusb_device_handle *dev,
 		return LIBUSB_ERROR_NOT_SUPPORTED;
 }
 
+/** \ingroup dev
+ * Allocate memory for transfers on a device. The memory is shared with the
+ * operating system where the platform allows it, so that bulk transfers
+ * whose buffers lie inside it skip the copy between user and kernel space.
+ * On Linux this needs a kernel which can map usbfs memory (4.6 or newer).
+ *
+ * The memory is zeroed and page aligned, and must be released with
+ * libusb_dev_mem_free() before the handle is closed. Callers should be
+ * prepared for this function to fail and fall back to malloc() or a static
+ * buffer: such memory works with every transfer function, just without the
+ * zero-copy benefit.
+ *
+ * \param dev a device handle
+ * \param length size of the buffer in bytes
+ * \returns a pointer to the memory, or NULL if it could not be allocated or
+ * the platform does not support it
+ * \see libusb_dev_mem_free()
+ */
+API_EXPORTED unsigned char *libusb_dev_mem_alloc(libusb_device_handle *dev,
+	size_t length)
+{
+	usbi_dbg("length %zu", length);
+	if (!length || !usbi_backend->dev_mem_alloc)
+		return NULL;
+	return usbi_backend->dev_mem_alloc(dev, length);
+}
+
+/** \ingroup dev
+ * Free memory allocated with libusb_dev_mem_alloc(). No transfer may still
+ * be using the memory.
+ *
+ * \param dev the device handle the memory was allocated for
+ * \param buffer the memory, as returned by libusb_dev_mem_alloc()
+ * \param length the length passed to libusb_dev_mem_alloc()
+ * \returns 0 on success
+ * \returns LIBUSB_ERROR_NOT_SUPPORTED if the platform does not support it
+ * \returns another LIBUSB_ERROR code on other failure
+ */
+API_EXPORTED int libusb_dev_mem_free(libusb_device_handle *dev,
+	unsigned char *buffer, size_t length)
+{
+	usbi_dbg("length %zu", length);
+	if (!usbi_backend->dev_mem_free)
+		return LIBUSB_ERROR_NOT_SUPPORTED;
+	return usbi_backend->dev_mem_free(dev, buffer, length);
+}
+
 /** \ingroup lib
  * Set message verbosity.
  *  - Level 0: no messages ever printed by the library (default)
@@ -1484,7 +1524,7 @@ API_EXPORTED int libusb_init(libusb_context **context)
 	r = usbi_io_init(ctx);
 	if (r < 0) {
 		if (usbi_backend->exit)
-			usbi_backend->exit();
+			usbi_backend->exit(ctx);
 		goto err;
 	}
 
@@ -1521,7 +1561,7 @@ API_EXPORTED void libusb_exit(struct libusb_context *ctx)
 
 	usbi_io_exit(ctx);
 	if (usbi_backend->exit)
-		usbi_backend->exit();
+		usbi_backend->exit(ctx);
 
 	pthread_mutex_lock(&default_context_lock);
 	if (ctx == usbi_default_context) {
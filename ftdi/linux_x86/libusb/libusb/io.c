@@ -20,6 +20,7 @@
 
 #include <config.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <poll.h>
 #include <pthread.h>
 #include <signal.h>
@@ -34,6 +35,17 @@
 #include <sys/timerfd.h>
 #endif
 
+#ifdef USBI_EVENTFD_AVAILABLE
+#include <sys/eventfd.h>
+#endif
+
+#ifdef USBI_EPOLL_AVAILABLE
+#include <sys/epoll.h>
+
+/* most events collected by a single epoll_wait() call */
+#define USBI_MAX_EPOLL_EVENTS	64
+#endif
+
 #include "libusbi.h"
 
 /**
@@ -1008,16 +1020,42 @@ int usbi_io_init(struct libusb_context *ctx)
 	pthread_mutex_init(&ctx->flying_transfers_lock, NULL);
 	pthread_mutex_init(&ctx->pollfds_lock, NULL);
 	pthread_mutex_init(&ctx->pollfd_modify_lock, NULL);
+	pthread_mutex_init(&ctx->ctrl_pending_lock, NULL);
 	pthread_mutex_init(&ctx->events_lock, NULL);
 	pthread_mutex_init(&ctx->event_waiters_lock, NULL);
 	pthread_cond_init(&ctx->event_waiters_cond, NULL);
 	list_init(&ctx->flying_transfers);
 	list_init(&ctx->pollfds);
 
-	/* FIXME should use an eventfd on kernels that support it */
-	r = pipe(ctx->ctrl_pipe);
-	if (r < 0)
-		return LIBUSB_ERROR_OTHER;
+#ifdef USBI_EPOLL_AVAILABLE
+	/* must exist before the first usbi_add_pollfd() call */
+	ctx->epfd = epoll_create(USBI_MAX_EPOLL_EVENTS);
+	if (ctx->epfd >= 0) {
+		usbi_dbg("using epoll for event handling");
+		fcntl(ctx->epfd, F_SETFD, FD_CLOEXEC);
+	} else {
+		usbi_dbg("epoll not available (code %d error %d)", ctx->epfd, errno);
+		ctx->epfd = -1;
+	}
+#endif
+
+	ctx->ctrl_pending = 0;
+	timerclear(&ctx->wait_deadline);
+#ifdef USBI_EVENTFD_AVAILABLE
+	/* one fd and one syscall per direction instead of two pipe ends. fall
+	 * back on the pipe for kernels without eventfd (pre-2.6.22) */
+	r = eventfd(0, 0);
+	if (r >= 0) {
+		usbi_dbg("using eventfd for signalling");
+		fcntl(r, F_SETFD, FD_CLOEXEC);
+		ctx->ctrl_pipe[0] = ctx->ctrl_pipe[1] = r;
+	} else
+#endif
+	{
+		r = pipe(ctx->ctrl_pipe);
+		if (r < 0)
+			return LIBUSB_ERROR_OTHER;
+	}
 
 	r = usbi_add_pollfd(ctx, ctx->ctrl_pipe[0], POLLIN);
 	if (r < 0)
@@ -1046,13 +1084,133 @@ void usbi_io_exit(struct libusb_context *ctx)
 {
 	usbi_remove_pollfd(ctx, ctx->ctrl_pipe[0]);
 	close(ctx->ctrl_pipe[0]);
-	close(ctx->ctrl_pipe[1]);
+	if (ctx->ctrl_pipe[1] != ctx->ctrl_pipe[0])
+		close(ctx->ctrl_pipe[1]);
 #ifdef USBI_TIMERFD_AVAILABLE
 	if (usbi_using_timerfd(ctx)) {
 		usbi_remove_pollfd(ctx, ctx->timerfd);
 		close(ctx->timerfd);
 	}
 #endif
+#ifdef USBI_EPOLL_AVAILABLE
+	if (usbi_using_epoll(ctx))
+		close(ctx->epfd);
+#endif
+}
+
+static int signal_event_locked(struct libusb_context *ctx)
+{
+	ssize_t r;
+
+	if (ctx->ctrl_pending)
+		return 0;
+
+	if (ctx->ctrl_pipe[1] == ctx->ctrl_pipe[0]) {
+		uint64_t one = 1;
+		r = write(ctx->ctrl_pipe[1], &one, sizeof(one));
+	} else {
+		unsigned char dummy = 1;
+		r = write(ctx->ctrl_pipe[1], &dummy, sizeof(dummy));
+	}
+
+	if (r <= 0) {
+		usbi_warn(ctx, "internal signalling write failed");
+		return LIBUSB_ERROR_IO;
+	}
+
+	ctx->ctrl_pending = 1;
+	return 0;
+}
+
+/* Interrupt the event handler through the control pipe. Wakeups are
+ * coalesced: while one is pending, further calls return without writing.
+ * The pending wakeup is consumed by usbi_clear_event(), called by the event
+ * handler when it sees the control pipe readable and by threads that
+ * interrupted it once they hold the events lock. */
+int usbi_signal_event(struct libusb_context *ctx)
+{
+	int r;
+
+	pthread_mutex_lock(&ctx->ctrl_pending_lock);
+	r = signal_event_locked(ctx);
+	pthread_mutex_unlock(&ctx->ctrl_pending_lock);
+	return r;
+}
+
+/* Consume a pending wakeup, if there is one. */
+void usbi_clear_event(struct libusb_context *ctx)
+{
+	ssize_t r;
+
+	pthread_mutex_lock(&ctx->ctrl_pending_lock);
+	if (ctx->ctrl_pending) {
+		if (ctx->ctrl_pipe[1] == ctx->ctrl_pipe[0]) {
+			uint64_t count;
+			r = read(ctx->ctrl_pipe[0], &count, sizeof(count));
+		} else {
+			unsigned char dummy;
+			r = read(ctx->ctrl_pipe[0], &dummy, sizeof(dummy));
+		}
+
+		if (r <= 0)
+			usbi_warn(ctx, "internal signalling read failed");
+		ctx->ctrl_pending = 0;
+	}
+	pthread_mutex_unlock(&ctx->ctrl_pending_lock);
+}
+
+/* Interrupt the event handler if it is waiting past the given monotonic
+ * timeout, so that it notices the timeout in time. A burst of submissions
+ * costs one wakeup at most: only the first can be earliest in line, and
+ * wakeups are coalesced anyway. */
+static void wake_for_timeout(struct libusb_context *ctx,
+	struct timeval *timeout)
+{
+	pthread_mutex_lock(&ctx->ctrl_pending_lock);
+	if (timerisset(&ctx->wait_deadline)
+			&& timercmp(timeout, &ctx->wait_deadline, <))
+		signal_event_locked(ctx);
+	pthread_mutex_unlock(&ctx->ctrl_pending_lock);
+}
+
+/* Publish the monotonic time until which handle_events() is about to wait,
+ * so that submissions with an earlier timeout wake it. A transfer submitted
+ * before the deadline was published is caught by checking the flying list
+ * again afterwards, which may shorten the wait. Not needed with a timerfd,
+ * or where the OS handles timeouts. */
+static void begin_wait(struct libusb_context *ctx, int *timeout_ms)
+{
+#ifndef USBI_OS_HANDLES_TIMEOUT
+	struct timespec now_ts;
+	struct timeval now;
+	struct timeval tv;
+	int ms;
+
+	if (usbi_using_timerfd(ctx) || *timeout_ms <= 0)
+		return;
+	if (usbi_backend->clock_gettime(USBI_CLOCK_MONOTONIC, &now_ts) < 0)
+		return;
+
+	TIMESPEC_TO_TIMEVAL(&now, &now_ts);
+	tv.tv_sec = *timeout_ms / 1000;
+	tv.tv_usec = (*timeout_ms % 1000) * 1000;
+	pthread_mutex_lock(&ctx->ctrl_pending_lock);
+	timeradd(&now, &tv, &ctx->wait_deadline);
+	pthread_mutex_unlock(&ctx->ctrl_pending_lock);
+
+	if (libusb_get_next_timeout(ctx, &tv) == 1) {
+		ms = (tv.tv_sec * 1000) + ((tv.tv_usec + 999) / 1000);
+		if (ms < *timeout_ms)
+			*timeout_ms = ms;
+	}
+#endif
+}
+
+static void end_wait(struct libusb_context *ctx)
+{
+	pthread_mutex_lock(&ctx->ctrl_pending_lock);
+	timerclear(&ctx->wait_deadline);
+	pthread_mutex_unlock(&ctx->ctrl_pending_lock);
 }
 
 static int calculate_timeout(struct usbi_transfer *transfer)
@@ -1252,6 +1410,13 @@ API_EXPORTED int libusb_submit_transfer(struct libusb_transfer *transfer)
 	}
 #endif
 
+#ifndef USBI_OS_HANDLES_TIMEOUT
+	/* without a timerfd, an event handler that is already waiting does not
+	 * know about a timeout earlier than the ones it was waiting for */
+	if (r == 0 && first && !usbi_using_timerfd(ctx))
+		wake_for_timeout(ctx, &itransfer->timeout);
+#endif
+
 out:
 	pthread_mutex_unlock(&itransfer->lock);
 	return r;
@@ -1771,6 +1936,75 @@ out:
 }
 #endif
 
+#ifdef USBI_EPOLL_AVAILABLE
+/* epoll flavour of handle_events(). fds are registered with the epoll
+ * instance as they are added, so there is no per-call walk of the pollfd
+ * list. only the fds that are ready are passed on to the backend, in an
+ * array built here, so the backend's work is proportional to the number of
+ * events rather than to the number of open devices. */
+static int handle_events_epoll(struct libusb_context *ctx, int timeout_ms)
+{
+	struct epoll_event events[USBI_MAX_EPOLL_EVENTS];
+	struct pollfd fds[USBI_MAX_EPOLL_EVENTS];
+	nfds_t nfds = 0;
+	int r;
+	int i;
+
+	begin_wait(ctx, &timeout_ms);
+	usbi_dbg("epoll_wait() with timeout in %dms", timeout_ms);
+	r = epoll_wait(ctx->epfd, events, USBI_MAX_EPOLL_EVENTS, timeout_ms);
+	usbi_dbg("epoll_wait() returned %d", r);
+	end_wait(ctx);
+	if (r == 0) {
+		return handle_timeouts(ctx);
+	} else if (r == -1 && errno == EINTR) {
+		return LIBUSB_ERROR_INTERRUPTED;
+	} else if (r < 0) {
+		usbi_err(ctx, "epoll_wait failed %d err=%d\n", r, errno);
+		return LIBUSB_ERROR_IO;
+	}
+
+	for (i = 0; i < r; i++) {
+		int fd = events[i].data.fd;
+
+		if (fd == ctx->ctrl_pipe[0]) {
+			/* another thread wanted to interrupt event handling. as with
+			 * poll(), handle whatever else is ready and return */
+			usbi_dbg("caught a fish on the control pipe");
+			usbi_clear_event(ctx);
+			continue;
+		}
+
+#ifdef USBI_TIMERFD_AVAILABLE
+		if (usbi_using_timerfd(ctx) && fd == ctx->timerfd) {
+			int ret;
+			usbi_dbg("timerfd triggered");
+
+			ret = handle_timerfd_trigger(ctx);
+			if (ret < 0)
+				return ret;
+			continue;
+		}
+#endif
+
+		/* EPOLLIN, EPOLLOUT, EPOLLERR and EPOLLHUP have the same values
+		 * as their poll() counterparts */
+		fds[nfds].fd = fd;
+		fds[nfds].events = events[i].events;
+		fds[nfds].revents = events[i].events;
+		nfds++;
+	}
+
+	if (nfds == 0)
+		return 0;
+
+	r = usbi_backend->handle_events(ctx, fds, nfds, nfds);
+	if (r)
+		usbi_err(ctx, "backend handle_events failed with error %d", r);
+	return r;
+}
+#endif
+
 /* do the actual event handling. assumes that no other thread is concurrently
  * doing the same thing. */
 static int handle_events(struct libusb_context *ctx, struct timeval *tv)
@@ -1782,6 +2016,17 @@ static int handle_events(struct libusb_context *ctx, struct timeval *tv)
 	int i = -1;
 	int timeout_ms;
 
+	timeout_ms = (tv->tv_sec * 1000) + (tv->tv_usec / 1000);
+
+	/* round up to next millisecond */
+	if (tv->tv_usec % 1000)
+		timeout_ms++;
+
+#ifdef USBI_EPOLL_AVAILABLE
+	if (usbi_using_epoll(ctx))
+		return handle_events_epoll(ctx, timeout_ms);
+#endif
+
 	pthread_mutex_lock(&ctx->pollfds_lock);
 	list_for_each_entry(ipollfd, &ctx->pollfds, list)
 		nfds++;
@@ -1801,15 +2046,11 @@ static int handle_events(struct libusb_context *ctx, struct timeval *tv)
 	}
 	pthread_mutex_unlock(&ctx->pollfds_lock);
 
-	timeout_ms = (tv->tv_sec * 1000) + (tv->tv_usec / 1000);
-
-	/* round up to next millisecond */
-	if (tv->tv_usec % 1000)
-		timeout_ms++;
-
+	begin_wait(ctx, &timeout_ms);
 	usbi_dbg("poll() %d fds with timeout in %dms", nfds, timeout_ms);
 	r = poll(fds, nfds, timeout_ms);
 	usbi_dbg("poll() returned %d", r);
+	end_wait(ctx);
 	if (r == 0) {
 		free(fds);
 		return handle_timeouts(ctx);
@@ -1828,6 +2069,7 @@ static int handle_events(struct libusb_context *ctx, struct timeval *tv)
 		 * handle any other events that cropped up at the same time, and
 		 * simply return */
 		usbi_dbg("caught a fish on the control pipe");
+		usbi_clear_event(ctx);
 
 		if (r == 1) {
 			r = 0;
@@ -2190,6 +2432,22 @@ int usbi_add_pollfd(struct libusb_context *ctx, int fd, short events)
 	usbi_dbg("add fd %d events %d", fd, events);
 	ipollfd->pollfd.fd = fd;
 	ipollfd->pollfd.events = events;
+
+#ifdef USBI_EPOLL_AVAILABLE
+	if (usbi_using_epoll(ctx)) {
+		struct epoll_event ev;
+
+		memset(&ev, 0, sizeof(ev));
+		ev.events = events;
+		ev.data.fd = fd;
+		if (epoll_ctl(ctx->epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+			usbi_err(ctx, "epoll_ctl add fd %d failed errno=%d", fd, errno);
+			free(ipollfd);
+			return LIBUSB_ERROR_OTHER;
+		}
+	}
+#endif
+
 	pthread_mutex_lock(&ctx->pollfds_lock);
 	list_add_tail(&ipollfd->list, &ctx->pollfds);
 	pthread_mutex_unlock(&ctx->pollfds_lock);
@@ -2222,6 +2480,14 @@ void usbi_remove_pollfd(struct libusb_context *ctx, int fd)
 	list_del(&ipollfd->list);
 	pthread_mutex_unlock(&ctx->pollfds_lock);
 	free(ipollfd);
+
+#ifdef USBI_EPOLL_AVAILABLE
+	/* fails harmlessly if the caller has already closed the fd, which
+	 * removes it from the epoll set anyway */
+	if (usbi_using_epoll(ctx))
+		epoll_ctl(ctx->epfd, EPOLL_CTL_DEL, fd, NULL);
+#endif
+
 	if (ctx->fd_removed_cb)
 		ctx->fd_removed_cb(fd, ctx->fd_cb_user_data);
 }
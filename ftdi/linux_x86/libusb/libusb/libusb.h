@@ -816,6 +816,10 @@ int libusb_kernel_driver_active(libusb_device_handle *dev, int interface);
 int libusb_detach_kernel_driver(libusb_device_handle *dev, int interface);
 int libusb_attach_kernel_driver(libusb_device_handle *dev, int interface);
 
+unsigned char *libusb_dev_mem_alloc(libusb_device_handle *dev, size_t length);
+int libusb_dev_mem_free(libusb_device_handle *dev, unsigned char *buffer,
+	size_t length);
+
 /* async I/O */
 
 /** \ingroup asyncio
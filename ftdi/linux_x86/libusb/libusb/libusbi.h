@@ -145,9 +145,19 @@ struct libusb_context {
 	int debug_fixed;
 
 	/* internal control pipe, used for interrupting event handling when
-	 * something needs to modify poll fds. */
+	 * something needs to modify poll fds or the event handler's timeout.
+	 * where eventfd is available both ends are the same eventfd. written
+	 * and read only through usbi_signal_event() and usbi_clear_event(). */
 	int ctrl_pipe[2];
 
+	/* set while a wakeup is written to ctrl_pipe but not yet consumed, so
+	 * that further wakeups can be skipped. the monotonic time until which
+	 * libusb's own event handler is waiting, or zero if it is not. and a
+	 * lock to protect them. */
+	int ctrl_pending;
+	struct timeval wait_deadline;
+	pthread_mutex_t ctrl_pending_lock;
+
 	struct list_head usb_devs;
 	pthread_mutex_t usb_devs_lock;
 
@@ -193,6 +203,17 @@ struct libusb_context {
 	 * this timerfd is maintained to trigger on the next pending timeout */
 	int timerfd;
 #endif
+
+#ifdef USBI_EPOLL_AVAILABLE
+	/* epoll instance holding every fd in pollfds, if supported by OS.
+	 * fds are registered once when they are added, so waiting for events
+	 * does not depend on how many of them there are */
+	int epfd;
+#endif
+
+	/* private backend data, set up by the backend's init function and
+	 * released by its exit function */
+	void *os_priv;
 };
 
 #ifdef USBI_TIMERFD_AVAILABLE
@@ -201,6 +222,12 @@ struct libusb_context {
 #define usbi_using_timerfd(ctx) (0)
 #endif
 
+#ifdef USBI_EPOLL_AVAILABLE
+#define usbi_using_epoll(ctx) ((ctx)->epfd >= 0)
+#else
+#define usbi_using_epoll(ctx) (0)
+#endif
+
 struct libusb_device {
 	/* lock protects refcnt, everything else is finalized at initialization
 	 * time */
@@ -320,6 +347,8 @@ struct usbi_pollfd {
 
 int usbi_add_pollfd(struct libusb_context *ctx, int fd, short events);
 void usbi_remove_pollfd(struct libusb_context *ctx, int fd);
+int usbi_signal_event(struct libusb_context *ctx);
+void usbi_clear_event(struct libusb_context *ctx);
 
 /* device discovery */
 
@@ -361,7 +390,7 @@ struct usbi_os_backend {
 	 *
 	 * This function is called when the user deinitializes the library.
 	 */
-	void (*exit)(void);
+	void (*exit)(struct libusb_context *ctx);
 
 	/* Enumerate all the USB devices on the system, returning them in a list
 	 * of discovered devices.
@@ -693,6 +722,29 @@ struct usbi_os_backend {
 	int (*attach_kernel_driver)(struct libusb_device_handle *handle,
 		int interface);
 
+	/* Allocate memory for transfers to and from a device. Optional.
+	 *
+	 * The memory should be shared with the kernel, so that data in transfers
+	 * whose buffers lie inside it need not be copied between user and kernel
+	 * space. length is the size the caller asked for.
+	 *
+	 * Return a pointer to the memory, or NULL if it could not be allocated
+	 * or the device does not support it. The caller falls back to ordinary
+	 * memory in that case.
+	 */
+	unsigned char *(*dev_mem_alloc)(struct libusb_device_handle *handle,
+		size_t length);
+
+	/* Free memory allocated by dev_mem_alloc. Optional, but must be provided
+	 * if dev_mem_alloc is.
+	 *
+	 * Return:
+	 * - 0 on success
+	 * - another LIBUSB_ERROR code on failure
+	 */
+	int (*dev_mem_free)(struct libusb_device_handle *handle,
+		unsigned char *buffer, size_t length);
+
 	/* Destroy a device. Optional.
 	 *
 	 * This function is called when the last reference to a device is
@@ -331,7 +331,7 @@ static int darwin_init(struct libusb_context *ctx) {
   return 0;
 }
 
-static void darwin_exit (void) {
+static void darwin_exit (struct libusb_context *ctx) {
   if (!(--initCount)) {
     void *ret;
 
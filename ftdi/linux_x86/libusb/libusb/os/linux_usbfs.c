@@ -29,6 +29,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/utsname.h>
@@ -89,6 +90,23 @@ static const char *usbfs_path = NULL;
  */
 static int supports_flag_bulk_continuation = -1;
 
+/* Linux 3.3 drops the 16kb limit on the size of a bulk URB. usbfs instead
+ * limits the memory held by all URBs in flight to the usbfs_memory_mb
+ * parameter of usbcore (16MB by default, 0 meaning no limit), so a handful
+ * of large URBs can replace a long train of small ones, saving an ioctl and
+ * a reap per 16kb. Linux 3.6 reports this as USBFS_CAP_NO_PACKET_SIZE_LIM;
+ * for handles on older kernels we go by the kernel version.
+ *
+ * The URB size defaults to DEFAULT_BULK_URB_LENGTH and can be set with the
+ * LIBUSB_BULK_URB_SIZE environment variable. It is rounded down to whole
+ * 1024 byte (SuperSpeed) packets, because with SHORT_NOT_OK set a URB ending
+ * in the middle of a packet would look like a short transfer. */
+#define DEFAULT_BULK_URB_LENGTH	131072
+#define MAX_BULK_URB_LENGTH	(1 << 30)
+
+static int supports_large_bulk_urbs = -1;
+static unsigned int bulk_urb_length;
+
 /* clock ID for monotonic clock, as not all clock sources are available on all
  * systems. appropriate choice made at initialization time. */
 static clockid_t monotonic_clkid = -1;
@@ -106,8 +124,65 @@ struct linux_device_priv {
 	unsigned char *config_descriptor;
 };
 
+/* bulk and interrupt transfers take their URB arrays from a small pool kept
+ * by each handle, so that a stream of transfers does not go through malloc()
+ * and free() for every one of them. */
+#define URB_POOL_SIZE	8
+
+struct linux_urb_block {
+	int capacity;
+	struct usbfs_urb urbs[0];
+};
+
 struct linux_device_handle_priv {
 	int fd;
+
+	/* size of the URBs bulk transfers are split into */
+	unsigned int bulk_urb_len;
+
+	pthread_mutex_t urb_pool_lock;
+	int urb_pool_len;
+	struct linux_urb_block *urb_pool[URB_POOL_SIZE];
+};
+
+/* device cache:
+ * without one, every libusb_get_device_list() call after the application has
+ * released its previous list re-reads busnum/devnum from sysfs and, in the
+ * usbfs fallback, opens every device node to re-read its descriptors. on
+ * systems with many devices this dominates enumeration time.
+ *
+ * each context therefore keeps a reference to every device it has
+ * enumerated, keyed on the inode number of the directory entry the device
+ * was found through (the sysfs device directory, or the usbfs node). the
+ * kernel hands out a fresh inode when a device is unplugged and something
+ * else takes its name or address, so an unchanged inode means we can reuse
+ * the libusb_device and the descriptors already read for it. entries not
+ * seen during a complete rescan are dropped.
+ *
+ * the cache lock is held for the duration of a scan, so concurrent scans of
+ * the same context are serialized rather than interleaved. */
+#define DEVICE_CACHE_BUCKETS	64
+
+struct linux_cached_device {
+	struct list_head list;
+	struct libusb_device *dev;
+	ino_t ino;
+	unsigned int scan;
+};
+
+struct linux_context_priv {
+	pthread_mutex_t cache_lock;
+	struct list_head cache[DEVICE_CACHE_BUCKETS];
+
+	/* incremented at the start of each scan; entries carrying an older
+	 * value were not seen by the current one */
+	unsigned int scan;
+
+	/* open handles indexed by usbfs fd, so that op_handle_events() finds
+	 * the handle for a ready fd without walking open_devs. protected by the
+	 * context's open_devs_lock. */
+	struct libusb_device_handle **fd_handles;
+	int fd_handles_len;
 };
 
 enum reap_action {
@@ -148,6 +223,11 @@ static struct linux_device_priv *__device_priv(struct libusb_device *dev)
 	return (struct linux_device_priv *) dev->os_priv;
 }
 
+static struct linux_context_priv *__context_priv(struct libusb_context *ctx)
+{
+	return (struct linux_context_priv *) ctx->os_priv;
+}
+
 static struct linux_device_handle_priv *__device_handle_priv(
 	struct libusb_device_handle *handle)
 {
@@ -182,6 +262,11 @@ static const char *find_usbfs_path(void)
 	const char *path = "/dev/bus/usb";
 	const char *ret = NULL;
 
+#ifdef USBFS_PATH
+	/* build-time override, used to point the backend at a fake tree */
+	path = USBFS_PATH;
+#endif
+
 	if (check_usb_vfs(path)) {
 		ret = path;
 	} else {
@@ -212,26 +297,70 @@ static clockid_t find_monotonic_clock(void)
 	}
 }
 
-/* bulk continuation URB flag available from Linux 2.6.32 */
-static int check_flag_bulk_continuation(void)
+#define LINUX_VERSION(a, b, c)	((a) * 1000000 + (b) * 1000 + (c))
+
+/* running kernel as LINUX_VERSION(), 0 if unrecognised or -1 on error */
+static int get_kernel_version(void)
 {
 	struct utsname uts;
-	int sublevel;
+	int major;
+	int minor;
+	int sublevel = 0;
 
 	if (uname(&uts) < 0)
 		return -1;
-	if (strlen(uts.release) < 4)
+	if (sscanf(uts.release, "%d.%d.%d", &major, &minor, &sublevel) < 2)
 		return 0;
-	if (strncmp(uts.release, "2.6.", 4) != 0)
+	return LINUX_VERSION(major, minor, sublevel);
+}
+
+/* bulk continuation URB flag available from Linux 2.6.32 */
+static int check_flag_bulk_continuation(int version)
+{
+	return version >= LINUX_VERSION(2, 6, 32);
+}
+
+/* usbfs_memory_mb in bytes, or 0 if there is no limit or it is unknown */
+static unsigned long get_usbfs_memory_limit(void)
+{
+	FILE *f = fopen("/sys/module/usbcore/parameters/usbfs_memory_mb", "r");
+	unsigned long mb = 0;
+
+	if (!f)
 		return 0;
+	if (fscanf(f, "%lu", &mb) != 1)
+		mb = 0;
+	fclose(f);
+	return mb > MAX_BULK_URB_LENGTH >> 20 ? 0 : mb << 20;
+}
 
-	sublevel = atoi(uts.release + 4);
-	return sublevel >= 32;
+static unsigned int find_bulk_urb_length(struct libusb_context *ctx)
+{
+	unsigned long len = DEFAULT_BULK_URB_LENGTH;
+	unsigned long limit = get_usbfs_memory_limit();
+	char *env = getenv("LIBUSB_BULK_URB_SIZE");
+
+	if (env) {
+		char *end;
+		len = strtoul(env, &end, 0);
+		if (end == env || *end || len < 1024 || len > MAX_BULK_URB_LENGTH) {
+			usbi_warn(ctx, "ignoring LIBUSB_BULK_URB_SIZE=%s", env);
+			len = DEFAULT_BULK_URB_LENGTH;
+		}
+	}
+
+	/* a single URB must fit in the usbfs memory limit */
+	if (limit && len > limit)
+		len = limit;
+	return len - len % 1024;
 }
 
 static int op_init(struct libusb_context *ctx)
 {
+	struct linux_context_priv *cpriv;
 	struct stat statbuf;
+	int version;
+	int i;
 	int r;
 
 	usbfs_path = find_usbfs_path();
@@ -244,16 +373,23 @@ static int op_init(struct libusb_context *ctx)
 		monotonic_clkid = find_monotonic_clock();
 
 	if (supports_flag_bulk_continuation == -1) {
-		supports_flag_bulk_continuation = check_flag_bulk_continuation();
-		if (supports_flag_bulk_continuation == -1) {
+		version = get_kernel_version();
+		if (version == -1) {
 			usbi_err(ctx, "error checking for bulk continuation support");
 			return LIBUSB_ERROR_OTHER;
 		}
+		supports_flag_bulk_continuation = check_flag_bulk_continuation(version);
+		supports_large_bulk_urbs = version >= LINUX_VERSION(3, 3, 0);
 	}
 
 	if (supports_flag_bulk_continuation)
 		usbi_dbg("bulk continuation flag supported");
 
+	if (bulk_urb_length == 0) {
+		bulk_urb_length = find_bulk_urb_length(ctx);
+		usbi_dbg("bulk URBs up to %u bytes", bulk_urb_length);
+	}
+
 	r = stat(SYSFS_DEVICE_PATH, &statbuf);
 	if (r == 0 && S_ISDIR(statbuf.st_mode)) {
 		usbi_dbg("found usb devices in sysfs");
@@ -263,9 +399,44 @@ static int op_init(struct libusb_context *ctx)
 		sysfs_can_relate_devices = 0;
 	}
 
+	cpriv = malloc(sizeof(*cpriv));
+	if (!cpriv)
+		return LIBUSB_ERROR_NO_MEM;
+
+	pthread_mutex_init(&cpriv->cache_lock, NULL);
+	for (i = 0; i < DEVICE_CACHE_BUCKETS; i++)
+		list_init(&cpriv->cache[i]);
+	cpriv->scan = 0;
+	cpriv->fd_handles = NULL;
+	cpriv->fd_handles_len = 0;
+	ctx->os_priv = cpriv;
 	return 0;
 }
 
+static void cache_remove(struct linux_cached_device *entry)
+{
+	list_del(&entry->list);
+	libusb_unref_device(entry->dev);
+	free(entry);
+}
+
+static void op_exit(struct libusb_context *ctx)
+{
+	struct linux_context_priv *cpriv = __context_priv(ctx);
+	struct linux_cached_device *entry;
+	struct linux_cached_device *tmp;
+	int i;
+
+	for (i = 0; i < DEVICE_CACHE_BUCKETS; i++)
+		list_for_each_entry_safe(entry, tmp, &cpriv->cache[i], list)
+			cache_remove(entry);
+
+	pthread_mutex_destroy(&cpriv->cache_lock);
+	free(cpriv->fd_handles);
+	free(cpriv);
+	ctx->os_priv = NULL;
+}
+
 static int usbfs_get_device_descriptor(struct libusb_device *dev,
 	unsigned char *buffer)
 {
@@ -297,11 +468,19 @@ static int __open_sysfs_attr(struct libusb_device *dev, const char *attr)
 static int sysfs_get_device_descriptor(struct libusb_device *dev,
 	unsigned char *buffer)
 {
+	struct linux_device_priv *priv = __device_priv(dev);
 	int fd;
 	ssize_t r;
 
-	/* sysfs provides access to an in-memory copy of the device descriptor,
-	 * so we use that rather than keeping our own copy */
+	/* sysfs provides access to an in-memory copy of the device descriptor.
+	 * it cannot change for the lifetime of the sysfs node, so we keep the
+	 * first copy we read: the device cache keeps devices alive across
+	 * enumerations, and applications typically fetch every device
+	 * descriptor after each one. */
+	if (priv->dev_descriptor) {
+		memcpy(buffer, priv->dev_descriptor, DEVICE_DESC_LENGTH);
+		return 0;
+	}
 
 	fd = __open_sysfs_attr(dev, "descriptors");
 	if (fd < 0)
@@ -317,6 +496,9 @@ static int sysfs_get_device_descriptor(struct libusb_device *dev,
 		return LIBUSB_ERROR_IO;
 	}
 
+	priv->dev_descriptor = malloc(DEVICE_DESC_LENGTH);
+	if (priv->dev_descriptor)
+		memcpy(priv->dev_descriptor, buffer, DEVICE_DESC_LENGTH);
 	return 0;
 }
 
@@ -783,10 +965,114 @@ static int initialize_device(struct libusb_device *dev, uint8_t busnum,
 	return 0;
 }
 
+/* find the cache entry for a directory entry. sysfs-discovered devices are
+ * matched on their sysfs directory name, usbfs-discovered ones on bus number
+ * and address. */
+static struct linux_cached_device *cache_lookup(
+	struct linux_context_priv *cpriv, ino_t ino, const char *sysfs_dir,
+	uint8_t busnum, uint8_t devaddr)
+{
+	struct linux_cached_device *entry;
+
+	list_for_each_entry(entry, &cpriv->cache[ino % DEVICE_CACHE_BUCKETS],
+			list) {
+		struct libusb_device *dev = entry->dev;
+		const char *dir = __device_priv(dev)->sysfs_dir;
+
+		if (entry->ino != ino)
+			continue;
+		if (sysfs_dir) {
+			if (dir && strcmp(dir, sysfs_dir) == 0)
+				return entry;
+		} else if (!dir && dev->bus_number == busnum
+				&& dev->device_address == devaddr) {
+			return entry;
+		}
+	}
+
+	return NULL;
+}
+
+/* add a cached device to discdevs, marking it as seen by the current scan */
+static int cache_append(struct linux_context_priv *cpriv,
+	struct discovered_devs **_discdevs, struct linux_cached_device *entry)
+{
+	struct discovered_devs *discdevs;
+
+	usbi_dbg("using cached device for %d/%d", entry->dev->bus_number,
+		entry->dev->device_address);
+	entry->scan = cpriv->scan;
+	discdevs = discovered_devs_append(*_discdevs, entry->dev);
+	if (!discdevs)
+		return LIBUSB_ERROR_NO_MEM;
+
+	*_discdevs = discdevs;
+	return 0;
+}
+
+static void cache_insert(struct linux_context_priv *cpriv,
+	struct libusb_device *dev, ino_t ino)
+{
+	struct linux_cached_device *entry;
+
+	/* not every filesystem reports inode numbers through readdir. without
+	 * one we cannot tell a replugged device from the old one, so don't
+	 * cache it. failing to allocate an entry only costs us a rescan. */
+	if (ino == 0)
+		return;
+
+	entry = malloc(sizeof(*entry));
+	if (!entry)
+		return;
+
+	entry->dev = libusb_ref_device(dev);
+	entry->ino = ino;
+	entry->scan = cpriv->scan;
+	list_add(&entry->list, &cpriv->cache[ino % DEVICE_CACHE_BUCKETS]);
+}
+
+/* drop cache entries at a bus/address whose directory entry no longer
+ * matched. returns 1 if any were dropped, meaning the device at that address
+ * has been replaced. */
+static int cache_evict(struct linux_context_priv *cpriv, uint8_t busnum,
+	uint8_t devaddr)
+{
+	struct linux_cached_device *entry;
+	struct linux_cached_device *tmp;
+	int evicted = 0;
+	int i;
+
+	for (i = 0; i < DEVICE_CACHE_BUCKETS; i++)
+		list_for_each_entry_safe(entry, tmp, &cpriv->cache[i], list) {
+			if (entry->dev->bus_number != busnum
+					|| entry->dev->device_address != devaddr)
+				continue;
+			usbi_dbg("device %d/%d was replaced", busnum, devaddr);
+			cache_remove(entry);
+			evicted = 1;
+		}
+
+	return evicted;
+}
+
+/* drop cache entries that the last scan did not see */
+static void cache_sweep(struct linux_context_priv *cpriv)
+{
+	struct linux_cached_device *entry;
+	struct linux_cached_device *tmp;
+	int i;
+
+	for (i = 0; i < DEVICE_CACHE_BUCKETS; i++)
+		list_for_each_entry_safe(entry, tmp, &cpriv->cache[i], list)
+			if (entry->scan != cpriv->scan)
+				cache_remove(entry);
+}
+
 static int enumerate_device(struct libusb_context *ctx,
 	struct discovered_devs **_discdevs, uint8_t busnum, uint8_t devaddr,
-	const char *sysfs_dir)
+	const char *sysfs_dir, ino_t ino)
 {
+	struct linux_context_priv *cpriv = __context_priv(ctx);
 	struct discovered_devs *discdevs;
 	unsigned long session_id;
 	int need_unref = 0;
@@ -800,7 +1086,13 @@ static int enumerate_device(struct libusb_context *ctx,
 	usbi_dbg("busnum %d devaddr %d session_id %ld", busnum, devaddr,
 		session_id);
 
-	dev = usbi_get_device_by_session_id(ctx, session_id);
+	/* if we had cached a device at this address, it was not the one we are
+	 * looking at now; don't hand its libusb_device out again */
+	if (cache_evict(cpriv, busnum, devaddr))
+		dev = NULL;
+	else
+		dev = usbi_get_device_by_session_id(ctx, session_id);
+
 	if (dev) {
 		usbi_dbg("using existing device for %d/%d (session %ld)",
 			busnum, devaddr, session_id);
@@ -819,6 +1111,7 @@ static int enumerate_device(struct libusb_context *ctx,
 			goto out;
 	}
 
+	cache_insert(cpriv, dev, ino);
 	discdevs = discovered_devs_append(*_discdevs, dev);
 	if (!discdevs)
 		r = LIBUSB_ERROR_NO_MEM;
@@ -838,6 +1131,7 @@ out:
 static int usbfs_scan_busdir(struct libusb_context *ctx,
 	struct discovered_devs **_discdevs, uint8_t busnum)
 {
+	struct linux_context_priv *cpriv = __context_priv(ctx);
 	DIR *dir;
 	char dirpath[PATH_MAX];
 	struct dirent *entry;
@@ -855,6 +1149,7 @@ static int usbfs_scan_busdir(struct libusb_context *ctx,
 	}
 
 	while ((entry = readdir(dir))) {
+		struct linux_cached_device *cached;
 		int devaddr;
 
 		if (entry->d_name[0] == '.')
@@ -866,7 +1161,13 @@ static int usbfs_scan_busdir(struct libusb_context *ctx,
 			continue;
 		}
 
-		r = enumerate_device(ctx, &discdevs, busnum, (uint8_t) devaddr, NULL);
+		cached = cache_lookup(cpriv, entry->d_ino, NULL, busnum,
+			(uint8_t) devaddr);
+		if (cached)
+			r = cache_append(cpriv, &discdevs, cached);
+		else
+			r = enumerate_device(ctx, &discdevs, busnum, (uint8_t) devaddr,
+				NULL, entry->d_ino);
 		if (r < 0)
 			goto out;
 	}
@@ -917,7 +1218,7 @@ out:
 }
 
 static int sysfs_scan_device(struct libusb_context *ctx,
-	struct discovered_devs **_discdevs, const char *devname,
+	struct discovered_devs **_discdevs, const char *devname, ino_t ino,
 	int *usbfs_fallback)
 {
 	int r;
@@ -987,12 +1288,13 @@ static int sysfs_scan_device(struct libusb_context *ctx,
 		return LIBUSB_ERROR_INVALID_PARAM;
 
 	return enumerate_device(ctx, _discdevs, busnum & 0xff, devaddr & 0xff,
-		devname);
+		devname, ino);
 }
 
 static int sysfs_get_device_list(struct libusb_context *ctx,
 	struct discovered_devs **_discdevs, int *usbfs_fallback)
 {
+	struct linux_context_priv *cpriv = __context_priv(ctx);
 	struct discovered_devs *discdevs = *_discdevs;
 	DIR *devices = opendir(SYSFS_DEVICE_PATH);
 	struct dirent *entry;
@@ -1005,13 +1307,20 @@ static int sysfs_get_device_list(struct libusb_context *ctx,
 
 	while ((entry = readdir(devices))) {
 		struct discovered_devs *discdevs_new = discdevs;
+		struct linux_cached_device *cached;
 
 		if ((!isdigit(entry->d_name[0]) && strncmp(entry->d_name, "usb", 3))
 				|| strchr(entry->d_name, ':'))
 			continue;
 
-		r = sysfs_scan_device(ctx, &discdevs_new, entry->d_name,
-			usbfs_fallback);
+		/* an unchanged sysfs entry is the device we saw last time; skip
+		 * reading its busnum and devnum */
+		cached = cache_lookup(cpriv, entry->d_ino, entry->d_name, 0, 0);
+		if (cached)
+			r = cache_append(cpriv, &discdevs_new, cached);
+		else
+			r = sysfs_scan_device(ctx, &discdevs_new, entry->d_name,
+				entry->d_ino, usbfs_fallback);
 		if (r < 0)
 			goto out;
 		discdevs = discdevs_new;
@@ -1035,21 +1344,68 @@ static int op_get_device_list(struct libusb_context *ctx,
 	 * sysfs but not enough information to relate sysfs devices to usbfs
 	 * nodes. the usbfs_fallback variable is used to indicate that we should
 	 * fall back on usbfs.
+	 *
+	 * the whole scan runs under the device cache lock; see the
+	 * "device cache" comment.
 	 */
-	if (sysfs_can_relate_devices != 0) {
-		int usbfs_fallback = 0;
-		int r = sysfs_get_device_list(ctx, _discdevs, &usbfs_fallback);
-		if (!usbfs_fallback)
-			return r;
+	struct linux_context_priv *cpriv = __context_priv(ctx);
+	int usbfs_fallback = 0;
+	int r = 0;
+
+	pthread_mutex_lock(&cpriv->cache_lock);
+	cpriv->scan++;
+
+	if (sysfs_can_relate_devices != 0)
+		r = sysfs_get_device_list(ctx, _discdevs, &usbfs_fallback);
+	if (sysfs_can_relate_devices == 0 || usbfs_fallback)
+		r = usbfs_get_device_list(ctx, _discdevs);
+
+	/* only a complete scan tells us which devices have gone away */
+	if (r == 0)
+		cache_sweep(cpriv);
+
+	pthread_mutex_unlock(&cpriv->cache_lock);
+	return r;
+}
+
+/* record (or, with a NULL handle, forget) the handle that owns an fd */
+static int set_fd_handle(struct libusb_context *ctx, int fd,
+	struct libusb_device_handle *handle)
+{
+	struct linux_context_priv *cpriv = __context_priv(ctx);
+	struct libusb_device_handle **fd_handles;
+	int len;
+	int r = 0;
+
+	pthread_mutex_lock(&ctx->open_devs_lock);
+	if (fd >= cpriv->fd_handles_len) {
+		if (!handle)
+			goto out;
+
+		len = MAX(fd + 1, cpriv->fd_handles_len * 2);
+		fd_handles = realloc(cpriv->fd_handles, len * sizeof(*fd_handles));
+		if (!fd_handles) {
+			r = LIBUSB_ERROR_NO_MEM;
+			goto out;
+		}
+		memset(fd_handles + cpriv->fd_handles_len, 0,
+			(len - cpriv->fd_handles_len) * sizeof(*fd_handles));
+		cpriv->fd_handles = fd_handles;
+		cpriv->fd_handles_len = len;
 	}
+	cpriv->fd_handles[fd] = handle;
 
-	return usbfs_get_device_list(ctx, _discdevs);
+out:
+	pthread_mutex_unlock(&ctx->open_devs_lock);
+	return r;
 }
 
 static int op_open(struct libusb_device_handle *handle)
 {
 	struct linux_device_handle_priv *hpriv = __device_handle_priv(handle);
 	char filename[PATH_MAX];
+	unsigned int caps;
+	int r;
 
 	__get_usbfs_path(handle->dev, filename);
 	hpriv->fd = open(filename, O_RDWR);
@@ -1069,14 +1425,46 @@ static int op_open(struct libusb_device_handle *handle)
 		}
 	}
 
-	return usbi_add_pollfd(HANDLE_CTX(handle), hpriv->fd, POLLOUT);
+	hpriv->bulk_urb_len = bulk_urb_length;
+	if (ioctl(hpriv->fd, IOCTL_USBFS_GET_CAPABILITIES, &caps) < 0)
+		caps = supports_large_bulk_urbs ? USBFS_CAP_NO_PACKET_SIZE_LIM : 0;
+	if (!(caps & USBFS_CAP_NO_PACKET_SIZE_LIM)
+			&& hpriv->bulk_urb_len > MAX_BULK_BUFFER_LENGTH)
+		hpriv->bulk_urb_len = MAX_BULK_BUFFER_LENGTH;
+
+	hpriv->urb_pool_len = 0;
+	pthread_mutex_init(&hpriv->urb_pool_lock, NULL);
+
+	r = set_fd_handle(HANDLE_CTX(handle), hpriv->fd, handle);
+	if (r < 0)
+		goto err;
+
+	r = usbi_add_pollfd(HANDLE_CTX(handle), hpriv->fd, POLLOUT);
+	if (r < 0) {
+		set_fd_handle(HANDLE_CTX(handle), hpriv->fd, NULL);
+		goto err;
+	}
+	return 0;
+
+err:
+	pthread_mutex_destroy(&hpriv->urb_pool_lock);
+	close(hpriv->fd);
+	return r;
 }
 
 static void op_close(struct libusb_device_handle *dev_handle)
 {
-	int fd = __device_handle_priv(dev_handle)->fd;
+	struct linux_device_handle_priv *hpriv = __device_handle_priv(dev_handle);
+	int fd = hpriv->fd;
+	int i;
+
 	usbi_remove_pollfd(HANDLE_CTX(dev_handle), fd);
+	set_fd_handle(HANDLE_CTX(dev_handle), fd, NULL);
 	close(fd);
+
+	for (i = 0; i < hpriv->urb_pool_len; i++)
+		free(hpriv->urb_pool[i]);
+	pthread_mutex_destroy(&hpriv->urb_pool_lock);
 }
 
 static int op_get_configuration(struct libusb_device_handle *handle,
@@ -1305,15 +1693,42 @@ static int op_attach_kernel_driver(struct libusb_device_handle *handle,
 	return 0;
 }
 
+/* usbfs lets a device fd be mapped since Linux 4.6. The kernel allocates the
+ * memory itself and, when an URB's buffer lies inside such a mapping, hands
+ * it to the host controller directly instead of copying through a bounce
+ * buffer. Older kernels fail the mmap with ENODEV or EINVAL; report that as
+ * NULL so the caller can fall back to ordinary memory. */
+static unsigned char *op_dev_mem_alloc(struct libusb_device_handle *handle,
+	size_t len)
+{
+	struct linux_device_handle_priv *hpriv = __device_handle_priv(handle);
+	unsigned char *buffer;
+
+	buffer = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, hpriv->fd, 0);
+	if (buffer == MAP_FAILED) {
+		usbi_dbg("usbfs mmap of %zu bytes failed errno %d", len, errno);
+		return NULL;
+	}
+	return buffer;
+}
+
+static int op_dev_mem_free(struct libusb_device_handle *handle,
+	unsigned char *buffer, size_t len)
+{
+	if (munmap(buffer, len) != 0) {
+		usbi_err(HANDLE_CTX(handle), "free dev mem failed errno %d", errno);
+		return LIBUSB_ERROR_OTHER;
+	}
+	return 0;
+}
+
 static void op_destroy_device(struct libusb_device *dev)
 {
 	struct linux_device_priv *priv = __device_priv(dev);
-	if (!sysfs_has_descriptors) {
-		if (priv->dev_descriptor)
-			free(priv->dev_descriptor);
-		if (priv->config_descriptor)
-			free(priv->config_descriptor);
-	}
+	if (priv->dev_descriptor)
+		free(priv->dev_descriptor);
+	if (priv->config_descriptor)
+		free(priv->config_descriptor);
 	if (priv->sysfs_dir)
 		free(priv->sysfs_dir);
 }
@@ -1332,6 +1747,55 @@ static void free_iso_urbs(struct linux_transfer_priv *tpriv)
 	tpriv->iso_urbs = NULL;
 }
 
+/* take an array of at least num_urbs zeroed URBs from the handle's pool */
+static struct usbfs_urb *alloc_bulk_urbs(struct linux_device_handle_priv *hpriv,
+	int num_urbs)
+{
+	struct linux_urb_block *block = NULL;
+	int capacity;
+	int i;
+
+	pthread_mutex_lock(&hpriv->urb_pool_lock);
+	for (i = 0; i < hpriv->urb_pool_len; i++) {
+		if (hpriv->urb_pool[i]->capacity >= num_urbs) {
+			block = hpriv->urb_pool[i];
+			hpriv->urb_pool[i] = hpriv->urb_pool[--hpriv->urb_pool_len];
+			break;
+		}
+	}
+	pthread_mutex_unlock(&hpriv->urb_pool_lock);
+
+	if (!block) {
+		/* round up, so that blocks can be shared by transfers of
+		 * similar length */
+		for (capacity = 4; capacity < num_urbs; capacity *= 2)
+			;
+		block = malloc(sizeof(*block) + capacity * sizeof(struct usbfs_urb));
+		if (!block)
+			return NULL;
+		block->capacity = capacity;
+	}
+
+	memset(block->urbs, 0, num_urbs * sizeof(struct usbfs_urb));
+	return block->urbs;
+}
+
+/* return URBs from alloc_bulk_urbs() to the pool, or free them if it is full */
+static void free_bulk_urbs(struct linux_device_handle_priv *hpriv,
+	struct usbfs_urb *urbs)
+{
+	struct linux_urb_block *block = (struct linux_urb_block *)
+		((unsigned char *) urbs - offsetof(struct linux_urb_block, urbs));
+
+	pthread_mutex_lock(&hpriv->urb_pool_lock);
+	if (hpriv->urb_pool_len < URB_POOL_SIZE) {
+		hpriv->urb_pool[hpriv->urb_pool_len++] = block;
+		block = NULL;
+	}
+	pthread_mutex_unlock(&hpriv->urb_pool_lock);
+	free(block);
+}
+
 static int submit_bulk_transfer(struct usbi_transfer *itransfer,
 	unsigned char urb_type)
 {
@@ -1343,33 +1807,28 @@ static int submit_bulk_transfer(struct usbi_transfer *itransfer,
 	struct usbfs_urb *urbs;
 	int is_out = (transfer->endpoint & LIBUSB_ENDPOINT_DIR_MASK)
 		== LIBUSB_ENDPOINT_OUT;
+	unsigned int urb_len;
+	int num_urbs;
 	int r;
 	int i;
-	size_t alloc_size;
 
 	if (tpriv->urbs)
 		return LIBUSB_ERROR_BUSY;
 
-	/* usbfs places a 16kb limit on bulk URBs. we divide up larger requests
-	 * into smaller units to meet such restriction, then fire off all the
-	 * units at once. it would be simpler if we just fired one unit at a time,
-	 * but there is a big performance gain through doing it this way. */
-	int num_urbs = transfer->length / MAX_BULK_BUFFER_LENGTH;
-	int last_urb_partial = 0;
-
-	if (transfer->length == 0) {
-		num_urbs = 1;
-	} else if ((transfer->length % MAX_BULK_BUFFER_LENGTH) > 0) {
-		last_urb_partial = 1;
+retry:
+	/* we divide up requests larger than the URB size into smaller units,
+	 * then fire off all the units at once. it would be simpler if we just
+	 * fired one unit at a time, but there is a big performance gain through
+	 * doing it this way. */
+	urb_len = dpriv->bulk_urb_len;
+	num_urbs = transfer->length / urb_len;
+	if (transfer->length == 0 || (transfer->length % urb_len) > 0)
 		num_urbs++;
-	}
 	usbi_dbg("need %d urbs for new transfer with length %d", num_urbs,
 		transfer->length);
-	alloc_size = num_urbs * sizeof(struct usbfs_urb);
-	urbs = malloc(alloc_size);
+	urbs = alloc_bulk_urbs(dpriv, num_urbs);
 	if (!urbs)
 		return LIBUSB_ERROR_NO_MEM;
-	memset(urbs, 0, alloc_size);
 	tpriv->urbs = urbs;
 	tpriv->num_urbs = num_urbs;
 	tpriv->num_retired = 0;
@@ -1380,15 +1839,13 @@ static int submit_bulk_transfer(struct usbi_transfer *itransfer,
 		urb->usercontext = itransfer;
 		urb->type = urb_type;
 		urb->endpoint = transfer->endpoint;
-		urb->buffer = transfer->buffer + (i * MAX_BULK_BUFFER_LENGTH);
+		urb->buffer = transfer->buffer + (i * urb_len);
 		if (supports_flag_bulk_continuation && !is_out)
 			urb->flags = USBFS_URB_SHORT_NOT_OK;
-		if (i == num_urbs - 1 && last_urb_partial)
-			urb->buffer_length = transfer->length % MAX_BULK_BUFFER_LENGTH;
-		else if (transfer->length == 0)
-			urb->buffer_length = 0;
+		if (i == num_urbs - 1)
+			urb->buffer_length = transfer->length - i * urb_len;
 		else
-			urb->buffer_length = MAX_BULK_BUFFER_LENGTH;
+			urb->buffer_length = urb_len;
 
 		if (i > 0 && supports_flag_bulk_continuation)
 			urb->flags |= USBFS_URB_BULK_CONTINUATION;
@@ -1397,6 +1854,20 @@ static int submit_bulk_transfer(struct usbi_transfer *itransfer,
 		if (r < 0) {
 			int j;
 
+			/* the kernel could not find the memory for an URB this large;
+			 * settle for smaller ones on this handle from now on */
+			if (i == 0 && errno == ENOMEM
+					&& urb_len > MAX_BULK_BUFFER_LENGTH) {
+				dpriv->bulk_urb_len = urb_len / 2 > MAX_BULK_BUFFER_LENGTH ?
+					(urb_len / 2) - (urb_len / 2) % 1024 :
+					MAX_BULK_BUFFER_LENGTH;
+				usbi_dbg("%u byte URB refused, trying %u bytes", urb_len,
+					dpriv->bulk_urb_len);
+				free_bulk_urbs(dpriv, urbs);
+				tpriv->urbs = NULL;
+				goto retry;
+			}
+
 			if (errno == ENODEV) {
 				r = LIBUSB_ERROR_NO_DEVICE;
 			} else {
@@ -1409,7 +1880,7 @@ static int submit_bulk_transfer(struct usbi_transfer *itransfer,
 			 * return failure immediately. */
 			if (i == 0) {
 				usbi_dbg("first URB failed, easy peasy");
-				free(urbs);
+				free_bulk_urbs(dpriv, urbs);
 				tpriv->urbs = NULL;
 				return r;
 			}
@@ -1769,9 +2240,14 @@ static void op_clear_transfer_priv(struct usbi_transfer *itransfer)
 
 	switch (transfer->type) {
 	case LIBUSB_TRANSFER_TYPE_CONTROL:
+		free(tpriv->urbs);
+		tpriv->urbs = NULL;
+		break;
 	case LIBUSB_TRANSFER_TYPE_BULK:
 	case LIBUSB_TRANSFER_TYPE_INTERRUPT:
-		free(tpriv->urbs);
+		if (tpriv->urbs)
+			free_bulk_urbs(__device_handle_priv(transfer->dev_handle),
+				tpriv->urbs);
 		tpriv->urbs = NULL;
 		break;
 	case LIBUSB_TRANSFER_TYPE_ISOCHRONOUS:
@@ -1787,6 +2263,8 @@ static int handle_bulk_completion(struct usbi_transfer *itransfer,
 	struct usbfs_urb *urb)
 {
 	struct linux_transfer_priv *tpriv = usbi_transfer_get_os_priv(itransfer);
+	struct linux_device_handle_priv *hpriv = __device_handle_priv(
+		__USBI_TRANSFER_TO_LIBUSB_TRANSFER(itransfer)->dev_handle);
 	int num_urbs = tpriv->num_urbs;
 	int urb_idx = urb - tpriv->urbs;
 	enum libusb_transfer_status status = LIBUSB_TRANSFER_COMPLETED;
@@ -1834,7 +2312,7 @@ static int handle_bulk_completion(struct usbi_transfer *itransfer,
 		if (tpriv->num_retired == num_urbs) {
 			usbi_dbg("abnormal reap: last URB handled, reporting");
 			if (tpriv->reap_action == CANCELLED) {
-				free(tpriv->urbs);
+				free_bulk_urbs(hpriv, tpriv->urbs);
 				tpriv->urbs = NULL;
 				pthread_mutex_unlock(&itransfer->lock);
 				r = usbi_handle_transfer_cancellation(itransfer);
@@ -1912,7 +2390,7 @@ static int handle_bulk_completion(struct usbi_transfer *itransfer,
 	}
 
 completed:
-	free(tpriv->urbs);
+	free_bulk_urbs(hpriv, tpriv->urbs);
 	tpriv->urbs = NULL;
 	pthread_mutex_unlock(&itransfer->lock);
 	return usbi_handle_transfer_completion(itransfer, status);
@@ -2101,6 +2579,7 @@ static int reap_for_handle(struct libusb_device_handle *handle)
 static int op_handle_events(struct libusb_context *ctx,
 	struct pollfd *fds, nfds_t nfds, int num_ready)
 {
+	struct linux_context_priv *cpriv = __context_priv(ctx);
 	int r;
 	int i = 0;
 
@@ -2114,11 +2593,15 @@ static int op_handle_events(struct libusb_context *ctx,
 			continue;
 
 		num_ready--;
-		list_for_each_entry(handle, &ctx->open_devs, list) {
-			hpriv =  __device_handle_priv(handle);
-			if (hpriv->fd == pollfd->fd)
-				break;
+		handle = NULL;
+		if (pollfd->fd < cpriv->fd_handles_len)
+			handle = cpriv->fd_handles[pollfd->fd];
+		if (!handle) {
+			/* not one of ours, or closed since it was found ready */
+			usbi_dbg("no handle for fd %d", pollfd->fd);
+			continue;
 		}
+		hpriv = __device_handle_priv(handle);
 
 		if (pollfd->revents & POLLERR) {
 			usbi_remove_pollfd(HANDLE_CTX(handle), hpriv->fd);
@@ -2162,7 +2645,7 @@ static clockid_t op_get_timerfd_clockid(void)
 const struct usbi_os_backend linux_usbfs_backend = {
 	.name = "Linux usbfs",
 	.init = op_init,
-	.exit = NULL,
+	.exit = op_exit,
 	.get_device_list = op_get_device_list,
 	.get_device_descriptor = op_get_device_descriptor,
 	.get_active_config_descriptor = op_get_active_config_descriptor,
@@ -2183,6 +2666,9 @@ const struct usbi_os_backend linux_usbfs_backend = {
 	.detach_kernel_driver = op_detach_kernel_driver,
 	.attach_kernel_driver = op_attach_kernel_driver,
 
+	.dev_mem_alloc = op_dev_mem_alloc,
+	.dev_mem_free = op_dev_mem_free,
+
 	.destroy_device = op_destroy_device,
 
 	.submit_transfer = op_submit_transfer,
@@ -21,7 +21,9 @@
 #ifndef __LIBUSB_USBFS_H__
 #define __LIBUSB_USBFS_H__
 
+#ifndef SYSFS_DEVICE_PATH
 #define SYSFS_DEVICE_PATH "/sys/bus/usb/devices"
+#endif
 
 struct usbfs_ctrltransfer {
 	/* keep in sync with usbdevice_fs.h:usbdevfs_ctrltransfer */
@@ -79,7 +81,7 @@ struct usbfs_iso_packet_desc {
 };
 
 #define MAX_ISO_BUFFER_LENGTH		32768
-#define MAX_BULK_BUFFER_LENGTH		16384
+#define MAX_BULK_BUFFER_LENGTH		16384	/* per URB, before Linux 3.3 */
 #define MAX_CTRL_BUFFER_LENGTH		4096
 
 struct usbfs_urb {
@@ -134,5 +136,12 @@ struct usbfs_hub_portinfo {
 #define IOCTL_USBFS_CLEAR_HALT	_IOR('U', 21, unsigned int)
 #define IOCTL_USBFS_DISCONNECT	_IO('U', 22)
 #define IOCTL_USBFS_CONNECT	_IO('U', 23)
+#define IOCTL_USBFS_GET_CAPABILITIES	_IOR('U', 26, unsigned int)
+
+/* capabilities reported by IOCTL_USBFS_GET_CAPABILITIES (Linux 3.6) */
+#define USBFS_CAP_ZERO_PACKET		0x01
+#define USBFS_CAP_BULK_CONTINUATION	0x02
+#define USBFS_CAP_NO_PACKET_SIZE_LIM	0x04
+#define USBFS_CAP_BULK_SCATTER_GATHER	0x08
 
 #endif
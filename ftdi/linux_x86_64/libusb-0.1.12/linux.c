@@ -14,12 +14,42 @@
 #include <errno.h>
 #include <sys/time.h>
 #include <dirent.h>
+#include <poll.h>
+#include <pthread.h>
+#include <time.h>
 
 #include "linux.h"
 #include "usbi.h"
 
 static char usb_path[PATH_MAX + 1] = "";
 
+/*
+ * Per open device state for URB completion, kept in dev->impl_info.
+ *
+ * usbfs hands out completed URBs of a device through one queue, whichever
+ * thread submitted them. A thread waiting for its URBs becomes the reaper
+ * if there is none: it blocks in poll() on the device fd (usbfs reports
+ * POLLOUT while completed URBs are queued), reaps everything that has
+ * completed and marks each URB done for the thread that owns it. Other
+ * waiters sleep on the condition variable, which is signalled after every
+ * round of reaping, and take over when the reaper leaves.
+ */
+struct linux_dev_handle {
+  pthread_mutex_t lock;
+  pthread_cond_t cond;		/* URBs marked done or reaper gone */
+  int reaping;			/* a thread is in poll() for this device */
+  int error;			/* fatal reap error, -ENODEV after unplug */
+};
+
+/* An URB and its completion flag; the URB must stay the first member */
+struct linux_urb {
+  struct usb_urb urb;
+  int done;
+};
+
+/* Kernel without USB_URB_BULK_CONTINUATION (before 2.6.32) */
+static int no_bulk_continuation = 0;
+
 static int device_open(struct usb_device *dev)
 {
   char filename[PATH_MAX + 1];
@@ -41,6 +71,20 @@ static int device_open(struct usb_device *dev)
 
 int usb_os_open(usb_dev_handle *dev)
 {
+  struct linux_dev_handle *h;
+  pthread_condattr_t attr;
+
+  h = calloc(1, sizeof(*h));
+  if (!h)
+    USB_ERROR(-ENOMEM);
+
+  pthread_mutex_init(&h->lock, NULL);
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&h->cond, &attr);
+  pthread_condattr_destroy(&attr);
+  dev->impl_info = h;
+
   dev->fd = device_open(dev->device);
 
   return 0;
@@ -48,6 +92,15 @@ int usb_os_open(usb_dev_handle *dev)
 
 int usb_os_close(usb_dev_handle *dev)
 {
+  struct linux_dev_handle *h = dev->impl_info;
+
+  if (h) {
+    pthread_cond_destroy(&h->cond);
+    pthread_mutex_destroy(&h->lock);
+    free(h);
+    dev->impl_info = NULL;
+  }
+
   if (dev->fd < 0)
     return 0;
 
@@ -156,123 +209,221 @@ int usb_control_msg(usb_dev_handle *dev, int requesttype, int request,
   return ret;
 }
 
-#define URB_USERCONTEXT_COOKIE		((void *)0x1)
+/*
+ * Number of URBs of one bulk transfer kept in flight. A transfer longer
+ * than MAX_READ_WRITE is split into URBs that are queued together, so the
+ * host controller never idles between chunks.
+ */
+#define MAX_URBS_IN_FLIGHT	8
 
-/* Reading and writing are the same except for the endpoint */
-static int usb_urb_transfer(usb_dev_handle *dev, int ep, int urbtype,
-	char *bytes, int size, int timeout)
+/* Milliseconds left until a deadline, rounded up; -1 for no deadline */
+static int ms_left(const struct timespec *deadline)
 {
-  struct usb_urb urb;
-  int bytesdone = 0, requested;
-  struct timeval tv, tv_ref, tv_now;
-  struct usb_urb *context;
-  int ret, waiting;
+  struct timespec now;
+  long long ns;
 
-  /*
-   * HACK: The use of urb.usercontext is a hack to get threaded applications
-   * sort of working again. Threaded support is still not recommended, but
-   * this should allow applications to work in the common cases. Basically,
-   * if we get the completion for an URB we're not waiting for, then we update
-   * the usercontext pointer to 1 for the other threads URB and it will see
-   * the change after it wakes up from the the timeout. Ugly, but it works.
-   */
+  if (!deadline)
+    return -1;
 
-  /*
-   * Get actual time, and add the timeout value. The result is the absolute
-   * time where we have to quit waiting for an message.
-   */
-  gettimeofday(&tv_ref, NULL);
-  tv_ref.tv_sec = tv_ref.tv_sec + timeout / 1000;
-  tv_ref.tv_usec = tv_ref.tv_usec + (timeout % 1000) * 1000;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  ns = (long long)(deadline->tv_sec - now.tv_sec) * 1000000000LL +
+	(deadline->tv_nsec - now.tv_nsec);
+  if (ns <= 0)
+    return 0;
 
-  if (tv_ref.tv_usec > 1000000) {
-    tv_ref.tv_usec -= 1000000;
-    tv_ref.tv_sec++;
-  }
+  return (int)((ns + 999999) / 1000000);
+}
 
-  do {
-    fd_set writefds;
+/*
+ * Wait until an URB has been reaped, reaping the completions of other
+ * threads on the way. Returns 0, -ETIMEDOUT at the deadline (NULL for none)
+ * or the fatal reap error of the device.
+ */
+static int usb_urb_wait(usb_dev_handle *dev, struct linux_urb *lurb,
+	const struct timespec *deadline)
+{
+  struct linux_dev_handle *h = dev->impl_info;
+  struct usb_urb *context;
+  struct pollfd pfd;
+  int ret = 0, ms, err;
+
+  pthread_mutex_lock(&h->lock);
+  while (!lurb->done && !h->error) {
+    if (h->reaping) {
+      if (!deadline)
+        pthread_cond_wait(&h->cond, &h->lock);
+      else if (pthread_cond_timedwait(&h->cond, &h->lock, deadline) == ETIMEDOUT &&
+	  !lurb->done) {
+        ret = -ETIMEDOUT;
+        break;
+      }
+      continue;
+    }
 
-    requested = size - bytesdone;
-    if (requested > MAX_READ_WRITE)
-      requested = MAX_READ_WRITE;
+    ms = ms_left(deadline);
+    if (ms == 0) {
+      ret = -ETIMEDOUT;
+      break;
+    }
 
-    urb.type = urbtype;
-    urb.endpoint = ep;
-    urb.flags = 0;
-    urb.buffer = bytes + bytesdone;
-    urb.buffer_length = requested;
-    urb.signr = 0;
-    urb.actual_length = 0;
-    urb.number_of_packets = 0;	/* don't do isochronous yet */
-    urb.usercontext = NULL;
+    h->reaping = 1;
+    pthread_mutex_unlock(&h->lock);
 
-    ret = ioctl(dev->fd, IOCTL_USB_SUBMITURB, &urb);
-    if (ret < 0) {
-      USB_ERROR_STR(-errno, "error submitting URB: %s", strerror(errno));
-      return ret;
-    }
+    pfd.fd = dev->fd;
+    pfd.events = POLLOUT;
+    pfd.revents = 0;
+    if (poll(&pfd, 1, ms) < 0 && errno != EINTR)
+      err = -errno;
+    else
+      err = 0;
 
-    FD_ZERO(&writefds);
-    FD_SET(dev->fd, &writefds);
+    /* Reap without the lock, mark done with it */
+    while (!err && ioctl(dev->fd, IOCTL_USB_REAPURBNDELAY, &context) == 0) {
+      pthread_mutex_lock(&h->lock);
+      ((struct linux_urb *)context)->done = 1;
+      pthread_mutex_unlock(&h->lock);
+    }
+    if (!err && errno != EAGAIN)
+      err = -errno;
+
+    pthread_mutex_lock(&h->lock);
+    if (err && !h->error)
+      h->error = err;
+    h->reaping = 0;
+    pthread_cond_broadcast(&h->cond);
+  }
+  if (!lurb->done && !ret)
+    ret = h->error;
+  pthread_mutex_unlock(&h->lock);
 
-restart:
-    waiting = 1;
-    context = NULL;
-    while (!urb.usercontext && ((ret = ioctl(dev->fd, IOCTL_USB_REAPURBNDELAY, &context)) == -1) && waiting) {
-      tv.tv_sec = 0;
-      tv.tv_usec = 1000; // 1 msec
-      select(dev->fd + 1, NULL, &writefds, NULL, &tv); //sub second wait
+  return ret;
+}
 
-      if (timeout) {
-        /* compare with actual time, as the select timeout is not that precise */
-        gettimeofday(&tv_now, NULL);
+/*
+ * Reading and writing are the same except for the endpoint.
+ *
+ * A bulk transfer is split into URBs of at most MAX_READ_WRITE bytes, up to
+ * MAX_URBS_IN_FLIGHT of them queued at once. All but the last are
+ * submitted with SHORT_NOT_OK and all but the first with BULK_CONTINUATION,
+ * so a short packet ends the transfer: the kernel cancels the URBs queued
+ * after it instead of filling them with the data of the next transfer.
+ * Kernels without these flags, and interrupt transfers, get one URB at a
+ * time.
+ */
+static int usb_urb_transfer(usb_dev_handle *dev, int ep, int urbtype,
+	char *bytes, int size, int timeout)
+{
+  struct linux_urb urbs[MAX_URBS_IN_FLIGHT], *lurb;
+  struct timespec deadline, *dl = NULL;
+  struct usb_urb *urb;
+  int count, limit, submitted = 0, finished = 0, ended = 0, failed = 0;
+  int bytesdone = 0, rc = 0, ret, i, len;
+
+  if (!dev->impl_info)
+    USB_ERROR(-EBADF);
+
+  /* timeout 0 waits forever */
+  if (timeout) {
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += timeout / 1000;
+    deadline.tv_nsec += (timeout % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+      deadline.tv_nsec -= 1000000000L;
+      deadline.tv_sec++;
+    }
+    dl = &deadline;
+  }
 
-        if ((tv_now.tv_sec > tv_ref.tv_sec) ||
-            ((tv_now.tv_sec == tv_ref.tv_sec) && (tv_now.tv_usec >= tv_ref.tv_usec)))
-          waiting = 0;
+  count = (size + MAX_READ_WRITE - 1) / MAX_READ_WRITE;
+  if (count == 0)
+    count = 1;	/* zero length packet */
+  limit = (urbtype == USB_URB_TYPE_BULK && !no_bulk_continuation) ?
+	MAX_URBS_IN_FLIGHT : 1;
+
+  for (;;) {
+    /* Keep the queue full */
+    while (!ended && submitted < count && submitted - finished < limit) {
+      lurb = &urbs[submitted % MAX_URBS_IN_FLIGHT];
+      urb = &lurb->urb;
+
+      len = size - submitted * MAX_READ_WRITE;
+      if (len > MAX_READ_WRITE)
+        len = MAX_READ_WRITE;
+
+      memset(lurb, 0, sizeof(*lurb));
+      urb->type = urbtype;
+      urb->endpoint = ep;
+      if (limit > 1) {
+        if (submitted < count - 1)
+          urb->flags |= USB_URB_SHORT_NOT_OK;
+        if (submitted > 0)
+          urb->flags |= USB_URB_BULK_CONTINUATION;
       }
+      urb->buffer = bytes + submitted * MAX_READ_WRITE;
+      urb->buffer_length = len;
+      urb->number_of_packets = 0;	/* don't do isochronous yet */
+      urb->usercontext = lurb;
+
+      ret = ioctl(dev->fd, IOCTL_USB_SUBMITURB, urb);
+      if (ret < 0) {
+        if (errno == EINVAL && (urb->flags & USB_URB_BULK_CONTINUATION)) {
+          /* Old kernel, go on with one URB at a time */
+          no_bulk_continuation = 1;
+          limit = 1;
+          continue;
+        }
+        /* reported once the URBs in flight are collected */
+        rc = -errno;
+        failed = 1;
+        break;
+      }
+      submitted++;
     }
 
-    if (context && context != &urb) {
-      context->usercontext = URB_USERCONTEXT_COOKIE;
-      /* We need to restart since we got a successful URB, but not ours */
-      goto restart;
+    if (finished == submitted)
+      break;
+    if (failed && !ended)
+      goto end;
+
+    /* URBs of an endpoint complete in order, wait for the oldest */
+    lurb = &urbs[finished % MAX_URBS_IN_FLIGHT];
+    ret = usb_urb_wait(dev, lurb, ended ? NULL : dl);
+    if (ret < 0 && (ret != -ETIMEDOUT || ended)) {
+      /* device gone, usbfs will not touch the buffers any more */
+      USB_ERROR_STR(ret, "error reaping URB: %s", strerror(-ret));
     }
+    if (ret == 0) {
+      urb = &lurb->urb;
+      finished++;
+      if (ended)
+        continue;	/* collecting after the end of the transfer */
+
+      bytesdone += urb->actual_length;
+      if (urb->status < 0 && urb->status != -EREMOTEIO)
+        rc = urb->status;
+      else if (urb->actual_length == urb->buffer_length)
+        continue;
+      /* error or short packet */
+    } else
+      rc = ret;
 
+end:
     /*
-     * If there was an error, that wasn't EAGAIN (no completion), then
-     * something happened during the reaping and we should return that
-     * error now
-     */
-    if (ret < 0 && !urb.usercontext && errno != EAGAIN)
-      USB_ERROR_STR(-errno, "error reaping URB: %s", strerror(errno));
-
-    bytesdone += urb.actual_length;
-  } while ((ret == 0 || urb.usercontext) && bytesdone < size && urb.actual_length == requested);
-
-  /* If the URB didn't complete in success or error, then let's unlink it */
-  if (ret < 0 && !urb.usercontext) {
-    int rc;
-
-    if (!waiting)
-      rc = -ETIMEDOUT;
-    else
-      rc = urb.status;
-
-    ret = ioctl(dev->fd, IOCTL_USB_DISCARDURB, &urb);
-    if (ret < 0 && errno != EINVAL && usb_debug >= 1)
-      fprintf(stderr, "error discarding URB: %s", strerror(errno));
-
-    /*
-     * When the URB is unlinked, it gets moved to the completed list and
-     * then we need to reap it or else the next time we call this function,
-     * we'll get the previous completion and exit early
+     * The transfer is over: unlink the URBs still queued and collect them,
+     * unlinked URBs complete at once
      */
-    ioctl(dev->fd, IOCTL_USB_REAPURB, &context);
+    ended = 1;
+    for (i = finished; i < submitted; i++) {
+      ret = ioctl(dev->fd, IOCTL_USB_DISCARDURB, &urbs[i % MAX_URBS_IN_FLIGHT].urb);
+      if (ret < 0 && errno != EINVAL && usb_debug >= 1)
+        fprintf(stderr, "error discarding URB: %s", strerror(errno));
+    }
+  }
 
+  if (failed)
+    USB_ERROR_STR(rc, "error submitting URB: %s", strerror(-rc));
+  if (rc < 0)
     return rc;
-  }
 
   return bytesdone;
 }
@@ -42,8 +42,10 @@ struct usb_getdriver {
 	char driver[USB_MAXDRIVERNAME + 1];
 };
 
+#define USB_URB_SHORT_NOT_OK	0x01
 #define USB_URB_DISABLE_SPD	1
 #define USB_URB_ISO_ASAP	2
+#define USB_URB_BULK_CONTINUATION	0x04
 #define USB_URB_QUEUE_BULK	0x10
 
 #define USB_URB_TYPE_ISO	0
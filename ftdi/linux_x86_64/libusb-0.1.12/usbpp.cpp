@@ -10,6 +10,7 @@
 #include <errno.h>
 #include <cstdlib>
 #include <stdio.h>
+#include <algorithm>
 
 //remove after debugging
 #include <iostream>
@@ -33,24 +34,63 @@ namespace USB {
     Interface *this_Interface;
     AltSetting *this_AltSetting;
     Endpoint *this_Endpoint;
+    size_t nBus = 0, nDevice = 0, nConfiguration = 0, nInterface = 0;
+    size_t nAltSetting = 0, nEndpoint = 0;
     int i, j, k, l;
 
     usb_find_busses();
     usb_find_devices();
 
+    /* size the arenas first, so that no node moves once linked */
     for (bus = usb_get_busses(); bus; bus = bus->next) {
+      nBus++;
+      for (dev = bus->devices; dev; dev = dev->next) {
+	nDevice++;
+	for (i = 0; i < dev->descriptor.bNumConfigurations; i++) {
+	  nConfiguration++;
+	  for (j = 0; j < dev->config[i].bNumInterfaces; j++) {
+	    nInterface++;
+	    for (k = 0; k < dev->config[i].interface[j].num_altsetting; k++) {
+	      nAltSetting++;
+	      nEndpoint += dev->config[i].interface[j].altsetting[k].bNumEndpoints;
+	    }
+	  }
+	}
+      }
+    }
+
+    /* drop the previous tree; clear() keeps the arena storage */
+    clear();
+    m_endpointArena.clear();
+    m_altSettingArena.clear();
+    m_interfaceArena.clear();
+    m_configurationArena.clear();
+    m_deviceArena.clear();
+    m_busArena.clear();
+    m_busArena.resize(nBus);
+    m_deviceArena.resize(nDevice);
+    m_configurationArena.resize(nConfiguration);
+    m_interfaceArena.resize(nInterface);
+    m_altSettingArena.resize(nAltSetting);
+    m_endpointArena.resize(nEndpoint);
+    this_Bus = m_busArena.empty() ? NULL : &m_busArena[0];
+    this_Device = m_deviceArena.empty() ? NULL : &m_deviceArena[0];
+    this_Configuration = m_configurationArena.empty() ? NULL : &m_configurationArena[0];
+    this_Interface = m_interfaceArena.empty() ? NULL : &m_interfaceArena[0];
+    this_AltSetting = m_altSettingArena.empty() ? NULL : &m_altSettingArena[0];
+    this_Endpoint = m_endpointArena.empty() ? NULL : &m_endpointArena[0];
+
+    for (bus = usb_get_busses(); bus; bus = bus->next, this_Bus++) {
       std::string dirName(bus->dirname);
 
-      this_Bus = new Bus;
       this_Bus->setDirectoryName(dirName);
       push_back(this_Bus);
 
-      for (dev = bus->devices; dev; dev = dev->next) {
+      for (dev = bus->devices; dev; dev = dev->next, this_Device++) {
 	std::string buf, fileName(dev->filename);
 	usb_dev_handle *dev_handle;
 	int ret;
 
-	this_Device = new Device;
 	this_Device->setFileName(fileName);
 	this_Device->setDescriptor(dev->descriptor);
 
@@ -80,25 +120,21 @@ namespace USB {
 
 	this_Bus->push_back(this_Device);
 
-	for (i = 0; i < this_Device->numConfigurations(); i++) {
-	  this_Configuration = new Configuration;
+	for (i = 0; i < this_Device->numConfigurations(); i++, this_Configuration++) {
 	  this_Configuration->setDescriptor(dev->config[i]);
 	  this_Device->push_back(this_Configuration);
 
-	  for (j = 0; j < this_Configuration->numInterfaces(); j ++) {
-	    this_Interface = new Interface;
+	  for (j = 0; j < this_Configuration->numInterfaces(); j++, this_Interface++) {
 	    this_Interface->setNumAltSettings(dev->config[i].interface[j].num_altsetting);
 	    this_Interface->setParent(this_Device);
 	    this_Interface->setInterfaceNumber(j);
 	    this_Configuration->push_back(this_Interface);
 
-	    for (k = 0; k < this_Interface->numAltSettings(); k ++) {
-	      this_AltSetting = new AltSetting;
+	    for (k = 0; k < this_Interface->numAltSettings(); k++, this_AltSetting++) {
 	      this_AltSetting->setDescriptor(dev->config[i].interface[j].altsetting[k]);
 	      this_Interface->push_back(this_AltSetting);
 
-	      for (l = 0; l < this_AltSetting->numEndpoints(); l++) {
-		this_Endpoint = new Endpoint;
+	      for (l = 0; l < this_AltSetting->numEndpoints(); l++, this_Endpoint++) {
 		this_Endpoint->setDescriptor(dev->config[i].interface[j].altsetting[k].endpoint[l]);
 		this_Endpoint->setParent(this_Device);
 		this_AltSetting->push_back(this_Endpoint);
@@ -108,51 +144,90 @@ namespace USB {
 	}
       }
     }
+
+    buildIndex();
+  }
+
+  unsigned int Busses::idHash(u_int16_t vendor, u_int16_t product)
+  {
+    unsigned int h = ((unsigned int)vendor << 16) | product;
+
+    /* multiplicative hashing, the table index is taken from the top bits */
+    return h * 2654435761u;
+  }
+
+  void Busses::buildIndex(void)
+  {
+    size_t n = m_deviceArena.size(), size = 16;
+    int shift = 28;
+
+    while (size < 2 * n) {
+      size <<= 1;
+      shift--;
+    }
+
+    m_idHead.assign(size, -1);
+    m_idNext.assign(n, -1);
+    m_classHead.assign(256, -1);
+    m_classNext.assign(n, -1);
+
+    /* insert backwards so that every chain is in device order */
+    for (size_t i = n; i-- > 0; ) {
+      Device &device = m_deviceArena[i];
+      unsigned int b = idHash(device.idVendor(), device.idProduct()) >> shift;
+
+      m_idNext[i] = m_idHead[b];
+      m_idHead[b] = (int)i;
+      m_classNext[i] = m_classHead[device.devClass()];
+      m_classHead[device.devClass()] = (int)i;
+    }
   }
 
   std::list<Device *> Busses::match(u_int8_t class_code)
   {
     std::list<Device *> match_list;
-    USB::Bus *bus;
-    std::list<USB::Bus *>::const_iterator biter;
-
-    for (biter = begin(); biter != end(); biter++) {
-      USB::Device *device;
-      std::list<USB::Device *>::const_iterator diter;
-      bus = *biter;
-
-      for (diter = bus->begin(); diter != bus->end(); diter++) {
-        device = *diter;
-	if (device->devClass() == class_code)
-	  match_list.push_back(device);
-      }
-    }
+    int i;
+
+    if (m_classHead.empty())
+      return match_list;
+
+    for (i = m_classHead[class_code]; i >= 0; i = m_classNext[i])
+      match_list.push_back(&m_deviceArena[i]);
+
     return match_list;
   }
 
   std::list<Device *> Busses::match(DeviceIDList devList)
   {
     std::list<Device *> match_list;
-    USB::Bus *bus;
-    std::list<USB::Bus *>::const_iterator biter;
+    std::vector<int> found;
+    DeviceIDList::iterator it;
+    size_t size = m_idHead.size();
+    int shift = 28, i;
+
+    if (size == 0)
+      return match_list;
+    while (size > 16) {
+      size >>= 1;
+      shift--;
+    }
 
-    for (biter = begin(); biter != end(); biter++) {
-      USB::Device *device;
-      std::list<USB::Device *>::const_iterator diter;
+    for (it = devList.begin(); it != devList.end(); it++) {
+      u_int16_t vendor = (*it).vendor(), product = (*it).product();
+      unsigned int b = idHash(vendor, product) >> shift;
 
-      bus = *biter;
-      for (diter = bus->begin(); diter != bus->end(); diter++) {
-	DeviceIDList::iterator it;
+      /* the chain also holds other IDs that hash to this bucket */
+      for (i = m_idHead[b]; i >= 0; i = m_idNext[i])
+	if (m_deviceArena[i].idVendor() == vendor &&
+	    m_deviceArena[i].idProduct() == product)
+	  found.push_back(i);
+    }
 
-        device = *diter;
+    /* devices in bus order, as a device matching two IDs is listed twice */
+    std::stable_sort(found.begin(), found.end());
+    for (std::vector<int>::iterator f = found.begin(); f != found.end(); f++)
+      match_list.push_back(&m_deviceArena[*f]);
 
-	for (it = devList.begin(); it != devList.end(); it++) {
-	  if (device->idVendor() == (*it).vendor() &&
-	      device->idProduct() == (*it).product())
-	    match_list.push_back(device);
-	}
-      }
-    }
     return match_list;
   }
 
@@ -168,7 +243,8 @@ namespace USB {
 
   Device::~Device(void)
   {
-    usb_close(m_handle);
+    if (m_handle)
+      usb_close(m_handle);
   }
 
   std::string Device::fileName(void)
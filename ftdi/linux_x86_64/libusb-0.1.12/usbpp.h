@@ -4,6 +4,7 @@
 
 #include <string>
 #include <list>
+#include <vector>
 
 #include <usb.h>
 
@@ -422,7 +423,7 @@ namespace USB {
 		friend class Endpoint;
 
 	public:
-		Device() {};
+		Device() : m_dev(NULL), m_handle(NULL) {};
 		~Device();
 
 		/**
@@ -843,6 +844,31 @@ namespace USB {
 
 	private:
 		std::list<Bus *>::const_iterator iter;
+
+		/*
+		 * The tree is kept in one arena per level, filled depth first,
+		 * so the children of a node are a contiguous run of the next
+		 * arena. A rescan destroys the previous tree (closing its
+		 * device handles) and refills the arenas in place, keeping
+		 * their storage. Pointers into the tree are valid until then.
+		 */
+		std::vector<Bus> m_busArena;
+		std::vector<Device> m_deviceArena;
+		std::vector<Configuration> m_configurationArena;
+		std::vector<Interface> m_interfaceArena;
+		std::vector<AltSetting> m_altSettingArena;
+		std::vector<Endpoint> m_endpointArena;
+
+		/*
+		 * Indices for match(): chains of device arena indices, -1
+		 * terminated. m_idHead is a power of two sized hash table on
+		 * (vendor, product), m_classHead has one chain per class code.
+		 */
+		std::vector<int> m_idHead, m_idNext;
+		std::vector<int> m_classHead, m_classNext;
+
+		static unsigned int idHash(u_int16_t vendor, u_int16_t product);
+		void buildIndex(void);
 	};
   
 	class Error {
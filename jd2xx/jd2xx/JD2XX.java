@@ -28,12 +28,37 @@
 
 package jd2xx;
 
+import java.io.BufferedReader;
+import java.io.FileNotFoundException;
+import java.io.FileReader;
 import java.io.IOException;
+import java.lang.ref.Cleaner;
+import java.lang.reflect.Field;
+import java.lang.reflect.Modifier;
+import java.nio.ByteBuffer;
+import java.util.ArrayList;
+import java.util.Collection;
+import java.util.List;
 import java.util.TooManyListenersException;
 
 import cz.adamh.utils.NativeUtils;
 
-/** Java D2XX class */
+/** Java D2XX class
+
+	Device handles are kept in a native table and every call pins the handle
+	it uses, so close() may be called while other threads are inside read(),
+	write() or any other call on the same object: the driver handle is
+	released once those calls return, and calls made after close() fail
+	with an IOException instead of touching a freed handle.
+
+	Reads and writes are full duplex: one thread may read while another
+	writes on the same object. The read path and the write path share no
+	state in this class or in the native library (each call copies through a
+	private buffer or uses the caller's direct buffer), so neither side waits
+	for the other. Concurrent reads, or concurrent writes, from several
+	threads are allowed but their data is not ordered with respect to each
+	other.
+*/
 public class JD2XX implements Runnable {
 
 	/* Device status */
@@ -143,7 +168,8 @@ public class JD2XX implements Runnable {
 		DEVICE_232R = 5,
     DEVICE_2232H = 6,
     DEVICE_4232H = 7,
-    DEVICE_232H = 8;
+    DEVICE_232H = 8,
+    DEVICE_X_SERIES = 9;
 
   /* Device information flags */
 	public static final int
@@ -439,6 +465,165 @@ public class JD2XX implements Runnable {
 		}
 	}
 
+	/** Device settings, applied in one native call by configure() and
+		openAll(). Settings left UNSET keep what the device has; when a
+		driver call sets several of them (data characteristics, flow
+		control, timeouts, USB parameters, chars, bit mode), the unset ones
+		keep their last applied values, or the values after open.
+
+		load() reads a configuration from a file in the format of the
+		driver's ftd2xx.cfg: [Globals] applies to all devices,
+		[VID_0403&PID_6001] to devices with that ID and a section named
+		after a serial number to that device, each overriding the one
+		before. Keys are the field names, in any case, with decimal or 0x
+		values, e.g. "BaudRate=115200"; other keys, like the driver's own
+		ConfigFlags, are ignored.
+	*/
+	public static class DeviceConfig {
+		public static final int UNSET = -1;
+
+		public int baudRate = UNSET;
+		public int wordLength = UNSET; // BITS_xxx
+		public int stopBits = UNSET; // STOP_BITS_xxx
+		public int parity = UNSET; // PARITY_xxx
+		public int flowControl = UNSET; // FLOW_xxx
+		public int xonChar = UNSET;
+		public int xoffChar = UNSET;
+		public int readTimeout = UNSET; // ms
+		public int writeTimeout = UNSET; // ms
+		public int latencyTimer = UNSET; // ms
+		public int inTransferSize = UNSET; // bytes, multiple of 64
+		public int outTransferSize = UNSET;
+		public int eventChar = UNSET;
+		public int eventCharEnabled = UNSET;
+		public int errorChar = UNSET;
+		public int errorCharEnabled = UNSET;
+		public int bitMask = UNSET; // pin directions for bitMode
+		public int bitMode = UNSET; // BITMODE_xxx
+
+		/** Native layout, CONFIG_xxx in jd2xx.h */
+		int[] marshal() {
+			return new int[] {
+				baudRate, wordLength, stopBits, parity, flowControl, xonChar, xoffChar,
+				readTimeout, writeTimeout, latencyTimer, inTransferSize, outTransferSize,
+				eventChar, eventCharEnabled, errorChar, errorCharEnabled, bitMask, bitMode
+			};
+		}
+
+		/** Settings of this configuration overridden by those set in another */
+		public DeviceConfig merge(DeviceConfig other) {
+			DeviceConfig c = new DeviceConfig();
+			try {
+				for (Field f : settings()) {
+					int v = f.getInt(other);
+					f.setInt(c, v != UNSET ? v : f.getInt(this));
+				}
+			}
+			catch (IllegalAccessException e) {
+				throw new IllegalStateException(e);
+			}
+			return c;
+		}
+
+		/** Read the configuration of a device from an ftd2xx.cfg style file
+			@param path file name
+			@param id device ID (VID << 16 | PID, as in DeviceInfo), 0 for none
+			@param serial device serial number, null for none
+		*/
+		public static DeviceConfig load(String path, int id, String serial) throws IOException {
+			String vidPid = String.format("VID_%04X&PID_%04X", id >>> 16, id & 0xffff);
+			DeviceConfig global = new DeviceConfig(), device = new DeviceConfig(),
+				unit = new DeviceConfig(), section = null;
+			BufferedReader r = new BufferedReader(new FileReader(path));
+			try {
+				String l;
+				int n = 0;
+				while ((l = r.readLine()) != null) {
+					++n;
+					l = l.trim();
+					if (l.length() == 0 || l.startsWith(";") || l.startsWith("#")) continue;
+					if (l.startsWith("[") && l.endsWith("]")) {
+						String name = l.substring(1, l.length() - 1).trim();
+						if (name.equalsIgnoreCase("Globals") || name.equalsIgnoreCase("Global")) section = global;
+						else if (id != 0 && name.equalsIgnoreCase(vidPid)) section = device;
+						else if (serial != null && name.equals(serial)) section = unit;
+						else section = null;
+						continue;
+					}
+					int e = l.indexOf('=');
+					if (e < 0) throw new IOException(path + ":" + n + ": expected key=value");
+					if (section == null) continue;
+					Field f = setting(l.substring(0, e).trim());
+					if (f == null) continue;
+					try {
+						f.setInt(section, Integer.decode(l.substring(e + 1).trim()));
+					}
+					catch (NumberFormatException x) {
+						throw new IOException(path + ":" + n + ": bad value for " + f.getName());
+					}
+					catch (IllegalAccessException x) {
+						throw new IllegalStateException(x);
+					}
+				}
+			}
+			finally {
+				r.close();
+			}
+			return global.merge(device).merge(unit);
+		}
+
+		/** Read the configuration of a listed device from an ftd2xx.cfg style file */
+		public static DeviceConfig load(String path, DeviceInfo device) throws IOException {
+			return load(path, device.id, device.serial);
+		}
+
+		/** The setting fields */
+		static Field[] settings() {
+			List<Field> l = new ArrayList<Field>();
+			for (Field f : DeviceConfig.class.getFields())
+				if (!Modifier.isStatic(f.getModifiers())) l.add(f);
+			return l.toArray(new Field[l.size()]);
+		}
+
+		/** Setting field for a file key, null if it is not one */
+		static Field setting(String key) {
+			for (Field f : settings())
+				if (f.getName().equalsIgnoreCase(key)) return f;
+			return null;
+		}
+
+		public String toString() {
+			StringBuffer b = new StringBuffer();
+			try {
+				for (Field f : settings()) {
+					int v = f.getInt(this);
+					if (v == UNSET) continue;
+					if (b.length() > 0) b.append(", ");
+					b.append(f.getName() + ": " + v);
+				}
+			}
+			catch (IllegalAccessException e) {
+				throw new IllegalStateException(e);
+			}
+			return b.toString();
+		}
+	}
+
+	/** Outcome of openAll for one device */
+	public static class OpenResult {
+		public String serial;
+		public JD2XX device; // open and configured, null if it failed
+		public String error; // failed call and driver status, e.g. "open: device not found (2)"
+
+		public boolean ok() {
+			return device != null;
+		}
+
+		public String toString() {
+			return "serial: " + serial + ", " + (device != null ? "ok" : error);
+		}
+	}
+
 	/* D2XX API */
 	/** Get library version */
 	public native int getLibraryVersion();
@@ -457,8 +642,12 @@ public class JD2XX implements Runnable {
 	/** Open device by number and associate it to this JD2XX object
 		@param deviceNumber device enumeration
 	*/
-	public native void open(int deviceNumber) throws IOException;
-	/** Close device
+	public void open(int deviceNumber) throws IOException {
+		nativeOpen(deviceNumber);
+		disposer.handle = handle;
+	}
+	private native void nativeOpen(int deviceNumber) throws IOException;
+	/** Close device. Calls in progress on other threads complete first.
 	*/
 	public native void close() throws IOException;
 	/** List devices
@@ -470,12 +659,68 @@ public class JD2XX implements Runnable {
 		@param name device serial number or description
 		@param flags selects open from serial number or description
 	*/
-	public native void openEx(String name, int flags) throws IOException;
+	public void openEx(String name, int flags) throws IOException {
+		nativeOpenEx(name, flags);
+		disposer.handle = handle;
+	}
+	private native void nativeOpenEx(String name, int flags) throws IOException;
 	/** Extended open (by number)
 		@param location device location
 		@param flags selects open by location
 	*/
-	public native void openEx(int location, int flags) throws IOException;
+	public void openEx(int location, int flags) throws IOException {
+		nativeOpenEx(location, flags);
+		disposer.handle = handle;
+	}
+	private native void nativeOpenEx(int location, int flags) throws IOException;
+
+	/** Open devices by serial number and configure them, all at the same
+		time in native worker threads. A device that fails to open or
+		configure is closed again and does not affect the others.
+		@param serials device serial numbers
+		@param config settings applied to every device, null for none
+		@return one result per serial number, in the same order
+	*/
+	public static List<OpenResult> openAll(Collection<String> serials, DeviceConfig config)
+		throws IOException
+	{
+		String[] s = serials.toArray(new String[serials.size()]);
+		for (int i = 0; i < s.length; ++i)
+			if (s[i] == null) throw new NullPointerException("serial number");
+		long[] handles = new long[s.length];
+		String[] errors = new String[s.length];
+		nativeOpenAll(s, (config != null ? config : new DeviceConfig()).marshal(), handles, errors);
+
+		List<OpenResult> results = new ArrayList<OpenResult>(s.length);
+		for (int i = 0; i < s.length; ++i) {
+			OpenResult r = new OpenResult();
+			r.serial = s[i];
+			r.error = errors[i];
+			if (r.error == null) {
+				r.device = new JD2XX();
+				r.device.handle = handles[i];
+				r.device.opened();
+			}
+			results.add(r);
+		}
+		return results;
+	}
+	private static native void nativeOpenAll(String[] serials, int[] config,
+		long[] handles, String[] errors) throws IOException;
+
+	/** Apply a device configuration in one native call. Driver calls whose
+		settings already have the values last applied to this device are
+		skipped. Settings of a call the configuration leaves unset keep
+		the values last applied, also by the set methods: after
+		setTimeouts(500, 1000), a configuration with only readTimeout
+		100 sets timeouts of 100 and 1000.
+		@param config settings to change
+		@return number of driver calls made, 0 if nothing changed
+	*/
+	public int configure(DeviceConfig config) throws IOException {
+		return nativeConfigure(config.marshal());
+	}
+	private native int nativeConfigure(int[] config) throws IOException;
 
 	/** Read bytes from device
 		@param bytes array to store read bytes
@@ -492,6 +737,84 @@ public class JD2XX implements Runnable {
 	*/
 	public native int write(byte[] bytes, int offset, int length) throws IOException;
 
+	/** Read bytes from device and update a CRC with them in the same pass
+		that copies them into the array. If an exception is thrown after
+		some bytes were read, the CRC does not include them; reset it.
+		@param bytes array to store read bytes
+		@param offset begin index
+		@param length amount of bytes desired
+		@param crc CRC to update
+		@return number of bytes actually read
+	*/
+	public int read(byte[] bytes, int offset, int length, JD2XXCrc crc) throws IOException {
+		long r = readCrc(bytes, offset, length, crc.kind, crc.register);
+		crc.register = (int)r;
+		return (int)(r >>> 32);
+	}
+	private native long readCrc(byte[] bytes, int offset, int length, int kind, int register) throws IOException;
+
+	/** Read bytes from device straight into a direct buffer
+		@param buffer direct buffer, filled from its position up to its limit
+		@return number of bytes actually read, the position is advanced by it
+	*/
+	public int read(ByteBuffer buffer) throws IOException {
+		int r = readDirect(buffer, buffer.position(), buffer.remaining());
+		buffer.position(buffer.position() + r);
+		return r;
+	}
+	private native int readDirect(ByteBuffer buffer, int offset, int length) throws IOException;
+	/** Write bytes to device straight from a direct buffer
+		@param buffer direct buffer, sent from its position up to its limit
+		@return number of bytes actually written, the position is advanced by it
+	*/
+	public int write(ByteBuffer buffer) throws IOException {
+		int r = writeDirect(buffer, buffer.position(), buffer.remaining());
+		buffer.position(buffer.position() + r);
+		return r;
+	}
+	private native int writeDirect(ByteBuffer buffer, int offset, int length) throws IOException;
+
+	/** Allocate a direct buffer for read(ByteBuffer) and write(ByteBuffer).
+		The memory is whole pages, pre-faulted and locked in RAM where the
+		memlock limit allows, so a stream does not stall on page faults.
+		Falls back to ByteBuffer.allocateDirect where mapping is not
+		available or the VM cannot wrap the mapped pages. The pages are
+		unmapped once the buffer and every view derived from it are
+		unreachable.
+		@param capacity buffer size in bytes
+		@return direct buffer
+	*/
+	public static ByteBuffer allocateDirect(int capacity) {
+		if (capacity < 0) throw new IllegalArgumentException("negative capacity");
+		long address = (capacity > 0) ? mapBuffer(capacity) : 0;
+		if (address == 0) return ByteBuffer.allocateDirect(capacity);
+		ByteBuffer buffer = wrapBuffer(address, capacity);
+		if (buffer == null) {
+			unmapBuffer(address, capacity);
+			return ByteBuffer.allocateDirect(capacity);
+		}
+		cleaner.register(buffer, new Unmapper(address, capacity));
+		return buffer;
+	}
+	private static native long mapBuffer(int capacity);
+	private static native ByteBuffer wrapBuffer(long address, int capacity);
+	private static native void unmapBuffer(long address, int capacity);
+
+	/** Cleaner action for allocateDirect; must not reference the buffer */
+	private static class Unmapper implements Runnable {
+		private final long address;
+		private final int capacity;
+
+		Unmapper(long address, int capacity) {
+			this.address = address;
+			this.capacity = capacity;
+		}
+
+		public void run() {
+			unmapBuffer(address, capacity);
+		}
+	}
+
 	// public native void ioCtl(...);
 
 	/** Set device baud rate
@@ -588,6 +911,29 @@ public class JD2XX implements Runnable {
 	public native void writeEE(int wordOffset, short value) throws IOException;
 	/** Clear EEPROM */
 	public native void eraseEE() throws IOException;
+	/** Read consecutive EEPROM words in one call
+		@param wordOffset first word address
+		@param numWords number of words (64 for a 93C46, 128 for a 93C56,
+		256 for a 93C66; addresses beyond the chip wrap around)
+		@return EEPROM image
+	*/
+	public native short[] dumpEE(int wordOffset, int numWords) throws IOException;
+	/** Write an EEPROM image, skipping words that already hold the value
+		@param wordOffset first word address
+		@param image words to write
+		@return number of words written
+	*/
+	public int updateEE(int wordOffset, short[] image) throws IOException {
+		return updateEE(wordOffset, image, null);
+	}
+	/** Write an EEPROM image against known contents, e.g. from dumpEE,
+		without reading the words back first
+		@param wordOffset first word address
+		@param image words to write
+		@param current current contents of the same range, or null to read them
+		@return number of words written
+	*/
+	public native int updateEE(int wordOffset, short[] image, short[] current) throws IOException;
 
 	/** Program EEPROM
 		@param data ProgramData object holding device information
@@ -605,6 +951,21 @@ public class JD2XX implements Runnable {
 		String manufacturer, String manufacturerId,
 		String description, String serialNumber
 	) throws IOException;
+	/** Read EEPROM into a chip specific structure (FT_EEPROM_Read)
+		@param ee structure for the device type, e.g. JD2XXEeprom.forDevice(getDeviceInfo().type)
+	*/
+	public void eepromRead(JD2XXEeprom ee) throws IOException {
+		nativeEepromRead(ee.data, ee.size);
+	}
+	/** Program EEPROM from a chip specific structure (FT_EEPROM_Program)
+		@param ee structure for the device type
+	*/
+	public void eepromProgram(JD2XXEeprom ee) throws IOException {
+		nativeEepromProgram(ee.data, ee.size);
+	}
+	private native void nativeEepromRead(ByteBuffer data, int size) throws IOException;
+	private native void nativeEepromProgram(ByteBuffer data, int size) throws IOException;
+
 	/** Read device information from EEPROM
 		@return ProgramData object with device information
 	*/
@@ -700,6 +1061,29 @@ public class JD2XX implements Runnable {
 	public native int eeReadEcc(int option) throws IOException;
 	public native int getQueueStatusEx() throws IOException;
 
+	/** Record reads, writes and modem status changes of this device with
+		their times into a capture file (see JD2XXReplay), with 16 MB file
+		segments and a 4 MB buffer */
+	public void startCapture(String path) throws IOException {
+		startCapture(path, 16 << 20, 4 << 20);
+	}
+
+	/** Record reads, writes and modem status changes of this device with
+		their times into a capture file, replacing any running capture. I/O
+		never waits for the file: a background thread writes the records and
+		records that do not fit into the buffer are dropped and counted.
+		The capture also ends when the device is closed. Not on Windows.
+		@param path file to create
+		@param segmentSize file segment size (a multiple of 4096, at least 64 KB)
+		@param bufferSize memory buffer for records not written yet
+	*/
+	public native void startCapture(String path, int segmentSize, int bufferSize) throws IOException;
+	/** Stop recording and finish the capture file */
+	public native void stopCapture() throws IOException;
+	/** @return records, bytes and dropped records of the current or last
+		capture, and the file size written so far */
+	public native long[] getCaptureStatistics() throws IOException;
+
 	/** Add event listener
 		@param el JD2XX event listener object
 	*/
@@ -712,7 +1096,7 @@ public class JD2XX implements Runnable {
 	public native int waitEvent();
 
 
-	/** Internal FT_HANDLE */
+	/** Internal handle table token */
 	protected long handle = -1;
 	/** Internal event handle */
 	protected int event = -1;
@@ -725,40 +1109,195 @@ public class JD2XX implements Runnable {
 	/** Listener notifier thread */
 	protected Thread notifier = null;
 
+	/** Native library variant actually loaded ("baseline", "avx2" or "neon") */
+	public static final String nativeVariant;
+
+	/** Revision of the native interface, NATIVE_INTERFACE in JD2XX.c */
+	private static final int NATIVE_INTERFACE = 2;
+	private static native int nativeInterface();
+
 	static {
 		String dataModel = System.getProperty("sun.arch.data.model");
-		String osName = System.getProperty("os.name").toLowerCase();;
-
-		StringBuilder lib = new StringBuilder("/jni/");
+		String osName = System.getProperty("os.name").toLowerCase();
+		String osArch = System.getProperty("os.arch").toLowerCase();
 
-		if (osName.contains("win"))
-			lib.append("win/");
-		else if (osName.contains("linux"))
-			lib.append("linux/");
-		else if (osName.contains("mac"))
-			lib.append("mac/");
+		String os, name, ext;
+		if (osName.contains("win")) {
+			os = "win"; name = "jd2xx"; ext = ".dll";
+		}
+		else if (osName.contains("linux")) {
+			os = "linux"; name = "libjd2xx"; ext = ".so";
+		}
+		else if (osName.contains("mac")) {
+			os = "mac"; name = "libjd2xx"; ext = ".jnilib";
+		}
 		else
 			throw new UnsatisfiedLinkError("Loading JD2XX JNI: Unsupported operating system ("+osName+")");
 
-		if (dataModel.equals("32"))
-			lib.append("x86_32/");
-		else if (dataModel.equals("64"))
-			lib.append("x86_64/");
+		String arch;
+		if (osArch.equals("aarch64") || osArch.equals("arm64"))
+			arch = "aarch64";
+		else if (osArch.startsWith("arm"))
+			arch = isHardFloat() ? "armhf" : "armel";
+		else if (dataModel != null && dataModel.equals("32"))
+			arch = "x86_32";
+		else if (dataModel != null && dataModel.equals("64"))
+			arch = "x86_64";
 		else
 			throw new UnsatisfiedLinkError("Loading JD2XX JNI: Unknown runtime data model ("+dataModel+")");
 
-		if (osName.contains("win"))
-			lib.append("jd2xx.dll");
-		else if (osName.contains("linux"))
-			lib.append("libjd2xx.so");
-		else if (osName.contains("mac"))
-			lib.append("libjd2xx.jnilib");
+		String dir = "/jni/" + os + "/" + arch + "/";
+
+		/* Prefer the CPU-optimized build when the CPU supports it and the jar
+		 * ships it; any failure falls back to the baseline library. The
+		 * jd2xx.variant property forces a particular variant. */
+		String variant = System.getProperty("jd2xx.variant");
+		if (variant == null) variant = optimizedVariant(arch);
 
+		/* The jd2xx.library property names a library file to load instead
+		 * of the packaged ones (e.g. a build against the test mock driver) */
+		String library = System.getProperty("jd2xx.library");
+
+		String loaded = "baseline";
+		boolean done = false;
+		if (library != null) {
+			System.load(library);
+			loaded = "external";
+			done = true;
+		}
+		else if (variant != null && !variant.equals("baseline")) {
+			try {
+				NativeUtils.loadLibraryFromJar(dir + name + "_" + variant + ext);
+				loaded = variant;
+				done = true;
+			} catch (IOException e) {
+				// not packaged, use baseline
+			} catch (UnsatisfiedLinkError e) {
+				// cannot run here, use baseline
+			}
+		}
+
+		if (!done) {
+			try {
+				NativeUtils.loadLibraryFromJar(dir + name + ext);
+			} catch (FileNotFoundException e) {
+				throw new UnsatisfiedLinkError("Loading JD2XX JNI: no native library for "
+					+ os + "/" + arch + " (" + dir + name + ext + " is not in the jar); build it"
+					+ " there with \"make jni jni-install\" or name one with -Djd2xx.library");
+			} catch (IOException e) {
+				throw new UnsatisfiedLinkError(e.getMessage());
+			}
+		}
+
+		/* A library built from older sources loads fine and only fails
+		 * when a missing native is first called; catch that here */
+		int found;
 		try {
-			NativeUtils.loadLibraryFromJar(lib.toString());
+			found = nativeInterface();
+		} catch (UnsatisfiedLinkError e) {
+			found = 0;
+		}
+		if (found != NATIVE_INTERFACE)
+			throw new UnsatisfiedLinkError("Loading JD2XX JNI: the " + loaded + " library for "
+				+ os + "/" + arch + " does not match jd2xx.jar (interface " + found
+				+ ", expected " + NATIVE_INTERFACE + "); rebuild it with \"make jni jni-install\"");
+		nativeVariant = loaded;
+	}
+
+
+	/** Check whether the running JVM uses the ARM hard-float ABI.
+		Looks at sun.arch.abi first and then at the EABI flags of the JVM
+		executable (EF_ARM_ABI_FLOAT_HARD).
+	*/
+	private static boolean isHardFloat() {
+		String abi = System.getProperty("sun.arch.abi");
+		if (abi != null) return abi.toLowerCase().contains("hf");
+
+		String[] exes = {
+			System.getProperty("java.home") + "/bin/java",
+			"/proc/self/exe"
+		};
+		for (int i=0; i<exes.length; ++i) {
+			java.io.RandomAccessFile f = null;
+			try {
+				f = new java.io.RandomAccessFile(exes[i], "r");
+				byte[] h = new byte[0x28];
+				f.readFully(h);
+				if (h[0] != 0x7f || h[1] != 'E' || h[2] != 'L' || h[3] != 'F' || h[4] != 1)
+					continue; // not a 32-bit ELF
+				int flags = (h[0x24] & 0xff) | (h[0x25] & 0xff) << 8
+					| (h[0x26] & 0xff) << 16 | (h[0x27] & 0xff) << 24;
+				return (flags & 0x400) != 0;
+			} catch (IOException e) {
+				// try next one
+			} finally {
+				if (f != null) try { f.close(); } catch (IOException e) { }
+			}
+		}
+		return new java.io.File("/lib/arm-linux-gnueabihf").isDirectory();
+	}
+
+	/** Select the optimized native variant supported by this CPU
+		@param arch JNI architecture directory name
+		@return variant suffix or null if only the baseline applies
+	*/
+	private static String optimizedVariant(String arch) {
+		String features = cpuFeatures();
+		if (features == null) return null;
+		if (arch.startsWith("x86") && features.contains(" avx2 ")
+			&& features.contains(" pclmulqdq ")) return "avx2";
+		if (arch.startsWith("arm") && features.contains(" neon ")) return "neon";
+		if (arch.equals("aarch64") && features.contains(" asimd ")
+			&& features.contains(" crc32 ")) return "neon";
+		return null;
+	}
+
+	/** Read the CPU feature flags from /proc/cpuinfo (Linux only)
+		@return space-delimited feature list or null if unavailable
+	*/
+	private static String cpuFeatures() {
+		java.io.BufferedReader r = null;
+		try {
+			r = new java.io.BufferedReader(new java.io.FileReader("/proc/cpuinfo"));
+			String l;
+			while ((l = r.readLine()) != null) {
+				if (l.startsWith("flags") || l.startsWith("Features")) {
+					int c = l.indexOf(':');
+					if (c >= 0) return " " + l.substring(c+1).trim() + " ";
+				}
+			}
 		} catch (IOException e) {
-			throw new UnsatisfiedLinkError(e.getMessage());
+			// not Linux
+		} finally {
+			if (r != null) try { r.close(); } catch (IOException e) { }
 		}
+		return null;
+	}
+
+	/** Releases the native handle of unreachable objects */
+	static final Cleaner cleaner = Cleaner.create(); // shared by the package
+
+	/** Cleaner action; must not reference the JD2XX object */
+	private static class Disposer implements Runnable {
+		volatile long handle = -1;
+
+		public void run() {
+			if (handle != -1) dispose(handle);
+		}
+	}
+
+	private final Disposer disposer = new Disposer();
+
+	/** Close a handle table token without throwing */
+	private static native void dispose(long handle);
+
+	/** Track a handle set natively outside open() and openEx() */
+	void opened() {
+		disposer.handle = handle;
+	}
+
+	{
+		cleaner.register(this, disposer);
 	}
 
 	/** Create a new unopened JD2XX object */
@@ -780,17 +1319,6 @@ public class JD2XX implements Runnable {
 		openEx(location, flags);
 	}
 
-	protected void finalize()
-	throws Throwable {
-		try {
-			// if (handle != 0) close();
-			close();
-		}
-		finally {
-			super.finalize();
-		}
-	}
-
 	/** Open device by serial number alias */
 	public void openBySerialNumber(String name) throws IOException {
 		openEx(name, OPEN_BY_SERIAL_NUMBER);
@@ -0,0 +1,175 @@
+/*
+	Copyright (c) 2005 Pablo Bleyer Kocik.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	1. Redistributions of source code must retain the above copyright notice, this
+	list of conditions and the following disclaimer.
+
+	2. Redistributions in binary form must reproduce the above copyright notice,
+	this list of conditions and the following disclaimer in the documentation
+	and/or other materials provided with the distribution.
+
+	3. The name of the author may not be used to endorse or promote products
+	derived from this software without specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR IMPLIED
+	WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+	MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+	EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+	SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+	PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+	BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+	IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+package jd2xx;
+
+import java.io.IOException;
+import java.util.concurrent.locks.ReadWriteLock;
+import java.util.concurrent.locks.ReentrantReadWriteLock;
+
+/** CBUS bit-bang on FT232R and FT-X devices
+
+	Pins 0-3 are CBUS0-3 (they must be configured as I/O in the EEPROM).
+	The output value and direction are kept as shadow state, so changing
+	one pin does not read the others back and the mode byte is built
+	without a device call. With a coalescing window set, changes made
+	within the window after the first one are sent together in a single
+	FT_SetBitMode; an error of such a deferred send is thrown by the next
+	call. Methods may be called from any thread; close() waits for the
+	calls in progress, and calls made after it fail.
+*/
+public class JD2XXCbus {
+
+	/** Native CBUS state */
+	protected long cbus = 0;
+	/** Read: native state in use by a call; write: state being disposed */
+	private final ReadWriteLock lock = new ReentrantReadWriteLock();
+
+	/** Device */
+	protected JD2XX jd2xx;
+
+	/** Cleaner action; must not reference the JD2XXCbus object */
+	private static class Disposer implements Runnable {
+		volatile long cbus = 0;
+
+		public void run() {
+			if (cbus != 0) dispose(cbus);
+		}
+	}
+	private final Disposer disposer = new Disposer();
+
+	/** Enable CBUS bit-bang on an open device, all pins inputs
+		@param jd open device, must stay open while this object is used
+	*/
+	public JD2XXCbus(JD2XX jd) throws IOException {
+		jd2xx = jd;
+		cbus = disposer.cbus = nativeOpen(jd);
+		JD2XX.cleaner.register(this, disposer);
+	}
+
+	/** Send pending changes and return the device to reset mode */
+	public void close() {
+		lock.writeLock().lock();
+		try {
+			long c = cbus;
+			cbus = disposer.cbus = 0;
+			if (c != 0) dispose(c);
+		}
+		finally {
+			lock.writeLock().unlock();
+		}
+	}
+
+	/** Set output pins, leaving the others unchanged
+		@param mask pins to change
+		@param value new state of the pins in mask
+	*/
+	public void set(int mask, int value) throws IOException {
+		lock.readLock().lock();
+		try { nativeSet(cbus, mask, value); }
+		finally { lock.readLock().unlock(); }
+	}
+
+	/** Set one output pin */
+	public void set(int pin, boolean on) throws IOException {
+		lock.readLock().lock();
+		try { nativeSet(cbus, 1 << pin, on ? ~0 : 0); }
+		finally { lock.readLock().unlock(); }
+	}
+
+	/** Set pin directions
+		@param mask pins to change
+		@param outputs 1 for pins in mask that become outputs, 0 for inputs
+	*/
+	public void setDirection(int mask, int outputs) throws IOException {
+		lock.readLock().lock();
+		try { nativeSetDirection(cbus, mask, outputs); }
+		finally { lock.readLock().unlock(); }
+	}
+
+	/** Read pins; pending changes are sent first */
+	public int get() throws IOException {
+		lock.readLock().lock();
+		try { return nativeGet(cbus); }
+		finally { lock.readLock().unlock(); }
+	}
+
+	/** Read one pin */
+	public boolean get(int pin) throws IOException {
+		lock.readLock().lock();
+		try { return (nativeGet(cbus) & (1 << pin)) != 0; }
+		finally { lock.readLock().unlock(); }
+	}
+
+	/** Outputs as last set (no device access) */
+	public int getOutput() throws IOException {
+		lock.readLock().lock();
+		try { return nativeGetOutput(cbus, false); }
+		finally { lock.readLock().unlock(); }
+	}
+
+	/** Directions as last set (no device access) */
+	public int getDirection() throws IOException {
+		lock.readLock().lock();
+		try { return nativeGetOutput(cbus, true); }
+		finally { lock.readLock().unlock(); }
+	}
+
+	/** Set coalescing window
+		@param micros time from the first change to the send, 0 sends every change at once
+	*/
+	public void setWindow(int micros) throws IOException {
+		lock.readLock().lock();
+		try { nativeSetWindow(cbus, micros); }
+		finally { lock.readLock().unlock(); }
+	}
+
+	/** Send pending changes now */
+	public void flush() throws IOException {
+		lock.readLock().lock();
+		try { nativeFlush(cbus); }
+		finally { lock.readLock().unlock(); }
+	}
+
+	/** Number of FT_SetBitMode calls made so far */
+	public long getTransfers() {
+		lock.readLock().lock();
+		try { return nativeGetTransfers(cbus); }
+		finally { lock.readLock().unlock(); }
+	}
+
+	private static native long nativeOpen(JD2XX jd) throws IOException;
+	private static native void dispose(long cbus);
+	private static native void nativeSet(long cbus, int mask, int value) throws IOException;
+	private static native void nativeSetDirection(long cbus, int mask, int outputs) throws IOException;
+	private static native int nativeGet(long cbus) throws IOException;
+	private static native int nativeGetOutput(long cbus, boolean direction) throws IOException;
+	private static native void nativeSetWindow(long cbus, int micros) throws IOException;
+	private static native void nativeFlush(long cbus) throws IOException;
+	private static native long nativeGetTransfers(long cbus);
+}
@@ -0,0 +1,141 @@
+/*
+	Copyright (c) 2005 Pablo Bleyer Kocik.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	1. Redistributions of source code must retain the above copyright notice, this
+	list of conditions and the following disclaimer.
+
+	2. Redistributions in binary form must reproduce the above copyright notice,
+	this list of conditions and the following disclaimer in the documentation
+	and/or other materials provided with the distribution.
+
+	3. The name of the author may not be used to endorse or promote products
+	derived from this software without specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR IMPLIED
+	WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+	MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+	EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+	SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+	PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+	BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+	IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+package jd2xx;
+
+import java.nio.ByteBuffer;
+
+/** Native CRC-16/MODBUS, CRC-16/CCITT and CRC-32
+
+	Computed by the JNI library with slice-by-8 tables and, for CRC-32,
+	carry-less multiplication (PCLMULQDQ) or the ARMv8 CRC32 instructions
+	in the CPU-optimized library variants. A JD2XXCrc can be attached to
+	reads (JD2XX.read(byte[], int, int, JD2XXCrc)) to check data in the
+	same pass that copies it into the array, and a JD2XXFramer can check
+	and strip a CRC on every frame (JD2XXFramer.setCrc).
+
+	Data sent with its CRC appended in wire order (low byte first for
+	CRC16_MODBUS and CRC32, high byte first for CRC_CCITT, see appendTo)
+	can be checked by updating over data and CRC and calling isValid().
+	Not thread safe.
+*/
+public class JD2XXCrc {
+
+	/** No CRC */
+	public static final int NONE = -1;
+	/** CRC-16/MODBUS: reflected polynomial 0x8005, initial value 0xFFFF */
+	public static final int CRC16_MODBUS = 0;
+	/** CRC-16/CCITT-FALSE: polynomial 0x1021, initial value 0xFFFF */
+	public static final int CRC_CCITT = 1;
+	/** CRC-32 of IEEE 802.3, same value as java.util.zip.CRC32 */
+	public static final int CRC32 = 2;
+
+	/** Variant, one of the constants above */
+	public final int kind;
+
+	int register; // shift register, updated by JD2XX.read
+
+	static {
+		String v = JD2XX.nativeVariant; // loads the JNI library
+	}
+
+	/** Create a CRC of the given kind */
+	public JD2XXCrc(int kind) {
+		size(kind);
+		this.kind = kind;
+		reset();
+	}
+
+	/** Restart from the initial value */
+	public void reset() {
+		register = kind == CRC32 ? 0xffffffff : 0xffff;
+	}
+
+	/** Update with bytes of an array */
+	public void update(byte[] b, int off, int len) {
+		if (off < 0 || len < 0 || off > b.length - len) throw new IndexOutOfBoundsException();
+		if (len > 0) register = nativeUpdate(kind, register, b, off, len);
+	}
+
+	/** Update with all bytes of an array */
+	public void update(byte[] b) {
+		update(b, 0, b.length);
+	}
+
+	/** Update with the bytes of a buffer from its position to its limit;
+		the position is advanced to the limit */
+	public void update(ByteBuffer buffer) {
+		int p = buffer.position(), n = buffer.remaining();
+		if (n == 0) return;
+		if (buffer.isDirect()) register = nativeUpdateDirect(kind, register, buffer, p, n);
+		else if (buffer.hasArray()) update(buffer.array(), buffer.arrayOffset() + p, n);
+		else {
+			byte[] b = new byte[n];
+			buffer.get(b);
+			update(b);
+		}
+		buffer.position(p + n);
+	}
+
+	/** @return CRC of the bytes so far (16 bits for the CRC-16 kinds) */
+	public int getValue() {
+		return kind == CRC32 ? ~register : register;
+	}
+
+	/** @return true if the bytes so far end with their correct CRC in wire order */
+	public boolean isValid() {
+		return register == (kind == CRC32 ? 0xdebb20e3 : 0);
+	}
+
+	/** Store the current value in wire order
+		@return offset after the CRC
+	*/
+	public int appendTo(byte[] b, int off) {
+		int v = getValue(), n = size(kind);
+		for (int i = 0; i < n; ++i)
+			b[off + i] = (byte)(kind == CRC_CCITT ? v >> 8 * (n - 1 - i) : v >> 8 * i);
+		return off + n;
+	}
+
+	/** @return CRC length in bytes */
+	public static int size(int kind) {
+		if (kind == CRC16_MODBUS || kind == CRC_CCITT) return 2;
+		if (kind == CRC32) return 4;
+		throw new IllegalArgumentException("unknown CRC");
+	}
+
+	/** CRC of a range of an array */
+	public static int compute(int kind, byte[] b, int off, int len) {
+		JD2XXCrc c = new JD2XXCrc(kind);
+		c.update(b, off, len);
+		return c.getValue();
+	}
+
+	private static native int nativeUpdate(int kind, int register, byte[] b, int off, int len);
+	private static native int nativeUpdateDirect(int kind, int register, ByteBuffer b, int off, int len);
+}
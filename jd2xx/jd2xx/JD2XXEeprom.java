@@ -0,0 +1,340 @@
+/*
+	Copyright (c) 2005 Pablo Bleyer Kocik.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	1. Redistributions of source code must retain the above copyright notice, this
+	list of conditions and the following disclaimer.
+
+	2. Redistributions in binary form must reproduce the above copyright notice,
+	this list of conditions and the following disclaimer in the documentation
+	and/or other materials provided with the distribution.
+
+	3. The name of the author may not be used to endorse or promote products
+	derived from this software without specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR IMPLIED
+	WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+	MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+	EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+	SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+	PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+	BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+	IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+package jd2xx;
+
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
+import java.nio.charset.StandardCharsets;
+
+/** Chip specific EEPROM contents for JD2XX.eepromRead and eepromProgram
+
+	The data lives in one direct buffer laid out exactly like the driver's
+	FT_EEPROM_xxx structure for the chip, followed by the four string
+	buffers, and is handed to FT_EEPROM_Read/FT_EEPROM_Program as is:
+	reading and programming create no Java objects and set no fields one by
+	one. Fields are addressed with the constants of the chip family classes
+	below, which encode size and offset (size << 16 | offset); the common
+	header fields are defined here.
+*/
+public abstract class JD2XXEeprom {
+
+	/** Size of each string buffer, including the terminating zero */
+	public static final int STRING_SIZE = 64;
+
+	/* Common header (FT_EEPROM_HEADER) */
+	public static final int
+		DEVICE_TYPE = 4<<16 | 0,
+		VENDOR_ID = 2<<16 | 4,
+		PRODUCT_ID = 2<<16 | 6,
+		SER_NUM_ENABLE = 1<<16 | 8,
+		MAX_POWER = 2<<16 | 10,
+		SELF_POWERED = 1<<16 | 12,
+		REMOTE_WAKEUP = 1<<16 | 13,
+		PULL_DOWN_ENABLE = 1<<16 | 14;
+
+	/* String slots */
+	static final int MANUFACTURER = 0, MANUFACTURER_ID = 1, DESCRIPTION = 2, SERIAL_NUMBER = 3;
+
+	/** Structure followed by the string buffers, native byte order */
+	public final ByteBuffer data;
+
+	/** Size of the driver structure */
+	public final int size;
+
+	protected JD2XXEeprom(int deviceType, int size) {
+		this.size = size;
+		data = ByteBuffer.allocateDirect(size + 4 * STRING_SIZE).order(ByteOrder.nativeOrder());
+		set(DEVICE_TYPE, deviceType);
+	}
+
+	/** Structure for a device type (JD2XX.DEVICE_xxx)
+		@return null if the type has no FT_EEPROM_xxx structure
+	*/
+	public static JD2XXEeprom forDevice(int deviceType) {
+		switch (deviceType) {
+		case JD2XX.DEVICE_BM: return new FT232B();
+		case JD2XX.DEVICE_2232C: return new FT2232();
+		case JD2XX.DEVICE_232R: return new FT232R();
+		case JD2XX.DEVICE_2232H: return new FT2232H();
+		case JD2XX.DEVICE_4232H: return new FT4232H();
+		case JD2XX.DEVICE_232H: return new FT232H();
+		case JD2XX.DEVICE_X_SERIES: return new XSeries();
+		default: return null;
+		}
+	}
+
+	/** Get field value */
+	public int get(int field) {
+		int off = field & 0xffff;
+		switch (field >>> 16) {
+		case 1: return data.get(off) & 0xff;
+		case 2: return data.getShort(off) & 0xffff;
+		default: return data.getInt(off);
+		}
+	}
+
+	/** Set field value */
+	public void set(int field, int value) {
+		int off = field & 0xffff;
+		switch (field >>> 16) {
+		case 1: data.put(off, (byte)value); break;
+		case 2: data.putShort(off, (short)value); break;
+		default: data.putInt(off, value);
+		}
+	}
+
+	/** Get flag field */
+	public boolean is(int field) {
+		return get(field) != 0;
+	}
+
+	/** Set flag field */
+	public void set(int field, boolean value) {
+		set(field, value ? 1 : 0);
+	}
+
+	public int getDeviceType() {
+		return get(DEVICE_TYPE);
+	}
+
+	public String getManufacturer() { return getString(MANUFACTURER); }
+	public String getManufacturerId() { return getString(MANUFACTURER_ID); }
+	public String getDescription() { return getString(DESCRIPTION); }
+	public String getSerialNumber() { return getString(SERIAL_NUMBER); }
+
+	public void setManufacturer(String s) { setString(MANUFACTURER, s); }
+	public void setManufacturerId(String s) { setString(MANUFACTURER_ID, s); }
+	public void setDescription(String s) { setString(DESCRIPTION, s); }
+	public void setSerialNumber(String s) { setString(SERIAL_NUMBER, s); }
+
+	/** Decode zero terminated string slot */
+	protected String getString(int slot) {
+		int base = size + slot * STRING_SIZE, n = 0;
+		while (n < STRING_SIZE - 1 && data.get(base + n) != 0) ++n;
+		byte[] b = new byte[n];
+		for (int i = 0; i < n; ++i) b[i] = data.get(base + i);
+		return new String(b, StandardCharsets.US_ASCII);
+	}
+
+	/** Encode string slot, zero terminated */
+	protected void setString(int slot, String s) {
+		byte[] b = s.getBytes(StandardCharsets.US_ASCII);
+		if (b.length >= STRING_SIZE)
+			throw new IllegalArgumentException("string longer than " + (STRING_SIZE - 1) + " characters");
+		int base = size + slot * STRING_SIZE;
+		for (int i = 0; i < b.length; ++i) data.put(base + i, b[i]);
+		data.put(base + b.length, (byte)0);
+	}
+
+	/** FT232B/FT245B EEPROM (FT_EEPROM_232B) */
+	public static class FT232B extends JD2XXEeprom {
+		public FT232B() {
+			super(JD2XX.DEVICE_BM, 16);
+		}
+	}
+
+	/** FT2232C/D EEPROM (FT_EEPROM_2232) */
+	public static class FT2232 extends JD2XXEeprom {
+		public static final int
+			A_IS_HIGH_CURRENT = 1<<16 | 16,
+			B_IS_HIGH_CURRENT = 1<<16 | 17,
+			A_IS_FIFO = 1<<16 | 18,
+			A_IS_FIFO_TAR = 1<<16 | 19,
+			A_IS_FAST_SER = 1<<16 | 20,
+			B_IS_FIFO = 1<<16 | 21,
+			B_IS_FIFO_TAR = 1<<16 | 22,
+			B_IS_FAST_SER = 1<<16 | 23,
+			A_DRIVER_TYPE = 1<<16 | 24,
+			B_DRIVER_TYPE = 1<<16 | 25;
+
+		public FT2232() {
+			super(JD2XX.DEVICE_2232C, 28);
+		}
+	}
+
+	/** FT232R/FT245R EEPROM (FT_EEPROM_232R) */
+	public static class FT232R extends JD2XXEeprom {
+		public static final int
+			IS_HIGH_CURRENT = 1<<16 | 16,
+			USE_EXT_OSC = 1<<16 | 17,
+			INVERT_TXD = 1<<16 | 18,
+			INVERT_RXD = 1<<16 | 19,
+			INVERT_RTS = 1<<16 | 20,
+			INVERT_CTS = 1<<16 | 21,
+			INVERT_DTR = 1<<16 | 22,
+			INVERT_DSR = 1<<16 | 23,
+			INVERT_DCD = 1<<16 | 24,
+			INVERT_RI = 1<<16 | 25,
+			CBUS0 = 1<<16 | 26,
+			CBUS1 = 1<<16 | 27,
+			CBUS2 = 1<<16 | 28,
+			CBUS3 = 1<<16 | 29,
+			CBUS4 = 1<<16 | 30,
+			DRIVER_TYPE = 1<<16 | 31;
+
+		public FT232R() {
+			super(JD2XX.DEVICE_232R, 32);
+		}
+	}
+
+	/** FT2232H EEPROM (FT_EEPROM_2232H) */
+	public static class FT2232H extends JD2XXEeprom {
+		public static final int
+			AL_SLOW_SLEW = 1<<16 | 16,
+			AL_SCHMITT_INPUT = 1<<16 | 17,
+			AL_DRIVE_CURRENT = 1<<16 | 18,
+			AH_SLOW_SLEW = 1<<16 | 19,
+			AH_SCHMITT_INPUT = 1<<16 | 20,
+			AH_DRIVE_CURRENT = 1<<16 | 21,
+			BL_SLOW_SLEW = 1<<16 | 22,
+			BL_SCHMITT_INPUT = 1<<16 | 23,
+			BL_DRIVE_CURRENT = 1<<16 | 24,
+			BH_SLOW_SLEW = 1<<16 | 25,
+			BH_SCHMITT_INPUT = 1<<16 | 26,
+			BH_DRIVE_CURRENT = 1<<16 | 27,
+			A_IS_FIFO = 1<<16 | 28,
+			A_IS_FIFO_TAR = 1<<16 | 29,
+			A_IS_FAST_SER = 1<<16 | 30,
+			B_IS_FIFO = 1<<16 | 31,
+			B_IS_FIFO_TAR = 1<<16 | 32,
+			B_IS_FAST_SER = 1<<16 | 33,
+			POWER_SAVE_ENABLE = 1<<16 | 34,
+			A_DRIVER_TYPE = 1<<16 | 35,
+			B_DRIVER_TYPE = 1<<16 | 36;
+
+		public FT2232H() {
+			super(JD2XX.DEVICE_2232H, 40);
+		}
+	}
+
+	/** FT4232H EEPROM (FT_EEPROM_4232H) */
+	public static class FT4232H extends JD2XXEeprom {
+		public static final int
+			A_SLOW_SLEW = 1<<16 | 16,
+			A_SCHMITT_INPUT = 1<<16 | 17,
+			A_DRIVE_CURRENT = 1<<16 | 18,
+			B_SLOW_SLEW = 1<<16 | 19,
+			B_SCHMITT_INPUT = 1<<16 | 20,
+			B_DRIVE_CURRENT = 1<<16 | 21,
+			C_SLOW_SLEW = 1<<16 | 22,
+			C_SCHMITT_INPUT = 1<<16 | 23,
+			C_DRIVE_CURRENT = 1<<16 | 24,
+			D_SLOW_SLEW = 1<<16 | 25,
+			D_SCHMITT_INPUT = 1<<16 | 26,
+			D_DRIVE_CURRENT = 1<<16 | 27,
+			A_RI_IS_TXDEN = 1<<16 | 28,
+			B_RI_IS_TXDEN = 1<<16 | 29,
+			C_RI_IS_TXDEN = 1<<16 | 30,
+			D_RI_IS_TXDEN = 1<<16 | 31,
+			A_DRIVER_TYPE = 1<<16 | 32,
+			B_DRIVER_TYPE = 1<<16 | 33,
+			C_DRIVER_TYPE = 1<<16 | 34,
+			D_DRIVER_TYPE = 1<<16 | 35;
+
+		public FT4232H() {
+			super(JD2XX.DEVICE_4232H, 36);
+		}
+	}
+
+	/** FT232H EEPROM (FT_EEPROM_232H) */
+	public static class FT232H extends JD2XXEeprom {
+		public static final int
+			AC_SLOW_SLEW = 1<<16 | 16,
+			AC_SCHMITT_INPUT = 1<<16 | 17,
+			AC_DRIVE_CURRENT = 1<<16 | 18,
+			AD_SLOW_SLEW = 1<<16 | 19,
+			AD_SCHMITT_INPUT = 1<<16 | 20,
+			AD_DRIVE_CURRENT = 1<<16 | 21,
+			CBUS0 = 1<<16 | 22,
+			CBUS1 = 1<<16 | 23,
+			CBUS2 = 1<<16 | 24,
+			CBUS3 = 1<<16 | 25,
+			CBUS4 = 1<<16 | 26,
+			CBUS5 = 1<<16 | 27,
+			CBUS6 = 1<<16 | 28,
+			CBUS7 = 1<<16 | 29,
+			CBUS8 = 1<<16 | 30,
+			CBUS9 = 1<<16 | 31,
+			FT1248_CPOL = 1<<16 | 32,
+			FT1248_LSB = 1<<16 | 33,
+			FT1248_FLOW_CONTROL = 1<<16 | 34,
+			IS_FIFO = 1<<16 | 35,
+			IS_FIFO_TAR = 1<<16 | 36,
+			IS_FAST_SER = 1<<16 | 37,
+			IS_FT1248 = 1<<16 | 38,
+			POWER_SAVE_ENABLE = 1<<16 | 39,
+			DRIVER_TYPE = 1<<16 | 40;
+
+		public FT232H() {
+			super(JD2XX.DEVICE_232H, 44);
+		}
+	}
+
+	/** FT-X series EEPROM (FT_EEPROM_X_SERIES) */
+	public static class XSeries extends JD2XXEeprom {
+		public static final int
+			AC_SLOW_SLEW = 1<<16 | 16,
+			AC_SCHMITT_INPUT = 1<<16 | 17,
+			AC_DRIVE_CURRENT = 1<<16 | 18,
+			AD_SLOW_SLEW = 1<<16 | 19,
+			AD_SCHMITT_INPUT = 1<<16 | 20,
+			AD_DRIVE_CURRENT = 1<<16 | 21,
+			CBUS0 = 1<<16 | 22,
+			CBUS1 = 1<<16 | 23,
+			CBUS2 = 1<<16 | 24,
+			CBUS3 = 1<<16 | 25,
+			CBUS4 = 1<<16 | 26,
+			CBUS5 = 1<<16 | 27,
+			CBUS6 = 1<<16 | 28,
+			INVERT_TXD = 1<<16 | 29,
+			INVERT_RXD = 1<<16 | 30,
+			INVERT_RTS = 1<<16 | 31,
+			INVERT_CTS = 1<<16 | 32,
+			INVERT_DTR = 1<<16 | 33,
+			INVERT_DSR = 1<<16 | 34,
+			INVERT_DCD = 1<<16 | 35,
+			INVERT_RI = 1<<16 | 36,
+			BCD_ENABLE = 1<<16 | 37,
+			BCD_FORCE_CBUS_PWREN = 1<<16 | 38,
+			BCD_DISABLE_SLEEP = 1<<16 | 39,
+			I2C_SLAVE_ADDRESS = 2<<16 | 40,
+			I2C_DEVICE_ID = 4<<16 | 44,
+			I2C_DISABLE_SCHMITT = 1<<16 | 48,
+			FT1248_CPOL = 1<<16 | 49,
+			FT1248_LSB = 1<<16 | 50,
+			FT1248_FLOW_CONTROL = 1<<16 | 51,
+			RS485_ECHO_SUPPRESS = 1<<16 | 52,
+			POWER_SAVE_ENABLE = 1<<16 | 53,
+			DRIVER_TYPE = 1<<16 | 54;
+
+		public XSeries() {
+			super(JD2XX.DEVICE_X_SERIES, 56);
+		}
+	}
+}
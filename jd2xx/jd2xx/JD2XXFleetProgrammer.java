@@ -0,0 +1,335 @@
+/*
+	Copyright (c) 2005 Pablo Bleyer Kocik.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	1. Redistributions of source code must retain the above copyright notice, this
+	list of conditions and the following disclaimer.
+
+	2. Redistributions in binary form must reproduce the above copyright notice,
+	this list of conditions and the following disclaimer in the documentation
+	and/or other materials provided with the distribution.
+
+	3. The name of the author may not be used to endorse or promote products
+	derived from this software without specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR IMPLIED
+	WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+	MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+	EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+	SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+	PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+	BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+	IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+package jd2xx;
+
+import java.io.IOException;
+import java.lang.reflect.Field;
+import java.util.ArrayList;
+import java.util.List;
+import java.util.concurrent.Callable;
+import java.util.concurrent.ExecutionException;
+import java.util.concurrent.ExecutorService;
+import java.util.concurrent.Executors;
+import java.util.concurrent.Future;
+import java.util.concurrent.atomic.AtomicInteger;
+import java.util.function.Predicate;
+
+import jd2xx.JD2XX.DeviceInfo;
+import jd2xx.JD2XX.ProgramData;
+
+/** Programs and verifies the EEPROMs of many devices in parallel
+
+	Every matching device that is not already open gets a copy of the
+	template with its own serial number. Devices are opened by location, so
+	a unit keeps its identity while its serial number changes. Each one is
+	programmed, read back and compared in a worker of a bounded pool; EEPROM
+	access is mostly waiting on USB control transfers, so units on one hub
+	overlap well. The readback is compared on the fields the chip family
+	actually stores.
+*/
+public class JD2XXFleetProgrammer {
+
+	/* Result status */
+	public static final int
+		OK = 0,
+		OPEN_FAILED = 1,
+		PROGRAM_FAILED = 2,
+		VERIFY_FAILED = 3;
+
+	static final String[] statusNames = {
+		"ok", "open failed", "program failed", "verify failed"
+	};
+
+	/** Generates the serial number of each unit */
+	public interface SerialNumbers {
+		String next(DeviceInfo device);
+	}
+
+	/** Serial numbers made of a prefix and a counter
+		@param prefix fixed part, e.g. "FX"
+		@param first first counter value
+		@param digits counter width, zero padded
+	*/
+	public static SerialNumbers sequence(final String prefix, int first, final int digits) {
+		final AtomicInteger counter = new AtomicInteger(first);
+		return new SerialNumbers() {
+			public String next(DeviceInfo device) {
+				return prefix + String.format("%0" + digits + "d", counter.getAndIncrement());
+			}
+		};
+	}
+
+	/** Outcome for one device */
+	public static class Result {
+		public int location;
+		public int type;
+		public String oldSerial;
+		public String serial;
+		public int status;
+		public String error; // I/O error message, if any
+		public List<String> mismatches = new ArrayList<String>(); // "field: wrote x, read y"
+		public long millis;
+
+		public String toString() {
+			StringBuffer b = new StringBuffer();
+			b.append("location: 0x" + Integer.toHexString(location));
+			b.append(", type: " + type);
+			b.append(", serial: " + oldSerial + " -> " + serial);
+			b.append(", status: " + statusNames[status]);
+			b.append(", time: " + millis + " ms");
+			if (error != null) b.append(", error: " + error);
+			for (String m : mismatches) b.append(", " + m);
+			return b.toString();
+		}
+	}
+
+	/** Results of one run, in device list order */
+	public static class Report {
+		public List<Result> results;
+		public long millis;
+
+		Report(List<Result> r, long t) {
+			results = r;
+			millis = t;
+		}
+
+		/** Number of devices that ended with a status */
+		public int count(int status) {
+			int n = 0;
+			for (Result r : results) if (r.status == status) ++n;
+			return n;
+		}
+
+		public boolean allOk() {
+			return count(OK) == results.size();
+		}
+
+		public String toString() {
+			StringBuffer b = new StringBuffer();
+			for (Result r : results) b.append(r.toString()).append('\n');
+			b.append(results.size() + " devices, " + count(OK) + " ok, "
+				+ (results.size() - count(OK)) + " failed in " + millis + " ms");
+			return b.toString();
+		}
+	}
+
+	/* Fields compared after programming, per chip family */
+	static final String[] commonFields = {
+		"vendorID", "productID", "manufacturer", "manufacturerID", "description",
+		"serialNumber", "maxPower", "selfPowered", "remoteWakeup"
+	};
+	static final String[] fieldsBM = {
+		"isoIn", "isoOut", "pullDownEnable", "serNumEnable", "usbVersionEnable", "usbVersion"
+	};
+	static final String[] fields2232C = {
+		"isoInA", "isoInB", "isoOutA", "isoOutB", "pullDownEnable5", "serNumEnable5",
+		"usbVersionEnable5", "usbVersion5", "aIsHighCurrent", "bIsHighCurrent",
+		"ifAIsFifo", "ifAIsFifoTar", "ifAIsFastSer", "aIsVCP",
+		"ifBIsFifo", "ifBIsFifoTar", "ifBIsFastSer", "bIsVCP"
+	};
+	static final String[] fields232R = {
+		"useExtOsc", "highDriveIOs", "pullDownEnableR", "serNumEnableR",
+		"invertTXD", "invertRXD", "invertRTS", "invertCTS",
+		"invertDTR", "invertDSR", "invertDCD", "invertRI",
+		"cbus0", "cbus1", "cbus2", "cbus3", "cbus4", "rIsD2XX"
+	};
+	static final String[] fields2232H = {
+		"pullDownEnable7", "serNumEnable7",
+		"alSlowSlew", "alSchmittInput", "alDriveCurrent",
+		"ahSlowSlew", "ahSchmittInput", "ahDriveCurrent",
+		"blSlowSlew", "blSchmittInput", "blDriveCurrent",
+		"bhSlowSlew", "bhSchmittInput", "bhDriveCurrent",
+		"ifAIsFifo7", "ifAIsFifoTar7", "ifAIsFastSer7", "aIsVCP7",
+		"ifBIsFifo7", "ifBIsFifoTar7", "ifBIsFastSer7", "bIsVCP7", "powerSaveEnable"
+	};
+	static final String[] fields4232H = {
+		"pullDownEnable8", "serNumEnable8",
+		"aSlowSlew", "aSchmittInput", "aDriveCurrent",
+		"bSlowSlew", "bSchmittInput", "bDriveCurrent",
+		"cSlowSlew", "cSchmittInput", "cDriveCurrent",
+		"dSlowSlew", "dSchmittInput", "dDriveCurrent",
+		"aRIIsTXDEN", "bRIIsTXDEN", "cRIIsTXDEN", "dRIIsTXDEN",
+		"aIsVCP8", "bIsVCP8", "cIsVCP8", "dIsVCP8"
+	};
+	static final String[] fields232H = {
+		"pullDownEnableH", "serNumEnableH",
+		"acSlowSlewH", "acSchmittInputH", "acDriveCurrentH",
+		"adSlowSlewH", "adSchmittInputH", "adDriveCurrentH",
+		"cbus0H", "cbus1H", "cbus2H", "cbus3H", "cbus4H",
+		"cbus5H", "cbus6H", "cbus7H", "cbus8H", "cbus9H",
+		"isFifoH", "isFifoTarH", "isFastSerH", "isFt1248H",
+		"ft1248CpolH", "ft1248LsbH", "ft1248FlowControlH", "isVCPH", "powerSaveEnableH"
+	};
+
+	protected int workers;
+
+	/** @param workers maximum number of devices programmed at the same time */
+	public JD2XXFleetProgrammer(int workers) {
+		if (workers < 1) throw new IllegalArgumentException("workers < 1");
+		this.workers = workers;
+	}
+
+	public JD2XXFleetProgrammer() {
+		this(8);
+	}
+
+	/** Program all matching devices
+		@param match selects devices from the device info list
+		@param template EEPROM contents; not modified
+		@param serials serial number source, called in device list order; null keeps the template serial
+		@return one result per matching device
+	*/
+	public Report program(Predicate<DeviceInfo> match, final ProgramData template,
+		SerialNumbers serials) throws IOException
+	{
+		long t0 = System.nanoTime();
+		List<DeviceInfo> devices = new ArrayList<DeviceInfo>();
+		JD2XX jd = new JD2XX();
+		int n = jd.createDeviceInfoList();
+		for (int i = 0; i < n; ++i) {
+			DeviceInfo di = jd.getDeviceInfoDetail(i);
+			if ((di.flags & JD2XX.FLAGS_OPENED) == 0 && match.test(di)) devices.add(di);
+		}
+
+		List<Result> results = new ArrayList<Result>();
+		if (!devices.isEmpty()) {
+			ExecutorService pool = Executors.newFixedThreadPool(Math.min(workers, devices.size()));
+			List<Future<Result>> pending = new ArrayList<Future<Result>>();
+			try {
+				for (final DeviceInfo di : devices) {
+					// serials are handed out here so they follow device list order
+					final String serial = (serials != null) ? serials.next(di) : template.serialNumber;
+					pending.add(pool.submit(new Callable<Result>() {
+						public Result call() {
+							return programDevice(di, template, serial);
+						}
+					}));
+				}
+				for (Future<Result> f : pending) results.add(f.get());
+			}
+			catch (InterruptedException e) {
+				Thread.currentThread().interrupt();
+				throw new IOException("interrupted");
+			}
+			catch (ExecutionException e) {
+				throw new IOException(e.getCause());
+			}
+			finally {
+				pool.shutdownNow();
+			}
+		}
+
+		return new Report(results, (System.nanoTime() - t0) / 1000000);
+	}
+
+	/** Program, read back and compare one device */
+	protected Result programDevice(DeviceInfo di, ProgramData template, String serial) {
+		long t0 = System.nanoTime();
+		Result r = new Result();
+		r.location = di.location;
+		r.type = di.type;
+		r.oldSerial = di.serial;
+		r.serial = serial;
+
+		JD2XX jd = new JD2XX();
+		try {
+			jd.openEx(di.location, JD2XX.OPEN_BY_LOCATION);
+		}
+		catch (IOException e) {
+			r.status = OPEN_FAILED;
+			r.error = e.getMessage();
+			r.millis = (System.nanoTime() - t0) / 1000000;
+			return r;
+		}
+
+		try {
+			ProgramData pd = copy(template);
+			pd.serialNumber = serial;
+			r.status = PROGRAM_FAILED;
+			jd.eeProgram(pd);
+
+			r.status = VERIFY_FAILED;
+			ProgramData rd = jd.eeRead();
+			diff(pd, rd, commonFields, r.mismatches);
+			diff(pd, rd, fieldsFor(di.type), r.mismatches);
+			if (r.mismatches.isEmpty()) r.status = OK;
+		}
+		catch (IOException e) {
+			r.error = e.getMessage();
+		}
+		finally {
+			try { jd.close(); }
+			catch (IOException e) { }
+		}
+
+		r.millis = (System.nanoTime() - t0) / 1000000;
+		return r;
+	}
+
+	/** Chip family specific fields for a device type */
+	protected static String[] fieldsFor(int type) {
+		switch (type) {
+		case JD2XX.DEVICE_BM:
+		case JD2XX.DEVICE_AM: return fieldsBM;
+		case JD2XX.DEVICE_2232C: return fields2232C;
+		case JD2XX.DEVICE_232R: return fields232R;
+		case JD2XX.DEVICE_2232H: return fields2232H;
+		case JD2XX.DEVICE_4232H: return fields4232H;
+		case JD2XX.DEVICE_232H: return fields232H;
+		default: return new String[0];
+		}
+	}
+
+	/** Field by field copy of a ProgramData */
+	public static ProgramData copy(ProgramData src) {
+		ProgramData dst = new ProgramData();
+		try {
+			for (Field f : ProgramData.class.getFields()) f.set(dst, f.get(src));
+		}
+		catch (IllegalAccessException e) {
+			throw new IllegalStateException(e);
+		}
+		return dst;
+	}
+
+	/** Append "field: wrote x, read y" for every listed field that differs */
+	static void diff(ProgramData wrote, ProgramData read, String[] fields, List<String> out) {
+		try {
+			for (String name : fields) {
+				Field f = ProgramData.class.getField(name);
+				Object w = f.get(wrote), r = f.get(read);
+				if (w == null ? r != null : !w.equals(r))
+					out.add(name + ": wrote " + w + ", read " + r);
+			}
+		}
+		catch (ReflectiveOperationException e) {
+			throw new IllegalStateException(e);
+		}
+	}
+}
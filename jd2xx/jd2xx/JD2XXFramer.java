@@ -0,0 +1,213 @@
+/*
+	Copyright (c) 2005 Pablo Bleyer Kocik.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	1. Redistributions of source code must retain the above copyright notice, this
+	list of conditions and the following disclaimer.
+
+	2. Redistributions in binary form must reproduce the above copyright notice,
+	this list of conditions and the following disclaimer in the documentation
+	and/or other materials provided with the distribution.
+
+	3. The name of the author may not be used to endorse or promote products
+	derived from this software without specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR IMPLIED
+	WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+	MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+	EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+	SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+	PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+	BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+	IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+package jd2xx;
+
+import java.io.IOException;
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
+import java.nio.IntBuffer;
+import java.util.Arrays;
+
+/** COBS or SLIP frame decoder on the receive path
+
+	receive() reads from the device and decodes every complete frame in
+	native code into the direct buffer data; frame i of the batch starts
+	at offset(i) and is length(i) bytes long, valid until the next call.
+	Delimiters are found with a vector scan and frames are decoded while
+	being copied, so there is no per-byte work or allocation in Java.
+	Malformed and oversized frames are dropped and counted by getErrors().
+	With setCrc, every frame ends with a CRC that is checked while the frame
+	is decoded and then removed from it.
+	Reads through the device's read timeout; must not be used together with
+	other reads on the same device. Not thread safe.
+*/
+public class JD2XXFramer {
+
+	/** Consistent overhead byte stuffing, frames end with 0x00 */
+	public static final int COBS = 0;
+	/** RFC 1055 SLIP, frames end with 0xC0 */
+	public static final int SLIP = 1;
+
+	/** Decoded frames of the last batch */
+	public final ByteBuffer data;
+
+	private final IntBuffer index; // offset, length pairs
+	private final ByteBuffer view; // for copying frames out
+	private int count = 0;
+
+	/** Native decoder state */
+	protected long framer = 0;
+
+	/** Device */
+	protected JD2XX jd2xx;
+
+	/** Cleaner action; must not reference the JD2XXFramer object */
+	private static class Disposer implements Runnable {
+		volatile long framer = 0;
+
+		public void run() {
+			if (framer != 0) dispose(framer);
+		}
+	}
+	private final Disposer disposer = new Disposer();
+
+	/** Attach a decoder with 64 KB of frame data and up to 1024 frames per batch */
+	public JD2XXFramer(JD2XX jd, int mode) throws IOException {
+		this(jd, mode, 65536, 1024);
+	}
+
+	/** Attach a decoder to an open device
+		@param jd open device, must stay open while this object is used
+		@param mode COBS or SLIP
+		@param capacity size of the data buffer, also the longest encoded frame
+		@param maxFrames maximum frames per batch
+	*/
+	public JD2XXFramer(JD2XX jd, int mode, int capacity, int maxFrames) throws IOException {
+		jd2xx = jd;
+		data = ByteBuffer.allocateDirect(capacity);
+		view = data.duplicate();
+		ByteBuffer ib = ByteBuffer.allocateDirect(8 * maxFrames).order(ByteOrder.nativeOrder());
+		index = ib.asIntBuffer();
+		framer = disposer.framer = nativeOpen(jd, mode, data, ib);
+		JD2XX.cleaner.register(this, disposer);
+	}
+
+	/** Release the decoder; bytes of an incomplete frame are lost */
+	public void close() {
+		long f = framer;
+		framer = disposer.framer = 0;
+		count = 0;
+		dispose(f);
+	}
+
+	/** Receive a batch of frames; waits for the read timeout if no frame
+		is complete yet
+		@return number of frames, 0 on timeout
+	*/
+	public int receive() throws IOException {
+		count = 0;
+		return count = nativeReceive(framer);
+	}
+
+	/** @return number of frames in the current batch */
+	public int count() {
+		return count;
+	}
+
+	/** @return offset of frame i in data */
+	public int offset(int i) {
+		if (i < 0 || i >= count) throw new IndexOutOfBoundsException();
+		return index.get(2 * i);
+	}
+
+	/** @return length of frame i */
+	public int length(int i) {
+		if (i < 0 || i >= count) throw new IndexOutOfBoundsException();
+		return index.get(2 * i + 1);
+	}
+
+	/** Copy frame i into a (reusable) array
+		@return frame length
+	*/
+	public int frame(int i, byte[] dst) {
+		int n = length(i);
+		view.limit(offset(i) + n).position(offset(i));
+		view.get(dst, 0, n);
+		return n;
+	}
+
+	/** @return copy of frame i */
+	public byte[] frame(int i) {
+		byte[] b = new byte[length(i)];
+		frame(i, b);
+		return b;
+	}
+
+	/** Number of frames dropped as malformed or too long */
+	public long getErrors() {
+		return nativeGetErrors(framer);
+	}
+
+	/** Check a CRC at the end of every frame (in JD2XXCrc wire order);
+		frames with a bad CRC are dropped and counted by getCrcErrors(), the
+		CRC is stripped from good ones
+		@param kind JD2XXCrc kind or JD2XXCrc.NONE
+	*/
+	public void setCrc(int kind) throws IOException {
+		nativeSetCrc(framer, kind);
+	}
+
+	/** Number of frames dropped for a bad CRC */
+	public long getCrcErrors() {
+		return nativeGetCrcErrors(framer);
+	}
+
+	/** Encode a frame for sending, including the delimiter(s)
+		@param mode COBS or SLIP
+	*/
+	public static byte[] encode(int mode, byte[] frame) {
+		int p = 0;
+
+		if (mode == COBS) {
+			byte[] b = new byte[frame.length + frame.length / 254 + 2];
+			int code = 1, at = p++;
+			for (byte x : frame) {
+				if (x != 0) {
+					b[p++] = x;
+					if (++code < 0xff) continue;
+				}
+				b[at] = (byte)code;
+				at = p++;
+				code = 1;
+			}
+			b[at] = (byte)code;
+			b[p++] = 0;
+			return Arrays.copyOf(b, p);
+		}
+		if (mode == SLIP) {
+			byte[] b = new byte[2 * frame.length + 2];
+			b[p++] = (byte)0xc0; // flush line noise
+			for (byte x : frame) {
+				if (x == (byte)0xc0) { b[p++] = (byte)0xdb; b[p++] = (byte)0xdc; }
+				else if (x == (byte)0xdb) { b[p++] = (byte)0xdb; b[p++] = (byte)0xdd; }
+				else b[p++] = x;
+			}
+			b[p++] = (byte)0xc0;
+			return Arrays.copyOf(b, p);
+		}
+		throw new IllegalArgumentException("unknown framing");
+	}
+
+	private static native long nativeOpen(JD2XX jd, int mode, ByteBuffer data, ByteBuffer index) throws IOException;
+	private static native void dispose(long framer);
+	private static native int nativeReceive(long framer) throws IOException;
+	private static native long nativeGetErrors(long framer);
+	private static native void nativeSetCrc(long framer, int kind) throws IOException;
+	private static native long nativeGetCrcErrors(long framer);
+}
@@ -0,0 +1,249 @@
+/*
+	Copyright (c) 2005 Pablo Bleyer Kocik.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	1. Redistributions of source code must retain the above copyright notice, this
+	list of conditions and the following disclaimer.
+
+	2. Redistributions in binary form must reproduce the above copyright notice,
+	this list of conditions and the following disclaimer in the documentation
+	and/or other materials provided with the distribution.
+
+	3. The name of the author may not be used to endorse or promote products
+	derived from this software without specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR IMPLIED
+	WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+	MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+	EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+	SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+	PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+	BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+	IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+package jd2xx;
+
+import java.io.IOException;
+import java.util.TooManyListenersException;
+import java.util.concurrent.locks.ReadWriteLock;
+import java.util.concurrent.locks.ReentrantReadWriteLock;
+
+/** GPIO on MPSSE capable devices (FT2232D/H, FT4232H, FT232H)
+
+	Pins 0-7 are ADBUS0-7 and pins 8-15 are ACBUS0-7; all methods take and
+	return 16 bit pin masks. The channel is switched to MPSSE mode when the
+	object is created and back to reset mode on close(); meanwhile its read
+	and write timeouts belong to this object.
+
+	Outputs live in a native shadow of the output latch, so set() changes
+	single pins without reading the port back. Between begin() and commit()
+	changes are queued and reach the device in a single USB transfer, in
+	order, so pulses come out at MPSSE speed.
+
+	startPolling() samples the pins from a native thread at a fixed rate and
+	passes only changes to the listener, which runs on a notifier thread.
+	Methods may be called from any thread; close() waits for the calls in
+	progress, and calls made after it fail.
+*/
+public class JD2XXGpio implements Runnable {
+
+	/** Native GPIO state */
+	protected long gpio = 0;
+	/** Read: native state in use by a call; write: state being disposed */
+	private final ReadWriteLock lock = new ReentrantReadWriteLock();
+
+	/** Device */
+	protected JD2XX jd2xx;
+
+	/** Pin change listener */
+	protected JD2XXGpioListener listener = null;
+
+	/** Listener notifier thread */
+	protected Thread notifier = null;
+
+	/** Cleaner action; must not reference the JD2XXGpio object */
+	private static class Disposer implements Runnable {
+		volatile long gpio = 0;
+
+		public void run() {
+			if (gpio != 0) dispose(gpio);
+		}
+	}
+	private final Disposer disposer = new Disposer();
+
+	/** Switch an open device to MPSSE mode for GPIO
+		@param jd open device, must stay open while this object is used
+	*/
+	public JD2XXGpio(JD2XX jd) throws IOException {
+		jd2xx = jd;
+		gpio = disposer.gpio = nativeOpen(jd);
+		JD2XX.cleaner.register(this, disposer);
+	}
+
+	/** Stop polling and return the device to reset mode */
+	public synchronized void close() {
+		stopPolling();
+		lock.writeLock().lock();
+		try {
+			long g = gpio;
+			gpio = disposer.gpio = 0;
+			if (g != 0) dispose(g);
+		}
+		finally {
+			lock.writeLock().unlock();
+		}
+	}
+
+	/** Set output pins, leaving the others unchanged
+		@param mask pins to change
+		@param value new state of the pins in mask
+	*/
+	public void set(int mask, int value) throws IOException {
+		lock.readLock().lock();
+		try { nativeSet(gpio, mask, value); }
+		finally { lock.readLock().unlock(); }
+	}
+
+	/** Set one output pin */
+	public void set(int pin, boolean on) throws IOException {
+		lock.readLock().lock();
+		try { nativeSet(gpio, 1 << pin, on ? ~0 : 0); }
+		finally { lock.readLock().unlock(); }
+	}
+
+	/** Set pin directions
+		@param mask pins to change
+		@param outputs 1 for pins in mask that become outputs, 0 for inputs
+	*/
+	public void setDirection(int mask, int outputs) throws IOException {
+		lock.readLock().lock();
+		try { nativeSetDirection(gpio, mask, outputs); }
+		finally { lock.readLock().unlock(); }
+	}
+
+	/** Read all pins; queued changes are sent first */
+	public int get() throws IOException {
+		lock.readLock().lock();
+		try { return nativeGet(gpio); }
+		finally { lock.readLock().unlock(); }
+	}
+
+	/** Read one pin */
+	public boolean get(int pin) throws IOException {
+		lock.readLock().lock();
+		try { return (nativeGet(gpio) & (1 << pin)) != 0; }
+		finally { lock.readLock().unlock(); }
+	}
+
+	/** Output latch as last set (no device access) */
+	public int getOutput() throws IOException {
+		lock.readLock().lock();
+		try { return nativeGetOutput(gpio, false); }
+		finally { lock.readLock().unlock(); }
+	}
+
+	/** Pin directions as last set (no device access) */
+	public int getDirection() throws IOException {
+		lock.readLock().lock();
+		try { return nativeGetOutput(gpio, true); }
+		finally { lock.readLock().unlock(); }
+	}
+
+	/** Start queueing changes; batches may nest */
+	public void begin() throws IOException {
+		lock.readLock().lock();
+		try { nativeBegin(gpio); }
+		finally { lock.readLock().unlock(); }
+	}
+
+	/** End a batch; the outermost commit sends the queued changes */
+	public void commit() throws IOException {
+		lock.readLock().lock();
+		try { nativeCommit(gpio); }
+		finally { lock.readLock().unlock(); }
+	}
+
+	/** Add pin change listener
+		@param l GPIO listener object
+	*/
+	public void addGpioListener(JD2XXGpioListener l) throws TooManyListenersException {
+		if (listener == null) listener = l;
+		else throw new TooManyListenersException();
+	}
+	/** Remove pin change listener */
+	public void removeGpioListener() {
+		listener = null;
+	}
+
+	/** Sample pins periodically and report changes to the listener
+		@param mask pins to watch
+		@param periodMicros sampling period in microseconds
+		@return pin state at start
+	*/
+	public synchronized int startPolling(int mask, int periodMicros) throws IOException {
+		stopPolling();
+		int v;
+		lock.readLock().lock();
+		try { v = nativeStartPolling(gpio, mask, periodMicros); }
+		finally { lock.readLock().unlock(); }
+		notifier = new Thread(this);
+		notifier.setDaemon(true);
+		notifier.start();
+		return v;
+	}
+
+	/** Stop sampling; pending changes are still delivered */
+	public synchronized void stopPolling() {
+		if (notifier == null) return;
+		lock.readLock().lock();
+		try { nativeStopPolling(gpio); }
+		finally { lock.readLock().unlock(); }
+		if (Thread.currentThread() != notifier) {
+			try { notifier.join(); }
+			catch (InterruptedException e) { Thread.currentThread().interrupt(); }
+		}
+		notifier = null;
+	}
+
+	public void dispatchEvent(long t, int changed, int value) {
+		if (listener != null) listener.gpioChanged(new JD2XXGpioEvent(this, t, changed, value));
+	}
+
+	/** Notifier thread function */
+	public void run() {
+		try {
+			long[] c;
+			while ((c = waitChanges()) != null)
+				for (int i = 0; i < c.length; i += 2)
+					dispatchEvent(c[i], (int)(c[i + 1] >>> 16), (int)c[i + 1] & 0xffff);
+		}
+		catch (IOException e) {
+			// sampling failed (device closed or unplugged): stop notifying
+		}
+	}
+
+	/** Wait for pin changes without holding the lock while the listener
+		runs, so the listener may close this object */
+	private long[] waitChanges() throws IOException {
+		lock.readLock().lock();
+		try { return nativeWaitChanges(gpio); }
+		finally { lock.readLock().unlock(); }
+	}
+
+	private static native long nativeOpen(JD2XX jd) throws IOException;
+	private static native void dispose(long gpio);
+	private static native void nativeSet(long gpio, int mask, int value) throws IOException;
+	private static native void nativeSetDirection(long gpio, int mask, int outputs) throws IOException;
+	private static native int nativeGet(long gpio) throws IOException;
+	private static native int nativeGetOutput(long gpio, boolean direction) throws IOException;
+	private static native void nativeBegin(long gpio) throws IOException;
+	private static native void nativeCommit(long gpio) throws IOException;
+	private static native int nativeStartPolling(long gpio, int mask, int periodMicros) throws IOException;
+	private static native void nativeStopPolling(long gpio);
+	private static native long[] nativeWaitChanges(long gpio) throws IOException;
+}
@@ -31,9 +31,14 @@ package jd2xx;
 import java.io.InputStream;
 import java.io.IOException;
 
+/** Input stream reading from a device
+	<p>Safe to use from one thread while another thread writes to the same
+	device through a JD2XXOutputStream (see JD2XX for the full-duplex
+	contract). Closing the stream detaches it, the device stays open.</p>
+*/
 public class JD2XXInputStream extends InputStream {
 
-	public JD2XX jd2xx = null;
+	public volatile JD2XX jd2xx = null;
 
 	public JD2XXInputStream() {
 	}
@@ -54,16 +59,34 @@ public class JD2XXInputStream extends InputStream {
 		jd2xx = new JD2XX(n, f);
 	}
 
+	/** Get attached device, fail if the stream was closed */
+	protected JD2XX device() throws IOException {
+		JD2XX j = jd2xx;
+		if (j == null) throw new IOException("stream closed");
+		return j;
+	}
+
 	public void close() throws IOException {
 		// jd2xx.close();
 		jd2xx = null;
 	}
 
 	public int read() throws IOException {
-		return jd2xx.read();
+		return device().read();
 	}
 
 	public int read(byte[] b) throws IOException {
-		return jd2xx.read(b);
+		return read(b, 0, b.length);
+	}
+
+	/** Read up to len bytes in a single driver call
+		@return number of bytes read, 0 on read timeout
+	*/
+	public int read(byte[] b, int off, int len) throws IOException {
+		return device().read(b, off, len);
+	}
+
+	public int available() throws IOException {
+		return device().getQueueStatus();
 	}
 }
@@ -0,0 +1,228 @@
+/*
+	Copyright (c) 2005 Pablo Bleyer Kocik.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	1. Redistributions of source code must retain the above copyright notice, this
+	list of conditions and the following disclaimer.
+
+	2. Redistributions in binary form must reproduce the above copyright notice,
+	this list of conditions and the following disclaimer in the documentation
+	and/or other materials provided with the distribution.
+
+	3. The name of the author may not be used to endorse or promote products
+	derived from this software without specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR IMPLIED
+	WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+	MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+	EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+	SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+	PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+	BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+	IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+package jd2xx;
+
+import java.io.IOException;
+
+/** Modbus RTU master on an RS-485 adapter
+
+	Frames are timed in native code: a response ends when its expected
+	length has arrived or after a 3.5 character silence (plus the latency
+	timer), and requests are spaced by 3.5 characters. Besides single
+	requests, a poll table can be read round-robin by a native thread;
+	waitResults() returns the ids of entries read since the last call and
+	getValues() their latest values. One object per bus; objects on
+	different adapters poll in parallel. Methods may be called from any
+	thread, except close(); requests made while polling are interleaved
+	with the poll transactions.
+*/
+public class JD2XXModbus {
+
+	/** Function codes */
+	public static final int
+		READ_COILS = 1,
+		READ_DISCRETE_INPUTS = 2,
+		READ_HOLDING_REGISTERS = 3,
+		READ_INPUT_REGISTERS = 4,
+		WRITE_SINGLE_COIL = 5,
+		WRITE_SINGLE_REGISTER = 6,
+		WRITE_MULTIPLE_COILS = 15,
+		WRITE_MULTIPLE_REGISTERS = 16;
+
+	/** Transaction status; positive values are Modbus exception codes */
+	public static final int
+		OK = 0,
+		TIMEOUT = -1,
+		CRC_ERROR = -2,
+		FRAME_ERROR = -3,
+		IO_ERROR = -4;
+
+	/** Native bus state */
+	protected long modbus = 0;
+
+	/** Device */
+	protected JD2XX jd2xx;
+
+	/** Cleaner action; must not reference the JD2XXModbus object */
+	private static class Disposer implements Runnable {
+		volatile long modbus = 0;
+
+		public void run() {
+			if (modbus != 0) dispose(modbus);
+		}
+	}
+	private final Disposer disposer = new Disposer();
+
+	/** Configure an open device for Modbus RTU: 8 data bits, the given
+		parity (two stop bits without parity), 2 ms latency timer, 1 s
+		response timeout
+		@param jd open device, must stay open while this object is used
+		@param baudRate line rate
+		@param parity JD2XX.PARITY_EVEN (Modbus default), PARITY_ODD or PARITY_NONE
+	*/
+	public JD2XXModbus(JD2XX jd, int baudRate, int parity) throws IOException {
+		jd2xx = jd;
+		jd.setBaudRate(baudRate);
+		jd.setDataCharacteristics(JD2XX.BITS_8,
+			parity == JD2XX.PARITY_NONE ? JD2XX.STOP_BITS_2 : JD2XX.STOP_BITS_1, parity);
+		jd.setFlowControl(JD2XX.FLOW_NONE, 0, 0);
+		jd.setLatencyTimer(2);
+		modbus = disposer.modbus = nativeOpen(jd, baudRate, 1000);
+		JD2XX.cleaner.register(this, disposer);
+	}
+
+	/** Stop polling and release the bus */
+	public void close() {
+		long m = modbus;
+		modbus = disposer.modbus = 0;
+		dispose(m);
+	}
+
+	/** Set response timeout
+		@param millis time to wait for the first byte of a response
+	*/
+	public void setTimeout(int millis) throws IOException {
+		nativeSetTimeout(modbus, millis);
+	}
+
+	/** Run one request
+		@param slave slave address, 0 to broadcast a write
+		@param function function code
+		@param address first coil or register
+		@param count number of coils or registers
+		@param values receives the values of a read (coils as 0/1), holds
+		the values of a write
+		@return OK, TIMEOUT, CRC_ERROR, FRAME_ERROR or a Modbus exception code
+	*/
+	public int transact(int slave, int function, int address, int count, short[] values) throws IOException {
+		return nativeTransact(modbus, slave, function, address, count, values);
+	}
+
+	/** Read holding registers, throw on any failure */
+	public short[] readHoldingRegisters(int slave, int address, int count) throws IOException {
+		short[] v = new short[count];
+		check(transact(slave, READ_HOLDING_REGISTERS, address, count, v));
+		return v;
+	}
+
+	/** Read input registers, throw on any failure */
+	public short[] readInputRegisters(int slave, int address, int count) throws IOException {
+		short[] v = new short[count];
+		check(transact(slave, READ_INPUT_REGISTERS, address, count, v));
+		return v;
+	}
+
+	/** Write one holding register, throw on any failure */
+	public void writeRegister(int slave, int address, int value) throws IOException {
+		check(transact(slave, WRITE_SINGLE_REGISTER, address, 1, new short[] { (short)value }));
+	}
+
+	/** Write holding registers, throw on any failure */
+	public void writeRegisters(int slave, int address, short[] values) throws IOException {
+		check(transact(slave, WRITE_MULTIPLE_REGISTERS, address, values.length, values));
+	}
+
+	/** Add a read to the poll table
+		@param function READ_COILS to READ_INPUT_REGISTERS
+		@return poll id
+	*/
+	public int addPoll(int slave, int function, int address, int count) throws IOException {
+		return nativeAddPoll(modbus, slave, function, address, count);
+	}
+
+	/** Start reading the poll table round-robin
+		@param periodMicros time between the starts of two rounds, 0 to poll back to back
+	*/
+	public void startPolling(int periodMicros) throws IOException {
+		nativeStartPolling(modbus, periodMicros);
+	}
+
+	/** Stop polling; returns after the current transaction */
+	public void stopPolling() throws IOException {
+		nativeStopPolling(modbus);
+	}
+
+	/** Wait for poll results
+		@param timeoutMillis maximum wait
+		@return ids of the entries read since the last call, null on timeout
+		or if polling is stopped
+	*/
+	public int[] waitResults(int timeoutMillis) throws IOException {
+		return nativeWaitResults(modbus, timeoutMillis);
+	}
+
+	/** Latest values of a poll entry
+		@param values receives the values of the last successful read
+		@return status of the last read
+	*/
+	public int getValues(int id, short[] values) throws IOException {
+		return nativeGetValues(modbus, id, values);
+	}
+
+	/** Statistics of a poll entry
+		@return successful reads, failed reads, time of the last read
+		(native monotonic clock, nanoseconds)
+	*/
+	public long[] getStatistics(int id) throws IOException {
+		return nativeGetStatistics(modbus, id);
+	}
+
+	/** Number of transactions run on the bus */
+	public long getTransactions() {
+		return nativeGetTransactions(modbus);
+	}
+
+	/** Describe a transaction status */
+	public static String statusText(int status) {
+		switch (status) {
+		case OK: return "ok";
+		case TIMEOUT: return "timeout";
+		case CRC_ERROR: return "CRC error";
+		case FRAME_ERROR: return "frame error";
+		case IO_ERROR: return "I/O error";
+		default: return "exception " + status;
+		}
+	}
+
+	private static void check(int status) throws IOException {
+		if (status != OK) throw new IOException("modbus: " + statusText(status));
+	}
+
+	private static native long nativeOpen(JD2XX jd, int baudRate, int timeout) throws IOException;
+	private static native void dispose(long modbus);
+	private static native void nativeSetTimeout(long modbus, int timeout) throws IOException;
+	private static native int nativeTransact(long modbus, int slave, int function, int address, int count, short[] values) throws IOException;
+	private static native int nativeAddPoll(long modbus, int slave, int function, int address, int count) throws IOException;
+	private static native void nativeStartPolling(long modbus, int periodMicros) throws IOException;
+	private static native void nativeStopPolling(long modbus) throws IOException;
+	private static native int[] nativeWaitResults(long modbus, int timeout) throws IOException;
+	private static native int nativeGetValues(long modbus, int id, short[] values) throws IOException;
+	private static native long[] nativeGetStatistics(long modbus, int id) throws IOException;
+	private static native long nativeGetTransactions(long modbus);
+}
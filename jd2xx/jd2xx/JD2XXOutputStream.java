@@ -28,12 +28,18 @@
 
 package jd2xx;
 
+import java.io.InterruptedIOException;
 import java.io.OutputStream;
 import java.io.IOException;
 
+/** Output stream writing to a device
+	<p>Safe to use from one thread while another thread reads from the same
+	device through a JD2XXInputStream (see JD2XX for the full-duplex
+	contract). Closing the stream detaches it, the device stays open.</p>
+*/
 public class JD2XXOutputStream extends OutputStream {
 
-	public JD2XX jd2xx = null;
+	public volatile JD2XX jd2xx = null;
 
 	public JD2XXOutputStream() {
 	}
@@ -54,18 +60,43 @@ public class JD2XXOutputStream extends OutputStream {
 		jd2xx = new JD2XX(n, f);
 	}
 
+	/** Get attached device, fail if the stream was closed */
+	protected JD2XX device() throws IOException {
+		JD2XX j = jd2xx;
+		if (j == null) throw new IOException("stream closed");
+		return j;
+	}
+
 	public void close() throws IOException {
 		// jd2xx.close();
 		jd2xx = null;
 	}
 
 	public void write(int b) throws IOException {
-		byte[] c = new byte[1];
-		c[0] = (byte)b;
-		while (jd2xx.write(c) != 0) ;
+		write(new byte[] { (byte)b }, 0, 1);
 	}
 
 	public void write(byte[] b) throws IOException {
-		jd2xx.write(b);
+		write(b, 0, b.length);
+	}
+
+	/** Write all bytes, retrying partial writes left by write timeouts
+		@throws InterruptedIOException if a write timed out without sending
+		anything; bytesTransferred tells how many bytes were sent before
+	*/
+	public void write(byte[] b, int off, int len) throws IOException {
+		JD2XX j = device();
+		int done = 0;
+		while (len > 0) {
+			int n = j.write(b, off, len);
+			if (n <= 0) {
+				InterruptedIOException e = new InterruptedIOException("write timed out");
+				e.bytesTransferred = done;
+				throw e;
+			}
+			off += n;
+			len -= n;
+			done += n;
+		}
 	}
 }
@@ -0,0 +1,194 @@
+/*
+	Copyright (c) 2005 Pablo Bleyer Kocik.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	1. Redistributions of source code must retain the above copyright notice, this
+	list of conditions and the following disclaimer.
+
+	2. Redistributions in binary form must reproduce the above copyright notice,
+	this list of conditions and the following disclaimer in the documentation
+	and/or other materials provided with the distribution.
+
+	3. The name of the author may not be used to endorse or promote products
+	derived from this software without specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR IMPLIED
+	WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+	MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+	EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+	SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+	PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+	BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+	IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+package jd2xx;
+
+import java.io.IOException;
+import java.util.Map;
+import java.util.WeakHashMap;
+import java.util.concurrent.locks.ReadWriteLock;
+import java.util.concurrent.locks.ReentrantReadWriteLock;
+
+/** Pool of open devices
+
+	Opening a device takes 10 to 100 ms on Linux: the driver claims the
+	interface, resets the chip and reads its EEPROM. release() keeps the
+	driver handle open in the pool instead of closing it, and the next open
+	of the same device by the same serial number, description or location
+	takes it back in microseconds. Released devices have their queues
+	purged, bit mode reset and the baud rate set back to 9600; on checkout
+	the handle is checked with getModemStatus()/getQueueStatus() and
+	replaced by a fresh open if the device has gone. A device closed with
+	close() instead of release() is simply not pooled. Thread safe: calls
+	share a read lock on the native pool state, and close() takes the
+	write lock, so it waits for calls in progress and later calls fail
+	with "pool closed".
+*/
+public class JD2XXPool {
+
+	/** Native pool state */
+	protected long pool = 0;
+	/** Read: pool in use by a call; write: pool being disposed */
+	private final ReadWriteLock lock = new ReentrantReadWriteLock();
+
+	/** How a device was opened */
+	private static class Key {
+		final String name;
+		final int location, flags;
+
+		Key(String name, int location, int flags) {
+			this.name = name;
+			this.location = location;
+			this.flags = flags;
+		}
+	}
+
+	/** Keys of the devices lent out, for release() */
+	private final Map<JD2XX, Key> keys = new WeakHashMap<JD2XX, Key>();
+
+	/** Cleaner action; must not reference the JD2XXPool object */
+	private static class Disposer implements Runnable {
+		volatile long pool = 0;
+
+		public void run() {
+			if (pool != 0) dispose(pool);
+		}
+	}
+	private final Disposer disposer = new Disposer();
+
+	/** Pool of up to 16 devices, closed after a minute unused */
+	public JD2XXPool() throws IOException {
+		this(16, 60000);
+	}
+
+	/** Create a pool
+		@param capacity idle devices kept open, the oldest is closed beyond
+		@param idleMillis idle devices are closed after this time
+	*/
+	public JD2XXPool(int capacity, int idleMillis) throws IOException {
+		pool = disposer.pool = nativeCreate(capacity, idleMillis);
+		JD2XX.cleaner.register(this, disposer);
+	}
+
+	/** Close all idle devices; devices lent out stay open */
+	public void close() {
+		lock.writeLock().lock();
+		try {
+			long p = pool;
+			pool = disposer.pool = 0;
+			dispose(p);
+		}
+		finally {
+			lock.writeLock().unlock();
+		}
+	}
+
+	/** Open a device by serial number or description
+		@param name serial number or description
+		@param flags JD2XX.OPEN_BY_SERIAL_NUMBER or OPEN_BY_DESCRIPTION
+		@return open device, give it back with release()
+	*/
+	public JD2XX openEx(String name, int flags) throws IOException {
+		if (name == null) throw new NullPointerException();
+		if (flags == JD2XX.OPEN_BY_LOCATION) throw new IllegalArgumentException("name given to open by location");
+		return open(name, 0, flags);
+	}
+
+	/** Open a device by location
+		@param location device location
+		@param flags JD2XX.OPEN_BY_LOCATION
+		@return open device, give it back with release()
+	*/
+	public JD2XX openEx(int location, int flags) throws IOException {
+		if (flags != JD2XX.OPEN_BY_LOCATION) throw new IllegalArgumentException("location given to open by name");
+		return open(null, location, flags);
+	}
+
+	/** Open device by serial number alias */
+	public JD2XX openBySerialNumber(String name) throws IOException {
+		return openEx(name, JD2XX.OPEN_BY_SERIAL_NUMBER);
+	}
+
+	/** Open device by location alias */
+	public JD2XX openByLocation(int location) throws IOException {
+		return openEx(location, JD2XX.OPEN_BY_LOCATION);
+	}
+
+	/** Give a device opened by this pool back. The JD2XX object is left
+		closed; if a call on another thread is still using the device it is
+		closed instead of pooled.
+	*/
+	public void release(JD2XX jd) throws IOException {
+		Key key;
+		synchronized (keys) {
+			key = keys.remove(jd);
+		}
+		if (key == null) throw new IllegalArgumentException("device not opened by this pool");
+		lock.readLock().lock();
+		try {
+			nativeRelease(pool, jd, key.name, key.location, key.flags);
+		}
+		finally {
+			lock.readLock().unlock();
+		}
+	}
+
+	/** @return checkouts served from the pool, checkouts that opened the
+		device, pooled handles found stale on checkout, and idle devices */
+	public long[] getStatistics() throws IOException {
+		lock.readLock().lock();
+		try {
+			return nativeGetStatistics(pool);
+		}
+		finally {
+			lock.readLock().unlock();
+		}
+	}
+
+	private JD2XX open(String name, int location, int flags) throws IOException {
+		JD2XX jd = new JD2XX();
+		lock.readLock().lock();
+		try {
+			nativeOpen(pool, jd, name, location, flags);
+		}
+		finally {
+			lock.readLock().unlock();
+		}
+		jd.opened();
+		synchronized (keys) {
+			keys.put(jd, new Key(name, location, flags));
+		}
+		return jd;
+	}
+
+	private static native long nativeCreate(int capacity, int idleMillis) throws IOException;
+	private static native void dispose(long pool);
+	private static native void nativeOpen(long pool, JD2XX jd, String name, int location, int flags) throws IOException;
+	private static native void nativeRelease(long pool, JD2XX jd, String name, int location, int flags) throws IOException;
+	private static native long[] nativeGetStatistics(long pool) throws IOException;
+}
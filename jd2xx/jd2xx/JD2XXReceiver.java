@@ -0,0 +1,167 @@
+/*
+	Copyright (c) 2005 Pablo Bleyer Kocik.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	1. Redistributions of source code must retain the above copyright notice, this
+	list of conditions and the following disclaimer.
+
+	2. Redistributions in binary form must reproduce the above copyright notice,
+	this list of conditions and the following disclaimer in the documentation
+	and/or other materials provided with the distribution.
+
+	3. The name of the author may not be used to endorse or promote products
+	derived from this software without specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR IMPLIED
+	WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+	MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+	EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+	SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+	PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+	BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+	IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+package jd2xx;
+
+import java.io.IOException;
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
+
+/** Receive mode with per-chunk arrival times
+
+	A native thread polls the receive queue of the device and reads every
+	chunk that arrives into a ring buffer, tagged with the monotonic clock
+	at the poll that saw it (on Linux the clock of System.nanoTime, so
+	times of several devices and of the application compare directly).
+	The resolution is the poll period plus the latency timer of the chip.
+	receive() hands over a batch of records [timestamp (8 bytes), length (4
+	bytes), bytes] in native byte order in the direct buffer data; walk it
+	with next(), timestamp(), length() and offset(). Must not be used
+	together with other reads on the same device. Not thread safe.
+*/
+public class JD2XXReceiver {
+
+	/** Size of a record header: timestamp and length */
+	public static final int HEADER = 12;
+
+	/** Records of the last batch */
+	public final ByteBuffer data;
+
+	private final ByteBuffer view; // for copying payloads out
+	private int limit = 0, next = 0, record = -1; // batch end, next and current record
+
+	/** Native receiver state */
+	protected long receiver = 0;
+
+	/** Device */
+	protected JD2XX jd2xx;
+
+	/** Cleaner action; must not reference the JD2XXReceiver object */
+	private static class Disposer implements Runnable {
+		volatile long receiver = 0;
+
+		public void run() {
+			if (receiver != 0) dispose(receiver);
+		}
+	}
+	private final Disposer disposer = new Disposer();
+
+	/** Start receiving with a 1 MB ring, 64 KB batches and a 250 us poll period */
+	public JD2XXReceiver(JD2XX jd) throws IOException {
+		this(jd, 1 << 20, 65536, 250);
+	}
+
+	/** Start receiving from an open device
+		@param jd open device, must stay open while this object is used
+		@param ringSize bytes buffered natively until receive() is called
+		@param batchSize size of data, also bounds the length of a record
+		@param periodMicros receive queue poll period
+	*/
+	public JD2XXReceiver(JD2XX jd, int ringSize, int batchSize, int periodMicros) throws IOException {
+		jd2xx = jd;
+		data = ByteBuffer.allocateDirect(batchSize).order(ByteOrder.nativeOrder());
+		view = data.duplicate();
+		receiver = disposer.receiver = nativeOpen(jd, ringSize, batchSize, periodMicros);
+		JD2XX.cleaner.register(this, disposer);
+	}
+
+	/** Stop the reader thread; bytes not received yet are lost */
+	public void close() {
+		long r = receiver;
+		receiver = disposer.receiver = 0;
+		limit = next = 0;
+		record = -1;
+		dispose(r);
+	}
+
+	/** Take a batch of records, waiting for the first one
+		@param timeout milliseconds to wait if none is buffered
+		@return number of records, 0 on timeout
+	*/
+	public int receive(int timeout) throws IOException {
+		limit = next = 0;
+		record = -1;
+		long r = nativeReceive(receiver, data, timeout);
+		limit = (int)r;
+		return (int)(r >>> 32);
+	}
+
+	/** Move to the next record of the batch
+		@return false at the end of the batch
+	*/
+	public boolean next() {
+		if (next >= limit) {
+			record = -1;
+			return false;
+		}
+		record = next;
+		next += HEADER + data.getInt(record + 8);
+		return true;
+	}
+
+	/** @return arrival time of the current record (monotonic clock, ns) */
+	public long timestamp() {
+		return data.getLong(current());
+	}
+
+	/** @return length of the current record */
+	public int length() {
+		return data.getInt(current() + 8);
+	}
+
+	/** @return offset of the bytes of the current record in data */
+	public int offset() {
+		return current() + HEADER;
+	}
+
+	/** Copy the bytes of the current record into a (reusable) array
+		@return record length
+	*/
+	public int get(byte[] dst) {
+		int n = length();
+		view.limit(offset() + n).position(offset());
+		view.get(dst, 0, n);
+		return n;
+	}
+
+	/** @return records, bytes, stalls (the reader waited for receive()) and
+		bytes buffered */
+	public long[] getStatistics() throws IOException {
+		return nativeGetStatistics(receiver);
+	}
+
+	private int current() {
+		if (record < 0) throw new IllegalStateException("no current record");
+		return record;
+	}
+
+	private static native long nativeOpen(JD2XX jd, int ringSize, int batchSize, int period) throws IOException;
+	private static native void dispose(long receiver);
+	private static native long nativeReceive(long receiver, ByteBuffer data, int timeout) throws IOException;
+	private static native long[] nativeGetStatistics(long receiver) throws IOException;
+}
@@ -0,0 +1,318 @@
+/*
+	Copyright (c) 2005 Pablo Bleyer Kocik.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	1. Redistributions of source code must retain the above copyright notice, this
+	list of conditions and the following disclaimer.
+
+	2. Redistributions in binary form must reproduce the above copyright notice,
+	this list of conditions and the following disclaimer in the documentation
+	and/or other materials provided with the distribution.
+
+	3. The name of the author may not be used to endorse or promote products
+	derived from this software without specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR IMPLIED
+	WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+	MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+	EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+	SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+	PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+	BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+	IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+package jd2xx;
+
+import java.io.IOException;
+import java.io.RandomAccessFile;
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
+import java.nio.MappedByteBuffer;
+import java.nio.channels.FileChannel;
+
+/** Device that replays a capture made with JD2XX.startCapture
+
+	Data read by the captured device is delivered again by read() when its
+	capture time comes up, relative to the first record and divided by the
+	speed factor (0 delivers everything at once, for load tests), and the
+	modem status follows the recorded changes. Writes are accepted and
+	counted; the line settings, modem control and timing calls other than
+	setTimeouts are ignored, so code written against JD2XX runs unchanged
+	on a capture. Native companions (frame decoder, receiver, Modbus) need
+	a real device. The capture file is mapped one segment at a time.
+*/
+public class JD2XXReplay extends JD2XX {
+
+	/** Record types */
+	public static final int
+		READ = 1,
+		WRITE = 2,
+		MODEM_STATUS = 3;
+
+	static final int HEADER = 4096; // file header size
+	static final int SEGMENT_HEADER = 32;
+	static final int SEGMENT_MAGIC = 0x4745534a;
+	static final int RECORD_HEADER = 16;
+
+	/** Monotonic clock time the capture was started at (ns) */
+	public final long startTime;
+	/** Wall clock time the capture was started at (ns since 1970) */
+	public final long startWallTime;
+
+	private final RandomAccessFile file;
+	private final FileChannel channel;
+	private final int segmentSize;
+	private final long segments;
+	private final double speed;
+
+	private final Cursor cursor = new Cursor(); // next record not delivered
+	private int consumed = 0; // bytes of the current READ record delivered
+	private long first = -1; // time of the first record
+	private long origin; // System.nanoTime() the replay started at
+	private int readTimeout = 0; // ms, 0 waits as long as data is to come
+	private int modemStatus = 0;
+	private long writes = 0;
+
+	/** Position in the capture */
+	private final class Cursor {
+		long segment = -1;
+		int pos, used;
+		MappedByteBuffer map;
+		long time;
+		int type, length, data; // current record
+
+		Cursor copy() {
+			Cursor c = new Cursor();
+			c.segment = segment; c.pos = pos; c.used = used; c.map = map;
+			c.time = time; c.type = type; c.length = length; c.data = data;
+			return c;
+		}
+
+		/** Load the record at pos, mapping the next segments as needed
+			@return false at the end of the capture
+		*/
+		boolean load() throws IOException {
+			while (segment < 0 || pos >= used) {
+				if (segment + 1 >= segments) return false;
+				map = channel.map(FileChannel.MapMode.READ_ONLY,
+					HEADER + (segment + 1) * segmentSize,
+					Math.min(segmentSize, channel.size() - HEADER - (segment + 1) * segmentSize));
+				map.order(ByteOrder.nativeOrder());
+				++segment;
+				if (map.getInt(0) != SEGMENT_MAGIC) return false; // allocated but never written
+				used = map.getInt(8);
+				pos = SEGMENT_HEADER;
+			}
+			time = map.getLong(pos);
+			length = map.getInt(pos + 8);
+			type = map.getInt(pos + 12);
+			data = pos + RECORD_HEADER;
+			return true;
+		}
+
+		void advance() {
+			pos = (data + length + 7) & ~7;
+		}
+	}
+
+	/** Open a capture for replay
+		@param path capture file
+		@param speed replay speed factor, 1 for the original timing, 0 for
+		no delays
+	*/
+	public JD2XXReplay(String path, double speed) throws IOException {
+		file = new RandomAccessFile(path, "r");
+		channel = file.getChannel();
+		ByteBuffer h = ByteBuffer.allocate(32).order(ByteOrder.nativeOrder());
+		channel.read(h, 0);
+		h.flip();
+		byte[] magic = new byte[8];
+		if (h.limit() == 32) h.get(magic);
+		if (!new String(magic, "US-ASCII").equals("JD2XXCAP") || h.getInt() != 1) {
+			file.close();
+			throw new IOException("not a JD2XX capture");
+		}
+		segmentSize = h.getInt();
+		startTime = h.getLong();
+		startWallTime = h.getLong();
+		segments = (channel.size() - HEADER + segmentSize - 1) / segmentSize;
+		this.speed = speed;
+		if (cursor.load()) first = cursor.time;
+		origin = System.nanoTime();
+	}
+
+	/** Restart the replay from the beginning of the capture */
+	public synchronized void rewind() throws IOException {
+		cursor.segment = -1;
+		consumed = 0;
+		modemStatus = 0;
+		cursor.load();
+		origin = System.nanoTime();
+	}
+
+	/** @return true when all received data has been replayed */
+	public synchronized boolean isFinished() throws IOException {
+		if (next(System.nanoTime())) return false;
+		for (Cursor c = cursor.copy(); c.load(); c.advance())
+			if (c.type == READ && c.length > 0) return false;
+		return true;
+	}
+
+	/** @return number of bytes written to the replayed device */
+	public synchronized long getBytesWritten() {
+		return writes;
+	}
+
+	/** System.nanoTime() a record time comes up at */
+	private long due(long time) {
+		if (speed <= 0) return origin;
+		return origin + (long)((time - first) / speed);
+	}
+
+	/** Apply the records that are due up to the next READ record
+		@return true if the cursor is on a READ record that is due
+	*/
+	private boolean next(long now) throws IOException {
+		while (cursor.load() && due(cursor.time) <= now) {
+			if (cursor.type == READ && consumed < cursor.length) return true;
+			if (cursor.type == MODEM_STATUS && cursor.length == 4)
+				modemStatus = cursor.map.getInt(cursor.data);
+			cursor.advance();
+			consumed = 0;
+		}
+		return false;
+	}
+
+	/** Read replayed data: returns when length bytes have been delivered,
+		the read timeout expired or the capture ended */
+	@Override
+	public synchronized int read(byte[] bytes, int offset, int length) throws IOException {
+		if (offset < 0 || length < 0 || offset > bytes.length - length) throw new IndexOutOfBoundsException();
+		long deadline = readTimeout > 0 ? System.nanoTime() + readTimeout * 1000000L : Long.MAX_VALUE;
+		int n = 0;
+
+		while (n < length) {
+			long now = System.nanoTime();
+			if (!next(now)) {
+				if (!cursor.load() || now >= deadline) break; // end of the capture or timeout
+				long wait = Math.min(due(cursor.time), deadline) - now;
+				try {
+					wait(wait / 1000000, (int)(wait % 1000000));
+				} catch (InterruptedException e) {
+					Thread.currentThread().interrupt();
+					break;
+				}
+				continue;
+			}
+			int k = Math.min(length - n, cursor.length - consumed);
+			ByteBuffer d = cursor.map.duplicate();
+			d.position(cursor.data + consumed);
+			d.get(bytes, offset + n, k);
+			consumed += k;
+			n += k;
+		}
+		return n;
+	}
+
+	@Override
+	public int read(ByteBuffer buffer) throws IOException {
+		byte[] b = new byte[buffer.remaining()];
+		int n = read(b, 0, b.length);
+		buffer.put(b, 0, n);
+		return n;
+	}
+
+	@Override
+	public int read(byte[] bytes, int offset, int length, JD2XXCrc crc) throws IOException {
+		int n = read(bytes, offset, length);
+		crc.update(bytes, offset, n);
+		return n;
+	}
+
+	/** Accept and count written data */
+	@Override
+	public synchronized int write(byte[] bytes, int offset, int length) throws IOException {
+		if (offset < 0 || length < 0 || offset > bytes.length - length) throw new IndexOutOfBoundsException();
+		writes += length;
+		return length;
+	}
+
+	@Override
+	public synchronized int write(ByteBuffer buffer) throws IOException {
+		int n = buffer.remaining();
+		buffer.position(buffer.limit());
+		writes += n;
+		return n;
+	}
+
+	/** @return replayed bytes that are due and not read yet */
+	@Override
+	public synchronized int getQueueStatus() throws IOException {
+		long now = System.nanoTime();
+		if (!next(now)) return 0;
+
+		Cursor c = cursor.copy();
+		long n = cursor.length - consumed;
+		c.advance();
+		while (c.load() && due(c.time) <= now && n < Integer.MAX_VALUE) {
+			if (c.type == READ) n += c.length;
+			c.advance();
+		}
+		return (int)Math.min(n, Integer.MAX_VALUE);
+	}
+
+	@Override
+	public int[] getStatus() throws IOException {
+		return new int[] { getQueueStatus(), 0, 0 };
+	}
+
+	/** @return modem status recorded last before the current replay time */
+	@Override
+	public synchronized int getModemStatus() throws IOException {
+		next(System.nanoTime());
+		return modemStatus;
+	}
+
+	/** Set the read timeout; the write timeout is ignored */
+	@Override
+	public synchronized void setTimeouts(int readTimeout, int writeTimeout) {
+		this.readTimeout = readTimeout;
+	}
+
+	/** PURGE_RX drops the data that is due */
+	@Override
+	public synchronized void purge(int mask) throws IOException {
+		if ((mask & PURGE_RX) == 0) return;
+		long now = System.nanoTime();
+		while (next(now)) {
+			cursor.advance();
+			consumed = 0;
+		}
+	}
+
+	@Override
+	public void close() throws IOException {
+		file.close();
+	}
+
+	// line settings and modem control have no effect on a replay
+	@Override public void setBaudRate(int baudRate) { }
+	@Override public void setDivisor(int divisor) { }
+	@Override public void setDataCharacteristics(int wordLength, int stopBits, int parity) { }
+	@Override public void setFlowControl(int flowControl, int xonChar, int xoffChar) { }
+	@Override public void setChars(int eventChar, boolean eventCharEn, int errorChar, boolean errorCharEn) { }
+	@Override public void setDtr() { }
+	@Override public void clrDtr() { }
+	@Override public void setRts() { }
+	@Override public void clrRts() { }
+	@Override public void setBreakOn() { }
+	@Override public void setBreakOff() { }
+	@Override public void resetDevice() { }
+	@Override public void setLatencyTimer(int time) { }
+	@Override public void setUSBParameters(int inputSize, int outputSize) { }
+}
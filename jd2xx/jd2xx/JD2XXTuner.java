@@ -0,0 +1,145 @@
+/*
+	Copyright (c) 2005 Pablo Bleyer Kocik.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	1. Redistributions of source code must retain the above copyright notice, this
+	list of conditions and the following disclaimer.
+
+	2. Redistributions in binary form must reproduce the above copyright notice,
+	this list of conditions and the following disclaimer in the documentation
+	and/or other materials provided with the distribution.
+
+	3. The name of the author may not be used to endorse or promote products
+	derived from this software without specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR IMPLIED
+	WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+	MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+	EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+	SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+	PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+	BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+	IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+package jd2xx;
+
+import java.io.IOException;
+
+/** Latency timer and transfer size tuner
+
+	A native thread watches how data arrives on a device (receive queue
+	depth sampled every period, read sizes and idle gaps) and sets the
+	latency timer and the USB IN transfer size within the given bounds,
+	for the lowest latency or for the highest throughput; see tuner.c for
+	the rules. The tuner owns both settings while it runs: do not call
+	setLatencyTimer or setUSBParameters on the device meanwhile. The
+	settings chosen, the measurements they were based on and the
+	decisions taken are available from getStatistics(), indexed by the
+	constants below.
+*/
+public class JD2XXTuner {
+
+	/** Goals */
+	public static final int
+		LATENCY = 0,
+		THROUGHPUT = 1;
+
+	/** Indices into getStatistics() */
+	public static final int
+		LATENCY_TIMER = 0, // current latency timer (ms)
+		TRANSFER_SIZE = 1, // current IN transfer size (bytes)
+		RATE = 2, // bytes read per second, last window
+		AVERAGE_READ = 3, // bytes per read call, last window
+		PEAK_QUEUE = 4, // deepest receive queue, last window
+		BUSY = 5, // samples with data waiting or read, per mille, last window
+		IDLE_GAP = 6, // longest time without data, last window (us)
+		WINDOWS = 7, // windows evaluated
+		LATENCY_CHANGES = 8, // latency timer changes
+		TRANSFER_CHANGES = 9, // transfer size changes
+		LATENCY_REASON = 10, // reason of the last latency timer change
+		TRANSFER_REASON = 11, // reason of the last transfer size change
+		STATISTICS = 12;
+
+	/** Reasons of a change */
+	public static final int
+		REASON_NONE = 0, // not changed yet
+		REASON_GOAL = 1, // lowest latency timer for the latency goal
+		REASON_STREAM = 2, // continuous stream, highest latency timer
+		REASON_FILL = 3, // latency timer from the packet fill time
+		REASON_RATE = 4, // transfer size from the arrival rate
+		REASON_BACKLOG = 5; // receive queue near the transfer size
+
+	/** Native tuner state */
+	protected long tuner = 0;
+
+	/** Device */
+	protected JD2XX jd2xx;
+
+	/** Cleaner action; must not reference the JD2XXTuner object */
+	private static class Disposer implements Runnable {
+		volatile long tuner = 0;
+
+		public void run() {
+			if (tuner != 0) dispose(tuner);
+		}
+	}
+	private final Disposer disposer = new Disposer();
+
+	/** Tune for a goal with the full ranges: latency timer 2 to 255 ms,
+		transfers of 64 bytes to 64 KB, sampled every millisecond and
+		decided on every 100 samples */
+	public JD2XXTuner(JD2XX jd, int goal) throws IOException {
+		this(jd, goal, 2, 255, 64, 65536, 1000, 100);
+	}
+
+	/** Start tuning an open device
+		@param jd open device, must stay open while this object is used
+		@param goal LATENCY or THROUGHPUT
+		@param minLatency lowest latency timer (ms, at least 2 on most chips)
+		@param maxLatency highest latency timer (ms, at most 255)
+		@param minTransfer smallest IN transfer size (multiple of 64)
+		@param maxTransfer largest IN transfer size (multiple of 64, at most 65536)
+		@param periodMicros receive queue sample period
+		@param window samples per decision
+	*/
+	public JD2XXTuner(JD2XX jd, int goal, int minLatency, int maxLatency,
+		int minTransfer, int maxTransfer, int periodMicros, int window) throws IOException {
+		jd2xx = jd;
+		tuner = disposer.tuner = nativeOpen(jd, goal, minLatency, maxLatency,
+			minTransfer, maxTransfer, periodMicros, window);
+		JD2XX.cleaner.register(this, disposer);
+	}
+
+	/** Stop tuning; the device keeps the last settings */
+	public void close() {
+		long t = tuner;
+		tuner = disposer.tuner = 0;
+		dispose(t);
+	}
+
+	/** @return latency timer set by the tuner (ms) */
+	public int getLatencyTimer() throws IOException {
+		return (int)getStatistics()[LATENCY_TIMER];
+	}
+
+	/** @return IN transfer size set by the tuner */
+	public int getTransferSize() throws IOException {
+		return (int)getStatistics()[TRANSFER_SIZE];
+	}
+
+	/** @return settings, measurements and decisions, see the index
+		constants; throws if a driver error stopped the tuner */
+	public long[] getStatistics() throws IOException {
+		return nativeGetStatistics(tuner);
+	}
+
+	private static native long nativeOpen(JD2XX jd, int goal, int minLatency, int maxLatency,
+		int minTransfer, int maxTransfer, int period, int window) throws IOException;
+	private static native void dispose(long tuner);
+	private static native long[] nativeGetStatistics(long tuner) throws IOException;
+}
@@ -0,0 +1,272 @@
+/*
+	Copyright (c) 2004 Pablo Bleyer Kocik.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	1. Redistributions of source code must retain the above copyright notice, this
+	list of conditions and the following disclaimer.
+
+	2. Redistributions in binary form must reproduce the above copyright notice,
+	this list of conditions and the following disclaimer in the documentation
+	and/or other materials provided with the distribution.
+
+	3. The name of the author may not be used to endorse or promote products
+	derived from this software without specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR IMPLIED
+	WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+	MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+	EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+	SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+	PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+	BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+	IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+package jd2xx;
+
+import java.io.IOException;
+import java.nio.charset.StandardCharsets;
+import java.util.Arrays;
+import java.util.Collections;
+import java.util.LinkedHashMap;
+import java.util.Map;
+import java.util.Set;
+
+/** Key/value store in the EEPROM user area
+
+	The user area is split in two banks. The active bank holds a snapshot
+	of entries (header with sequence number and a CRC over the snapshot)
+	followed by a log with one record per commit, each protected by its
+	own CRC; later entries of a key win and an entry without value removes
+	the key. Values are read once into a cache and changes are kept until
+	commit(), which appends them as one record with a single eeUAWrite
+	covering the user area up to the end of that record. When the log is
+	full the live entries are written as a snapshot into the other bank
+	with the next sequence number.
+
+	eeUAWrite always starts at the beginning of the user area and the
+	driver rewrites every word it is given, so a commit costs one call
+	but does not spare the words before its record; writing single words
+	with updateEE is not done because the position of the user area
+	depends on the chip and its strings, and the driver only keeps the
+	EEPROM checksum valid through eeUAWrite.
+
+	An interrupted commit leaves a record with a bad CRC, which is ignored
+	on load, and an interrupted compaction leaves a bank with a bad
+	snapshot CRC, so the previous bank stays in use: a commit is applied
+	completely or not at all. Not thread safe.
+*/
+public class JD2XXUserStore {
+
+	/** Maximum length of a key or a value in bytes */
+	public static final int MAX_LENGTH = 254;
+
+	static final int MAGIC = 0x4b56; // "KV"
+	static final int HEADER = 7; // magic, sequence, snapshot length, CRC
+	static final int REMOVED = 0xff; // value length of a removal
+	static final int ERASED = 0xff;
+
+	/** Device */
+	protected JD2XX jd2xx;
+
+	private byte[] image; // user area as on the device
+	private final int bankSize;
+	private int bank = 1, seq = 0; // active bank and its sequence number
+	private int end; // end of the log in the active bank
+	private final Map<String, byte[]> cache = new LinkedHashMap<String, byte[]>();
+	private final Map<String, byte[]> pending = new LinkedHashMap<String, byte[]>(); // null: removal
+
+	/** Load the store from the user area of an open device; an area without
+		a valid bank is treated as empty and overwritten on the first commit
+		@param jd open device, must stay open while this object is used
+	*/
+	public JD2XXUserStore(JD2XX jd) throws IOException {
+		jd2xx = jd;
+		image = jd.eeUARead(jd.eeUASize());
+		bankSize = image.length / 2;
+		if (bankSize < HEADER + 4) throw new IOException("user area too small");
+		end = bankSize; // no valid bank: first commit compacts into bank 0
+
+		int s0 = header(0), s1 = header(1);
+		if (s0 >= 0 && (s1 < 0 || newer(s0, s1))) load(0, s0);
+		else if (s1 >= 0) load(1, s1);
+	}
+
+	/** Get a value
+		@return value or null if the key is not present
+	*/
+	public byte[] get(String key) {
+		byte[] v = cache.get(key);
+		return v == null ? null : v.clone();
+	}
+
+	/** Get an integer value stored with putInt
+		@param def value returned if the key is not present
+	*/
+	public int getInt(String key, int def) {
+		byte[] v = cache.get(key);
+		if (v == null || v.length != 4) return def;
+		return (v[0] & 0xff) << 24 | (v[1] & 0xff) << 16 | (v[2] & 0xff) << 8 | (v[3] & 0xff);
+	}
+
+	/** Set a value; written by the next commit()
+		@param value up to MAX_LENGTH bytes
+	*/
+	public void put(String key, byte[] value) {
+		if (value.length > MAX_LENGTH) throw new IllegalArgumentException("value too long");
+		encode(key);
+		byte[] old = cache.get(key);
+		if (old != null && Arrays.equals(old, value) && !pending.containsKey(key)) return;
+		value = value.clone();
+		cache.put(key, value);
+		pending.put(key, value);
+	}
+
+	/** Set an integer value (4 bytes, big endian) */
+	public void putInt(String key, int value) {
+		put(key, new byte[] { (byte)(value >> 24), (byte)(value >> 16), (byte)(value >> 8), (byte)value });
+	}
+
+	/** Remove a key; written by the next commit() */
+	public void remove(String key) {
+		if (cache.remove(key) != null || pending.containsKey(key)) pending.put(key, null);
+	}
+
+	/** @return keys present, including uncommitted changes */
+	public Set<String> keys() {
+		return Collections.unmodifiableSet(cache.keySet());
+	}
+
+	/** @return true if there are uncommitted changes */
+	public boolean isDirty() {
+		return !pending.isEmpty();
+	}
+
+	/** Write pending changes to the device. The cache and the pending
+		changes are unchanged if writing fails. */
+	public void commit() throws IOException {
+		if (pending.isEmpty()) return;
+
+		byte[] e = entries(pending);
+		byte[] next = image.clone();
+		int o = bank * bankSize;
+
+		if (end + e.length + 4 <= bankSize) {
+			put16(next, o + end, e.length);
+			System.arraycopy(e, 0, next, o + end + 2, e.length);
+			put16(next, o + end + 2 + e.length, crc16(next, o + end, e.length + 2, 0xffff ^ seq));
+			jd2xx.eeUAWrite(Arrays.copyOf(next, o + end + e.length + 4));
+			end += e.length + 4;
+		}
+		else {
+			e = entries(cache);
+			if (HEADER + e.length > bankSize) throw new IOException("user area full");
+			int nb = 1 - bank, ns = (seq + 1) & 0xff;
+
+			o = nb * bankSize;
+			Arrays.fill(next, o, o + bankSize, (byte)ERASED);
+			put16(next, o, MAGIC);
+			next[o + 2] = (byte)ns;
+			put16(next, o + 3, e.length);
+			System.arraycopy(e, 0, next, o + HEADER, e.length);
+			put16(next, o + 5, crc16(next, o + HEADER, e.length, crc16(next, o + 2, 3, 0xffff)));
+			jd2xx.eeUAWrite(next);
+			bank = nb;
+			seq = ns;
+			end = HEADER + e.length;
+		}
+
+		image = next;
+		pending.clear();
+	}
+
+	/** Check the header of a bank
+		@return sequence number or -1 if the bank is not valid
+	*/
+	private int header(int b) {
+		int o = b * bankSize, len = get16(o + 3);
+		if (get16(o) != MAGIC || len > bankSize - HEADER) return -1;
+		if (get16(o + 5) != crc16(image, o + HEADER, len, crc16(image, o + 2, 3, 0xffff))) return -1;
+		return image[o + 2] & 0xff;
+	}
+
+	/** Load snapshot and log of a valid bank into the cache */
+	private void load(int b, int s) {
+		int o = b * bankSize;
+
+		bank = b;
+		seq = s;
+		end = HEADER + get16(o + 3);
+		decode(o + HEADER, o + end);
+		while (end + 4 <= bankSize) {
+			int n = 2 + get16(o + end);
+			if (n == 2 || end + n + 2 > bankSize) break; // erased
+			if (get16(o + end + n) != crc16(image, o + end, n, 0xffff ^ seq)) break; // interrupted commit
+			decode(o + end + 2, o + end + n);
+			end += n + 2;
+		}
+	}
+
+	/** Apply the entries between two offsets of the image to the cache */
+	private void decode(int p, int limit) {
+		while (p + 2 <= limit) {
+			int kl = image[p] & 0xff, vl = image[p + 1] & 0xff;
+			int n = 2 + kl + (vl == REMOVED ? 0 : vl);
+			if (kl == 0 || p + n > limit) break;
+			String key = new String(image, p + 2, kl, StandardCharsets.UTF_8);
+			if (vl == REMOVED) cache.remove(key);
+			else cache.put(key, Arrays.copyOfRange(image, p + 2 + kl, p + n));
+			p += n;
+		}
+	}
+
+	/** Encode entries: key length, value length (REMOVED for a removal), key, value */
+	private static byte[] entries(Map<String, byte[]> m) {
+		byte[] b = new byte[0];
+		for (Map.Entry<String, byte[]> e : m.entrySet()) {
+			byte[] k = encode(e.getKey()), v = e.getValue();
+			int p = b.length;
+			b = Arrays.copyOf(b, p + 2 + k.length + (v == null ? 0 : v.length));
+			b[p] = (byte)k.length;
+			b[p + 1] = (byte)(v == null ? REMOVED : v.length);
+			System.arraycopy(k, 0, b, p + 2, k.length);
+			if (v != null) System.arraycopy(v, 0, b, p + 2 + k.length, v.length);
+		}
+		return b;
+	}
+
+	private int get16(int i) {
+		return (image[i] & 0xff) << 8 | (image[i + 1] & 0xff);
+	}
+
+	private static void put16(byte[] b, int i, int v) {
+		b[i] = (byte)(v >> 8);
+		b[i + 1] = (byte)v;
+	}
+
+	private static byte[] encode(String key) {
+		byte[] k = key.getBytes(StandardCharsets.UTF_8);
+		if (k.length == 0 || k.length > MAX_LENGTH) throw new IllegalArgumentException("invalid key length");
+		return k;
+	}
+
+	/** Sequence number a is newer than b (modulo 256) */
+	private static boolean newer(int a, int b) {
+		int d = (a - b) & 0xff;
+		return d != 0 && d < 128;
+	}
+
+	/** CRC-16/CCITT (polynomial 0x1021) */
+	static int crc16(byte[] b, int off, int len, int crc) {
+		for (int i = off; i < off + len; ++i) {
+			crc ^= (b[i] & 0xff) << 8;
+			for (int j = 0; j < 8; ++j)
+				crc = (crc & 0x8000) != 0 ? (crc << 1) ^ 0x1021 : crc << 1;
+		}
+		return crc & 0xffff;
+	}
+}
@@ -28,24 +28,23 @@
 
 // #define DEBUG
 
-#include <jni.h>
-#include "jd2xx_JD2XX.h"
+#include <stdlib.h>
+#include <string.h>
 
-#ifdef WIN32
-	#include <windows.h>
+#ifndef WIN32
+#include <sys/mman.h>
+#include <unistd.h>
 #endif
 
-#undef WINAPI
-#define WINAPI
-#include "ftd2xx.h"
-
-#ifndef INVALID_HANDLE_VALUE
-#define INVALID_HANDLE_VALUE (-1)
-#endif
+#include "jd2xx.h"
+#include "jd2xx_JD2XX.h"
 
 /* Defines */
 #define DESCRIPTION_SIZE 256 // size for serial numbers and descriptions
 #define MAX_DEVICES 64 // maximum number of devices to list
+#define IO_STACK_SIZE 16384 // transfers up to this size are bounced through the stack
+#define EE_MAX_WORDS 1024 // largest EEPROM addressed by the word access calls
+#define NATIVE_INTERFACE 2 // JD2XX.NATIVE_INTERFACE, bump when natives change
 
 /* GLoabl variables */
 static JavaVM *javavm;
@@ -81,7 +80,7 @@ status_message[] = {
 };
 
 /** Get object handle */
-inline static jlong
+jlong
 get_handle(JNIEnv *env, jobject obj) {
 	return (*env)->GetLongField(env, obj, handleID);
 }
@@ -116,8 +115,17 @@ get_listener(JNIEnv *env, jobject obj) {
 	return (*env)->GetObjectField(env, obj, listenerID);
 }
 
+/** Throw exception of given class */
+void
+throw_new(JNIEnv *env, const char *cls, const char *msg) {
+	jclass exc = (*env)->FindClass(env, cls);
+	if (exc == 0) return;
+	(*env)->ThrowNew(env, exc, msg);
+	(*env)->DeleteLocalRef(env, exc);
+}
+
 /** Throw exception */
-inline static void
+void
 io_exception(JNIEnv *env, const char *msg) {
 	// jclass exc = (*env)->FindClass(env, "java/lang/RuntimeException");
 	jclass exc = (*env)->FindClass(env, "java/io/IOException");
@@ -127,7 +135,7 @@ io_exception(JNIEnv *env, const char *msg) {
 }
 
 /** Format exception error message */
-inline static char*
+char*
 format_status(char *buf, FT_STATUS st) {
 	if (buf != NULL)
 		sprintf(buf, "%s (%d)",
@@ -138,12 +146,41 @@ format_status(char *buf, FT_STATUS st) {
 }
 
 /** Format error message and throw exception */
-inline static void
+void
 io_exception_status(JNIEnv *env, FT_STATUS st) {
 	char msg[64];
 	io_exception(env, format_status(msg, st));
 }
 
+/** Pin driver handle for the duration of a call, throw if not open */
+FT_HANDLE
+acquire_handle(JNIEnv *env, jlong tok) {
+	FT_HANDLE h = handle_acquire(tok);
+	if (h == NULL) io_exception_status(env, FT_INVALID_HANDLE);
+	return h;
+}
+
+/** Register newly opened driver handle with object */
+void
+open_handle(JNIEnv *env, jobject obj, FT_HANDLE h) {
+	jlong tok = handle_register(h);
+
+	if (tok == (jlong)INVALID_HANDLE_VALUE) {
+		FT_Close(h);
+		io_exception_status(env, FT_INSUFFICIENT_RESOURCES);
+	}
+	else set_handle(env, obj, tok);
+}
+
+FT_HANDLE
+detach_handle(JNIEnv *env, jobject obj) {
+	jlong tok = get_handle(env, obj);
+
+	if (tok == (jlong)INVALID_HANDLE_VALUE) return NULL;
+	set_handle(env, obj, (jlong)INVALID_HANDLE_VALUE);
+	return handle_detach(tok);
+}
+
 /** Initialize JD2XX driver objects */
 JNIEXPORT jint JNICALL
 JNI_OnLoad(JavaVM *jvm, void *reserved) {
@@ -190,6 +227,7 @@ JNI_OnLoad(JavaVM *jvm, void *reserved) {
 //	pdCls = (*env)->NewWeakGlobalRef(env, cls);
 //	if (pdCls == 0) return JNI_ERR;
 
+	crc_init();
 	javavm = jvm; // initialize jvm pointer
 
 	return JNI_VERSION_1_2;
@@ -213,6 +251,12 @@ JNI_OnUnLoad(JavaVM *jvm, void *reserved) {
 }
 
 
+/** Revision of the natives, checked by the loader against the jar */
+JNIEXPORT jint JNICALL
+Java_jd2xx_JD2XX_nativeInterface(JNIEnv *env, jclass cls) {
+	return NATIVE_INTERFACE;
+}
+
 JNIEXPORT jint JNICALL
 Java_jd2xx_JD2XX_getLibraryVersion(JNIEnv *env, jobject obj) {
 	FT_STATUS st;
@@ -226,9 +270,9 @@ Java_jd2xx_JD2XX_getLibraryVersion(JNIEnv *env, jobject obj) {
 
 JNIEXPORT void JNICALL
 Java_jd2xx_JD2XX_rescan(JNIEnv *env, jobject obj) {
+#ifdef WIN32
 	FT_STATUS st;
 
-#ifdef WIN32
 	if (!FT_SUCCESS(st = FT_Rescan()))
 		io_exception_status(env, st);
 #else
@@ -314,26 +358,26 @@ panic:
 }
 
 JNIEXPORT void JNICALL
-Java_jd2xx_JD2XX_open(JNIEnv *env, jobject obj, jint dn) {
+Java_jd2xx_JD2XX_nativeOpen(JNIEnv *env, jobject obj, jint dn) {
 	jlong hnd = get_handle(env, obj);
 
-	if (hnd != (jint)INVALID_HANDLE_VALUE) // previously initialized!
+	if (hnd != (jlong)INVALID_HANDLE_VALUE) // previously initialized!
 		io_exception(env, "device already opened");
 	else {
 		FT_HANDLE h;
 		FT_STATUS st = FT_Open(dn, &h);
 		//fprintf(stderr, "FT_Open succeeded.  Handle is %p\n", h);
 
-		if (FT_SUCCESS(st)) set_handle(env, obj, (jlong)h);
+		if (FT_SUCCESS(st)) open_handle(env, obj, h);
 		else io_exception_status(env, st);
 	}
 }
 
 JNIEXPORT void JNICALL
-Java_jd2xx_JD2XX_openEx__Ljava_lang_String_2I(JNIEnv *env, jobject obj, jstring str, jint flg) {
+Java_jd2xx_JD2XX_nativeOpenEx__Ljava_lang_String_2I(JNIEnv *env, jobject obj, jstring str, jint flg) {
 	jlong hnd = get_handle(env, obj);
 
-	if (hnd != (jint)INVALID_HANDLE_VALUE) // previously initialized!
+	if (hnd != (jlong)INVALID_HANDLE_VALUE) // previously initialized!
 		io_exception(env, "device already opened");
 	else {
 		const char *cstr = (*env)->GetStringUTFChars(env, str, 0);
@@ -341,22 +385,22 @@ Java_jd2xx_JD2XX_openEx__Ljava_lang_String_2I(JNIEnv *env, jobject obj, jstring
 		FT_STATUS st = FT_OpenEx((PVOID)cstr, (DWORD)flg, &h);
 		(*env)->ReleaseStringUTFChars(env, str, cstr);
 
-		if (FT_SUCCESS(st)) set_handle(env, obj, (jlong)h);
+		if (FT_SUCCESS(st)) open_handle(env, obj, h);
 		else io_exception_status(env, st);
 	}
 }
 
 JNIEXPORT void JNICALL
-Java_jd2xx_JD2XX_openEx__II(JNIEnv *env, jobject obj, jint num, jint flg) {
+Java_jd2xx_JD2XX_nativeOpenEx__II(JNIEnv *env, jobject obj, jint num, jint flg) {
 	jlong hnd = get_handle(env, obj);
 
-	if (hnd != (jint)INVALID_HANDLE_VALUE) // previously initialized!
+	if (hnd != (jlong)INVALID_HANDLE_VALUE) // previously initialized!
 		io_exception(env, "device already opened");
 	else {
 		FT_HANDLE h;
 		FT_STATUS st = FT_OpenEx((PVOID)num, (DWORD)flg, &h);
 
-		if (FT_SUCCESS(st)) set_handle(env, obj, (jlong)h);
+		if (FT_SUCCESS(st)) open_handle(env, obj, h);
 		else io_exception_status(env, st);
 	}
 }
@@ -365,20 +409,22 @@ JNIEXPORT void JNICALL
 Java_jd2xx_JD2XX_close(JNIEnv *env, jobject obj) {
 	jlong hnd = get_handle(env, obj);
 
-//	if (hnd == (jint)INVALID_HANDLE_VALUE) {
-//		// not open!
-//		// fprintf(stderr,  "Ouch!\n");
-//		io_exception(env, "device not opened");
-//	}
-//	else {
-
-	if (hnd != (jint)INVALID_HANDLE_VALUE) {
-		FT_STATUS st = FT_Close((FT_HANDLE)hnd);
+	if (hnd != (jlong)INVALID_HANDLE_VALUE) {
+		FT_STATUS st;
+		// FT_Close is deferred until calls in progress on other threads return
+		handle_close(hnd, &st);
+		set_handle(env, obj, (jlong)INVALID_HANDLE_VALUE);
 		if (!FT_SUCCESS(st)) io_exception_status(env, st);
-		else set_handle(env, obj, (jlong)INVALID_HANDLE_VALUE);
 	}
 }
 
+/** Release native handle of a collected JD2XX object (cleaner action) */
+JNIEXPORT void JNICALL
+Java_jd2xx_JD2XX_dispose(JNIEnv *env, jclass cls, jlong hnd) {
+	FT_STATUS st;
+	handle_close(hnd, &st);
+}
+
 /**
 	@todo Check LIST_BY_LOCATION (array of Integers) implementation
 */
@@ -457,161 +503,387 @@ Java_jd2xx_JD2XX_listDevices(JNIEnv *env, jobject obj, jint flg) {
 	return result;
 }
 
-JNIEXPORT jint JNICALL
-Java_jd2xx_JD2XX_read(JNIEnv *env, jobject obj, jbyteArray arr, jint off, jint len) {
-	FT_STATUS st;
-	volatile DWORD ret;
-	jlong hnd = get_handle(env, obj);
-	int alen = (*env)->GetArrayLength(env, arr);
-	jbyte *buf;
+/*
+	Full-duplex contract: read and write keep no state outside the call. Data
+	is bounced through a buffer private to the call (stack or heap) instead of
+	pinning the Java array, so a reader blocked in FT_Read and a writer in
+	FT_Write on the same handle never wait for each other in JD2XX.
+*/
+
+/** Check array and range arguments of read/write
+	@return 0 if an exception was thrown
+*/
+static int
+check_range(JNIEnv *env, jbyteArray arr, jint off, jint len) {
+	jint alen;
 
 	if (arr == 0) {
-		jclass exc = (*env)->FindClass(env, "java/lang/NullPointerException");
-		if (exc != 0) (*env)->ThrowNew(env, exc, NULL);
-		(*env)->DeleteLocalRef(env, exc);
+		throw_new(env, "java/lang/NullPointerException", NULL);
 		return 0;
-	} else if ((off < 0) || (off > alen) || (len < 0)
+	}
+
+	alen = (*env)->GetArrayLength(env, arr);
+	if ((off < 0) || (off > alen) || (len < 0)
 		|| ((off + len) > alen) || ((off + len) < 0)) {
-		jclass exc = (*env)->FindClass(env, "java/lang/IndexOutOfBoundsException");
-		if (exc != 0) (*env)->ThrowNew(env, exc, NULL);
-		(*env)->DeleteLocalRef(env, exc);
+		throw_new(env, "java/lang/IndexOutOfBoundsException", NULL);
 		return 0;
-	} else if (len == 0) return 0;
+	}
 
-	buf = (*env)->GetByteArrayElements(env, arr, 0);
+	return 1;
+}
 
-	if (!FT_SUCCESS(st = FT_Read((FT_HANDLE)hnd, (LPVOID)(buf+off), len, (LPDWORD)&ret)))
-		io_exception_status(env, st);
+JNIEXPORT jint JNICALL
+Java_jd2xx_JD2XX_read(JNIEnv *env, jobject obj, jbyteArray arr, jint off, jint len) {
+	FT_STATUS st;
+	DWORD ret = 0;
+	jlong tok = get_handle(env, obj);
+	FT_HANDLE hnd;
+	jbyte sbuf[IO_STACK_SIZE], *buf = sbuf;
+
+	if (!check_range(env, arr, off, len) || len == 0) return 0;
+
+	if (len > IO_STACK_SIZE && (buf = malloc(len)) == NULL) {
+		io_exception_status(env, FT_INSUFFICIENT_RESOURCES);
+		return 0;
+	}
 
-//	result = (*env)->NewByteArray(env, ret);
-//	if (result != 0) (*env)->SetByteArrayRegion(env, result, 0, ret, buf);
-	(*env)->ReleaseByteArrayElements(env, arr, buf, 0);
+	if ((hnd = acquire_handle(env, tok)) != NULL) {
+		st = FT_Read(hnd, (LPVOID)buf, len, &ret);
+		capture_io(tok, CAPTURE_READ, buf, ret);
+		handle_release(tok);
+
+		// bytes read before an error are still delivered
+		if (ret > 0) (*env)->SetByteArrayRegion(env, arr, off, ret, buf);
+		if (!FT_SUCCESS(st)) io_exception_status(env, st);
+	}
+
+	if (buf != sbuf) free(buf);
 	return (jint)ret;
 }
 
+/** Read like read() and update a CRC register with the bytes read while
+	copying them into the array
+	@return bytes read << 32 | new register value
+*/
+JNIEXPORT jlong JNICALL
+Java_jd2xx_JD2XX_readCrc(JNIEnv *env, jobject obj, jbyteArray arr, jint off, jint len,
+	jint kind, jint c) {
+	FT_STATUS st = FT_OK;
+	DWORD ret = 0;
+	jlong tok = get_handle(env, obj);
+	FT_HANDLE hnd;
+	jbyte sbuf[IO_STACK_SIZE], *buf = sbuf, *dst;
+
+	if (!check_range(env, arr, off, len) || len == 0) return (jlong)(unsigned int)c;
+
+	if (len > IO_STACK_SIZE && (buf = malloc(len)) == NULL) {
+		io_exception_status(env, FT_INSUFFICIENT_RESOURCES);
+		return (jlong)(unsigned int)c;
+	}
+
+	if ((hnd = acquire_handle(env, tok)) != NULL) {
+		st = FT_Read(hnd, (LPVOID)buf, len, &ret);
+		capture_io(tok, CAPTURE_READ, buf, ret);
+		handle_release(tok);
+
+		if (ret > 0) {
+			if ((dst = (*env)->GetPrimitiveArrayCritical(env, arr, NULL)) != NULL) {
+				c = (jint)crc_copy(kind, (unsigned int)c, (unsigned char*)dst + off,
+					(unsigned char*)buf, ret);
+				(*env)->ReleasePrimitiveArrayCritical(env, arr, dst, 0);
+			}
+			else ret = 0; // OutOfMemoryError pending
+		}
+		if (!FT_SUCCESS(st)) io_exception_status(env, st);
+	}
+
+	if (buf != sbuf) free(buf);
+	return (jlong)ret << 32 | (unsigned int)c;
+}
+
 JNIEXPORT jint JNICALL
 Java_jd2xx_JD2XX_write(JNIEnv *env, jobject obj, jbyteArray arr, jint off, jint len) {
 	FT_STATUS st;
-	volatile DWORD ret;
-	jlong hnd = get_handle(env, obj);
-	int alen = (*env)->GetArrayLength(env, arr);
-	jbyte *buf;
+	DWORD ret = 0;
+	jlong tok = get_handle(env, obj);
+	FT_HANDLE hnd;
+	jbyte sbuf[IO_STACK_SIZE], *buf = sbuf;
 
-	if (arr == 0) {
-		jclass exc = (*env)->FindClass(env, "java/lang/NullPointerException");
-		if (exc != 0) (*env)->ThrowNew(env, exc, NULL);
-		(*env)->DeleteLocalRef(env, exc);
-		return 0;
-	} else if ((off < 0) || (off > alen) || (len < 0)
-		|| ((off + len) > alen) || ((off + len) < 0)) {
-		jclass exc = (*env)->FindClass(env, "java/lang/IndexOutOfBoundsException");
-		if (exc != 0) (*env)->ThrowNew(env, exc, NULL);
-		(*env)->DeleteLocalRef(env, exc);
+	if (!check_range(env, arr, off, len) || len == 0) return 0;
+
+	if (len > IO_STACK_SIZE && (buf = malloc(len)) == NULL) {
+		io_exception_status(env, FT_INSUFFICIENT_RESOURCES);
 		return 0;
-	} else if (len == 0) return 0;
+	}
+	(*env)->GetByteArrayRegion(env, arr, off, len, buf);
+
+	if ((hnd = acquire_handle(env, tok)) != NULL) {
+		if (!FT_SUCCESS(st = FT_Write(hnd, (LPVOID)buf, len, &ret)))
+			io_exception_status(env, st);
+		capture_io(tok, CAPTURE_WRITE, buf, ret);
+		handle_release(tok);
+	}
+
+	if (buf != sbuf) free(buf);
+	return (jint)ret;
+}
+
+/** Resolve direct buffer range, throw if invalid
+	@return buffer address or NULL if an exception was thrown
+*/
+static jbyte*
+direct_range(JNIEnv *env, jobject bb, jint off, jint len) {
+	jbyte *buf = (bb != 0) ? (*env)->GetDirectBufferAddress(env, bb) : NULL;
+	jlong cap = (bb != 0) ? (*env)->GetDirectBufferCapacity(env, bb) : -1;
+
+	if (buf == NULL || cap < 0) {
+		throw_new(env, "java/lang/IllegalArgumentException", "direct buffer required");
+		return NULL;
+	}
+	if (off < 0 || len < 0 || (jlong)off + len > cap) {
+		throw_new(env, "java/lang/IndexOutOfBoundsException", NULL);
+		return NULL;
+	}
+
+	return buf + off;
+}
 
- 	buf = (*env)->GetByteArrayElements(env, arr, 0);
+JNIEXPORT jint JNICALL
+Java_jd2xx_JD2XX_readDirect(JNIEnv *env, jobject obj, jobject bb, jint off, jint len) {
+	FT_STATUS st;
+	DWORD ret = 0;
+	jlong tok = get_handle(env, obj);
+	FT_HANDLE hnd;
+	jbyte *buf = direct_range(env, bb, off, len);
 
-	if (!FT_SUCCESS(st = FT_Write((FT_HANDLE)hnd, (LPVOID)(buf+off), len, (LPDWORD)&ret)))
+	if (buf == NULL || len == 0) return 0;
+	if ((hnd = acquire_handle(env, tok)) == NULL) return 0;
+
+	if (!FT_SUCCESS(st = FT_Read(hnd, (LPVOID)buf, len, &ret)))
 		io_exception_status(env, st);
+	capture_io(tok, CAPTURE_READ, buf, ret);
+	handle_release(tok);
 
-	(*env)->ReleaseByteArrayElements(env, arr, buf, 0);
 	return (jint)ret;
 }
 
+JNIEXPORT jint JNICALL
+Java_jd2xx_JD2XX_writeDirect(JNIEnv *env, jobject obj, jobject bb, jint off, jint len) {
+	FT_STATUS st;
+	DWORD ret = 0;
+	jlong tok = get_handle(env, obj);
+	FT_HANDLE hnd;
+	jbyte *buf = direct_range(env, bb, off, len);
+
+	if (buf == NULL || len == 0) return 0;
+	if ((hnd = acquire_handle(env, tok)) == NULL) return 0;
+
+	if (!FT_SUCCESS(st = FT_Write(hnd, (LPVOID)buf, len, &ret)))
+		io_exception_status(env, st);
+	capture_io(tok, CAPTURE_WRITE, buf, ret);
+	handle_release(tok);
+
+	return (jint)ret;
+}
+
+/*
+	Mapped direct buffers
+
+	JD2XX.allocateDirect hands out whole anonymous pages, pre-faulted with
+	MAP_POPULATE and locked in RAM where RLIMIT_MEMLOCK allows, so a stream
+	never stalls on a page fault or a swapped out page in the middle of a
+	transfer. A zero address from mapBuffer or a null buffer from
+	wrapBuffer tells the Java side to fall back to ByteBuffer.allocateDirect.
+*/
+
+/** Round a buffer size up to whole pages */
+static size_t
+map_size(jint cap) {
+#ifdef WIN32
+	return 0;
+#else
+	size_t page = (size_t)sysconf(_SC_PAGESIZE);
+	return ((size_t)cap + page - 1) / page * page;
+#endif
+}
+
+/** Map a buffer of at least cap bytes
+	@return address or 0 if mapping is not available
+*/
+JNIEXPORT jlong JNICALL
+Java_jd2xx_JD2XX_mapBuffer(JNIEnv *env, jclass cls, jint cap) {
+#ifdef WIN32
+	return 0;
+#else
+	size_t size = map_size(cap);
+	int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+	void *m;
+
+#ifdef MAP_POPULATE
+	flags |= MAP_POPULATE;
+#endif
+	if (cap <= 0) return 0;
+	m = mmap(NULL, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+	if (m == MAP_FAILED) return 0;
+	mlock(m, size); // best effort, the buffer works unlocked too
+	return (jlong)(size_t)m;
+#endif
+}
+
+/** Wrap a mapped buffer in a direct ByteBuffer
+	@return buffer or NULL, with no exception pending, if the VM cannot
+	create one
+*/
+JNIEXPORT jobject JNICALL
+Java_jd2xx_JD2XX_wrapBuffer(JNIEnv *env, jclass cls, jlong addr, jint cap) {
+	jobject b = (*env)->NewDirectByteBuffer(env, (void*)(size_t)addr, (jlong)cap);
+
+	if (b == NULL) (*env)->ExceptionClear(env);
+	return b;
+}
+
+/** Unmap a buffer from mapBuffer (cleaner action) */
+JNIEXPORT void JNICALL
+Java_jd2xx_JD2XX_unmapBuffer(JNIEnv *env, jclass cls, jlong addr, jint cap) {
+#ifndef WIN32
+	munmap((void*)(size_t)addr, map_size(cap));
+#endif
+}
+
 JNIEXPORT void JNICALL
 Java_jd2xx_JD2XX_setBaudRate(JNIEnv *env, jobject obj, jint br) {
 	FT_STATUS st;
-	jlong hnd = get_handle(env, obj);
+	jlong tok = get_handle(env, obj);
+	FT_HANDLE hnd = acquire_handle(env, tok);
 
-	if (!FT_SUCCESS(st = FT_SetBaudRate((FT_HANDLE)hnd, (DWORD)br)))
+	if (hnd == NULL) return;
+	if (!FT_SUCCESS(st = FT_SetBaudRate(hnd, (DWORD)br)))
 		io_exception_status(env, st);
+	config_record(tok, st, CONFIG_BAUD_RATE, 1, &br);
+	handle_release(tok);
 }
 
 JNIEXPORT void JNICALL
 Java_jd2xx_JD2XX_setDivisor(JNIEnv *env, jobject obj, jint div) {
 	FT_STATUS st;
-	jlong hnd = get_handle(env, obj);
+	jlong tok = get_handle(env, obj);
+	FT_HANDLE hnd = acquire_handle(env, tok);
 
-	if (!FT_SUCCESS(st = FT_SetDivisor((FT_HANDLE)hnd, (USHORT)div)))
+	if (hnd == NULL) return;
+	if (!FT_SUCCESS(st = FT_SetDivisor(hnd, (USHORT)div)))
 		io_exception_status(env, st);
+	config_forget(tok, CONFIG_BAUD_RATE, 1);
+	handle_release(tok);
 }
 
 JNIEXPORT void JNICALL
 Java_jd2xx_JD2XX_setDataCharacteristics(
 	JNIEnv *env, jobject obj, jint wl, jint sb, jint pr) {
+	jint v[3] = { wl, sb, pr };
 	FT_STATUS st;
-	jlong hnd = get_handle(env, obj);
+	jlong tok = get_handle(env, obj);
+	FT_HANDLE hnd = acquire_handle(env, tok);
 
-	if (!FT_SUCCESS(st = FT_SetDataCharacteristics((FT_HANDLE)hnd,
+	if (hnd == NULL) return;
+	if (!FT_SUCCESS(st = FT_SetDataCharacteristics(hnd,
 		(UCHAR)wl, (UCHAR)sb, (UCHAR)pr)))
 		io_exception_status(env, st);
+	config_record(tok, st, CONFIG_WORD_LENGTH, 3, v);
+	handle_release(tok);
 }
 
 JNIEXPORT void JNICALL
 Java_jd2xx_JD2XX_setFlowControl(
 	JNIEnv *env, jobject obj, jint fc, jint xon, jint xoff) {
+	jint v[3] = { fc, xon, xoff };
 	FT_STATUS st;
-	jlong hnd = get_handle(env, obj);
+	jlong tok = get_handle(env, obj);
+	FT_HANDLE hnd = acquire_handle(env, tok);
 
-	if (!FT_SUCCESS(st = FT_SetFlowControl((FT_HANDLE)hnd,
+	if (hnd == NULL) return;
+	if (!FT_SUCCESS(st = FT_SetFlowControl(hnd,
 		(USHORT)fc, (UCHAR)xon, (UCHAR)xoff)))
 		io_exception_status(env, st);
+	config_record(tok, st, CONFIG_FLOW_CONTROL, 3, v);
+	handle_release(tok);
 }
 
 JNIEXPORT void JNICALL
 Java_jd2xx_JD2XX_resetDevice(JNIEnv *env, jobject obj) {
 	FT_STATUS st;
-	jlong hnd = get_handle(env, obj);
+	jlong tok = get_handle(env, obj);
+	FT_HANDLE hnd = acquire_handle(env, tok);
 
-	if (!FT_SUCCESS(st = FT_ResetDevice((FT_HANDLE)hnd)))
+	if (hnd == NULL) return;
+	if (!FT_SUCCESS(st = FT_ResetDevice(hnd)))
 		io_exception_status(env, st);
+	config_forget(tok, 0, CONFIG_SIZE);
+	handle_release(tok);
 }
 
 JNIEXPORT void JNICALL
 Java_jd2xx_JD2XX_setDtr(JNIEnv *env, jobject obj) {
 	FT_STATUS st;
-	jlong hnd = get_handle(env, obj);
+	jlong tok = get_handle(env, obj);
+	FT_HANDLE hnd = acquire_handle(env, tok);
 
-	if (!FT_SUCCESS(st = FT_SetDtr((FT_HANDLE)hnd)))
+	if (hnd == NULL) return;
+	if (!FT_SUCCESS(st = FT_SetDtr(hnd)))
 		io_exception_status(env, st);
+	handle_release(tok);
 }
 
 JNIEXPORT void JNICALL
 Java_jd2xx_JD2XX_clrDtr(JNIEnv *env, jobject obj) {
 	FT_STATUS st;
-	jlong hnd = get_handle(env, obj);
+	jlong tok = get_handle(env, obj);
+	FT_HANDLE hnd = acquire_handle(env, tok);
 
-	if (!FT_SUCCESS(st = FT_ClrDtr((FT_HANDLE)hnd)))
+	if (hnd == NULL) return;
+	if (!FT_SUCCESS(st = FT_ClrDtr(hnd)))
 		io_exception_status(env, st);
+	handle_release(tok);
 }
 
 JNIEXPORT void JNICALL
 Java_jd2xx_JD2XX_setRts(JNIEnv *env, jobject obj) {
 	FT_STATUS st;
-	jlong hnd = get_handle(env, obj);
+	jlong tok = get_handle(env, obj);
+	FT_HANDLE hnd = acquire_handle(env, tok);
 
-	if (!FT_SUCCESS(st = FT_SetRts((FT_HANDLE)hnd)))
+	if (hnd == NULL) return;
+	if (!FT_SUCCESS(st = FT_SetRts(hnd)))
 		io_exception_status(env, st);
+	handle_release(tok);
 }
 
 JNIEXPORT void JNICALL
 Java_jd2xx_JD2XX_clrRts(JNIEnv *env, jobject obj) {
 	FT_STATUS st;
-	jlong hnd = get_handle(env, obj);
+	jlong tok = get_handle(env, obj);
+	FT_HANDLE hnd = acquire_handle(env, tok);
 
-	if (!FT_SUCCESS(st = FT_ClrRts((FT_HANDLE)hnd)))
+	if (hnd == NULL) return;
+	if (!FT_SUCCESS(st = FT_ClrRts(hnd)))
 		io_exception_status(env, st);
+	handle_release(tok);
 }
 
 JNIEXPORT jint JNICALL
 Java_jd2xx_JD2XX_getModemStatus(JNIEnv *env, jobject obj) {
 	FT_STATUS st;
-	jlong hnd = get_handle(env, obj);
+	jlong tok = get_handle(env, obj);
+	FT_HANDLE hnd = acquire_handle(env, tok);
 	volatile ULONG ms;
 
-	if (!FT_SUCCESS(st = FT_GetModemStatus((FT_HANDLE)hnd, &ms)))
+	if (hnd == NULL) return 0;
+	if (!FT_SUCCESS(st = FT_GetModemStatus(hnd, &ms)))
 		io_exception_status(env, st);
+	else {
+		jint v = (jint)ms;
+		capture_io(tok, CAPTURE_MODEM_STATUS, &v, sizeof(v));
+	}
+	handle_release(tok);
 
 	return (jint)ms;
 }
@@ -621,40 +893,56 @@ Java_jd2xx_JD2XX_setChars(
 	JNIEnv *env, jobject obj,
 	jint evc, jboolean eve, jint erc, jboolean ere
 ) {
+	jint v[4] = { evc, eve ? 1 : 0, erc, ere ? 1 : 0 };
 	FT_STATUS st;
-	jlong hnd = get_handle(env, obj);
+	jlong tok = get_handle(env, obj);
+	FT_HANDLE hnd = acquire_handle(env, tok);
 
-	if (!FT_SUCCESS(st = FT_SetChars((FT_HANDLE)hnd,
+	if (hnd == NULL) return;
+	if (!FT_SUCCESS(st = FT_SetChars(hnd,
 		(UCHAR)evc, eve ? 1 : 0, (UCHAR)erc, ere ? 1 : 0)))
 		io_exception_status(env, st);
+	config_record(tok, st, CONFIG_EVENT_CHAR, 4, v);
+	handle_release(tok);
 }
 
 JNIEXPORT void JNICALL
 Java_jd2xx_JD2XX_purge(JNIEnv *env, jobject obj, jint msk) {
 	FT_STATUS st;
-	jlong hnd = get_handle(env, obj);
+	jlong tok = get_handle(env, obj);
+	FT_HANDLE hnd = acquire_handle(env, tok);
 
-	if (!FT_SUCCESS(st = FT_Purge((FT_HANDLE)hnd, (DWORD)msk)))
+	if (hnd == NULL) return;
+	if (!FT_SUCCESS(st = FT_Purge(hnd, (DWORD)msk)))
 		io_exception_status(env, st);
+	handle_release(tok);
 }
 
 JNIEXPORT void JNICALL
 Java_jd2xx_JD2XX_setTimeouts(JNIEnv *env, jobject obj, jint rt, jint wt) {
+	jint v[2] = { rt, wt };
 	FT_STATUS st;
-	jlong hnd = get_handle(env, obj);
+	jlong tok = get_handle(env, obj);
+	FT_HANDLE hnd = acquire_handle(env, tok);
 
-	if (!FT_SUCCESS(st = FT_SetTimeouts((FT_HANDLE)hnd, (DWORD)rt, (DWORD)wt)))
+	if (hnd == NULL) return;
+	if (!FT_SUCCESS(st = FT_SetTimeouts(hnd, (DWORD)rt, (DWORD)wt)))
 		io_exception_status(env, st);
+	config_record(tok, st, CONFIG_READ_TIMEOUT, 2, v);
+	handle_release(tok);
 }
 
 JNIEXPORT jint JNICALL
 Java_jd2xx_JD2XX_getQueueStatus(JNIEnv *env, jobject obj) {
 	FT_STATUS st;
-	jlong hnd = get_handle(env, obj);
+	jlong tok = get_handle(env, obj);
+	FT_HANDLE hnd = acquire_handle(env, tok);
 	volatile DWORD r;
 
-	if (!FT_SUCCESS(st = FT_GetQueueStatus((FT_HANDLE)hnd, &r)))
+	if (hnd == NULL) return 0;
+	if (!FT_SUCCESS(st = FT_GetQueueStatus(hnd, &r)))
 		io_exception_status(env, st);
+	handle_release(tok);
 
 	return (jint)r;
 }
@@ -662,21 +950,28 @@ Java_jd2xx_JD2XX_getQueueStatus(JNIEnv *env, jobject obj) {
 JNIEXPORT void JNICALL
 Java_jd2xx_JD2XX_setEventNotification(JNIEnv *env, jobject obj, jint msk, jint evh) {
 	FT_STATUS st;
-	jlong hnd = get_handle(env, obj);
+	jlong tok = get_handle(env, obj);
+	FT_HANDLE hnd = acquire_handle(env, tok);
 
+	if (hnd == NULL) return;
 	if (!FT_SUCCESS(
-		st = FT_SetEventNotification((FT_HANDLE)hnd, (DWORD)msk, (HANDLE)evh)
+		st = FT_SetEventNotification(hnd, (DWORD)msk, (HANDLE)evh)
 	)) io_exception_status(env, st);
+	handle_release(tok);
 }
 
 JNIEXPORT jintArray JNICALL
 Java_jd2xx_JD2XX_getStatus(JNIEnv *env, jobject obj) {
 	FT_STATUS st;
-	jlong hnd = get_handle(env, obj);
+	jlong tok = get_handle(env, obj);
+	FT_HANDLE hnd = acquire_handle(env, tok);
 	jintArray result;
 	volatile DWORD rte[3]; // rx, tx, ev;
 
-	if (!FT_SUCCESS(st = FT_GetStatus((FT_HANDLE)hnd, rte+0, rte+1, rte+2))) {
+	if (hnd == NULL) return NULL;
+	st = FT_GetStatus(hnd, rte+0, rte+1, rte+2);
+	handle_release(tok);
+	if (!FT_SUCCESS(st)) {
 		io_exception_status(env, st);
 		return NULL;
 	}
@@ -690,38 +985,50 @@ Java_jd2xx_JD2XX_getStatus(JNIEnv *env, jobject obj) {
 JNIEXPORT void JNICALL
 Java_jd2xx_JD2XX_setBreakOn(JNIEnv *env, jobject obj) {
 	FT_STATUS st;
-	jlong hnd = get_handle(env, obj);
+	jlong tok = get_handle(env, obj);
+	FT_HANDLE hnd = acquire_handle(env, tok);
 
-	if (!FT_SUCCESS(st = FT_SetBreakOn((FT_HANDLE)hnd)))
+	if (hnd == NULL) return;
+	if (!FT_SUCCESS(st = FT_SetBreakOn(hnd)))
 		io_exception_status(env, st);
+	handle_release(tok);
 }
 
 JNIEXPORT void JNICALL
 Java_jd2xx_JD2XX_setBreakOff(JNIEnv *env, jobject obj) {
 	FT_STATUS st;
-	jlong hnd = get_handle(env, obj);
+	jlong tok = get_handle(env, obj);
+	FT_HANDLE hnd = acquire_handle(env, tok);
 
-	if (!FT_SUCCESS(st = FT_SetBreakOff((FT_HANDLE)hnd)))
+	if (hnd == NULL) return;
+	if (!FT_SUCCESS(st = FT_SetBreakOff(hnd)))
 		io_exception_status(env, st);
+	handle_release(tok);
 }
 
 JNIEXPORT void JNICALL
 Java_jd2xx_JD2XX_setWaitMask(JNIEnv *env, jobject obj, jint msk) {
 	FT_STATUS st;
-	jlong hnd = get_handle(env, obj);
+	jlong tok = get_handle(env, obj);
+	FT_HANDLE hnd = acquire_handle(env, tok);
 
-	if (!FT_SUCCESS(st = FT_SetWaitMask((FT_HANDLE)hnd, (DWORD)msk)))
+	if (hnd == NULL) return;
+	if (!FT_SUCCESS(st = FT_SetWaitMask(hnd, (DWORD)msk)))
 		io_exception_status(env, st);
+	handle_release(tok);
 }
 
 JNIEXPORT jint JNICALL
 Java_jd2xx_JD2XX_waitOnMask(JNIEnv *env, jobject obj) {
 	FT_STATUS st;
-	jlong hnd = get_handle(env, obj);
+	jlong tok = get_handle(env, obj);
+	FT_HANDLE hnd = acquire_handle(env, tok);
 	volatile DWORD msk;
 
-	if (!FT_SUCCESS(st = FT_WaitOnMask((FT_HANDLE)hnd, &msk)))
+	if (hnd == NULL) return 0;
+	if (!FT_SUCCESS(st = FT_WaitOnMask(hnd, &msk)))
 		io_exception_status(env, st);
+	handle_release(tok);
 
 	return (jint)msk;
 }
@@ -729,32 +1036,150 @@ Java_jd2xx_JD2XX_waitOnMask(JNIEnv *env, jobject obj) {
 JNIEXPORT jint JNICALL
 Java_jd2xx_JD2XX_getEventStatus(JNIEnv *env, jobject obj) {
 	FT_STATUS st;
-	jlong hnd = get_handle(env, obj);
+	jlong tok = get_handle(env, obj);
+	FT_HANDLE hnd = acquire_handle(env, tok);
 	volatile DWORD msk;
 
-	if (!FT_SUCCESS(st = FT_GetEventStatus((FT_HANDLE)hnd, &msk)))
+	if (hnd == NULL) return 0;
+	if (!FT_SUCCESS(st = FT_GetEventStatus(hnd, &msk)))
 		io_exception_status(env, st);
+	handle_release(tok);
 
 	return (jint)msk;
 }
 
+JNIEXPORT jshort JNICALL
+Java_jd2xx_JD2XX_readEE(JNIEnv *env, jobject obj, jint off) {
+	FT_STATUS st;
+	jlong tok = get_handle(env, obj);
+	FT_HANDLE hnd = acquire_handle(env, tok);
+	WORD v = 0;
+
+	if (hnd == NULL) return 0;
+	if (!FT_SUCCESS(st = FT_ReadEE(hnd, (DWORD)off, &v)))
+		io_exception_status(env, st);
+	handle_release(tok);
+
+	return (jshort)v;
+}
+
+JNIEXPORT void JNICALL
+Java_jd2xx_JD2XX_writeEE(JNIEnv *env, jobject obj, jint off, jshort v) {
+	FT_STATUS st;
+	jlong tok = get_handle(env, obj);
+	FT_HANDLE hnd = acquire_handle(env, tok);
+
+	if (hnd == NULL) return;
+	if (!FT_SUCCESS(st = FT_WriteEE(hnd, (DWORD)off, (WORD)v)))
+		io_exception_status(env, st);
+	handle_release(tok);
+}
+
+JNIEXPORT void JNICALL
+Java_jd2xx_JD2XX_eraseEE(JNIEnv *env, jobject obj) {
+	FT_STATUS st;
+	jlong tok = get_handle(env, obj);
+	FT_HANDLE hnd = acquire_handle(env, tok);
+
+	if (hnd == NULL) return;
+	if (!FT_SUCCESS(st = FT_EraseEE(hnd)))
+		io_exception_status(env, st);
+	handle_release(tok);
+}
+
+/** Check a word range of the EEPROM, throw if out of bounds */
+static int
+ee_range(JNIEnv *env, jint off, jint len) {
+	if (off < 0 || len < 0 || len > EE_MAX_WORDS - off) {
+		throw_new(env, "java/lang/IndexOutOfBoundsException", "EEPROM word range");
+		return 0;
+	}
+	return 1;
+}
+
+JNIEXPORT jshortArray JNICALL
+Java_jd2xx_JD2XX_dumpEE(JNIEnv *env, jobject obj, jint off, jint len) {
+	FT_STATUS st = FT_OK;
+	jshortArray result;
+	WORD buf[EE_MAX_WORDS];
+	jlong tok = get_handle(env, obj);
+	FT_HANDLE hnd;
+	int i;
+
+	if (!ee_range(env, off, len)) return NULL;
+	if ((hnd = acquire_handle(env, tok)) == NULL) return NULL;
+	for (i = 0; i < len && FT_SUCCESS(st); ++i)
+		st = FT_ReadEE(hnd, (DWORD)(off + i), &buf[i]);
+	handle_release(tok);
+	if (!FT_SUCCESS(st)) {
+		io_exception_status(env, st);
+		return NULL;
+	}
+
+	result = (*env)->NewShortArray(env, len);
+	if (result != 0) (*env)->SetShortArrayRegion(env, result, 0, len, (jshort*)buf);
+
+	return result;
+}
+
+JNIEXPORT jint JNICALL
+Java_jd2xx_JD2XX_updateEE(JNIEnv *env, jobject obj, jint off, jshortArray arr, jshortArray old) {
+	FT_STATUS st = FT_OK;
+	WORD buf[EE_MAX_WORDS], cur[EE_MAX_WORDS];
+	jlong tok = get_handle(env, obj);
+	FT_HANDLE hnd;
+	jint len, i, n = 0;
+
+	if (arr == NULL) {
+		throw_new(env, "java/lang/NullPointerException", NULL);
+		return 0;
+	}
+	len = (*env)->GetArrayLength(env, arr);
+	if (!ee_range(env, off, len)) return 0;
+	if (old != NULL && (*env)->GetArrayLength(env, old) != len) {
+		throw_new(env, "java/lang/IllegalArgumentException", "image length mismatch");
+		return 0;
+	}
+	(*env)->GetShortArrayRegion(env, arr, 0, len, (jshort*)buf);
+	if (old != NULL) (*env)->GetShortArrayRegion(env, old, 0, len, (jshort*)cur);
+
+	if ((hnd = acquire_handle(env, tok)) == NULL) return 0;
+	for (i = 0; i < len && FT_SUCCESS(st); ++i) {
+		if (old == NULL && !FT_SUCCESS(st = FT_ReadEE(hnd, (DWORD)(off + i), &cur[i])))
+			break;
+		if (cur[i] != buf[i] && FT_SUCCESS(st = FT_WriteEE(hnd, (DWORD)(off + i), buf[i])))
+			++n;
+	}
+	handle_release(tok);
+	if (!FT_SUCCESS(st)) io_exception_status(env, st);
+
+	return n;
+}
+
 JNIEXPORT void JNICALL
 Java_jd2xx_JD2XX_setLatencyTimer(JNIEnv *env, jobject obj, jint tmr) {
 	FT_STATUS st;
-	jlong hnd = get_handle(env, obj);
+	jlong tok = get_handle(env, obj);
+	FT_HANDLE hnd = acquire_handle(env, tok);
 
-	if (!FT_SUCCESS(st = FT_SetLatencyTimer((FT_HANDLE)hnd, (UCHAR)tmr)))
+	if (hnd == NULL) return;
+	if (!FT_SUCCESS(st = FT_SetLatencyTimer(hnd, (UCHAR)tmr)))
 		io_exception_status(env, st);
+	config_record(tok, st, CONFIG_LATENCY_TIMER, 1, &tmr);
+	handle_release(tok);
 }
 
 JNIEXPORT jint JNICALL
 Java_jd2xx_JD2XX_getLatencyTimer(JNIEnv *env, jobject obj) {
 	FT_STATUS st;
-	jlong hnd = get_handle(env, obj);
+	jlong tok = get_handle(env, obj);
+	FT_HANDLE hnd = acquire_handle(env, tok);
 	volatile UCHAR tmr;
 
-	if (!FT_SUCCESS(st = FT_GetLatencyTimer((FT_HANDLE)hnd, &tmr)))
+	if (hnd == NULL) return 0;
+	if (!FT_SUCCESS(st = FT_GetLatencyTimer(hnd, &tmr)))
 		io_exception_status(env, st);
+	handle_release(tok);
 
 	return (jint)tmr;
 }
@@ -781,47 +1206,64 @@ devices only)
 
 JNIEXPORT void JNICALL
 Java_jd2xx_JD2XX_setBitMode(JNIEnv *env, jobject obj, jint msk, jint mod) {
+	jint v[2] = { msk, mod };
 	FT_STATUS st;
-	jlong hnd = get_handle(env, obj);
+	jlong tok = get_handle(env, obj);
+	FT_HANDLE hnd = acquire_handle(env, tok);
 
-	if (!FT_SUCCESS(st = FT_SetBitMode((FT_HANDLE)hnd, (UCHAR)msk, (UCHAR)mod)))
+	if (hnd == NULL) return;
+	if (!FT_SUCCESS(st = FT_SetBitMode(hnd, (UCHAR)msk, (UCHAR)mod)))
 		io_exception_status(env, st);
+	config_record(tok, st, CONFIG_BIT_MASK, 2, v);
+	handle_release(tok);
 }
 
 JNIEXPORT jint JNICALL
 Java_jd2xx_JD2XX_getBitMode(JNIEnv *env, jobject obj) {
 	FT_STATUS st;
-	jlong hnd = get_handle(env, obj);
+	jlong tok = get_handle(env, obj);
+	FT_HANDLE hnd = acquire_handle(env, tok);
 	volatile UCHAR msk;
 
-	if (!FT_SUCCESS(st = FT_GetBitMode((FT_HANDLE)hnd, &msk)))
+	if (hnd == NULL) return 0;
+	if (!FT_SUCCESS(st = FT_GetBitMode(hnd, &msk)))
 		io_exception_status(env, st);
+	handle_release(tok);
 
 	return (jint)msk;
 }
 
 JNIEXPORT void JNICALL
 Java_jd2xx_JD2XX_setUSBParameters(JNIEnv *env, jobject obj, jint isz, jint osz) {
+	jint v[2] = { isz, osz };
 	FT_STATUS st;
-	jlong hnd = get_handle(env, obj);
+	jlong tok = get_handle(env, obj);
+	FT_HANDLE hnd = acquire_handle(env, tok);
 
-	if (!FT_SUCCESS(st = FT_SetUSBParameters((FT_HANDLE)hnd, (ULONG)isz, (ULONG)osz)))
+	if (hnd == NULL) return;
+	if (!FT_SUCCESS(st = FT_SetUSBParameters(hnd, (ULONG)isz, (ULONG)osz)))
 		io_exception_status(env, st);
+	config_record(tok, st, CONFIG_IN_TRANSFER_SIZE, 2, v);
+	handle_release(tok);
 }
 
 JNIEXPORT void JNICALL
 Java_jd2xx_JD2XX_FT_setDeadmanTimeout(JNIEnv *env, jobject obj, jint dto) {
 	FT_STATUS st;
-	jlong hnd = get_handle(env, obj);
+	jlong tok = get_handle(env, obj);
+	FT_HANDLE hnd = acquire_handle(env, tok);
 
-	if (!FT_SUCCESS(st = FT_SetDeadmanTimeout((FT_HANDLE)hnd, (ULONG)dto)))
+	if (hnd == NULL) return;
+	if (!FT_SUCCESS(st = FT_SetDeadmanTimeout(hnd, (ULONG)dto)))
 		io_exception_status(env, st);
+	handle_release(tok);
 }
 
 JNIEXPORT jobject JNICALL
 Java_jd2xx_JD2XX_getDeviceInfo(JNIEnv *env, jobject obj) {
 	FT_STATUS st;
-	jlong hnd = get_handle(env, obj);
+	jlong tok = get_handle(env, obj);
+	FT_HANDLE hnd = acquire_handle(env, tok);
 	jobject result;
 
 	jclass dicls;
@@ -832,10 +1274,12 @@ Java_jd2xx_JD2XX_getDeviceInfo(JNIEnv *env, jobject obj) {
 	char serialNumber[DESCRIPTION_SIZE];
 	char description[DESCRIPTION_SIZE];
 
-	if (!FT_SUCCESS(st = FT_GetDeviceInfo(
-		(FT_HANDLE)hnd, (FT_DEVICE*)&deviceType, (DWORD*)&deviceID,
-		serialNumber, description, NULL)
-	)) {
+	if (hnd == NULL) return NULL;
+	st = FT_GetDeviceInfo(
+		hnd, (FT_DEVICE*)&deviceType, (DWORD*)&deviceID,
+		serialNumber, description, NULL);
+	handle_release(tok);
+	if (!FT_SUCCESS(st)) {
 		io_exception_status(env, st);
 		return NULL;
 	}
@@ -876,47 +1320,64 @@ panic:
 JNIEXPORT void JNICALL
 Java_jd2xx_JD2XX_stopInTask(JNIEnv *env, jobject obj) {
 	FT_STATUS st;
-	jlong hnd = get_handle(env, obj);
+	jlong tok = get_handle(env, obj);
+	FT_HANDLE hnd = acquire_handle(env, tok);
 
-	if (!FT_SUCCESS(st = FT_StopInTask((FT_HANDLE)hnd)))
+	if (hnd == NULL) return;
+	if (!FT_SUCCESS(st = FT_StopInTask(hnd)))
 		io_exception_status(env, st);
+	handle_release(tok);
 }
 
 JNIEXPORT void JNICALL
 Java_jd2xx_JD2XX_restartInTask(JNIEnv *env, jobject obj) {
 	FT_STATUS st;
-	jlong hnd = get_handle(env, obj);
+	jlong tok = get_handle(env, obj);
+	FT_HANDLE hnd = acquire_handle(env, tok);
 
-	if (!FT_SUCCESS(st = FT_RestartInTask((FT_HANDLE)hnd)))
+	if (hnd == NULL) return;
+	if (!FT_SUCCESS(st = FT_RestartInTask(hnd)))
 		io_exception_status(env, st);
+	handle_release(tok);
 }
 
 JNIEXPORT void JNICALL
 Java_jd2xx_JD2XX_setResetPipeRetryCount(JNIEnv *env, jobject obj, jint c) {
 	FT_STATUS st;
-	jlong hnd = get_handle(env, obj);
+	jlong tok = get_handle(env, obj);
+	FT_HANDLE hnd = acquire_handle(env, tok);
 
-	if (!FT_SUCCESS(st = FT_SetResetPipeRetryCount((FT_HANDLE)hnd, (DWORD)c)))
+	if (hnd == NULL) return;
+	if (!FT_SUCCESS(st = FT_SetResetPipeRetryCount(hnd, (DWORD)c)))
 		io_exception_status(env, st);
+	handle_release(tok);
 }
 
 JNIEXPORT void JNICALL
 Java_jd2xx_JD2XX_resetPort(JNIEnv *env, jobject obj) {
 	FT_STATUS st;
-	jlong hnd = get_handle(env, obj);
+	jlong tok = get_handle(env, obj);
+	FT_HANDLE hnd = acquire_handle(env, tok);
 
-	if (!FT_SUCCESS(st = FT_ResetPort((FT_HANDLE)hnd)))
+	if (hnd == NULL) return;
+	if (!FT_SUCCESS(st = FT_ResetPort(hnd)))
 		io_exception_status(env, st);
+	config_forget(tok, 0, CONFIG_SIZE);
+	handle_release(tok);
 }
 
 JNIEXPORT void JNICALL
 Java_jd2xx_JD2XX_cyclePort(JNIEnv *env, jobject obj) {
+#ifdef WIN32
 	FT_STATUS st;
-	jlong hnd = get_handle(env, obj);
+	jlong tok = get_handle(env, obj);
+	FT_HANDLE hnd = acquire_handle(env, tok);
 
-#ifdef WIN32
-	if (!FT_SUCCESS(st = FT_CyclePort((FT_HANDLE)hnd)))
+	if (hnd == NULL) return;
+	if (!FT_SUCCESS(st = FT_CyclePort(hnd)))
 		io_exception_status(env, st);
+	config_forget(tok, 0, CONFIG_SIZE);
+	handle_release(tok);
 #else
 	// Not available in Linux or OS X
 	// See FTDO docs for more details.
@@ -927,20 +1388,23 @@ Java_jd2xx_JD2XX_cyclePort(JNIEnv *env, jobject obj) {
 JNIEXPORT jint JNICALL
 Java_jd2xx_JD2XX_getDriverVersion(JNIEnv *env, jobject obj) {
 	FT_STATUS st;
-	jlong hnd = get_handle(env, obj);
+	jlong tok = get_handle(env, obj);
+	FT_HANDLE hnd = acquire_handle(env, tok);
 	volatile DWORD ver;
 
-	if (!FT_SUCCESS(st = FT_GetDriverVersion((FT_HANDLE)hnd, &ver)))
+	if (hnd == NULL) return 0;
+	if (!FT_SUCCESS(st = FT_GetDriverVersion(hnd, &ver)))
 		io_exception_status(env, st);
+	handle_release(tok);
 
 	return (jint)ver;
 }
 
 JNIEXPORT void JNICALL
 Java_jd2xx_JD2XX_reload(JNIEnv *env, jobject obj, jint vid, jint pid) {
+#ifdef WIN32
 	FT_STATUS st;
 
-#ifdef WIN32
 	if (!FT_SUCCESS(st = FT_Reload(vid, pid)))
 		io_exception_status(env, st);
 #else
@@ -951,13 +1415,16 @@ Java_jd2xx_JD2XX_reload(JNIEnv *env, jobject obj, jint vid, jint pid) {
 
 JNIEXPORT jint JNICALL
 Java_jd2xx_JD2XX_getComPortNumber(JNIEnv *env, jobject obj) {
+	volatile LONG pn = 0;
+#ifdef WIN32
 	FT_STATUS st;
-	jlong hnd = get_handle(env, obj);
-	volatile LONG pn;
+	jlong tok = get_handle(env, obj);
+	FT_HANDLE hnd = acquire_handle(env, tok);
 
-#ifdef WIN32
-	if (!FT_SUCCESS(st = FT_GetComPortNumber((FT_HANDLE)hnd, &pn)))
+	if (hnd == NULL) return 0;
+	if (!FT_SUCCESS(st = FT_GetComPortNumber(hnd, &pn)))
 		io_exception_status(env, st);
+	handle_release(tok);
 #else
 	// Not available outside of Win32.  See FTDI D2XX docs.
 	io_exception_status(env, FT_NOT_SUPPORTED);
@@ -969,11 +1436,14 @@ Java_jd2xx_JD2XX_getComPortNumber(JNIEnv *env, jobject obj) {
 JNIEXPORT jint JNICALL
 Java_jd2xx_JD2XX_eeReadConfig(JNIEnv *env, jobject obj, jint a) {
 	FT_STATUS st;
-	jlong hnd = get_handle(env, obj);
+	jlong tok = get_handle(env, obj);
+	FT_HANDLE hnd = acquire_handle(env, tok);
 	UCHAR c;
 
-	if (!FT_SUCCESS(st = FT_EE_ReadConfig((FT_HANDLE)hnd, (UCHAR)a, &c)))
+	if (hnd == NULL) return 0;
+	if (!FT_SUCCESS(st = FT_EE_ReadConfig(hnd, (UCHAR)a, &c)))
 		io_exception_status(env, st);
+	handle_release(tok);
 
 	return (jint)c;
 }
@@ -981,21 +1451,27 @@ Java_jd2xx_JD2XX_eeReadConfig(JNIEnv *env, jobject obj, jint a) {
 JNIEXPORT void JNICALL
 Java_jd2xx_JD2XX_eeWriteConfig(JNIEnv *env, jobject obj, jint a, jint c) {
 	FT_STATUS st;
-	jlong hnd = get_handle(env, obj);
+	jlong tok = get_handle(env, obj);
+	FT_HANDLE hnd = acquire_handle(env, tok);
 
-	if (!FT_SUCCESS(st = FT_EE_WriteConfig((FT_HANDLE)hnd, (UCHAR)a, (UCHAR)c)))
+	if (hnd == NULL) return;
+	if (!FT_SUCCESS(st = FT_EE_WriteConfig(hnd, (UCHAR)a, (UCHAR)c)))
 		io_exception_status(env, st);
+	handle_release(tok);
 }
 
 JNIEXPORT jint JNICALL
 Java_jd2xx_JD2XX_eeReadEcc(JNIEnv *env, jobject obj, jint opt) {
+	WORD v = 0;
+#ifdef WIN32
 	FT_STATUS st;
-	jlong hnd = get_handle(env, obj);
-	WORD v;
+	jlong tok = get_handle(env, obj);
+	FT_HANDLE hnd = acquire_handle(env, tok);
 
-#ifdef WIN32
-	if (!FT_SUCCESS(st = FT_EE_ReadEcc((FT_HANDLE)hnd, (UCHAR)opt, &v)))
+	if (hnd == NULL) return 0;
+	if (!FT_SUCCESS(st = FT_EE_ReadEcc(hnd, (UCHAR)opt, &v)))
 		io_exception_status(env, st);
+	handle_release(tok);
 #else
 	// Not available outside of Win32.  See FTDI D2XX docs.
 	io_exception_status(env, FT_NOT_SUPPORTED);
@@ -1007,21 +1483,108 @@ Java_jd2xx_JD2XX_eeReadEcc(JNIEnv *env, jobject obj, jint opt) {
 JNIEXPORT jint JNICALL
 Java_jd2xx_JD2XX_getQueueStatusEx(JNIEnv *env, jobject obj) {
 	FT_STATUS st;
-	jlong hnd = get_handle(env, obj);
+	jlong tok = get_handle(env, obj);
+	FT_HANDLE hnd = acquire_handle(env, tok);
 	volatile DWORD r;
 
-	if (!FT_SUCCESS(st = FT_GetQueueStatusEx((FT_HANDLE)hnd, &r)))
+	if (hnd == NULL) return 0;
+	if (!FT_SUCCESS(st = FT_GetQueueStatusEx(hnd, &r)))
 		io_exception_status(env, st);
+	handle_release(tok);
 
 	return (jint)r;
 }
 
 
+/*
+	Chip specific EEPROM structures: Java keeps the FT_EEPROM_xxx structure
+	followed by four string slots in one direct buffer (JD2XXEeprom), which
+	is passed to the driver without field by field marshalling.
+*/
+
+#ifdef FT_DRIVER_TYPE_D2XX // header has FT_EEPROM_Read/FT_EEPROM_Program
+
+/** Size of the FT_EEPROM_xxx structure for a device type, 0 if none */
+static jint
+eeprom_struct_size(FT_DEVICE type) {
+	switch (type) {
+	case FT_DEVICE_BM: return sizeof(FT_EEPROM_232B);
+	case FT_DEVICE_2232C: return sizeof(FT_EEPROM_2232);
+	case FT_DEVICE_232R: return sizeof(FT_EEPROM_232R);
+	case FT_DEVICE_2232H: return sizeof(FT_EEPROM_2232H);
+	case FT_DEVICE_4232H: return sizeof(FT_EEPROM_4232H);
+	case FT_DEVICE_232H: return sizeof(FT_EEPROM_232H);
+	case FT_DEVICE_X_SERIES: return sizeof(FT_EEPROM_X_SERIES);
+	default: return 0;
+	}
+}
+
+/** Read or program EEPROM through a JD2XXEeprom buffer */
+static void
+eeprom_call(JNIEnv *env, jobject obj, jobject bb, jint size, int program) {
+	FT_STATUS st;
+	jlong tok = get_handle(env, obj);
+	FT_HANDLE hnd;
+	char *buf = (bb != 0) ? (*env)->GetDirectBufferAddress(env, bb) : NULL;
+	jlong cap = (bb != 0) ? (*env)->GetDirectBufferCapacity(env, bb) : -1;
+	char str[4][DESCRIPTION_SIZE], *slot[4];
+	jint len, i;
+
+	if (buf == NULL || size <= 0 || cap < size + 4) {
+		throw_new(env, "java/lang/IllegalArgumentException", "direct buffer required");
+		return;
+	}
+	if (eeprom_struct_size(*(FT_DEVICE*)buf) != size) {
+		throw_new(env, "java/lang/IllegalArgumentException", "structure does not match device type");
+		return;
+	}
+
+	len = (jint)((cap - size) / 4);
+	for (i = 0; i < 4; ++i) {
+		slot[i] = buf + size + i * len;
+		slot[i][len - 1] = 0;
+	}
+
+	if ((hnd = acquire_handle(env, tok)) == NULL) return;
+	if (program) st = FT_EEPROM_Program(hnd, buf, size, slot[0], slot[1], slot[2], slot[3]);
+	else {
+		// the driver does not bound strings, so read them into full size buffers
+		st = FT_EEPROM_Read(hnd, buf, size, str[0], str[1], str[2], str[3]);
+		for (i = 0; i < 4 && FT_SUCCESS(st); ++i) {
+			str[i][DESCRIPTION_SIZE - 1] = 0;
+			strncpy(slot[i], str[i], len - 1);
+		}
+	}
+	handle_release(tok);
+
+	if (!FT_SUCCESS(st)) io_exception_status(env, st);
+}
+
+#else
+
+static void
+eeprom_call(JNIEnv *env, jobject obj, jobject bb, jint size, int program) {
+	io_exception_status(env, FT_NOT_SUPPORTED);
+}
+
+#endif
+
+JNIEXPORT void JNICALL
+Java_jd2xx_JD2XX_nativeEepromRead(JNIEnv *env, jobject obj, jobject bb, jint size) {
+	eeprom_call(env, obj, bb, size, 0);
+}
+
+JNIEXPORT void JNICALL
+Java_jd2xx_JD2XX_nativeEepromProgram(JNIEnv *env, jobject obj, jobject bb, jint size) {
+	eeprom_call(env, obj, bb, size, 1);
+}
+
 JNIEXPORT void JNICALL
 Java_jd2xx_JD2XX_eeProgram(JNIEnv *env, jobject obj, jobject pdo) {
 	FT_STATUS st;
 	FT_PROGRAM_DATA fpd;
-	jlong hnd = get_handle(env, obj);
+	jlong tok = get_handle(env, obj);
+	FT_HANDLE hnd;
 
 	jclass pdcls = (*env)->GetObjectClass(env, pdo);
 	jfieldID fid;
@@ -1431,8 +1994,11 @@ Java_jd2xx_JD2XX_eeProgram(JNIEnv *env, jobject obj, jobject pdo) {
 	fpd.PowerSaveEnableH = (UCHAR)(*env)->GetBooleanField(env, pdo, fid) ? 1 : 0;
 
 
-	if (!FT_SUCCESS(st = FT_EE_Program((FT_HANDLE)hnd, &fpd)))
-		io_exception_status(env, st);
+	if ((hnd = acquire_handle(env, tok)) != NULL) {
+		if (!FT_SUCCESS(st = FT_EE_Program(hnd, &fpd)))
+			io_exception_status(env, st);
+		handle_release(tok);
+	}
 
 
 end:
@@ -1453,7 +2019,8 @@ Java_jd2xx_JD2XX_eeRead(JNIEnv *env, jobject obj) {
 	FT_STATUS st;
 	FT_PROGRAM_DATA fpd;
 	jobject result;
-	jlong hnd = get_handle(env, obj);
+	jlong tok = get_handle(env, obj);
+	FT_HANDLE hnd = acquire_handle(env, tok);
 
 	jclass pdcls;
 	jfieldID fid;
@@ -1473,7 +2040,10 @@ Java_jd2xx_JD2XX_eeRead(JNIEnv *env, jobject obj) {
 	fpd.Description = description;
 	fpd.SerialNumber = serialNumber;
 
-	if (!FT_SUCCESS(st = FT_EE_Read((FT_HANDLE)hnd, &fpd))) {
+	if (hnd == NULL) return NULL;
+	st = FT_EE_Read(hnd, &fpd);
+	handle_release(tok);
+	if (!FT_SUCCESS(st)) {
 		io_exception_status(env, st);
 		return NULL;
 	}
@@ -1892,11 +2462,14 @@ panic:
 JNIEXPORT jint JNICALL
 Java_jd2xx_JD2XX_eeUASize(JNIEnv *env, jobject obj) {
 	FT_STATUS st;
-	jlong hnd = get_handle(env, obj);
+	jlong tok = get_handle(env, obj);
+	FT_HANDLE hnd = acquire_handle(env, tok);
 	volatile DWORD siz;
 
-	if (!FT_SUCCESS(st = FT_EE_UASize((FT_HANDLE)hnd, &siz)))
+	if (hnd == NULL) return 0;
+	if (!FT_SUCCESS(st = FT_EE_UASize(hnd, &siz)))
 		io_exception_status(env, st);
+	handle_release(tok);
 
 	return (jint)siz;
 }
@@ -1904,30 +2477,50 @@ Java_jd2xx_JD2XX_eeUASize(JNIEnv *env, jobject obj) {
 JNIEXPORT void JNICALL
 Java_jd2xx_JD2XX_eeUAWrite(JNIEnv *env, jobject obj, jbyteArray arr) {
 	FT_STATUS st;
-	jlong hnd = get_handle(env, obj);
-	int len = (*env)->GetArrayLength(env, arr);
-	jbyte *buf = (*env)->GetByteArrayElements(env, arr, 0);
+	jbyte buf[EE_MAX_WORDS * 2];
+	jlong tok = get_handle(env, obj);
+	FT_HANDLE hnd;
+	jint len;
+
+	if (arr == NULL) {
+		throw_new(env, "java/lang/NullPointerException", NULL);
+		return;
+	}
+	len = (*env)->GetArrayLength(env, arr);
+	if (len > (jint)sizeof(buf)) {
+		throw_new(env, "java/lang/IllegalArgumentException", "larger than user area");
+		return;
+	}
+	(*env)->GetByteArrayRegion(env, arr, 0, len, buf);
 
-	if (!FT_SUCCESS(st = FT_EE_UAWrite((FT_HANDLE)hnd, (PUCHAR)buf, (DWORD)len)))
+	if ((hnd = acquire_handle(env, tok)) == NULL) return;
+	if (!FT_SUCCESS(st = FT_EE_UAWrite(hnd, (PUCHAR)buf, (DWORD)len)))
 		io_exception_status(env, st);
-
-	(*env)->ReleaseByteArrayElements(env, arr, buf, 0);
+	handle_release(tok);
 }
 
 JNIEXPORT jbyteArray JNICALL
 Java_jd2xx_JD2XX_eeUARead(JNIEnv *env, jobject obj, jint len) {
 	FT_STATUS st;
 	jbyteArray result;
-	volatile DWORD ret; // bytes returned
-	jbyte buf[len];
-	jlong hnd = get_handle(env, obj);
+	volatile DWORD ret = 0; // bytes returned
+	jbyte buf[EE_MAX_WORDS * 2];
+	jlong tok = get_handle(env, obj);
+	FT_HANDLE hnd;
 
-	if (!FT_SUCCESS(st =
-		FT_EE_UARead((FT_HANDLE)hnd, (PUCHAR)buf, (DWORD)len, &ret)
-	)) {
+	if (len < 0 || len > (jint)sizeof(buf)) {
+		throw_new(env, "java/lang/IllegalArgumentException", "invalid user area length");
+		return NULL;
+	}
+
+	if ((hnd = acquire_handle(env, tok)) == NULL) return NULL;
+	st = FT_EE_UARead(hnd, (PUCHAR)buf, (DWORD)len, &ret);
+	handle_release(tok);
+	if (!FT_SUCCESS(st)) {
 		io_exception_status(env, st);
 		return NULL;
 	}
+	if (ret > (DWORD)len) ret = len;
 
 	result = (*env)->NewByteArray(env, ret);
 	if (result != 0) (*env)->SetByteArrayRegion(env, result, 0, ret, buf);
@@ -1957,9 +2550,11 @@ Java_jd2xx_JD2XX_registerEvent(
 	JNIEnv *env, jobject obj, jint msk
 ) {
 	FT_STATUS st;
-	jlong hnd = get_handle(env, obj);
+	jlong tok = get_handle(env, obj);
+	FT_HANDLE hnd = acquire_handle(env, tok);
 	HANDLE evh = (HANDLE)get_event(env, obj);
 
+	if (hnd == NULL) return;
 	if (msk != 0) { // new events
 		if (evh == INVALID_HANDLE_VALUE) {
 			evh = CreateEvent(
@@ -1967,13 +2562,16 @@ Java_jd2xx_JD2XX_registerEvent(
 				0, 0, // auto-reset, non-signaled
 				""
 			);
-			if (evh == INVALID_HANDLE_VALUE) return io_exception(env, "invalid event handle");
+			if (evh == INVALID_HANDLE_VALUE) {
+				handle_release(tok);
+				return io_exception(env, "invalid event handle");
+			}
 		}
 
 		if (!FT_SUCCESS(
-			st = FT_SetEventNotification((FT_HANDLE)hnd, (DWORD)msk, (HANDLE)evh)
+			st = FT_SetEventNotification(hnd, (DWORD)msk, (HANDLE)evh)
 		)) {
-			FT_SetEventNotification((FT_HANDLE)hnd, (DWORD)0, (HANDLE)INVALID_HANDLE_VALUE);
+			FT_SetEventNotification(hnd, (DWORD)0, (HANDLE)INVALID_HANDLE_VALUE);
 			CloseHandle(evh);
 			evh = INVALID_HANDLE_VALUE;
 			io_exception_status(env, st);
@@ -1987,7 +2585,7 @@ Java_jd2xx_JD2XX_registerEvent(
 	}
 	else if (evh != INVALID_HANDLE_VALUE) { // no more events
 		st = FT_SetEventNotification(
-			(FT_HANDLE)hnd, (DWORD)0, (HANDLE)INVALID_HANDLE_VALUE
+			hnd, (DWORD)0, (HANDLE)INVALID_HANDLE_VALUE
 		); //!
 		CloseHandle(evh);
 		set_event(env, obj, (jint)INVALID_HANDLE_VALUE);
@@ -1996,6 +2594,7 @@ Java_jd2xx_JD2XX_registerEvent(
 		fprintf(stderr, "JD2XX.registerEvent: %x\n", evh);
 #endif
 	}
+	handle_release(tok);
 }
 
 JNIEXPORT void JNICALL
@@ -2011,7 +2610,8 @@ Java_jd2xx_JD2XX_signalEvent(JNIEnv *env, jobject obj) {
 JNIEXPORT jint JNICALL
 Java_jd2xx_JD2XX_waitEvent(JNIEnv *env, jobject obj) {
 	FT_STATUS st;
-	jlong hnd = get_handle(env, obj), kill = get_kill(env, obj), ret = 0;
+	jlong tok = get_handle(env, obj), kill = get_kill(env, obj), ret = 0;
+	FT_HANDLE hnd;
 	volatile DWORD msk;
 	HANDLE evh = (HANDLE)get_event(env, obj);
 
@@ -2021,9 +2621,10 @@ Java_jd2xx_JD2XX_waitEvent(JNIEnv *env, jobject obj) {
 
 	WaitForSingleObject(evh, INFINITE);
 
-	if (!kill) {
-		if (!FT_SUCCESS(st = FT_GetEventStatus((FT_HANDLE)hnd, &msk)))
+	if (!kill && (hnd = acquire_handle(env, tok)) != NULL) {
+		if (!FT_SUCCESS(st = FT_GetEventStatus(hnd, &msk)))
 			io_exception_status(env, st);
+		handle_release(tok);
 
 		ret = (jint)msk;
 	}
@@ -2043,20 +2644,24 @@ Java_jd2xx_JD2XX_registerEvent(
 		JNIEnv *env, jobject obj, jint msk
 ) {
 	FT_STATUS st;
-	jlong hnd = get_handle(env, obj);
+	jlong tok = get_handle(env, obj);
+	FT_HANDLE hnd = acquire_handle(env, tok);
 
 	EVENT_HANDLE *evh = (EVENT_HANDLE *) get_event(env, obj);
 
+	if (hnd == NULL) return;
 	if (msk != 0) { // new events
 		if (evh == INVALID_HANDLE_VALUE) {
 			evh = (EVENT_HANDLE*) malloc(sizeof(EVENT_HANDLE));
 			pthread_mutex_init(&(evh->eMutex), NULL);
-			if (pthread_cond_init(&(evh->eCondVar), NULL) != 0)
+			if (pthread_cond_init(&(evh->eCondVar), NULL) != 0) {
+				handle_release(tok);
 				return io_exception(env, "invalid event handle");
+			}
 		}
 
-		if (!FT_SUCCESS(st = FT_SetEventNotification((FT_HANDLE)hnd, (DWORD)msk, (HANDLE)evh))) {
-			FT_SetEventNotification((FT_HANDLE)hnd, (DWORD)0, (HANDLE)INVALID_HANDLE_VALUE);
+		if (!FT_SUCCESS(st = FT_SetEventNotification(hnd, (DWORD)msk, (HANDLE)evh))) {
+			FT_SetEventNotification(hnd, (DWORD)0, (HANDLE)INVALID_HANDLE_VALUE);
 			pthread_mutex_destroy(&(evh->eMutex));
 			free(evh);
 			evh = (EVENT_HANDLE *) INVALID_HANDLE_VALUE;
@@ -2069,7 +2674,7 @@ Java_jd2xx_JD2XX_registerEvent(
 		fprintf(stderr, "JD2XX.registerEvent: %x\n", evh);
 #endif
 	} else if (evh != INVALID_HANDLE_VALUE) { // no more events
-		st = FT_SetEventNotification((FT_HANDLE)hnd, (DWORD)0, (HANDLE)INVALID_HANDLE_VALUE); //!
+		st = FT_SetEventNotification(hnd, (DWORD)0, (HANDLE)INVALID_HANDLE_VALUE); //!
 		pthread_mutex_destroy(&(evh->eMutex));
 		set_event(env, obj, (jint)INVALID_HANDLE_VALUE);
 		free(evh);
@@ -2079,6 +2684,7 @@ Java_jd2xx_JD2XX_registerEvent(
 		fprintf(stderr, "JD2XX.registerEvent: %x\n", evh);
 #endif
 	}
+	handle_release(tok);
 }
 
 JNIEXPORT void JNICALL
@@ -2095,7 +2701,8 @@ Java_jd2xx_JD2XX_signalEvent(JNIEnv *env, jobject obj) {
 JNIEXPORT jint JNICALL
 Java_jd2xx_JD2XX_waitEvent(JNIEnv *env, jobject obj) {
 	FT_STATUS st;
-	jlong hnd = get_handle(env, obj), kill = get_kill(env, obj), ret = 0;
+	jlong tok = get_handle(env, obj), kill = get_kill(env, obj), ret = 0;
+	FT_HANDLE hnd;
 	volatile DWORD msk;
 
 	EVENT_HANDLE* evh = (EVENT_HANDLE*) get_event(env, obj);
@@ -2108,9 +2715,10 @@ Java_jd2xx_JD2XX_waitEvent(JNIEnv *env, jobject obj) {
 	pthread_cond_wait(&(evh->eCondVar), &(evh->eMutex));
 	pthread_mutex_unlock(&(evh->eMutex));
 
-	if (!kill) {
-		if (!FT_SUCCESS(st = FT_GetEventStatus((FT_HANDLE)hnd, &msk)))
+	if (!kill && (hnd = acquire_handle(env, tok)) != NULL) {
+		if (!FT_SUCCESS(st = FT_GetEventStatus(hnd, &msk)))
 			io_exception_status(env, st);
+		handle_release(tok);
 
 		ret = (jint)msk;
 	}
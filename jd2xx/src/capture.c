@@ -0,0 +1,424 @@
+/*
+	Copyright (c) 2004 Pablo Bleyer Kocik.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	1. Redistributions of source code must retain the above copyright notice, this
+	list of conditions and the following disclaimer.
+
+	2. Redistributions in binary form must reproduce the above copyright notice,
+	this list of conditions and the following disclaimer in the documentation
+	and/or other materials provided with the distribution.
+
+	3. The name of the author may not be used to endorse or promote products
+	derived from this software without specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR IMPLIED
+	WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+	MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+	EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+	SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+	PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+	BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+	IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+	Capture of device traffic
+
+	startCapture attaches a capture to the handle table slot of a device.
+	The I/O paths (read, write and modem status calls, the frame decoder,
+	the timestamped receiver and the Modbus master) pass every transfer to
+	capture_io, which copies it into a memory ring under a short lock and
+	never waits: when the ring is full the record is dropped and counted.
+	A writer thread moves records from the ring into the capture file.
+	The file is mapped one segment at a time and the segment after the
+	current one is allocated ahead, so neither file growth nor page
+	faults on new blocks happen in the I/O path.
+
+	File format (byte order of the host, little-endian on all supported
+	platforms), read back by JD2XXReplay:
+
+	header, CAPTURE_HEADER bytes: "JD2XXCAP", version (4), segment size (4),
+		start time on the monotonic clock (8), start time in Unix ns (8)
+	segments of segment size bytes, each beginning with: magic (4), number
+		of records (4), bytes used including this header (4), reserved (4),
+		first and last record time (8 + 8)
+	records, 8-byte aligned: time on the monotonic clock (8), data length
+		(4), type (4), data
+
+	Records never cross a segment, so segment i is at CAPTURE_HEADER + i *
+	segment size and a time can be looked up by bisecting the segment
+	headers. A segment header is updated after every record it receives,
+	so a capture cut short by a crash is readable up to its last record.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#ifndef WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#include "jd2xx.h"
+#include "jd2xx_JD2XX.h"
+
+#define CAPTURE_HEADER 4096
+#define SEGMENT_HEADER 32
+#define SEGMENT_MAGIC 0x4745534a // "JSEG"
+#define RECORD_HEADER 16
+
+struct capture {
+	mutex_t ctl; // serializes start and stop
+
+	mutex_t lock; // guards everything below
+	cond_t cond;
+	volatile int active;
+	unsigned char *ring;
+	size_t size, max; // ring size, longest record data
+	unsigned long long head, tail; // bytes put, bytes written to the file
+	jlong modem; // last modem status recorded
+	jlong records, bytes, dropped, written;
+	int error; // errno of a failed file operation
+	thread_t writer;
+
+#ifndef WIN32
+	// file state, writer thread only
+	int fd;
+	size_t seg_size;
+	unsigned long long seg; // current segment
+	unsigned char *map; // current segment mapping
+	size_t pos; // end of the records in the segment
+#endif
+};
+
+/** Copy into the ring at a running offset, wrapping around */
+static void
+ring_put(capture_t *c, unsigned long long at, const void *p, size_t n) {
+	size_t off = (size_t)(at % c->size), k = c->size - off;
+
+	if (k > n) k = n;
+	memcpy(c->ring + off, p, k);
+	memcpy(c->ring, (const unsigned char*)p + k, n - k);
+}
+
+/** Copy out of the ring at a running offset, wrapping around */
+static void
+ring_get(capture_t *c, unsigned long long at, void *p, size_t n) {
+	size_t off = (size_t)(at % c->size), k = c->size - off;
+
+	if (k > n) k = n;
+	memcpy(p, c->ring + off, k);
+	memcpy((unsigned char*)p + k, c->ring, n - k);
+}
+
+void
+capture_put(capture_t *c, int type, const void *p, size_t n) {
+	unsigned long long ts;
+	const unsigned char *s = (const unsigned char*)p;
+	unsigned char h[RECORD_HEADER];
+	jint len, t = type;
+	size_t k;
+
+	if (!c->active) return; // checked again under the lock
+	ts = monotonic_ns();
+	mutex_lock(&c->lock);
+	if (c->active && type == CAPTURE_MODEM_STATUS && n == sizeof(jint)) {
+		memcpy(&len, p, sizeof(len));
+		if (len == c->modem) n = 0; // not a change
+		else c->modem = len;
+	}
+	while (c->active && n > 0) { // transfers longer than a segment are split
+		k = n < c->max ? n : c->max;
+		if (c->size - (size_t)(c->head - c->tail) < RECORD_HEADER + k) {
+			c->dropped++;
+			break;
+		}
+		len = (jint)k;
+		memcpy(h, &ts, 8);
+		memcpy(h + 8, &len, 4);
+		memcpy(h + 12, &t, 4);
+		ring_put(c, c->head, h, RECORD_HEADER);
+		ring_put(c, c->head + RECORD_HEADER, s, k);
+		c->head += RECORD_HEADER + k;
+		c->records++;
+		c->bytes += k;
+		s += k;
+		n -= k;
+		if (c->head - c->tail > c->size / 2) cond_signal(&c->cond); // writer sleeps otherwise
+	}
+	mutex_unlock(&c->lock);
+}
+
+void
+capture_io(jlong tok, int type, const void *p, size_t n) {
+	capture_t *c = handle_capture(tok);
+
+	if (type == CAPTURE_READ) handle_count_read(tok, n);
+	if (c != NULL && n > 0) capture_put(c, type, p, n);
+}
+
+#ifndef WIN32
+
+/** Allocate segment i of the file */
+static int
+file_allocate(capture_t *c, unsigned long long i) {
+	off_t end = (off_t)(CAPTURE_HEADER + (i + 1) * c->seg_size);
+#if defined(__APPLE__)
+	return ftruncate(c->fd, end) == 0 ? 0 : errno;
+#else
+	return posix_fallocate(c->fd, end - (off_t)c->seg_size, (off_t)c->seg_size);
+#endif
+}
+
+/** Map segment i, allocated already, and allocate the one after it */
+static int
+file_map(capture_t *c, unsigned long long i) {
+	void *m = mmap(NULL, c->seg_size, PROT_READ | PROT_WRITE, MAP_SHARED, c->fd,
+		(off_t)(CAPTURE_HEADER + i * c->seg_size));
+	jint magic = SEGMENT_MAGIC;
+
+	if (m == MAP_FAILED) return errno;
+	if (c->map != NULL) munmap(c->map, c->seg_size);
+	c->map = (unsigned char*)m;
+	c->seg = i;
+	c->pos = SEGMENT_HEADER;
+	memset(c->map, 0, SEGMENT_HEADER);
+	memcpy(c->map, &magic, 4);
+	return file_allocate(c, i + 1);
+}
+
+/** Append a record taken from the ring to the current segment */
+static int
+file_append(capture_t *c, const unsigned char *h, unsigned long long at, size_t n) {
+	size_t need = (RECORD_HEADER + n + 7) & ~(size_t)7;
+	jint records, used;
+	int e;
+
+	if (c->pos + need > c->seg_size && (e = file_map(c, c->seg + 1)) != 0) return e;
+
+	memcpy(c->map + c->pos, h, RECORD_HEADER);
+	ring_get(c, at, c->map + c->pos + RECORD_HEADER, n);
+	c->pos += need;
+
+	// segment header last, so it never covers a partial record
+	memcpy(&records, c->map + 4, 4);
+	if (records++ == 0) memcpy(c->map + 16, h, 8);
+	memcpy(c->map + 24, h, 8);
+	used = (jint)c->pos;
+	memcpy(c->map + 8, &used, 4);
+	memcpy(c->map + 4, &records, 4);
+	return 0;
+}
+
+static void
+capture_writer(void *arg) {
+	capture_t *c = (capture_t*)arg;
+	unsigned long long head, tail;
+	unsigned char h[RECORD_HEADER];
+	jint len;
+	int e = 0;
+
+	mutex_lock(&c->lock);
+	for (;;) {
+		while (c->head == c->tail && c->active)
+			cond_timedwait_ms(&c->cond, &c->lock, 50);
+		if (c->head == c->tail) break; // stopped and drained
+		head = c->head;
+		tail = c->tail;
+		mutex_unlock(&c->lock);
+
+		// records between tail and head are ours until tail moves
+		while (tail < head) {
+			ring_get(c, tail, h, RECORD_HEADER);
+			memcpy(&len, h + 8, 4);
+			if (e == 0) e = file_append(c, h, tail + RECORD_HEADER, (size_t)len);
+			tail += RECORD_HEADER + len;
+		}
+
+		mutex_lock(&c->lock);
+		if (e != 0 && c->error == 0) c->error = e;
+		c->written = (jlong)(CAPTURE_HEADER + c->seg * c->seg_size + c->pos);
+		c->tail = tail;
+	}
+	mutex_unlock(&c->lock);
+
+	// drop the allocated but unused space after the last record
+	if (c->map != NULL) {
+		munmap(c->map, c->seg_size);
+		c->map = NULL;
+	}
+	if (ftruncate(c->fd, (off_t)(CAPTURE_HEADER + c->seg * c->seg_size + c->pos)) != 0 && c->error == 0)
+		c->error = errno;
+	close(c->fd);
+	c->fd = -1;
+}
+
+/** Create the capture file and start the writer (ctl held) */
+static int
+capture_start(capture_t *c, const char *path, size_t seg_size, size_t size) {
+	unsigned char hdr[CAPTURE_HEADER];
+	unsigned long long t;
+	struct timespec now;
+	jint v;
+	int e;
+
+	if (c->ring == NULL || c->size != size) {
+		free(c->ring);
+		if ((c->ring = (unsigned char*)malloc(size)) == NULL) {
+			c->size = 0;
+			return ENOMEM;
+		}
+		c->size = size;
+	}
+	c->head = c->tail = 0;
+	c->records = c->bytes = c->dropped = c->written = 0;
+	c->modem = -1;
+	c->error = 0;
+	c->seg_size = seg_size;
+	c->max = seg_size - SEGMENT_HEADER - RECORD_HEADER;
+	if (c->max > size / 4) c->max = size / 4;
+
+	if ((c->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644)) < 0) return errno;
+	memset(hdr, 0, sizeof(hdr));
+	memcpy(hdr, "JD2XXCAP", 8);
+	v = 1;
+	memcpy(hdr + 8, &v, 4);
+	v = (jint)seg_size;
+	memcpy(hdr + 12, &v, 4);
+	t = monotonic_ns();
+	memcpy(hdr + 16, &t, 8);
+	clock_gettime(CLOCK_REALTIME, &now);
+	t = (unsigned long long)now.tv_sec * 1000000000ULL + now.tv_nsec;
+	memcpy(hdr + 24, &t, 8);
+
+	c->map = NULL;
+	if (write(c->fd, hdr, sizeof(hdr)) != sizeof(hdr)) e = errno;
+	else if ((e = file_allocate(c, 0)) == 0) e = file_map(c, 0);
+	if (e == 0) {
+		c->active = 1;
+		if (thread_start(&c->writer, capture_writer, c) != 0) {
+			c->active = 0;
+			e = ENOMEM;
+		}
+	}
+	if (e != 0) {
+		if (c->map != NULL) munmap(c->map, c->seg_size);
+		c->map = NULL;
+		close(c->fd);
+		c->fd = -1;
+	}
+	return e;
+}
+
+#endif // WIN32
+
+/** Stop recording and finish the file (ctl held) */
+static void
+capture_stop(capture_t *c) {
+	int was;
+
+	mutex_lock(&c->lock);
+	was = c->active;
+	c->active = 0;
+	cond_signal(&c->cond);
+	mutex_unlock(&c->lock);
+	if (was) thread_join(c->writer);
+}
+
+void
+capture_free(capture_t *c) {
+	capture_stop(c);
+	cond_destroy(&c->cond);
+	mutex_destroy(&c->lock);
+	mutex_destroy(&c->ctl);
+	free(c->ring);
+	free(c);
+}
+
+JNIEXPORT void JNICALL
+Java_jd2xx_JD2XX_startCapture(JNIEnv *env, jobject obj, jstring path, jint segment, jint buffer) {
+#ifdef WIN32
+	throw_new(env, "java/lang/UnsupportedOperationException", "capture needs mmap");
+#else
+	jlong tok = get_handle(env, obj);
+	const char *p;
+	capture_t *c, *n;
+	int e;
+
+	if (segment < 65536 || segment % 4096 != 0 || buffer < 65536) {
+		throw_new(env, "java/lang/IllegalArgumentException", "capture segment or buffer size");
+		return;
+	}
+	if (acquire_handle(env, tok) == NULL) return;
+
+	if ((c = handle_capture(tok)) == NULL) {
+		if ((n = (capture_t*)calloc(1, sizeof(capture_t))) == NULL) {
+			handle_release(tok);
+			io_exception_status(env, FT_INSUFFICIENT_RESOURCES);
+			return;
+		}
+		mutex_init(&n->ctl);
+		mutex_init(&n->lock);
+		cond_init(&n->cond);
+		n->fd = -1;
+		if ((c = handle_set_capture(tok, n)) != n) capture_free(n); // lost a race
+	}
+
+	if ((p = (*env)->GetStringUTFChars(env, path, NULL)) != NULL) {
+		mutex_lock(&c->ctl);
+		capture_stop(c);
+		e = capture_start(c, p, (size_t)segment, (size_t)buffer);
+		mutex_unlock(&c->ctl);
+		(*env)->ReleaseStringUTFChars(env, path, p);
+		if (e != 0) io_exception(env, strerror(e));
+	}
+	handle_release(tok);
+#endif
+}
+
+JNIEXPORT void JNICALL
+Java_jd2xx_JD2XX_stopCapture(JNIEnv *env, jobject obj) {
+	jlong tok = get_handle(env, obj);
+	capture_t *c;
+	int e = 0;
+
+	if (acquire_handle(env, tok) == NULL) return;
+	if ((c = handle_capture(tok)) != NULL) {
+		mutex_lock(&c->ctl);
+		capture_stop(c);
+		e = c->error;
+		mutex_unlock(&c->ctl);
+	}
+	handle_release(tok);
+	if (e != 0) io_exception(env, strerror(e));
+}
+
+JNIEXPORT jlongArray JNICALL
+Java_jd2xx_JD2XX_getCaptureStatistics(JNIEnv *env, jobject obj) {
+	jlong tok = get_handle(env, obj);
+	jlong s[4] = { 0, 0, 0, 0 };
+	jlongArray arr;
+	capture_t *c;
+
+	if (acquire_handle(env, tok) == NULL) return NULL;
+	if ((c = handle_capture(tok)) != NULL) {
+		mutex_lock(&c->lock);
+		s[0] = c->records;
+		s[1] = c->bytes;
+		s[2] = c->dropped;
+		s[3] = c->written;
+		mutex_unlock(&c->lock);
+	}
+	handle_release(tok);
+
+	if ((arr = (*env)->NewLongArray(env, 4)) != NULL)
+		(*env)->SetLongArrayRegion(env, arr, 0, 4, s);
+	return arr;
+}
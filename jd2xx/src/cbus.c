@@ -0,0 +1,320 @@
+/*
+	Copyright (c) 2004 Pablo Bleyer Kocik.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	1. Redistributions of source code must retain the above copyright notice, this
+	list of conditions and the following disclaimer.
+
+	2. Redistributions in binary form must reproduce the above copyright notice,
+	this list of conditions and the following disclaimer in the documentation
+	and/or other materials provided with the distribution.
+
+	3. The name of the author may not be used to endorse or promote products
+	derived from this software without specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR IMPLIED
+	WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+	MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+	EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+	SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+	PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+	BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+	IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+	CBUS bit-bang
+
+	FT232R/FT-X CBUS pins are driven with FT_SetBitMode(dir << 4 | value,
+	CBUS_BITBANG), one control transfer per call. The output value and the
+	direction nibble are kept here as shadow state; with a coalescing window
+	set, changes only mark the state dirty and a flusher thread sends the
+	latest state once the window has elapsed, so a burst of pin changes
+	costs one transfer. Errors of deferred sends are thrown by the next call.
+*/
+
+#include <stdlib.h>
+
+#include "jd2xx.h"
+#include "jd2xx_JD2XXCbus.h"
+
+/** CBUS state, one per JD2XXCbus object */
+typedef struct {
+	jlong tok; // JD2XX handle token
+
+	mutex_t io; // serializes FT_SetBitMode calls, guards sent
+	int sent; // last mode byte sent, -1 if unknown
+
+	mutex_t lock; // guards everything below
+	cond_t cond;
+	unsigned char value, dir; // shadow outputs and direction (1 = output)
+	int dirty;
+	unsigned long long window, due; // coalescing window, pending send time (ns)
+	thread_t flusher;
+	int running; // flusher thread started
+	FT_STATUS error; // failure of a deferred send
+	jlong transfers; // FT_SetBitMode calls made
+} cbus_t;
+
+/** Send shadow state if it differs from what the device has */
+static FT_STATUS
+cbus_flush(cbus_t *c) {
+	FT_STATUS st = FT_OK;
+	FT_HANDLE h;
+	int mode;
+
+	mutex_lock(&c->io);
+	mutex_lock(&c->lock);
+	mode = (c->dir << 4) | (c->value & c->dir);
+	c->dirty = 0;
+	mutex_unlock(&c->lock);
+
+	if (mode != c->sent) {
+		if ((h = handle_acquire(c->tok)) == NULL) st = FT_INVALID_HANDLE;
+		else {
+			st = FT_SetBitMode(h, (UCHAR)mode, FT_BITMODE_CBUS_BITBANG);
+			config_forget(c->tok, CONFIG_BIT_MASK, 2);
+			handle_release(c->tok);
+
+			mutex_lock(&c->lock);
+			c->transfers++;
+			mutex_unlock(&c->lock);
+		}
+		c->sent = FT_SUCCESS(st) ? mode : -1;
+	}
+	mutex_unlock(&c->io);
+	return st;
+}
+
+/** Flusher thread: sends dirty state when its window has elapsed */
+static void
+cbus_flusher(void *arg) {
+	cbus_t *c = (cbus_t*)arg;
+	unsigned long long due;
+	FT_STATUS st;
+
+	mutex_lock(&c->lock);
+	while (c->running) {
+		if (!c->dirty) {
+			cond_wait(&c->cond, &c->lock);
+			continue;
+		}
+		due = c->due;
+		mutex_unlock(&c->lock);
+
+		sleep_until_ns(due);
+		st = cbus_flush(c);
+
+		mutex_lock(&c->lock);
+		if (!FT_SUCCESS(st) && FT_SUCCESS(c->error)) c->error = st;
+	}
+	mutex_unlock(&c->lock);
+}
+
+/** Stop and join the flusher thread */
+static void
+cbus_stop(cbus_t *c) {
+	int running;
+
+	mutex_lock(&c->lock);
+	running = c->running;
+	c->running = 0;
+	cond_broadcast(&c->cond);
+	mutex_unlock(&c->lock);
+
+	if (running) thread_join(c->flusher);
+}
+
+/** Throw a pending deferred error
+	@return 0 if an exception was thrown
+*/
+static int
+cbus_check(JNIEnv *env, cbus_t *c) {
+	FT_STATUS st;
+
+	if (c == NULL) {
+		io_exception(env, "cbus closed");
+		return 0;
+	}
+
+	mutex_lock(&c->lock);
+	st = c->error;
+	c->error = FT_OK;
+	mutex_unlock(&c->lock);
+
+	if (!FT_SUCCESS(st)) io_exception_status(env, st);
+	return FT_SUCCESS(st);
+}
+
+/** Change shadow state, send now or within the window
+	@param vmask outputs to change
+	@param dmask directions to change
+*/
+static void
+cbus_update(JNIEnv *env, cbus_t *c, jint vmask, jint value, jint dmask, jint outputs) {
+	FT_STATUS st;
+	int now;
+
+	if (!cbus_check(env, c)) return;
+
+	mutex_lock(&c->lock);
+	c->value = ((c->value & ~vmask) | (value & vmask)) & 0x0f;
+	c->dir = ((c->dir & ~dmask) | (outputs & dmask)) & 0x0f;
+	now = !c->running;
+	if (!now && !c->dirty) {
+		// first change opens the window, later ones ride along
+		c->dirty = 1;
+		c->due = monotonic_ns() + c->window;
+		cond_signal(&c->cond);
+	}
+	mutex_unlock(&c->lock);
+
+	if (now && !FT_SUCCESS(st = cbus_flush(c))) io_exception_status(env, st);
+}
+
+JNIEXPORT jlong JNICALL
+Java_jd2xx_JD2XXCbus_nativeOpen(JNIEnv *env, jclass cls, jobject jd) {
+	jlong tok = get_handle(env, jd);
+	FT_HANDLE h = acquire_handle(env, tok);
+	FT_STATUS st;
+	cbus_t *c;
+
+	if (h == NULL) return 0;
+	st = FT_SetBitMode(h, 0, FT_BITMODE_CBUS_BITBANG); // all pins inputs
+	config_forget(tok, CONFIG_BIT_MASK, 2);
+	handle_release(tok);
+
+	if (!FT_SUCCESS(st)) {
+		io_exception_status(env, st);
+		return 0;
+	}
+	if ((c = (cbus_t*)calloc(1, sizeof(cbus_t))) == NULL) {
+		io_exception_status(env, FT_INSUFFICIENT_RESOURCES);
+		return 0;
+	}
+
+	c->tok = tok;
+	c->sent = 0;
+	mutex_init(&c->io);
+	mutex_init(&c->lock);
+	cond_init(&c->cond);
+	return (jlong)(size_t)c;
+}
+
+JNIEXPORT void JNICALL
+Java_jd2xx_JD2XXCbus_dispose(JNIEnv *env, jclass cls, jlong ptr) {
+	cbus_t *c = (cbus_t*)(size_t)ptr;
+	FT_HANDLE h;
+
+	if (c == NULL) return;
+	cbus_stop(c);
+
+	if ((h = handle_acquire(c->tok)) != NULL) {
+		FT_SetBitMode(h, 0, FT_BITMODE_RESET);
+		config_forget(c->tok, CONFIG_BIT_MASK, 2);
+		handle_release(c->tok);
+	}
+
+	cond_destroy(&c->cond);
+	mutex_destroy(&c->lock);
+	mutex_destroy(&c->io);
+	free(c);
+}
+
+JNIEXPORT void JNICALL
+Java_jd2xx_JD2XXCbus_nativeSet(JNIEnv *env, jclass cls, jlong ptr, jint mask, jint value) {
+	cbus_update(env, (cbus_t*)(size_t)ptr, mask, value, 0, 0);
+}
+
+JNIEXPORT void JNICALL
+Java_jd2xx_JD2XXCbus_nativeSetDirection(JNIEnv *env, jclass cls, jlong ptr, jint mask, jint outputs) {
+	cbus_update(env, (cbus_t*)(size_t)ptr, 0, 0, mask, outputs);
+}
+
+JNIEXPORT void JNICALL
+Java_jd2xx_JD2XXCbus_nativeFlush(JNIEnv *env, jclass cls, jlong ptr) {
+	cbus_t *c = (cbus_t*)(size_t)ptr;
+	FT_STATUS st;
+
+	if (!cbus_check(env, c)) return;
+	if (!FT_SUCCESS(st = cbus_flush(c))) io_exception_status(env, st);
+}
+
+JNIEXPORT jint JNICALL
+Java_jd2xx_JD2XXCbus_nativeGet(JNIEnv *env, jclass cls, jlong ptr) {
+	cbus_t *c = (cbus_t*)(size_t)ptr;
+	FT_STATUS st;
+	FT_HANDLE h;
+	UCHAR pins = 0;
+
+	if (!cbus_check(env, c)) return 0;
+	if (!FT_SUCCESS(st = cbus_flush(c))) {
+		io_exception_status(env, st);
+		return 0;
+	}
+
+	if ((h = acquire_handle(env, c->tok)) == NULL) return 0;
+	if (!FT_SUCCESS(st = FT_GetBitMode(h, &pins)))
+		io_exception_status(env, st);
+	handle_release(c->tok);
+
+	return pins & 0x0f;
+}
+
+JNIEXPORT jint JNICALL
+Java_jd2xx_JD2XXCbus_nativeGetOutput(JNIEnv *env, jclass cls, jlong ptr, jboolean dir) {
+	cbus_t *c = (cbus_t*)(size_t)ptr;
+	jint r;
+
+	if (c == NULL) {
+		io_exception(env, "cbus closed");
+		return 0;
+	}
+	mutex_lock(&c->lock);
+	r = dir ? c->dir : c->value;
+	mutex_unlock(&c->lock);
+	return r;
+}
+
+JNIEXPORT void JNICALL
+Java_jd2xx_JD2XXCbus_nativeSetWindow(JNIEnv *env, jclass cls, jlong ptr, jint micros) {
+	cbus_t *c = (cbus_t*)(size_t)ptr;
+	FT_STATUS st;
+	int start;
+
+	if (!cbus_check(env, c)) return;
+	if (micros < 0) {
+		throw_new(env, "java/lang/IllegalArgumentException", "window must not be negative");
+		return;
+	}
+
+	mutex_lock(&c->lock);
+	c->window = (unsigned long long)micros * 1000;
+	start = (micros > 0 && !c->running);
+	if (start) c->running = (thread_start(&c->flusher, cbus_flusher, c) == 0);
+	mutex_unlock(&c->lock);
+
+	if (start && !c->running) io_exception_status(env, FT_INSUFFICIENT_RESOURCES);
+	else if (micros == 0) {
+		// synchronous again: send whatever was still waiting
+		cbus_stop(c);
+		if (!FT_SUCCESS(st = cbus_flush(c))) io_exception_status(env, st);
+	}
+}
+
+JNIEXPORT jlong JNICALL
+Java_jd2xx_JD2XXCbus_nativeGetTransfers(JNIEnv *env, jclass cls, jlong ptr) {
+	cbus_t *c = (cbus_t*)(size_t)ptr;
+	jlong r = 0;
+
+	if (c != NULL) {
+		mutex_lock(&c->lock);
+		r = c->transfers;
+		mutex_unlock(&c->lock);
+	}
+	return r;
+}
@@ -0,0 +1,305 @@
+/*
+	Copyright (c) 2004 Pablo Bleyer Kocik.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	1. Redistributions of source code must retain the above copyright notice, this
+	list of conditions and the following disclaimer.
+
+	2. Redistributions in binary form must reproduce the above copyright notice,
+	this list of conditions and the following disclaimer in the documentation
+	and/or other materials provided with the distribution.
+
+	3. The name of the author may not be used to endorse or promote products
+	derived from this software without specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR IMPLIED
+	WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+	MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+	EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+	SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+	PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+	BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+	IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+	Device configuration
+
+	JD2XX.DeviceConfig travels to native code as one int array (layout in
+	jd2xx.h), so configure is a single JNI call that reads the handle once.
+	config_apply walks the settings one driver call at a time, in the order
+	a device is usually brought up: baud rate, data characteristics, flow
+	control, timeouts, latency timer, USB transfer sizes, special
+	characters, bit mode. A call is made if the configuration sets any of
+	its settings; the others of the same call keep their last applied
+	values, or take the values the driver has after open if those are not
+	known.
+
+	The handle table keeps the last applied array of every device, and a
+	call whose values all match it is skipped, so switching between two
+	configurations that differ in one setting costs one driver call. The
+	set calls of JD2XX store what they applied with config_record, so a
+	configure that changes one setting of a call keeps the others as set
+	(setTimeouts(500, 1000) then readTimeout 100 gives FT_SetTimeouts(100,
+	1000)). Only what cannot be known is marked unknown with
+	config_forget: a failed call, setDivisor, a reset or port cycle, and
+	the mode changes of the GPIO and CBUS helpers. Configure calls on one
+	device from several threads at once are not ordered.
+
+	openAll opens a list of devices by serial number with a small set of
+	worker threads taking devices from a shared counter; the calling thread
+	is one of them, so the batch completes even if no thread can be
+	started. FT_OpenEx spends most of its time waiting on USB control
+	transfers, so the opens overlap and bringing up a rig of devices takes
+	about as long as its slowest device instead of the sum of all of them.
+	A worker registers the handle only once the device is configured; a
+	device that fails to open or configure is closed and its error
+	reported, and does not affect the others. Nothing touches Java from
+	the workers: results go back to the caller's arrays after the join.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "jd2xx.h"
+#include "jd2xx_JD2XX.h"
+
+#define OPEN_WORKERS 32 // devices opened at the same time
+
+/** Settings made by one driver call */
+typedef struct {
+	const char *step; // JD2XX method making the same call
+	int first, n; // CONFIG_xxx range
+	jint defaults[4]; // values after open, for the settings left unset
+} config_call;
+
+static const config_call calls[] = {
+	{ "setBaudRate", CONFIG_BAUD_RATE, 1, { 9600 } },
+	{ "setDataCharacteristics", CONFIG_WORD_LENGTH, 3,
+		{ FT_BITS_8, FT_STOP_BITS_1, FT_PARITY_NONE } },
+	{ "setFlowControl", CONFIG_FLOW_CONTROL, 3, { FT_FLOW_NONE, 0x11, 0x13 } },
+	{ "setTimeouts", CONFIG_READ_TIMEOUT, 2, { 0, 0 } },
+	{ "setLatencyTimer", CONFIG_LATENCY_TIMER, 1, { 16 } },
+	{ "setUSBParameters", CONFIG_IN_TRANSFER_SIZE, 2, { 4096, 4096 } },
+	{ "setChars", CONFIG_EVENT_CHAR, 4, { 0, 0, 0, 0 } },
+	{ "setBitMode", CONFIG_BIT_MASK, 2, { 0, FT_BITMODE_RESET } }
+};
+
+static FT_STATUS
+config_call_driver(FT_HANDLE h, int first, const jint *v) {
+	switch (first) {
+	case CONFIG_BAUD_RATE:
+		return FT_SetBaudRate(h, (ULONG)v[0]);
+	case CONFIG_WORD_LENGTH:
+		return FT_SetDataCharacteristics(h, (UCHAR)v[0], (UCHAR)v[1], (UCHAR)v[2]);
+	case CONFIG_FLOW_CONTROL:
+		return FT_SetFlowControl(h, (USHORT)v[0], (UCHAR)v[1], (UCHAR)v[2]);
+	case CONFIG_READ_TIMEOUT:
+		return FT_SetTimeouts(h, (ULONG)v[0], (ULONG)v[1]);
+	case CONFIG_LATENCY_TIMER:
+		return FT_SetLatencyTimer(h, (UCHAR)v[0]);
+	case CONFIG_IN_TRANSFER_SIZE:
+		return FT_SetUSBParameters(h, (ULONG)v[0], (ULONG)v[1]);
+	case CONFIG_EVENT_CHAR:
+		return FT_SetChars(h, (UCHAR)v[0], (UCHAR)v[1], (UCHAR)v[2], (UCHAR)v[3]);
+	case CONFIG_BIT_MASK:
+		return FT_SetBitMode(h, (UCHAR)v[0], (UCHAR)v[1]);
+	}
+	return FT_INVALID_ARGS;
+}
+
+FT_STATUS
+config_apply(FT_HANDLE h, const jint *cfg, jint *last, const char **step, int *made) {
+	FT_STATUS st;
+	int c, i;
+
+	for (c = 0; c < (int)(sizeof(calls) / sizeof(calls[0])); ++c) {
+		const config_call *k = &calls[c];
+		jint v[4];
+		int set = 0, same = 1;
+
+		for (i = 0; i < k->n; ++i) {
+			v[i] = cfg[k->first + i];
+			if (v[i] != CONFIG_UNSET) set = 1;
+			else if ((v[i] = last[k->first + i]) == CONFIG_UNSET) v[i] = k->defaults[i];
+			if (v[i] != last[k->first + i]) same = 0;
+		}
+		if (!set || same) continue;
+
+		*step = k->step;
+		st = config_call_driver(h, k->first, v);
+		if (made != NULL) ++*made;
+		for (i = 0; i < k->n; ++i)
+			last[k->first + i] = FT_SUCCESS(st) ? v[i] : CONFIG_UNSET;
+		if (!FT_SUCCESS(st)) return st;
+	}
+	return FT_OK;
+}
+
+/** Describe a failed call as "step: status" */
+static char*
+config_error(char *msg, const char *step, FT_STATUS st) {
+	strcpy(msg, step);
+	strcat(msg, ": ");
+	format_status(msg + strlen(msg), st);
+	return msg;
+}
+
+void
+config_forget(jlong tok, int first, int n) {
+	jint *last = handle_config(tok);
+
+	if (last != NULL)
+		while (n-- > 0) last[first++] = CONFIG_UNSET;
+}
+
+void
+config_record(jlong tok, FT_STATUS st, int first, int n, const jint *v) {
+	jint *last = handle_config(tok);
+
+	if (last != NULL)
+		while (n-- > 0) last[first++] = FT_SUCCESS(st) ? *v++ : CONFIG_UNSET;
+}
+
+/** Apply a configuration to an open device
+	@return number of driver calls made
+*/
+JNIEXPORT jint JNICALL
+Java_jd2xx_JD2XX_nativeConfigure(JNIEnv *env, jobject obj, jintArray config) {
+	jint cfg[CONFIG_SIZE];
+	const char *step = NULL;
+	int made = 0;
+	jlong tok;
+	FT_HANDLE h;
+	FT_STATUS st;
+
+	if ((*env)->GetArrayLength(env, config) != CONFIG_SIZE) {
+		throw_new(env, "java/lang/IllegalArgumentException", "configuration array");
+		return 0;
+	}
+	(*env)->GetIntArrayRegion(env, config, 0, CONFIG_SIZE, cfg);
+
+	tok = get_handle(env, obj);
+	if ((h = acquire_handle(env, tok)) == NULL) return 0;
+	st = config_apply(h, cfg, handle_config(tok), &step, &made);
+	handle_release(tok);
+
+	if (!FT_SUCCESS(st)) {
+		char msg[96];
+		io_exception(env, config_error(msg, step, st));
+	}
+	return made;
+}
+
+/** One device of an openAll batch */
+typedef struct {
+	char *serial;
+	jlong tok; // handle table token, INVALID_HANDLE_VALUE on failure
+	FT_STATUS st;
+	const char *step; // failed call
+} open_job;
+
+typedef struct {
+	open_job *jobs;
+	int count;
+	volatile int next; // next job to take
+	jint cfg[CONFIG_SIZE];
+} open_batch;
+
+static void
+open_one(open_batch *b, open_job *j) {
+	jint last[CONFIG_SIZE];
+	FT_HANDLE h;
+	int i;
+
+	for (i = 0; i < CONFIG_SIZE; ++i) last[i] = CONFIG_UNSET;
+	j->step = "open";
+	if (!FT_SUCCESS(j->st = FT_OpenEx((PVOID)j->serial, FT_OPEN_BY_SERIAL_NUMBER, &h)))
+		return;
+	if (!FT_SUCCESS(j->st = config_apply(h, b->cfg, last, &j->step, NULL))) {
+		FT_Close(h);
+		return;
+	}
+	j->step = "open";
+	if ((j->tok = handle_register(h)) == (jlong)INVALID_HANDLE_VALUE) {
+		FT_Close(h);
+		j->st = FT_INSUFFICIENT_RESOURCES;
+	}
+	else memcpy(handle_config(j->tok), last, sizeof(last)); // not handed out yet
+}
+
+static void
+open_worker(void *p) {
+	open_batch *b = (open_batch*)p;
+	int i;
+
+	while ((i = atomic_add(&b->next, 1) - 1) < b->count)
+		open_one(b, &b->jobs[i]);
+}
+
+JNIEXPORT void JNICALL
+Java_jd2xx_JD2XX_nativeOpenAll(JNIEnv *env, jclass cls, jobjectArray serials,
+	jintArray config, jlongArray handles, jobjectArray errors)
+{
+	thread_t workers[OPEN_WORKERS];
+	open_batch b;
+	int n = 0, i;
+
+	memset(&b, 0, sizeof(b));
+	b.count = (*env)->GetArrayLength(env, serials);
+	if ((*env)->GetArrayLength(env, config) != CONFIG_SIZE
+		|| (*env)->GetArrayLength(env, handles) < b.count
+		|| (*env)->GetArrayLength(env, errors) < b.count) {
+		throw_new(env, "java/lang/IllegalArgumentException", "openAll arrays");
+		return;
+	}
+	if (b.count == 0) return;
+	(*env)->GetIntArrayRegion(env, config, 0, CONFIG_SIZE, b.cfg);
+
+	if ((b.jobs = (open_job*)calloc(b.count, sizeof(open_job))) == NULL) {
+		io_exception_status(env, FT_INSUFFICIENT_RESOURCES);
+		return;
+	}
+	for (i = 0; i < b.count; ++i) {
+		jstring s = (jstring)(*env)->GetObjectArrayElement(env, serials, i);
+		const char *cs = (*env)->GetStringUTFChars(env, s, NULL);
+
+		if (cs == NULL) break; // OutOfMemoryError pending
+		b.jobs[i].serial = strdup(cs);
+		b.jobs[i].tok = (jlong)INVALID_HANDLE_VALUE;
+		(*env)->ReleaseStringUTFChars(env, s, cs);
+		(*env)->DeleteLocalRef(env, s);
+		if (b.jobs[i].serial == NULL) break;
+	}
+
+	if (i == b.count) {
+		while (n < OPEN_WORKERS - 1 && n < b.count - 1
+			&& thread_start(&workers[n], open_worker, &b) == 0) ++n;
+		open_worker(&b);
+		for (i = 0; i < n; ++i) thread_join(workers[i]);
+
+		for (i = 0; i < b.count; ++i) {
+			open_job *j = &b.jobs[i];
+
+			if (FT_SUCCESS(j->st)) {
+				(*env)->SetLongArrayRegion(env, handles, i, 1, &j->tok);
+			}
+			else {
+				char msg[96];
+				jstring e = (*env)->NewStringUTF(env, config_error(msg, j->step, j->st));
+
+				(*env)->SetObjectArrayElement(env, errors, i, e);
+				(*env)->DeleteLocalRef(env, e);
+			}
+		}
+	}
+	else if (!(*env)->ExceptionCheck(env))
+		io_exception_status(env, FT_INSUFFICIENT_RESOURCES);
+
+	for (i = 0; i < b.count; ++i) free(b.jobs[i].serial);
+	free(b.jobs);
+}
@@ -0,0 +1,302 @@
+/*
+	Copyright (c) 2004 Pablo Bleyer Kocik.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	1. Redistributions of source code must retain the above copyright notice, this
+	list of conditions and the following disclaimer.
+
+	2. Redistributions in binary form must reproduce the above copyright notice,
+	this list of conditions and the following disclaimer in the documentation
+	and/or other materials provided with the distribution.
+
+	3. The name of the author may not be used to endorse or promote products
+	derived from this software without specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR IMPLIED
+	WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+	MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+	EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+	SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+	PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+	BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+	IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+	CRC engine
+
+	CRC-16/MODBUS, CRC-16/CCITT (the "FALSE" variant: polynomial 0x1021,
+	initial value 0xFFFF, not reflected) and CRC-32 (IEEE 802.3, as
+	java.util.zip.CRC32). crc_copy moves the data and updates the CRC in
+	the same pass, which is how reads are checked while they are copied
+	into the Java array.
+
+	Every variant has slice-by-8 tables: eight bytes per step with eight
+	independent lookups instead of a chain of eight. CRC-32 is folded with
+	carry-less multiplication (PCLMULQDQ, "Fast CRC Computation for Generic
+	Polynomials Using PCLMULQDQ", Intel 2009) in the AVX2 build and uses
+	the CRC32 instructions when built for ARMv8 with +crc.
+
+	The state passed around is the shift register: crc_start gives its
+	initial value, crc_value the checksum, and running a buffer followed by
+	its own CRC in wire order (low byte first for the reflected variants,
+	high byte first for CCITT) leaves it at crc_residue.
+*/
+
+#include <string.h>
+#if defined(__PCLMUL__) && defined(__SSE4_1__)
+#include <immintrin.h>
+#define CRC32_CLMUL
+#elif defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#include <stdint.h>
+#define CRC32_ARM
+#endif
+
+#include "jd2xx.h"
+#include "jd2xx_JD2XXCrc.h"
+
+static const struct {
+	int reflected;
+	unsigned int poly, init, xorout, residue;
+	int size;
+} spec[CRC_KINDS] = {
+	{ 1, 0xa001, 0xffff, 0, 0, 2 }, // CRC16_MODBUS
+	{ 0, 0x1021, 0xffff, 0, 0, 2 }, // CRC_CCITT
+	{ 1, 0xedb88320, 0xffffffff, 0xffffffff, 0xdebb20e3, 4 }, // CRC32
+};
+
+/* table[kind][k][b]: register contribution of byte b followed by k zero bytes */
+static unsigned int table[CRC_KINDS][8][256];
+
+void
+crc_init(void) {
+	int kind, k, b, i;
+	unsigned int c, p;
+
+	for (kind = 0; kind < CRC_KINDS; ++kind) {
+		p = spec[kind].poly;
+		for (b = 0; b < 256; ++b) {
+			if (spec[kind].reflected) {
+				for (c = b, i = 0; i < 8; ++i) c = c & 1 ? (c >> 1) ^ p : c >> 1;
+			}
+			else {
+				for (c = b << 8, i = 0; i < 8; ++i) c = c & 0x8000 ? ((c << 1) ^ p) & 0xffff : c << 1;
+			}
+			table[kind][0][b] = c;
+		}
+		for (k = 1; k < 8; ++k) {
+			for (b = 0; b < 256; ++b) {
+				c = table[kind][k - 1][b];
+				if (spec[kind].reflected) c = (c >> 8) ^ table[kind][0][c & 0xff];
+				else c = ((c << 8) & 0xffff) ^ table[kind][0][c >> 8];
+				table[kind][k][b] = c;
+			}
+		}
+	}
+}
+
+/** Slice-by-8 update, copying to d unless it is NULL; inlined once per
+	bit order so the loop has no branch on it */
+static inline unsigned int
+crc_slice(const unsigned int (*t)[256], int reflected, unsigned int c,
+	unsigned char *d, const unsigned char *s, size_t n) {
+	unsigned int lo, hi;
+
+	for (; n >= 8; n -= 8, s += 8) {
+		if (d != NULL) {
+			memcpy(d, s, 8);
+			d += 8;
+		}
+		// assembled byte by byte, compiles to plain loads on little-endian CPUs
+		lo = s[0] | s[1] << 8 | s[2] << 16 | (unsigned int)s[3] << 24;
+		hi = s[4] | s[5] << 8 | s[6] << 16 | (unsigned int)s[7] << 24;
+		if (reflected) lo ^= c;
+		else lo ^= (c >> 8 | c << 8) & 0xffff;
+		c = t[7][lo & 0xff] ^ t[6][(lo >> 8) & 0xff] ^ t[5][(lo >> 16) & 0xff] ^ t[4][lo >> 24]
+			^ t[3][hi & 0xff] ^ t[2][(hi >> 8) & 0xff] ^ t[1][(hi >> 16) & 0xff] ^ t[0][hi >> 24];
+	}
+	for (; n > 0; --n, ++s) {
+		if (d != NULL) *d++ = *s;
+		if (reflected) c = (c >> 8) ^ t[0][(c ^ *s) & 0xff];
+		else c = ((c << 8) & 0xffff) ^ t[0][((c >> 8) ^ *s) & 0xff];
+	}
+	return c;
+}
+
+static unsigned int
+crc_tables(int kind, unsigned int c, unsigned char *d, const unsigned char *s, size_t n) {
+	if (spec[kind].reflected) return crc_slice(table[kind], 1, c, d, s, n);
+	return crc_slice(table[kind], 0, c, d, s, n);
+}
+
+#if defined(CRC32_CLMUL)
+/** CRC-32 of n bytes (n >= 64, a multiple of 16) by folding 4x128 bits,
+	copying to d unless it is NULL */
+static unsigned int
+crc32_clmul(unsigned int c, unsigned char *d, const unsigned char *s, size_t n) {
+	// bit-reflected constants x^(k) mod P(x) and the Barrett reduction constants
+	const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596LL, 0x0154442bd4LL);
+	const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009eLL, 0x01751997d0LL);
+	const __m128i k5 = _mm_set_epi64x(0, 0x0163cd6124LL);
+	const __m128i poly = _mm_set_epi64x(0x01f7011641LL, 0x01db710641LL);
+	const __m128i mask = _mm_setr_epi32(~0, 0, ~0, 0);
+	__m128i x1, x2, x3, x4, y1, y2, y3, y4;
+
+	x1 = _mm_loadu_si128((const __m128i*)(s + 0x00));
+	x2 = _mm_loadu_si128((const __m128i*)(s + 0x10));
+	x3 = _mm_loadu_si128((const __m128i*)(s + 0x20));
+	x4 = _mm_loadu_si128((const __m128i*)(s + 0x30));
+	if (d != NULL) {
+		_mm_storeu_si128((__m128i*)(d + 0x00), x1);
+		_mm_storeu_si128((__m128i*)(d + 0x10), x2);
+		_mm_storeu_si128((__m128i*)(d + 0x20), x3);
+		_mm_storeu_si128((__m128i*)(d + 0x30), x4);
+		d += 64;
+	}
+	x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)c));
+	s += 64;
+	n -= 64;
+
+	for (; n >= 64; n -= 64, s += 64) {
+		y1 = _mm_loadu_si128((const __m128i*)(s + 0x00));
+		y2 = _mm_loadu_si128((const __m128i*)(s + 0x10));
+		y3 = _mm_loadu_si128((const __m128i*)(s + 0x20));
+		y4 = _mm_loadu_si128((const __m128i*)(s + 0x30));
+		if (d != NULL) {
+			_mm_storeu_si128((__m128i*)(d + 0x00), y1);
+			_mm_storeu_si128((__m128i*)(d + 0x10), y2);
+			_mm_storeu_si128((__m128i*)(d + 0x20), y3);
+			_mm_storeu_si128((__m128i*)(d + 0x30), y4);
+			d += 64;
+		}
+		x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k1k2, 0x00),
+			_mm_clmulepi64_si128(x1, k1k2, 0x11)), y1);
+		x2 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x2, k1k2, 0x00),
+			_mm_clmulepi64_si128(x2, k1k2, 0x11)), y2);
+		x3 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x3, k1k2, 0x00),
+			_mm_clmulepi64_si128(x3, k1k2, 0x11)), y3);
+		x4 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x4, k1k2, 0x00),
+			_mm_clmulepi64_si128(x4, k1k2, 0x11)), y4);
+	}
+
+	// fold the four lanes into one, then the remaining 16 byte blocks
+	x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x00),
+		_mm_clmulepi64_si128(x1, k3k4, 0x11)), x2);
+	x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x00),
+		_mm_clmulepi64_si128(x1, k3k4, 0x11)), x3);
+	x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x00),
+		_mm_clmulepi64_si128(x1, k3k4, 0x11)), x4);
+	for (; n >= 16; n -= 16, s += 16) {
+		y1 = _mm_loadu_si128((const __m128i*)s);
+		if (d != NULL) {
+			_mm_storeu_si128((__m128i*)d, y1);
+			d += 16;
+		}
+		x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x00),
+			_mm_clmulepi64_si128(x1, k3k4, 0x11)), y1);
+	}
+
+	// 128 to 64 bits
+	x2 = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+	x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+	x2 = _mm_srli_si128(x1, 4);
+	x1 = _mm_xor_si128(_mm_clmulepi64_si128(_mm_and_si128(x1, mask), k5, 0x00), x2);
+
+	// Barrett reduction to 32 bits
+	x2 = _mm_clmulepi64_si128(_mm_and_si128(x1, mask), poly, 0x10);
+	x2 = _mm_clmulepi64_si128(_mm_and_si128(x2, mask), poly, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+	return (unsigned int)_mm_extract_epi32(x1, 1);
+}
+#elif defined(CRC32_ARM)
+/** CRC-32 with the ARMv8 CRC32 instructions, copying to d unless it is NULL */
+static unsigned int
+crc32_arm(unsigned int c, unsigned char *d, const unsigned char *s, size_t n) {
+	uint64_t v;
+
+	for (; n >= 8; n -= 8, s += 8) {
+		memcpy(&v, s, 8);
+		if (d != NULL) {
+			memcpy(d, &v, 8);
+			d += 8;
+		}
+		c = __crc32d(c, v);
+	}
+	for (; n > 0; --n, ++s) {
+		if (d != NULL) *d++ = *s;
+		c = __crc32b(c, *s);
+	}
+	return c;
+}
+#endif
+
+unsigned int
+crc_copy(int kind, unsigned int c, unsigned char *d, const unsigned char *s, size_t n) {
+#if defined(CRC32_CLMUL)
+	size_t m;
+
+	if (kind == CRC32 && n >= 64) {
+		m = n & ~(size_t)15;
+		c = crc32_clmul(c, d, s, m);
+		if (d != NULL) d += m;
+		s += m;
+		n -= m;
+	}
+#elif defined(CRC32_ARM)
+	if (kind == CRC32) return crc32_arm(c, d, s, n);
+#endif
+	return crc_tables(kind, c, d, s, n);
+}
+
+unsigned int
+crc_update(int kind, unsigned int c, const unsigned char *s, size_t n) {
+	return crc_copy(kind, c, NULL, s, n);
+}
+
+unsigned int
+crc_start(int kind) {
+	return spec[kind].init;
+}
+
+unsigned int
+crc_value(int kind, unsigned int c) {
+	return c ^ spec[kind].xorout;
+}
+
+unsigned int
+crc_residue(int kind) {
+	return spec[kind].residue;
+}
+
+int
+crc_size(int kind) {
+	return kind >= 0 && kind < CRC_KINDS ? spec[kind].size : 0;
+}
+
+JNIEXPORT jint JNICALL
+Java_jd2xx_JD2XXCrc_nativeUpdate(JNIEnv *env, jclass cls, jint kind, jint c,
+	jbyteArray arr, jint off, jint len) {
+	unsigned char *b = (unsigned char*)(*env)->GetPrimitiveArrayCritical(env, arr, NULL);
+
+	if (b == NULL) return c; // OutOfMemoryError pending
+	c = (jint)crc_update(kind, (unsigned int)c, b + off, len);
+	(*env)->ReleasePrimitiveArrayCritical(env, arr, b, JNI_ABORT);
+	return c;
+}
+
+JNIEXPORT jint JNICALL
+Java_jd2xx_JD2XXCrc_nativeUpdateDirect(JNIEnv *env, jclass cls, jint kind, jint c,
+	jobject bb, jint off, jint len) {
+	unsigned char *b = (unsigned char*)(*env)->GetDirectBufferAddress(env, bb);
+
+	if (b == NULL) {
+		throw_new(env, "java/lang/IllegalArgumentException", "direct buffer required");
+		return c;
+	}
+	return (jint)crc_update(kind, (unsigned int)c, b + off, len);
+}
@@ -0,0 +1,314 @@
+/*
+	Copyright (c) 2004 Pablo Bleyer Kocik.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	1. Redistributions of source code must retain the above copyright notice, this
+	list of conditions and the following disclaimer.
+
+	2. Redistributions in binary form must reproduce the above copyright notice,
+	this list of conditions and the following disclaimer in the documentation
+	and/or other materials provided with the distribution.
+
+	3. The name of the author may not be used to endorse or promote products
+	derived from this software without specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR IMPLIED
+	WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+	MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+	EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+	SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+	PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+	BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+	IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+	Frame decoder
+
+	Reads from the device into a receive buffer, finds frame delimiters
+	with a vector scan (AVX2 or NEON when the library is built for them,
+	memchr otherwise) and decodes each complete COBS or SLIP frame while
+	copying it into the Java direct buffer, so Java never touches single
+	bytes. One receive call delivers all complete frames as (offset,
+	length) pairs in a second direct buffer; an incomplete frame stays in
+	the receive buffer for the next call and is not scanned again. With a
+	CRC set, the decoded runs go through crc_copy so the trailing CRC of
+	each frame is checked in the same pass, and then stripped.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "jd2xx.h"
+#include "jd2xx_JD2XXFramer.h"
+#include "jd2xx_JD2XXCrc.h"
+
+#define SLIP_END 0xc0
+#define SLIP_ESC 0xdb
+#define SLIP_ESC_END 0xdc
+#define SLIP_ESC_ESC 0xdd
+
+/** Decoder state, one per JD2XXFramer object */
+typedef struct {
+	jlong tok; // JD2XX handle token
+	int mode; // jd2xx_JD2XXFramer_COBS or _SLIP
+	unsigned char delim;
+	unsigned char *raw; // receive buffer
+	size_t size, used; // receive buffer size, bytes in it
+	size_t scanned; // bytes of raw known to hold no delimiter
+	int discard; // dropping an oversized frame up to its delimiter
+	unsigned char *out; // decoded frames (Java direct buffer)
+	size_t cap;
+	jint *index; // (offset, length) pairs (Java direct buffer)
+	size_t frames; // capacity of index in frames
+	jlong errors; // frames dropped as malformed or too long
+	int crc; // JD2XXCrc kind checked on every frame, or JD2XXCrc.NONE
+	jlong crc_errors; // frames dropped for a bad CRC
+} framer_t;
+
+/** Copy a run of decoded bytes, updating the CRC register c if kind is not NONE
+	@return end of the run in d
+*/
+static unsigned char*
+emit(int kind, unsigned int *c, unsigned char *d, const unsigned char *s, size_t n) {
+	if (kind < 0) memcpy(d, s, n);
+	else *c = crc_copy(kind, *c, d, s, n);
+	return d + n;
+}
+
+/** Find the first byte d in p[0..n)
+	@return its position, n if there is none
+*/
+static size_t
+scan(const unsigned char *p, size_t n, unsigned char d) {
+	size_t i = 0;
+#if defined(__AVX2__)
+	__m256i v = _mm256_set1_epi8((char)d);
+
+	for (; i + 32 <= n; i += 32) {
+		__m256i c = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(p + i)), v);
+		unsigned m = (unsigned)_mm256_movemask_epi8(c);
+		if (m != 0) return i + __builtin_ctz(m);
+	}
+#elif defined(__ARM_NEON)
+	uint8x16_t v = vdupq_n_u8(d);
+
+	for (; i + 16 <= n; i += 16) {
+		uint8x16_t c = vceqq_u8(vld1q_u8(p + i), v);
+		// narrow to 4 bits per byte to get a 64-bit mask
+		uint64_t m = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(c), 4)), 0);
+		if (m != 0) return i + (__builtin_ctzll(m) >> 2);
+	}
+#else
+	const unsigned char *q = (const unsigned char*)memchr(p, d, n);
+	if (q != NULL) return q - p;
+	i = n;
+#endif
+	for (; i < n; ++i)
+		if (p[i] == d) break;
+	return i;
+}
+
+/** Decode a COBS frame (without delimiter)
+	@return decoded length, -1 if malformed
+*/
+static long
+cobs_decode(const unsigned char *s, size_t n, unsigned char *d, int kind, unsigned int *crc) {
+	static const unsigned char zero = 0;
+	const unsigned char *e = s + n;
+	unsigned char *o = d;
+	unsigned c;
+
+	while (s < e) {
+		c = *s++;
+		if (c == 0 || (size_t)(e - s) < c - 1) return -1;
+		o = emit(kind, crc, o, s, c - 1);
+		s += c - 1;
+		if (c < 0xff && s < e) o = emit(kind, crc, o, &zero, 1);
+	}
+	return o - d;
+}
+
+/** Decode a SLIP frame (without END), copying runs between escapes
+	@return decoded length, -1 if malformed
+*/
+static long
+slip_decode(const unsigned char *s, size_t n, unsigned char *d, int kind, unsigned int *crc) {
+	static const unsigned char end = SLIP_END, esc = SLIP_ESC;
+	unsigned char *o = d;
+	size_t k;
+
+	while (n > 0) {
+		k = scan(s, n, SLIP_ESC);
+		o = emit(kind, crc, o, s, k);
+		s += k;
+		n -= k;
+		if (n == 0) break;
+		if (n < 2) return -1;
+		if (s[1] == SLIP_ESC_END) o = emit(kind, crc, o, &end, 1);
+		else if (s[1] == SLIP_ESC_ESC) o = emit(kind, crc, o, &esc, 1);
+		else return -1;
+		s += 2;
+		n -= 2;
+	}
+	return o - d;
+}
+
+/** Decode complete frames from the receive buffer into the output buffers
+	and drop the consumed bytes
+	@return number of frames
+*/
+static int
+framer_extract(framer_t *f) {
+	size_t start = 0, pos = 0, from, e, n;
+	int count = 0;
+	long len;
+	unsigned int c = 0;
+
+	while ((size_t)count < f->frames) {
+		from = f->scanned > start ? f->scanned : start;
+		e = from + scan(f->raw + from, f->used - from, f->delim);
+		if (e == f->used) { // incomplete frame
+			f->scanned = e;
+			break;
+		}
+
+		n = e - start;
+		if (f->discard) f->discard = 0;
+		else if (n > 0) { // empty frames (repeated delimiters) are skipped
+			if (pos + n > f->cap && pos > 0) break; // output full, keep for next call
+			if (f->crc >= 0) c = crc_start(f->crc);
+			if (f->mode == jd2xx_JD2XXFramer_COBS) len = cobs_decode(f->raw + start, n, f->out + pos, f->crc, &c);
+			else len = slip_decode(f->raw + start, n, f->out + pos, f->crc, &c);
+
+			if (len < 0) f->errors++;
+			else if (f->crc >= 0 && (len < crc_size(f->crc) || c != crc_residue(f->crc))) f->crc_errors++;
+			else if ((len -= crc_size(f->crc)) > 0) {
+				f->index[2 * count] = (jint)pos;
+				f->index[2 * count + 1] = (jint)len;
+				pos += len;
+				++count;
+			}
+		}
+		start = e + 1;
+	}
+
+	memmove(f->raw, f->raw + start, f->used - start);
+	f->used -= start;
+	f->scanned = f->scanned > start ? f->scanned - start : 0;
+
+	if (f->used == f->size) { // no delimiter in a full buffer
+		f->errors++;
+		f->discard = 1;
+		f->used = f->scanned = 0;
+	}
+	return count;
+}
+
+JNIEXPORT jlong JNICALL
+Java_jd2xx_JD2XXFramer_nativeOpen(JNIEnv *env, jclass cls, jobject jd, jint mode,
+	jobject data, jobject index) {
+	jlong tok = get_handle(env, jd);
+	framer_t *f;
+
+	if (mode != jd2xx_JD2XXFramer_COBS && mode != jd2xx_JD2XXFramer_SLIP) {
+		throw_new(env, "java/lang/IllegalArgumentException", "unknown framing");
+		return 0;
+	}
+	if ((f = (framer_t*)calloc(1, sizeof(framer_t))) == NULL) goto nomem;
+
+	f->tok = tok;
+	f->mode = mode;
+	f->delim = mode == jd2xx_JD2XXFramer_COBS ? 0 : SLIP_END;
+	f->crc = jd2xx_JD2XXCrc_NONE;
+	f->out = (unsigned char*)(*env)->GetDirectBufferAddress(env, data);
+	f->cap = (size_t)(*env)->GetDirectBufferCapacity(env, data);
+	f->index = (jint*)(*env)->GetDirectBufferAddress(env, index);
+	f->frames = (size_t)(*env)->GetDirectBufferCapacity(env, index) / (2 * sizeof(jint));
+	f->size = f->cap; // a decoded frame is never longer than its encoding
+	if ((f->raw = (unsigned char*)malloc(f->size)) == NULL) goto nomem;
+
+	return (jlong)(size_t)f;
+
+nomem:
+	if (f != NULL) free(f);
+	io_exception_status(env, FT_INSUFFICIENT_RESOURCES);
+	return 0;
+}
+
+JNIEXPORT void JNICALL
+Java_jd2xx_JD2XXFramer_dispose(JNIEnv *env, jclass cls, jlong ptr) {
+	framer_t *f = (framer_t*)(size_t)ptr;
+
+	if (f == NULL) return;
+	free(f->raw);
+	free(f);
+}
+
+JNIEXPORT jint JNICALL
+Java_jd2xx_JD2XXFramer_nativeReceive(JNIEnv *env, jclass cls, jlong ptr) {
+	framer_t *f = (framer_t*)(size_t)ptr;
+	FT_HANDLE h;
+	FT_STATUS st;
+	DWORD queued = 0, want, got = 0;
+	int count;
+
+	if (f == NULL) {
+		io_exception(env, "framer closed");
+		return 0;
+	}
+	if ((count = framer_extract(f)) > 0) return count; // left over from a full batch
+
+	do { // until a frame is complete or a read times out
+		if ((h = acquire_handle(env, f->tok)) == NULL) return 0;
+		st = FT_GetQueueStatus(h, &queued);
+		if (FT_SUCCESS(st)) {
+			want = (DWORD)(f->size - f->used);
+			if (queued == 0) want = 1; // wait for data up to the read timeout
+			else if (queued < want) want = queued;
+			st = FT_Read(h, f->raw + f->used, want, &got);
+			capture_io(f->tok, CAPTURE_READ, f->raw + f->used, got);
+		}
+		handle_release(f->tok);
+
+		if (!FT_SUCCESS(st)) {
+			io_exception_status(env, st);
+			return 0;
+		}
+		if (got == 0) break;
+		f->used += got;
+	} while ((count = framer_extract(f)) == 0);
+
+	return count;
+}
+
+JNIEXPORT jlong JNICALL
+Java_jd2xx_JD2XXFramer_nativeGetErrors(JNIEnv *env, jclass cls, jlong ptr) {
+	framer_t *f = (framer_t*)(size_t)ptr;
+	return f == NULL ? 0 : f->errors;
+}
+
+JNIEXPORT void JNICALL
+Java_jd2xx_JD2XXFramer_nativeSetCrc(JNIEnv *env, jclass cls, jlong ptr, jint kind) {
+	framer_t *f = (framer_t*)(size_t)ptr;
+
+	if (f == NULL) io_exception(env, "framer closed");
+	else if (kind != jd2xx_JD2XXCrc_NONE && crc_size(kind) == 0)
+		throw_new(env, "java/lang/IllegalArgumentException", "unknown CRC");
+	else f->crc = kind;
+}
+
+JNIEXPORT jlong JNICALL
+Java_jd2xx_JD2XXFramer_nativeGetCrcErrors(JNIEnv *env, jclass cls, jlong ptr) {
+	framer_t *f = (framer_t*)(size_t)ptr;
+	return f == NULL ? 0 : f->crc_errors;
+}
@@ -0,0 +1,474 @@
+/*
+	Copyright (c) 2004 Pablo Bleyer Kocik.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	1. Redistributions of source code must retain the above copyright notice, this
+	list of conditions and the following disclaimer.
+
+	2. Redistributions in binary form must reproduce the above copyright notice,
+	this list of conditions and the following disclaimer in the documentation
+	and/or other materials provided with the distribution.
+
+	3. The name of the author may not be used to endorse or promote products
+	derived from this software without specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR IMPLIED
+	WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+	MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+	EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+	SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+	PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+	BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+	IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+	MPSSE GPIO
+
+	Drives the ADBUS (pins 0-7) and ACBUS (pins 8-15) lines of MPSSE capable
+	devices with the "set/read data bits" MPSSE commands. Outputs are kept in
+	a shadow of the output latch, so read-modify-write needs no round trip,
+	and commands are queued in one buffer while a batch is open. A sampler
+	thread can poll the pins at a fixed rate and queue only the changes for
+	the Java notifier thread.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "jd2xx.h"
+#include "jd2xx_JD2XXGpio.h"
+
+/* MPSSE opcodes */
+#define MPSSE_SET_LOW 0x80 // value, direction
+#define MPSSE_GET_LOW 0x81
+#define MPSSE_SET_HIGH 0x82 // value, direction
+#define MPSSE_GET_HIGH 0x83
+#define MPSSE_LOOPBACK_OFF 0x85
+#define MPSSE_SEND_IMMEDIATE 0x87
+#define MPSSE_BAD_COMMAND 0xAA // answered with 0xFA 0xAA, used to sync
+
+#define GPIO_BATCH_SIZE 4096 // queued command bytes before a forced flush
+#define GPIO_RING_SIZE 256 // pin changes waiting for the notifier
+#define GPIO_TIMEOUT 1000 // device read/write timeout (ms)
+
+/** Pin change record */
+typedef struct {
+	unsigned long long time; // monotonic ns
+	unsigned changed, value;
+} change_t;
+
+/** GPIO state, one per JD2XXGpio object */
+typedef struct {
+	jlong tok; // JD2XX handle token
+
+	mutex_t io; // serializes device exchanges, guards shadow and queue
+	unsigned value, dir; // shadow output latch and direction (1 = output)
+	unsigned char cmd[GPIO_BATCH_SIZE]; // queued commands
+	int ncmd, batch; // queued bytes, batch nesting
+
+	mutex_t ev; // guards sampler and change ring
+	cond_t evc;
+	thread_t sampler;
+	int polling, started; // sampler should run, sampler must be joined
+	unsigned mask, last; // watched pins, last sample
+	unsigned long long period; // ns
+	FT_STATUS error; // why the sampler stopped
+	change_t ring[GPIO_RING_SIZE];
+	int head, count;
+} gpio_t;
+
+/** Write whole buffer to device */
+static FT_STATUS
+gpio_send(FT_HANDLE h, unsigned char *buf, DWORD len) {
+	FT_STATUS st;
+	DWORD n = 0;
+
+	if (len == 0) return FT_OK;
+	if (FT_SUCCESS(st = FT_Write(h, buf, len, &n)) && n != len) st = FT_IO_ERROR;
+	return st;
+}
+
+/** Send queued commands (io lock held) */
+static FT_STATUS
+gpio_flush(gpio_t *g, FT_HANDLE h) {
+	FT_STATUS st = gpio_send(h, g->cmd, g->ncmd);
+	g->ncmd = 0;
+	return st;
+}
+
+/** Queue a three byte command, flushing a full queue (io lock held) */
+static FT_STATUS
+gpio_queue(gpio_t *g, FT_HANDLE h, unsigned char op, unsigned char a, unsigned char b) {
+	FT_STATUS st = FT_OK;
+
+	if (g->ncmd + 3 > GPIO_BATCH_SIZE) st = gpio_flush(g, h);
+	g->cmd[g->ncmd++] = op;
+	g->cmd[g->ncmd++] = a;
+	g->cmd[g->ncmd++] = b;
+	return st;
+}
+
+/** Update shadow state, queue the bytes that changed, send unless batching (io lock held) */
+static FT_STATUS
+gpio_apply(gpio_t *g, FT_HANDLE h, unsigned value, unsigned dir) {
+	FT_STATUS st = FT_OK;
+	unsigned diff = (value ^ g->value) | (dir ^ g->dir);
+
+	g->value = value & 0xffff;
+	g->dir = dir & 0xffff;
+	if (diff & 0x00ff)
+		st = gpio_queue(g, h, MPSSE_SET_LOW, g->value & 0xff, g->dir & 0xff);
+	if (FT_SUCCESS(st) && (diff & 0xff00))
+		st = gpio_queue(g, h, MPSSE_SET_HIGH, g->value >> 8, g->dir >> 8);
+	if (FT_SUCCESS(st) && g->batch == 0)
+		st = gpio_flush(g, h);
+	return st;
+}
+
+/** Read all pins in one exchange (io lock held)
+	@param flush send queued commands first
+*/
+static FT_STATUS
+gpio_sample(gpio_t *g, FT_HANDLE h, int flush, unsigned *pins) {
+	static unsigned char rd[] = { MPSSE_GET_LOW, MPSSE_GET_HIGH, MPSSE_SEND_IMMEDIATE };
+	unsigned char buf[GPIO_BATCH_SIZE + sizeof(rd)];
+	FT_STATUS st;
+	DWORD len = 0, n = 0;
+
+	if (flush) {
+		memcpy(buf, g->cmd, g->ncmd);
+		len = g->ncmd;
+		g->ncmd = 0;
+	}
+	memcpy(buf + len, rd, sizeof(rd));
+
+	if (!FT_SUCCESS(st = gpio_send(h, buf, len + sizeof(rd)))) return st;
+	if (FT_SUCCESS(st = FT_Read(h, buf, 2, &n)) && n != 2) st = FT_IO_ERROR;
+	if (FT_SUCCESS(st)) *pins = buf[0] | (buf[1] << 8);
+	return st;
+}
+
+/** Switch device to MPSSE mode and check it answers */
+static FT_STATUS
+gpio_init(FT_HANDLE h) {
+	unsigned char buf[8];
+	FT_STATUS st;
+	DWORD n = 0;
+
+	if (!FT_SUCCESS(st = FT_SetBitMode(h, 0, FT_BITMODE_RESET))
+		|| !FT_SUCCESS(st = FT_SetBitMode(h, 0, FT_BITMODE_MPSSE))
+		|| !FT_SUCCESS(st = FT_SetTimeouts(h, GPIO_TIMEOUT, GPIO_TIMEOUT))
+		|| !FT_SUCCESS(st = FT_Purge(h, FT_PURGE_RX | FT_PURGE_TX)))
+		return st;
+
+	buf[0] = MPSSE_BAD_COMMAND;
+	if (!FT_SUCCESS(st = gpio_send(h, buf, 1))
+		|| !FT_SUCCESS(st = FT_Read(h, buf, 2, &n)))
+		return st;
+	if (n != 2 || buf[0] != 0xFA || buf[1] != MPSSE_BAD_COMMAND)
+		return FT_NOT_SUPPORTED; // not an MPSSE channel
+
+	// all pins inputs, matching the zeroed shadow state
+	buf[0] = MPSSE_LOOPBACK_OFF;
+	buf[1] = MPSSE_SET_LOW; buf[2] = 0; buf[3] = 0;
+	buf[4] = MPSSE_SET_HIGH; buf[5] = 0; buf[6] = 0;
+	return gpio_send(h, buf, 7);
+}
+
+/** Record a pin change, merging into the newest record when full (ev lock held) */
+static void
+gpio_change(gpio_t *g, unsigned long long t, unsigned changed, unsigned value) {
+	change_t *c;
+
+	if (g->count == GPIO_RING_SIZE) {
+		// the final state is never lost, only intermediate edges
+		c = &g->ring[(g->head + g->count - 1) % GPIO_RING_SIZE];
+		changed |= c->changed;
+	}
+	else c = &g->ring[(g->head + g->count++) % GPIO_RING_SIZE];
+
+	c->time = t;
+	c->changed = changed;
+	c->value = value;
+	cond_signal(&g->evc);
+}
+
+/** Sampler thread */
+static void
+gpio_sampler(void *arg) {
+	gpio_t *g = (gpio_t*)arg;
+	unsigned long long next = monotonic_ns(), t;
+	FT_STATUS st = FT_OK;
+	FT_HANDLE h;
+	unsigned pins;
+
+	for (;;) {
+		mutex_lock(&g->ev);
+		if (!g->polling) {
+			mutex_unlock(&g->ev);
+			break;
+		}
+		next += g->period;
+		mutex_unlock(&g->ev);
+
+		// after a stall skip the missed ticks instead of sampling in a burst
+		if ((t = monotonic_ns()) > next) next = t;
+		else sleep_until_ns(next);
+
+		if ((h = handle_acquire(g->tok)) == NULL) {
+			st = FT_INVALID_HANDLE;
+			break;
+		}
+		mutex_lock(&g->io);
+		st = gpio_sample(g, h, 0, &pins);
+		mutex_unlock(&g->io);
+		handle_release(g->tok);
+		if (!FT_SUCCESS(st)) break;
+
+		mutex_lock(&g->ev);
+		if ((pins ^ g->last) & g->mask)
+			gpio_change(g, monotonic_ns(), (pins ^ g->last) & g->mask, pins);
+		g->last = pins;
+		mutex_unlock(&g->ev);
+	}
+
+	mutex_lock(&g->ev);
+	g->polling = 0;
+	g->error = st;
+	cond_broadcast(&g->evc);
+	mutex_unlock(&g->ev);
+}
+
+/** Stop and join the sampler thread */
+static void
+gpio_stop(gpio_t *g) {
+	int started;
+
+	mutex_lock(&g->ev);
+	started = g->started;
+	g->polling = 0;
+	g->started = 0;
+	cond_broadcast(&g->evc);
+	mutex_unlock(&g->ev);
+
+	if (started) thread_join(g->sampler);
+}
+
+/** Pin device handle and GPIO state for an I/O call, throw on failure */
+static FT_HANDLE
+gpio_enter(JNIEnv *env, gpio_t *g) {
+	FT_HANDLE h;
+
+	if (g == NULL) {
+		io_exception(env, "gpio closed");
+		return NULL;
+	}
+	if ((h = acquire_handle(env, g->tok)) != NULL) mutex_lock(&g->io);
+	return h;
+}
+
+/** Leave an I/O call, throw if it failed */
+static void
+gpio_leave(JNIEnv *env, gpio_t *g, FT_STATUS st) {
+	mutex_unlock(&g->io);
+	handle_release(g->tok);
+	if (!FT_SUCCESS(st)) io_exception_status(env, st);
+}
+
+JNIEXPORT jlong JNICALL
+Java_jd2xx_JD2XXGpio_nativeOpen(JNIEnv *env, jclass cls, jobject jd) {
+	jlong tok = get_handle(env, jd);
+	FT_HANDLE h = acquire_handle(env, tok);
+	FT_STATUS st;
+	gpio_t *g;
+
+	if (h == NULL) return 0;
+	st = gpio_init(h);
+	config_forget(tok, CONFIG_READ_TIMEOUT, 2);
+	config_forget(tok, CONFIG_BIT_MASK, 2);
+	handle_release(tok);
+
+	if (!FT_SUCCESS(st)) {
+		io_exception_status(env, st);
+		return 0;
+	}
+	if ((g = (gpio_t*)calloc(1, sizeof(gpio_t))) == NULL) {
+		io_exception_status(env, FT_INSUFFICIENT_RESOURCES);
+		return 0;
+	}
+
+	g->tok = tok;
+	mutex_init(&g->io);
+	mutex_init(&g->ev);
+	cond_init(&g->evc);
+	return (jlong)(size_t)g;
+}
+
+JNIEXPORT void JNICALL
+Java_jd2xx_JD2XXGpio_dispose(JNIEnv *env, jclass cls, jlong ptr) {
+	gpio_t *g = (gpio_t*)(size_t)ptr;
+	FT_HANDLE h;
+
+	if (g == NULL) return;
+	gpio_stop(g);
+
+	// leave MPSSE mode if the device is still open
+	if ((h = handle_acquire(g->tok)) != NULL) {
+		FT_SetBitMode(h, 0, FT_BITMODE_RESET);
+		config_forget(g->tok, CONFIG_BIT_MASK, 2);
+		handle_release(g->tok);
+	}
+
+	cond_destroy(&g->evc);
+	mutex_destroy(&g->ev);
+	mutex_destroy(&g->io);
+	free(g);
+}
+
+JNIEXPORT void JNICALL
+Java_jd2xx_JD2XXGpio_nativeSet(JNIEnv *env, jclass cls, jlong ptr, jint mask, jint value) {
+	gpio_t *g = (gpio_t*)(size_t)ptr;
+	FT_HANDLE h = gpio_enter(env, g);
+
+	if (h == NULL) return;
+	gpio_leave(env, g, gpio_apply(g, h, (g->value & ~mask) | (value & mask), g->dir));
+}
+
+JNIEXPORT void JNICALL
+Java_jd2xx_JD2XXGpio_nativeSetDirection(JNIEnv *env, jclass cls, jlong ptr, jint mask, jint outputs) {
+	gpio_t *g = (gpio_t*)(size_t)ptr;
+	FT_HANDLE h = gpio_enter(env, g);
+
+	if (h == NULL) return;
+	gpio_leave(env, g, gpio_apply(g, h, g->value, (g->dir & ~mask) | (outputs & mask)));
+}
+
+JNIEXPORT jint JNICALL
+Java_jd2xx_JD2XXGpio_nativeGet(JNIEnv *env, jclass cls, jlong ptr) {
+	gpio_t *g = (gpio_t*)(size_t)ptr;
+	FT_HANDLE h = gpio_enter(env, g);
+	unsigned pins = 0;
+
+	if (h == NULL) return 0;
+	gpio_leave(env, g, gpio_sample(g, h, 1, &pins));
+	return (jint)pins;
+}
+
+JNIEXPORT jint JNICALL
+Java_jd2xx_JD2XXGpio_nativeGetOutput(JNIEnv *env, jclass cls, jlong ptr, jboolean dir) {
+	gpio_t *g = (gpio_t*)(size_t)ptr;
+	jint r;
+
+	if (g == NULL) {
+		io_exception(env, "gpio closed");
+		return 0;
+	}
+	mutex_lock(&g->io);
+	r = dir ? g->dir : g->value;
+	mutex_unlock(&g->io);
+	return r;
+}
+
+JNIEXPORT void JNICALL
+Java_jd2xx_JD2XXGpio_nativeBegin(JNIEnv *env, jclass cls, jlong ptr) {
+	gpio_t *g = (gpio_t*)(size_t)ptr;
+
+	if (g == NULL) {
+		io_exception(env, "gpio closed");
+		return;
+	}
+	mutex_lock(&g->io);
+	g->batch++;
+	mutex_unlock(&g->io);
+}
+
+JNIEXPORT void JNICALL
+Java_jd2xx_JD2XXGpio_nativeCommit(JNIEnv *env, jclass cls, jlong ptr) {
+	gpio_t *g = (gpio_t*)(size_t)ptr;
+	FT_HANDLE h = gpio_enter(env, g);
+	FT_STATUS st = FT_OK;
+
+	if (h == NULL) return;
+	if (g->batch > 0 && --g->batch == 0) st = gpio_flush(g, h);
+	gpio_leave(env, g, st);
+}
+
+JNIEXPORT jint JNICALL
+Java_jd2xx_JD2XXGpio_nativeStartPolling(JNIEnv *env, jclass cls, jlong ptr, jint mask, jint period) {
+	gpio_t *g = (gpio_t*)(size_t)ptr;
+	FT_HANDLE h;
+	FT_STATUS st;
+	unsigned pins = 0;
+
+	if (g == NULL) {
+		io_exception(env, "gpio closed");
+		return 0;
+	}
+	if (period <= 0) {
+		throw_new(env, "java/lang/IllegalArgumentException", "period must be positive");
+		return 0;
+	}
+	gpio_stop(g);
+
+	// the first sample is the reference, only later changes are reported
+	if ((h = gpio_enter(env, g)) == NULL) return 0;
+	st = gpio_sample(g, h, 1, &pins);
+	gpio_leave(env, g, st);
+	if (!FT_SUCCESS(st)) return 0;
+
+	mutex_lock(&g->ev);
+	g->mask = mask & 0xffff;
+	g->last = pins;
+	g->period = (unsigned long long)period * 1000;
+	g->head = g->count = 0;
+	g->error = FT_OK;
+	g->polling = 1;
+	if (thread_start(&g->sampler, gpio_sampler, g) != 0) g->polling = 0;
+	g->started = g->polling;
+	mutex_unlock(&g->ev);
+
+	if (!g->started) io_exception_status(env, FT_INSUFFICIENT_RESOURCES);
+	return (jint)pins;
+}
+
+JNIEXPORT void JNICALL
+Java_jd2xx_JD2XXGpio_nativeStopPolling(JNIEnv *env, jclass cls, jlong ptr) {
+	gpio_t *g = (gpio_t*)(size_t)ptr;
+	if (g != NULL) gpio_stop(g);
+}
+
+JNIEXPORT jlongArray JNICALL
+Java_jd2xx_JD2XXGpio_nativeWaitChanges(JNIEnv *env, jclass cls, jlong ptr) {
+	gpio_t *g = (gpio_t*)(size_t)ptr;
+	jlong buf[2 * GPIO_RING_SIZE];
+	jlongArray arr;
+	FT_STATUS st;
+	int i, n;
+
+	if (g == NULL) return NULL; // closed
+	mutex_lock(&g->ev);
+	while (g->count == 0 && g->polling) cond_wait(&g->evc, &g->ev);
+	for (i = n = 0; g->count > 0; --g->count, ++n) {
+		change_t *c = &g->ring[g->head];
+		g->head = (g->head + 1) % GPIO_RING_SIZE;
+		buf[i++] = (jlong)c->time;
+		buf[i++] = ((jlong)c->changed << 16) | c->value;
+	}
+	st = g->error;
+	mutex_unlock(&g->ev);
+
+	if (n == 0) {
+		// sampler stopped: on request or because of an error
+		if (!FT_SUCCESS(st)) io_exception_status(env, st);
+		return NULL;
+	}
+
+	if ((arr = (*env)->NewLongArray(env, 2 * n)) != NULL)
+		(*env)->SetLongArrayRegion(env, arr, 0, 2 * n, buf);
+	return arr;
+}
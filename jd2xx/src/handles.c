@@ -0,0 +1,216 @@
+/*
+	Copyright (c) 2004 Pablo Bleyer Kocik.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	1. Redistributions of source code must retain the above copyright notice, this
+	list of conditions and the following disclaimer.
+
+	2. Redistributions in binary form must reproduce the above copyright notice,
+	this list of conditions and the following disclaimer in the documentation
+	and/or other materials provided with the distribution.
+
+	3. The name of the author may not be used to endorse or promote products
+	derived from this software without specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR IMPLIED
+	WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+	MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+	EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+	SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+	PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+	BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+	IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "jd2xx.h"
+
+/* Slot state: generation (32) | closing (1) | references (31) */
+#define SLOT_CLOSING 0x80000000ULL
+#define SLOT_REFS 0x7fffffffULL
+#define SLOT_GEN(s) ((unsigned long long)(s) >> 32)
+
+#define TOKEN_SLOT(t) ((int)((t) & 0xffff))
+#define TOKEN_GEN(t) ((unsigned long long)(t) >> 16)
+
+typedef struct {
+	volatile unsigned long long state;
+	FT_HANDLE volatile ft;
+	capture_t * volatile capture; // kept until the slot is freed
+	volatile jlong reads, read_bytes; // read calls and bytes, for the tuner
+	jint config[CONFIG_SIZE]; // last applied configuration, for configure
+} handle_slot;
+
+static handle_slot handles[HANDLE_TABLE_SIZE];
+static volatile int next_slot = 0; // allocation hint
+
+/** Look up slot for token */
+inline static handle_slot*
+token_slot(jlong tok) {
+	int i = TOKEN_SLOT(tok);
+	if (tok < 0 || i >= HANDLE_TABLE_SIZE) return NULL;
+	return handles + i;
+}
+
+/** Close driver handle and recycle slot (last reference gone) */
+static FT_STATUS
+slot_free(handle_slot *s) {
+	FT_HANDLE ft = s->ft;
+	capture_t *c = s->capture;
+	unsigned long long g = SLOT_GEN(s->state) + 1;
+
+	s->ft = NULL;
+	s->capture = NULL;
+	if ((g & 0xffffffffULL) == 0) g = 1; // generation 0 never valid
+	__sync_lock_test_and_set(&s->state, g << 32); // publish as free
+
+	if (c != NULL) capture_free(c); // finishes the file
+	return (ft != NULL) ? FT_Close(ft) : FT_OK;
+}
+
+jlong
+handle_register(FT_HANDLE ft) {
+	int n, i, k;
+
+	for (n=0; n<HANDLE_TABLE_SIZE; ++n) {
+		handle_slot *s;
+		unsigned long long st;
+
+		i = (next_slot + n) % HANDLE_TABLE_SIZE;
+		s = handles + i;
+		st = s->state;
+
+		if ((st & (SLOT_CLOSING|SLOT_REFS)) != 0) continue; // in use
+		if (SLOT_GEN(st) == 0) { // never used
+			if (!atomic_cas(&s->state, st, (1ULL << 32))) continue;
+			st = 1ULL << 32;
+		}
+		// the reference held by the open device
+		if (!atomic_cas(&s->state, st, st + 1)) continue;
+
+		s->reads = s->read_bytes = 0;
+		for (k=0; k<CONFIG_SIZE; ++k) s->config[k] = CONFIG_UNSET;
+		s->ft = ft;
+		next_slot = i + 1;
+		return (jlong)((SLOT_GEN(st) << 16) | i);
+	}
+
+	return (jlong)INVALID_HANDLE_VALUE;
+}
+
+FT_HANDLE
+handle_acquire(jlong tok) {
+	handle_slot *s = token_slot(tok);
+	unsigned long long st;
+
+	if (s == NULL) return NULL;
+
+	do {
+		st = s->state;
+		if (SLOT_GEN(st) != TOKEN_GEN(tok) || (st & SLOT_CLOSING)
+			|| (st & SLOT_REFS) == 0)
+			return NULL;
+	} while (!atomic_cas(&s->state, st, st + 1));
+
+	return s->ft;
+}
+
+void
+handle_release(jlong tok) {
+	handle_slot *s = token_slot(tok);
+
+	if (s != NULL && (atomic_sub(&s->state, 1) & SLOT_REFS) == 0)
+		slot_free(s); // closed while we were using it
+}
+
+int
+handle_close(jlong tok, FT_STATUS *st) {
+	handle_slot *s = token_slot(tok);
+	unsigned long long v;
+
+	*st = FT_OK;
+	if (s == NULL) return 0;
+
+	do {
+		v = s->state;
+		if (SLOT_GEN(v) != TOKEN_GEN(tok) || (v & SLOT_CLOSING)
+			|| (v & SLOT_REFS) == 0)
+			return 0;
+	} while (!atomic_cas(&s->state, v, v | SLOT_CLOSING));
+
+	// drop the reference held by the open device
+	if ((atomic_sub(&s->state, 1) & SLOT_REFS) == 0)
+		*st = slot_free(s);
+
+	return 1;
+}
+
+FT_HANDLE
+handle_detach(jlong tok) {
+	handle_slot *s = token_slot(tok);
+	FT_HANDLE ft;
+	unsigned long long v;
+	FT_STATUS st;
+
+	if (s == NULL) return NULL;
+
+	do {
+		v = s->state;
+		if (SLOT_GEN(v) != TOKEN_GEN(tok) || (v & SLOT_CLOSING)
+			|| (v & SLOT_REFS) == 0)
+			return NULL;
+		if ((v & SLOT_REFS) != 1) { // pinned by a call on another thread
+			handle_close(tok, &st);
+			return NULL;
+		}
+	} while (!atomic_cas(&s->state, v, v | SLOT_CLOSING));
+
+	// nobody can pin it any more: take the driver handle, recycle the slot
+	ft = s->ft;
+	s->ft = NULL;
+	if ((atomic_sub(&s->state, 1) & SLOT_REFS) == 0)
+		slot_free(s);
+
+	return ft;
+}
+
+capture_t *
+handle_capture(jlong tok) {
+	handle_slot *s = token_slot(tok);
+	return s != NULL ? s->capture : NULL;
+}
+
+capture_t *
+handle_set_capture(jlong tok, capture_t *c) {
+	handle_slot *s = token_slot(tok);
+
+	if (s == NULL) return NULL;
+	if (atomic_cas(&s->capture, NULL, c)) return c;
+	return s->capture;
+}
+
+jint *
+handle_config(jlong tok) {
+	handle_slot *s = token_slot(tok);
+	return s != NULL ? s->config : NULL;
+}
+
+void
+handle_count_read(jlong tok, size_t n) {
+	handle_slot *s = token_slot(tok);
+
+	if (s == NULL) return;
+	atomic_add(&s->reads, 1);
+	if (n > 0) atomic_add(&s->read_bytes, (jlong)n);
+}
+
+void
+handle_read_counts(jlong tok, jlong *reads, jlong *bytes) {
+	handle_slot *s = token_slot(tok);
+
+	*reads = s != NULL ? s->reads : 0;
+	*bytes = s != NULL ? s->read_bytes : 0;
+}
@@ -0,0 +1,264 @@
+/*
+	Copyright (c) 2004 Pablo Bleyer Kocik.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	1. Redistributions of source code must retain the above copyright notice, this
+	list of conditions and the following disclaimer.
+
+	2. Redistributions in binary form must reproduce the above copyright notice,
+	this list of conditions and the following disclaimer in the documentation
+	and/or other materials provided with the distribution.
+
+	3. The name of the author may not be used to endorse or promote products
+	derived from this software without specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR IMPLIED
+	WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+	MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+	EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+	SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+	PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+	BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+	IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/* Declarations shared by the JD2XX native sources */
+
+#ifndef JD2XX_H
+#define JD2XX_H
+
+#include <jni.h>
+
+#ifdef WIN32
+	#include <windows.h>
+#endif
+
+#undef WINAPI
+#define WINAPI
+#include "ftd2xx.h"
+
+#ifndef INVALID_HANDLE_VALUE
+#define INVALID_HANDLE_VALUE (-1)
+#endif
+
+/* Atomic primitives (GCC builtins, full barriers) */
+#define atomic_cas(p, o, n) __sync_bool_compare_and_swap((p), (o), (n))
+#define atomic_add(p, v) __sync_add_and_fetch((p), (v))
+#define atomic_sub(p, v) __sync_sub_and_fetch((p), (v))
+
+/*
+	Handle table
+
+	Java only ever sees a token (generation << 16 | slot) instead of the raw
+	FT_HANDLE. Every call pins the slot with handle_acquire and unpins it with
+	handle_release; both are a single compare-and-swap, there is no lock on
+	the I/O path. Closing marks the slot and drops the reference held by the
+	open device, so FT_Close runs when the last in-flight call returns. A
+	stale token (closed or reused slot) fails to acquire instead of passing a
+	freed handle to the driver.
+*/
+#define HANDLE_TABLE_SIZE 1024 // maximum number of simultaneously open handles
+
+/** Register an open driver handle
+	@return token or INVALID_HANDLE_VALUE if the table is full
+*/
+jlong handle_register(FT_HANDLE ft);
+/** Pin the handle for a token
+	@return driver handle or NULL if the token is not open
+*/
+FT_HANDLE handle_acquire(jlong tok);
+/** Unpin a handle obtained from handle_acquire */
+void handle_release(jlong tok);
+/** Close the handle for a token
+	@param st receives the FT_Close status (FT_OK if the close is deferred)
+	@return 0 if the token was not open, 1 otherwise
+*/
+int handle_close(jlong tok, FT_STATUS *st);
+/** Close a token but keep its driver handle open, for a device pool
+	@return the driver handle, NULL if the token was not open or a call on
+	another thread still uses it (the handle is then closed as usual)
+*/
+FT_HANDLE handle_detach(jlong tok);
+/** Last applied configuration of a pinned token (see config.c) */
+jint *handle_config(jlong tok);
+/** Count a read call returning n bytes on a pinned token */
+void handle_count_read(jlong tok, size_t n);
+/** Read calls and bytes counted since the token was opened */
+void handle_read_counts(jlong tok, jlong *reads, jlong *bytes);
+
+/*
+	Capture of device traffic (capture.c)
+
+	Transfers on a handle with a capture attached are recorded with their
+	time; the types are the JD2XXReplay record types.
+*/
+#define CAPTURE_READ 1
+#define CAPTURE_WRITE 2
+#define CAPTURE_MODEM_STATUS 3
+
+typedef struct capture capture_t;
+
+/** Capture attached to a pinned token, NULL if none */
+capture_t *handle_capture(jlong tok);
+/** Attach a capture to a pinned token unless it has one
+	@return the capture attached to it
+*/
+capture_t *handle_set_capture(jlong tok, capture_t *c);
+/** Record a transfer on a pinned token: reads are counted for the tuner,
+	and the transfer is captured if a capture is attached; never blocks */
+void capture_io(jlong tok, int type, const void *p, size_t n);
+/** Record a transfer */
+void capture_put(capture_t *c, int type, const void *p, size_t n);
+/** Stop a capture, finish its file and free it */
+void capture_free(capture_t *c);
+
+/* Helpers exported by JD2XX.c */
+
+/** Get handle token of a JD2XX object */
+jlong get_handle(JNIEnv *env, jobject obj);
+/** Pin driver handle for the duration of a call, throw if not open */
+FT_HANDLE acquire_handle(JNIEnv *env, jlong tok);
+/** Register an open driver handle with a JD2XX object; closes it and
+	throws if the handle table is full */
+void open_handle(JNIEnv *env, jobject obj, FT_HANDLE h);
+/** Take the driver handle out of a JD2XX object, leaving the object closed
+	@return driver handle, NULL if not open or in use (see handle_detach)
+*/
+FT_HANDLE detach_handle(JNIEnv *env, jobject obj);
+/** Throw exception of given class */
+void throw_new(JNIEnv *env, const char *cls, const char *msg);
+/** Throw IOException */
+void io_exception(JNIEnv *env, const char *msg);
+/** Throw IOException describing a driver status */
+void io_exception_status(JNIEnv *env, FT_STATUS st);
+/** Describe a driver status, e.g. "invalid parameter (6)"
+	@param buf at least 64 bytes
+	@return buf
+*/
+char *format_status(char *buf, FT_STATUS st);
+
+/*
+	CRC engine (crc.c)
+
+	The kinds are the JD2XXCrc constants; the state is the raw shift
+	register, see crc.c.
+*/
+#define CRC16_MODBUS 0
+#define CRC_CCITT 1
+#define CRC32 2
+#define CRC_KINDS 3
+
+/** Build the tables, once before any other crc_ call */
+void crc_init(void);
+/** Update the register with n bytes */
+unsigned int crc_update(int kind, unsigned int c, const unsigned char *s, size_t n);
+/** Copy n bytes from s to d and update the register in the same pass */
+unsigned int crc_copy(int kind, unsigned int c, unsigned char *d, const unsigned char *s, size_t n);
+/** Initial register value */
+unsigned int crc_start(int kind);
+/** Checksum for a register value */
+unsigned int crc_value(int kind, unsigned int c);
+/** Register value after data followed by its correct CRC */
+unsigned int crc_residue(int kind);
+/** CRC length in bytes, 0 for an unknown kind */
+int crc_size(int kind);
+
+/*
+	Device configuration (config.c)
+
+	JD2XX.DeviceConfig is marshalled into an int array with this layout;
+	CONFIG_UNSET leaves a setting as the driver has it. Settings made by
+	one driver call are adjacent. The handle table keeps the last applied
+	array of every open device, with CONFIG_UNSET for settings not known.
+*/
+#define CONFIG_UNSET (-1)
+#define CONFIG_BAUD_RATE 0
+#define CONFIG_WORD_LENGTH 1
+#define CONFIG_STOP_BITS 2
+#define CONFIG_PARITY 3
+#define CONFIG_FLOW_CONTROL 4
+#define CONFIG_XON_CHAR 5
+#define CONFIG_XOFF_CHAR 6
+#define CONFIG_READ_TIMEOUT 7
+#define CONFIG_WRITE_TIMEOUT 8
+#define CONFIG_LATENCY_TIMER 9
+#define CONFIG_IN_TRANSFER_SIZE 10
+#define CONFIG_OUT_TRANSFER_SIZE 11
+#define CONFIG_EVENT_CHAR 12
+#define CONFIG_EVENT_CHAR_ENABLED 13
+#define CONFIG_ERROR_CHAR 14
+#define CONFIG_ERROR_CHAR_ENABLED 15
+#define CONFIG_BIT_MASK 16
+#define CONFIG_BIT_MODE 17
+#define CONFIG_SIZE 18
+
+/** Apply a marshalled configuration to a driver handle, skipping the
+	calls whose settings already have the values in last
+	@param last last applied configuration, updated with what was set
+	@param step receives the name of the failed call
+	@param calls incremented for every driver call made, may be NULL
+	@return FT_OK or the status of the first call that failed
+*/
+FT_STATUS config_apply(FT_HANDLE h, const jint *cfg, jint *last, const char **step, int *calls);
+/** A call other than configure changed n settings of a pinned token from
+	first on: their last applied values become unknown */
+void config_forget(jlong tok, int first, int n);
+/** Another call set n settings of a pinned token from first on to v: store
+	them as last applied if st is a success, otherwise forget them */
+void config_record(jlong tok, FT_STATUS st, int first, int n, const jint *v);
+
+/*
+	Threads
+
+	Minimal portable layer for the native worker threads (thread.c): Win32
+	critical sections and condition variables, pthreads elsewhere.
+*/
+#ifdef WIN32
+typedef CRITICAL_SECTION mutex_t;
+typedef CONDITION_VARIABLE cond_t;
+typedef HANDLE thread_t;
+#define mutex_init(m) InitializeCriticalSection(m)
+#define mutex_destroy(m) DeleteCriticalSection(m)
+#define mutex_lock(m) EnterCriticalSection(m)
+#define mutex_unlock(m) LeaveCriticalSection(m)
+#define cond_init(c) InitializeConditionVariable(c)
+#define cond_destroy(c) ((void)0)
+#define cond_signal(c) WakeConditionVariable(c)
+#define cond_broadcast(c) WakeAllConditionVariable(c)
+#define cond_wait(c, m) SleepConditionVariableCS((c), (m), INFINITE)
+#else
+#include <pthread.h>
+typedef pthread_mutex_t mutex_t;
+typedef pthread_cond_t cond_t;
+typedef pthread_t thread_t;
+#define mutex_init(m) pthread_mutex_init((m), NULL)
+#define mutex_destroy(m) pthread_mutex_destroy(m)
+#define mutex_lock(m) pthread_mutex_lock(m)
+#define mutex_unlock(m) pthread_mutex_unlock(m)
+#define cond_init(c) pthread_cond_init((c), NULL)
+#define cond_destroy(c) pthread_cond_destroy(c)
+#define cond_signal(c) pthread_cond_signal(c)
+#define cond_broadcast(c) pthread_cond_broadcast(c)
+#define cond_wait(c, m) pthread_cond_wait((c), (m))
+#endif
+
+/** Start a thread running fn(arg)
+	@return 0 on success
+*/
+int thread_start(thread_t *t, void (*fn)(void *), void *arg);
+/** Wait for a thread to finish */
+void thread_join(thread_t t);
+/** Wait on a condition for at most ms milliseconds
+	@return 0 if signalled, nonzero on timeout
+*/
+int cond_timedwait_ms(cond_t *c, mutex_t *m, unsigned long ms);
+/** Monotonic clock in nanoseconds */
+unsigned long long monotonic_ns(void);
+/** Sleep until the monotonic clock reaches t (nanoseconds) */
+void sleep_until_ns(unsigned long long t);
+
+#endif // JD2XX_H
@@ -0,0 +1,606 @@
+/*
+	Copyright (c) 2004 Pablo Bleyer Kocik.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	1. Redistributions of source code must retain the above copyright notice, this
+	list of conditions and the following disclaimer.
+
+	2. Redistributions in binary form must reproduce the above copyright notice,
+	this list of conditions and the following disclaimer in the documentation
+	and/or other materials provided with the distribution.
+
+	3. The name of the author may not be used to endorse or promote products
+	derived from this software without specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR IMPLIED
+	WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+	MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+	EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+	SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+	PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+	BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+	IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+	Modbus RTU master
+
+	RTU frames are delimited by 3.5 character times of silence, which Java
+	cannot time through blocking reads. Here a response is collected by
+	polling FT_GetQueueStatus: it is complete when the length expected for
+	the request (or for an exception response) has arrived, or when the
+	line has been silent for t3.5 plus the latency timer, the longest the
+	chip may hold received bytes back in the middle of a frame. The next
+	request is sent no earlier than t3.5 after the last byte received.
+
+	RTU is half-duplex, so a bus carries one transaction at a time; each
+	JD2XXModbus object walks its poll table round-robin in a native thread
+	and buses on separate adapters poll in parallel. Results are stored per
+	poll entry and the ids of updated entries are handed to Java in
+	batches, coalescing updates Java has not picked up yet.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "jd2xx.h"
+#include "jd2xx_JD2XXModbus.h"
+
+#define MB_MAX_ADU 256 // RTU frame size limit
+#define MB_MAX_POLLS 1024
+#define MB_MAX_BITS 2000 // coils or inputs per read
+#define MB_MAX_REGS 125 // registers per read
+
+/** Poll table entry */
+typedef struct {
+	unsigned char req[8]; // encoded read request
+	int function, count;
+	size_t expect; // response length
+	int status; // last result
+	unsigned long long time; // end of the last transaction (ns)
+	jlong ok, errors;
+	int updated; // id queued for Java
+	jshort *values; // last values read
+} poll_t;
+
+/** Bus state, one per JD2XXModbus object */
+typedef struct {
+	jlong tok; // JD2XX handle token
+
+	mutex_t io; // serializes transactions, guards everything up to lock
+	unsigned long long chr, t35, gap; // character time, frame gap, end of frame silence (ns)
+	unsigned long long idle; // earliest time for the next request
+	unsigned long timeout; // response timeout (ms)
+	jlong transactions;
+
+	mutex_t lock; // guards everything below
+	cond_t cond;
+	poll_t *polls[MB_MAX_POLLS];
+	int npolls;
+	int updates[MB_MAX_POLLS]; // ids updated since the last wait
+	int nupdates;
+	unsigned long long period; // round-robin cycle time, 0 = back to back
+	thread_t poller;
+	int running;
+} modbus_t;
+
+static unsigned
+crc16(const unsigned char *p, size_t n) {
+	return crc_update(CRC16_MODBUS, crc_start(CRC16_MODBUS), p, n);
+}
+
+/** Append CRC, low byte first
+	@return frame length
+*/
+static size_t
+mb_seal(unsigned char *b, size_t n) {
+	unsigned crc = crc16(b, n);
+	b[n] = (unsigned char)crc;
+	b[n + 1] = (unsigned char)(crc >> 8);
+	return n + 2;
+}
+
+/** Check function code and quantity
+	@return expected response length, 0 if invalid
+*/
+static size_t
+mb_expect(int function, int count, int values) {
+	switch (function) {
+	case jd2xx_JD2XXModbus_READ_COILS:
+	case jd2xx_JD2XXModbus_READ_DISCRETE_INPUTS:
+		return count >= 1 && count <= MB_MAX_BITS ? 5 + (count + 7) / 8 : 0;
+	case jd2xx_JD2XXModbus_READ_HOLDING_REGISTERS:
+	case jd2xx_JD2XXModbus_READ_INPUT_REGISTERS:
+		return count >= 1 && count <= MB_MAX_REGS ? 5 + 2 * count : 0;
+	case jd2xx_JD2XXModbus_WRITE_SINGLE_COIL:
+	case jd2xx_JD2XXModbus_WRITE_SINGLE_REGISTER:
+		return count == 1 && values >= 1 ? 8 : 0;
+	case jd2xx_JD2XXModbus_WRITE_MULTIPLE_COILS:
+		return count >= 1 && count <= 1968 && values >= count ? 8 : 0;
+	case jd2xx_JD2XXModbus_WRITE_MULTIPLE_REGISTERS:
+		return count >= 1 && count <= 123 && values >= count ? 8 : 0;
+	}
+	return 0;
+}
+
+/** Encode a request
+	@return frame length
+*/
+static size_t
+mb_request(unsigned char *b, int slave, int function, int address, int count, const jshort *v) {
+	size_t n = 6;
+	int i;
+
+	b[0] = (unsigned char)slave;
+	b[1] = (unsigned char)function;
+	b[2] = (unsigned char)(address >> 8);
+	b[3] = (unsigned char)address;
+	b[4] = (unsigned char)(count >> 8);
+	b[5] = (unsigned char)count;
+
+	switch (function) {
+	case jd2xx_JD2XXModbus_WRITE_SINGLE_COIL:
+		b[4] = v[0] ? 0xff : 0;
+		b[5] = 0;
+		break;
+	case jd2xx_JD2XXModbus_WRITE_SINGLE_REGISTER:
+		b[4] = (unsigned char)(v[0] >> 8);
+		b[5] = (unsigned char)v[0];
+		break;
+	case jd2xx_JD2XXModbus_WRITE_MULTIPLE_COILS:
+		b[n++] = (unsigned char)((count + 7) / 8);
+		memset(b + n, 0, (count + 7) / 8);
+		for (i = 0; i < count; ++i)
+			if (v[i]) b[n + i / 8] |= 1 << (i % 8);
+		n += (count + 7) / 8;
+		break;
+	case jd2xx_JD2XXModbus_WRITE_MULTIPLE_REGISTERS:
+		b[n++] = (unsigned char)(2 * count);
+		for (i = 0; i < count; ++i) {
+			b[n++] = (unsigned char)(v[i] >> 8);
+			b[n++] = (unsigned char)v[i];
+		}
+		break;
+	}
+	return mb_seal(b, n);
+}
+
+/** Run one transaction on the bus
+	@return OK with the response in rsp/len, TIMEOUT or IO_ERROR
+*/
+static int
+mb_transact(modbus_t *m, const unsigned char *req, size_t n, size_t expect,
+	unsigned char *rsp, size_t *len) {
+	FT_HANDLE h;
+	FT_STATUS st;
+	DWORD q, done = 0;
+	size_t r = 0;
+	unsigned long long now, last, deadline, step;
+
+	mutex_lock(&m->io);
+	if ((h = handle_acquire(m->tok)) == NULL) {
+		mutex_unlock(&m->io);
+		return jd2xx_JD2XXModbus_IO_ERROR;
+	}
+
+	sleep_until_ns(m->idle);
+	st = FT_GetQueueStatus(h, &q);
+	if (FT_SUCCESS(st) && q > 0) st = FT_Purge(h, FT_PURGE_RX); // late answer to an earlier request
+	if (FT_SUCCESS(st)) {
+		st = FT_Write(h, (LPVOID)req, (DWORD)n, &done);
+		capture_io(m->tok, CAPTURE_WRITE, req, done);
+	}
+	if (FT_SUCCESS(st) && done != n) st = FT_IO_ERROR;
+
+	// the request is on the line for n characters after the write returns at the latest
+	last = monotonic_ns() + n * m->chr;
+	deadline = last + (unsigned long long)m->timeout * 1000000ULL;
+	step = m->chr < 50000 ? 50000 : m->chr > 1000000 ? 1000000 : m->chr;
+	if (req[0] == 0) expect = 0; // broadcast, no response
+
+	while (FT_SUCCESS(st) && expect > 0) {
+		if (!FT_SUCCESS(st = FT_GetQueueStatus(h, &q))) break;
+		now = monotonic_ns();
+		if (q > 0) {
+			if (q > MB_MAX_ADU - r) q = (DWORD)(MB_MAX_ADU - r);
+			if (!FT_SUCCESS(st = FT_Read(h, rsp + r, q, &done))) break;
+			capture_io(m->tok, CAPTURE_READ, rsp + r, done);
+			r += done;
+			last = now;
+			if (r >= 2 && (rsp[1] & 0x80)) expect = 5; // exception response
+			if (r >= expect || r == MB_MAX_ADU) break;
+		}
+		else if (r > 0 ? now - last >= m->gap : now >= deadline) break;
+		sleep_until_ns(now + step);
+	}
+
+	m->idle = last + m->t35;
+	m->transactions++;
+	handle_release(m->tok);
+	mutex_unlock(&m->io);
+
+	*len = r;
+	if (!FT_SUCCESS(st)) return jd2xx_JD2XXModbus_IO_ERROR;
+	return r > 0 || req[0] == 0 ? jd2xx_JD2XXModbus_OK : jd2xx_JD2XXModbus_TIMEOUT;
+}
+
+/** Validate a response and decode the values of a read
+	@return OK, exception code or error status
+*/
+static int
+mb_response(const unsigned char *req, const unsigned char *rsp, size_t len, size_t expect,
+	int count, jshort *v) {
+	int i;
+
+	if (req[0] == 0) return jd2xx_JD2XXModbus_OK;
+	if (len < 4) return jd2xx_JD2XXModbus_FRAME_ERROR;
+	if (crc16(rsp, len) != 0) return jd2xx_JD2XXModbus_CRC_ERROR;
+	if (rsp[0] != req[0] || (rsp[1] & 0x7f) != req[1]) return jd2xx_JD2XXModbus_FRAME_ERROR;
+	if (rsp[1] & 0x80) return len == 5 && rsp[2] != 0 ? rsp[2] : jd2xx_JD2XXModbus_FRAME_ERROR;
+	if (len != expect) return jd2xx_JD2XXModbus_FRAME_ERROR;
+
+	switch (req[1]) {
+	case jd2xx_JD2XXModbus_READ_COILS:
+	case jd2xx_JD2XXModbus_READ_DISCRETE_INPUTS:
+		if (rsp[2] != expect - 5) return jd2xx_JD2XXModbus_FRAME_ERROR;
+		for (i = 0; i < count; ++i) v[i] = (rsp[3 + i / 8] >> (i % 8)) & 1;
+		break;
+	case jd2xx_JD2XXModbus_READ_HOLDING_REGISTERS:
+	case jd2xx_JD2XXModbus_READ_INPUT_REGISTERS:
+		if (rsp[2] != expect - 5) return jd2xx_JD2XXModbus_FRAME_ERROR;
+		for (i = 0; i < count; ++i) v[i] = (jshort)(rsp[3 + 2 * i] << 8 | rsp[4 + 2 * i]);
+		break;
+	default: // writes echo address and quantity or value
+		if (memcmp(rsp + 2, req + 2, 4) != 0) return jd2xx_JD2XXModbus_FRAME_ERROR;
+	}
+	return jd2xx_JD2XXModbus_OK;
+}
+
+/** Wait until a monotonic time or until polling stops (lock held) */
+static void
+mb_wait_until(modbus_t *m, unsigned long long t) {
+	unsigned long long now;
+
+	while (m->running && (now = monotonic_ns()) < t) {
+		if (t - now >= 1000000ULL) cond_timedwait_ms(&m->cond, &m->lock, (unsigned long)((t - now) / 1000000ULL));
+		else {
+			mutex_unlock(&m->lock);
+			sleep_until_ns(t);
+			mutex_lock(&m->lock);
+		}
+	}
+}
+
+/** Poller thread: one round-robin pass over the poll table per period */
+static void
+mb_poller(void *arg) {
+	modbus_t *m = (modbus_t*)arg;
+	unsigned char req[8], rsp[MB_MAX_ADU];
+	jshort v[MB_MAX_BITS];
+	unsigned long long round = monotonic_ns();
+	size_t len, expect;
+	int i = 0, count, st;
+	poll_t *p;
+
+	mutex_lock(&m->lock);
+	while (m->running) {
+		if (m->npolls == 0) {
+			cond_wait(&m->cond, &m->lock);
+			continue;
+		}
+		if (i == m->npolls) { // start the next round
+			i = 0;
+			if (m->period > 0) {
+				round += m->period;
+				mb_wait_until(m, round);
+				if (round < monotonic_ns()) round = monotonic_ns(); // overrun, do not catch up
+			}
+			continue;
+		}
+
+		p = m->polls[i];
+		memcpy(req, p->req, sizeof(req));
+		expect = p->expect;
+		count = p->count;
+		mutex_unlock(&m->lock);
+
+		st = mb_transact(m, req, sizeof(req), expect, rsp, &len);
+		if (st == jd2xx_JD2XXModbus_OK) st = mb_response(req, rsp, len, expect, count, v);
+
+		mutex_lock(&m->lock);
+		p->status = st;
+		p->time = monotonic_ns();
+		if (st == jd2xx_JD2XXModbus_OK) {
+			memcpy(p->values, v, count * sizeof(jshort));
+			p->ok++;
+		}
+		else p->errors++;
+		if (!p->updated) {
+			p->updated = 1;
+			m->updates[m->nupdates++] = i;
+		}
+		cond_broadcast(&m->cond);
+		++i;
+	}
+	mutex_unlock(&m->lock);
+}
+
+/** Stop and join the poller thread */
+static void
+mb_stop(modbus_t *m) {
+	int running;
+
+	mutex_lock(&m->lock);
+	running = m->running;
+	m->running = 0;
+	cond_broadcast(&m->cond);
+	mutex_unlock(&m->lock);
+
+	if (running) thread_join(m->poller);
+}
+
+/** Get bus state, throw if closed */
+static modbus_t *
+mb_get(JNIEnv *env, jlong ptr) {
+	modbus_t *m = (modbus_t*)(size_t)ptr;
+	if (m == NULL) io_exception(env, "modbus closed");
+	return m;
+}
+
+/** Look up a poll entry (lock held), throw if the id is unknown */
+static poll_t *
+mb_poll(JNIEnv *env, modbus_t *m, jint id) {
+	if (id < 0 || id >= m->npolls) {
+		throw_new(env, "java/lang/IndexOutOfBoundsException", "poll id");
+		return NULL;
+	}
+	return m->polls[id];
+}
+
+JNIEXPORT jlong JNICALL
+Java_jd2xx_JD2XXModbus_nativeOpen(JNIEnv *env, jclass cls, jobject jd, jint baud, jint timeout) {
+	jlong tok = get_handle(env, jd);
+	FT_HANDLE h = acquire_handle(env, tok);
+	UCHAR latency = 16;
+	modbus_t *m;
+
+	if (h == NULL) return 0;
+	FT_GetLatencyTimer(h, &latency);
+	handle_release(tok);
+
+	if (baud <= 0) {
+		throw_new(env, "java/lang/IllegalArgumentException", "baud rate");
+		return 0;
+	}
+	if ((m = (modbus_t*)calloc(1, sizeof(modbus_t))) == NULL) {
+		io_exception_status(env, FT_INSUFFICIENT_RESOURCES);
+		return 0;
+	}
+
+	m->tok = tok;
+	m->chr = 11000000000ULL / (unsigned)baud; // start, 8 data, parity or second stop, stop
+	m->t35 = baud > 19200 ? 1750000ULL : m->chr * 7 / 2; // fixed above 19200 baud
+	m->gap = m->t35 + latency * 1000000ULL;
+	m->timeout = timeout;
+	mutex_init(&m->io);
+	mutex_init(&m->lock);
+	cond_init(&m->cond);
+	return (jlong)(size_t)m;
+}
+
+JNIEXPORT void JNICALL
+Java_jd2xx_JD2XXModbus_dispose(JNIEnv *env, jclass cls, jlong ptr) {
+	modbus_t *m = (modbus_t*)(size_t)ptr;
+	int i;
+
+	if (m == NULL) return;
+	mb_stop(m);
+	for (i = 0; i < m->npolls; ++i) {
+		free(m->polls[i]->values);
+		free(m->polls[i]);
+	}
+	cond_destroy(&m->cond);
+	mutex_destroy(&m->lock);
+	mutex_destroy(&m->io);
+	free(m);
+}
+
+JNIEXPORT void JNICALL
+Java_jd2xx_JD2XXModbus_nativeSetTimeout(JNIEnv *env, jclass cls, jlong ptr, jint timeout) {
+	modbus_t *m = mb_get(env, ptr);
+
+	if (m == NULL) return;
+	mutex_lock(&m->io);
+	m->timeout = timeout;
+	mutex_unlock(&m->io);
+}
+
+JNIEXPORT jint JNICALL
+Java_jd2xx_JD2XXModbus_nativeTransact(JNIEnv *env, jclass cls, jlong ptr,
+	jint slave, jint function, jint address, jint count, jshortArray values) {
+	modbus_t *m = mb_get(env, ptr);
+	unsigned char req[MB_MAX_ADU], rsp[MB_MAX_ADU];
+	jshort v[MB_MAX_BITS];
+	jint nv = values != NULL ? (*env)->GetArrayLength(env, values) : 0;
+	size_t n, len, expect;
+	int st;
+
+	if (m == NULL) return 0;
+	if ((expect = mb_expect(function, count, nv)) == 0 || slave < 0 || slave > 247
+		|| address < 0 || address > 0xffff) {
+		throw_new(env, "java/lang/IllegalArgumentException", "invalid request");
+		return 0;
+	}
+	if (function <= jd2xx_JD2XXModbus_READ_INPUT_REGISTERS && (slave == 0 || nv < count)) {
+		throw_new(env, "java/lang/IllegalArgumentException", slave == 0 ? "broadcast read" : "values array too short");
+		return 0;
+	}
+
+	if (function > jd2xx_JD2XXModbus_READ_INPUT_REGISTERS)
+		(*env)->GetShortArrayRegion(env, values, 0, count, v);
+	n = mb_request(req, slave, function, address, count, v);
+
+	st = mb_transact(m, req, n, expect, rsp, &len);
+	if (st == jd2xx_JD2XXModbus_IO_ERROR) {
+		io_exception(env, "modbus transaction failed");
+		return st;
+	}
+	if (st == jd2xx_JD2XXModbus_OK) st = mb_response(req, rsp, len, expect, count, v);
+	if (st == jd2xx_JD2XXModbus_OK && function <= jd2xx_JD2XXModbus_READ_INPUT_REGISTERS)
+		(*env)->SetShortArrayRegion(env, values, 0, count, v);
+	return st;
+}
+
+JNIEXPORT jint JNICALL
+Java_jd2xx_JD2XXModbus_nativeAddPoll(JNIEnv *env, jclass cls, jlong ptr,
+	jint slave, jint function, jint address, jint count) {
+	modbus_t *m = mb_get(env, ptr);
+	poll_t *p;
+	jint id;
+
+	if (m == NULL) return -1;
+	if (function > jd2xx_JD2XXModbus_READ_INPUT_REGISTERS || mb_expect(function, count, 0) == 0
+		|| slave < 1 || slave > 247 || address < 0 || address > 0xffff) {
+		throw_new(env, "java/lang/IllegalArgumentException", "invalid poll");
+		return -1;
+	}
+	if ((p = (poll_t*)calloc(1, sizeof(poll_t))) == NULL
+		|| (p->values = (jshort*)calloc(count, sizeof(jshort))) == NULL) {
+		free(p);
+		io_exception_status(env, FT_INSUFFICIENT_RESOURCES);
+		return -1;
+	}
+
+	mb_request(p->req, slave, function, address, count, NULL);
+	p->function = function;
+	p->count = count;
+	p->expect = mb_expect(function, count, 0);
+	p->status = jd2xx_JD2XXModbus_TIMEOUT; // nothing read yet
+
+	mutex_lock(&m->lock);
+	if ((id = m->npolls) < MB_MAX_POLLS) {
+		m->polls[m->npolls++] = p;
+		cond_broadcast(&m->cond);
+	}
+	mutex_unlock(&m->lock);
+
+	if (id == MB_MAX_POLLS) {
+		free(p->values);
+		free(p);
+		throw_new(env, "java/lang/IllegalStateException", "poll table full");
+		return -1;
+	}
+	return id;
+}
+
+JNIEXPORT void JNICALL
+Java_jd2xx_JD2XXModbus_nativeStartPolling(JNIEnv *env, jclass cls, jlong ptr, jint period) {
+	modbus_t *m = mb_get(env, ptr);
+	int started;
+
+	if (m == NULL) return;
+	mutex_lock(&m->lock);
+	m->period = (unsigned long long)(period > 0 ? period : 0) * 1000ULL;
+	started = m->running;
+	if (!started) m->running = 1;
+	mutex_unlock(&m->lock);
+
+	if (!started && thread_start(&m->poller, mb_poller, m) != 0) {
+		m->running = 0;
+		io_exception_status(env, FT_INSUFFICIENT_RESOURCES);
+	}
+}
+
+JNIEXPORT void JNICALL
+Java_jd2xx_JD2XXModbus_nativeStopPolling(JNIEnv *env, jclass cls, jlong ptr) {
+	modbus_t *m = mb_get(env, ptr);
+	if (m != NULL) mb_stop(m);
+}
+
+JNIEXPORT jintArray JNICALL
+Java_jd2xx_JD2XXModbus_nativeWaitResults(JNIEnv *env, jclass cls, jlong ptr, jint timeout) {
+	modbus_t *m = mb_get(env, ptr);
+	unsigned long long end, now;
+	jint ids[MB_MAX_POLLS];
+	jintArray arr;
+	int i, n;
+
+	if (m == NULL) return NULL;
+	end = monotonic_ns() + (unsigned long long)(timeout > 0 ? timeout : 0) * 1000000ULL;
+	mutex_lock(&m->lock);
+	while (m->nupdates == 0 && m->running && (now = monotonic_ns()) < end)
+		cond_timedwait_ms(&m->cond, &m->lock, (unsigned long)((end - now + 999999) / 1000000));
+	for (i = n = 0; i < m->nupdates; ++i) {
+		ids[n++] = m->updates[i];
+		m->polls[m->updates[i]]->updated = 0;
+	}
+	m->nupdates = 0;
+	mutex_unlock(&m->lock);
+
+	if (n == 0) return NULL;
+	if ((arr = (*env)->NewIntArray(env, n)) != NULL)
+		(*env)->SetIntArrayRegion(env, arr, 0, n, ids);
+	return arr;
+}
+
+JNIEXPORT jint JNICALL
+Java_jd2xx_JD2XXModbus_nativeGetValues(JNIEnv *env, jclass cls, jlong ptr, jint id, jshortArray values) {
+	modbus_t *m = mb_get(env, ptr);
+	jshort v[MB_MAX_BITS];
+	poll_t *p;
+	jint st = 0, n = 0;
+
+	if (m == NULL) return 0;
+	mutex_lock(&m->lock);
+	if ((p = mb_poll(env, m, id)) != NULL) {
+		st = p->status;
+		n = p->count;
+		memcpy(v, p->values, n * sizeof(jshort));
+	}
+	mutex_unlock(&m->lock);
+
+	if (p == NULL) return 0;
+	if (values != NULL) {
+		jint len = (*env)->GetArrayLength(env, values);
+		(*env)->SetShortArrayRegion(env, values, 0, n < len ? n : len, v);
+	}
+	return st;
+}
+
+JNIEXPORT jlongArray JNICALL
+Java_jd2xx_JD2XXModbus_nativeGetStatistics(JNIEnv *env, jclass cls, jlong ptr, jint id) {
+	modbus_t *m = mb_get(env, ptr);
+	jlong s[3];
+	jlongArray arr;
+	poll_t *p;
+
+	if (m == NULL) return NULL;
+	mutex_lock(&m->lock);
+	if ((p = mb_poll(env, m, id)) != NULL) {
+		s[0] = p->ok;
+		s[1] = p->errors;
+		s[2] = (jlong)p->time;
+	}
+	mutex_unlock(&m->lock);
+
+	if (p == NULL) return NULL;
+	if ((arr = (*env)->NewLongArray(env, 3)) != NULL)
+		(*env)->SetLongArrayRegion(env, arr, 0, 3, s);
+	return arr;
+}
+
+JNIEXPORT jlong JNICALL
+Java_jd2xx_JD2XXModbus_nativeGetTransactions(JNIEnv *env, jclass cls, jlong ptr) {
+	modbus_t *m = (modbus_t*)(size_t)ptr;
+	jlong n;
+
+	if (m == NULL) return 0;
+	mutex_lock(&m->io);
+	n = m->transactions;
+	mutex_unlock(&m->io);
+	return n;
+}
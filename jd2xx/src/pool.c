@@ -0,0 +1,284 @@
+/*
+	Copyright (c) 2004 Pablo Bleyer Kocik.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	1. Redistributions of source code must retain the above copyright notice, this
+	list of conditions and the following disclaimer.
+
+	2. Redistributions in binary form must reproduce the above copyright notice,
+	this list of conditions and the following disclaimer in the documentation
+	and/or other materials provided with the distribution.
+
+	3. The name of the author may not be used to endorse or promote products
+	derived from this software without specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR IMPLIED
+	WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+	MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+	EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+	SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+	PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+	BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+	IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+	Device pool
+
+	FT_OpenEx claims the interface, resets the chip and reads its EEPROM,
+	which takes 10 to 100 ms on Linux. A pool keeps the driver handles of
+	devices given back to it open, keyed by how they were opened (serial
+	number, description or location), and hands them out again instead of
+	opening the device.
+
+	Giving a device back takes its driver handle out of the handle table
+	(unless a call on another thread still uses it, in which case it is
+	closed as usual) and resets the state a new user relies on: both queues
+	are purged, bit mode is reset and the baud rate goes back to 9600. That
+	is done on release so that checkout stays cheap: it takes the most
+	recently released matching handle and checks that the device is still
+	there with FT_GetModemStatus and FT_GetQueueStatus, which the driver
+	answers from its own state, purging bytes that arrived while the handle
+	was idle. A handle that fails the check is closed and the device opened
+	afresh. Handles idle for longer than the idle time are closed by the
+	next pool call, the oldest one when a release finds the pool full.
+
+	Driver calls are made without the pool lock, so a slow FT_OpenEx or
+	FT_Close does not hold up other threads.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "jd2xx.h"
+#include "jd2xx_JD2XXPool.h"
+
+#define POOL_NAME_SIZE 256 // serial numbers and descriptions
+
+/** An idle driver handle */
+typedef struct {
+	DWORD flags; // FT_OPEN_BY_xxx
+	jint location;
+	char name[POOL_NAME_SIZE];
+	FT_HANDLE ft;
+	unsigned long long since; // release time (monotonic, ns)
+} pool_entry;
+
+/** Pool state, one per JD2XXPool object */
+typedef struct {
+	mutex_t lock; // guards everything below
+	unsigned long long idle; // ns
+	jlong hits, misses, stale;
+	int capacity, count;
+	pool_entry *entries; // oldest release first
+} pool_t;
+
+inline static pool_t*
+pool_get(JNIEnv *env, jlong ptr) {
+	pool_t *p = (pool_t*)(size_t)ptr;
+	if (p == NULL) io_exception(env, "pool closed");
+	return p;
+}
+
+/** Remove entry i (lock held)
+	@return its driver handle
+*/
+static FT_HANDLE
+pool_take(pool_t *p, int i) {
+	FT_HANDLE ft = p->entries[i].ft;
+	memmove(p->entries + i, p->entries + i + 1, (p->count - i - 1) * sizeof(pool_entry));
+	p->count--;
+	return ft;
+}
+
+/** Close the handles that have been idle too long */
+static void
+pool_expire(pool_t *p) {
+	unsigned long long now = monotonic_ns();
+	FT_HANDLE ft;
+
+	for (;;) {
+		mutex_lock(&p->lock);
+		ft = (p->count > 0 && now - p->entries[0].since > p->idle) ? pool_take(p, 0) : NULL;
+		mutex_unlock(&p->lock);
+		if (ft == NULL) break;
+		FT_Close(ft);
+	}
+}
+
+/** Key of a device as passed to FT_OpenEx
+	@return 0 if the name does not fit (the device is then not pooled)
+*/
+static int
+pool_key(JNIEnv *env, pool_entry *e, jstring name, jint location, jint flags) {
+	e->flags = (DWORD)flags;
+	e->location = location;
+	e->name[0] = 0;
+	if (flags != FT_OPEN_BY_LOCATION) {
+		jsize n = (*env)->GetStringUTFLength(env, name);
+		if (n >= POOL_NAME_SIZE) return 0;
+		(*env)->GetStringUTFRegion(env, name, 0, (*env)->GetStringLength(env, name), e->name);
+		e->name[n] = 0;
+	}
+	return 1;
+}
+
+inline static int
+pool_match(const pool_entry *a, const pool_entry *b) {
+	return a->flags == b->flags && (a->flags == FT_OPEN_BY_LOCATION
+		? a->location == b->location : strcmp(a->name, b->name) == 0);
+}
+
+JNIEXPORT jlong JNICALL
+Java_jd2xx_JD2XXPool_nativeCreate(JNIEnv *env, jclass cls, jint capacity, jint idle) {
+	pool_t *p;
+
+	if (capacity <= 0 || idle < 0) {
+		throw_new(env, "java/lang/IllegalArgumentException", "pool capacity or idle time");
+		return 0;
+	}
+	if ((p = (pool_t*)calloc(1, sizeof(pool_t))) == NULL
+		|| (p->entries = (pool_entry*)calloc(capacity, sizeof(pool_entry))) == NULL) {
+		free(p);
+		io_exception_status(env, FT_INSUFFICIENT_RESOURCES);
+		return 0;
+	}
+
+	p->capacity = capacity;
+	p->idle = (unsigned long long)idle * 1000000ULL;
+	mutex_init(&p->lock);
+	return (jlong)(size_t)p;
+}
+
+/** Close all idle handles and free the pool (cleaner action) */
+JNIEXPORT void JNICALL
+Java_jd2xx_JD2XXPool_dispose(JNIEnv *env, jclass cls, jlong ptr) {
+	pool_t *p = (pool_t*)(size_t)ptr;
+	int i;
+
+	if (p == NULL) return;
+	for (i = 0; i < p->count; ++i)
+		FT_Close(p->entries[i].ft);
+	mutex_destroy(&p->lock);
+	free(p->entries);
+	free(p);
+}
+
+/** Open a device into an unopened JD2XX object, from the pool if possible */
+JNIEXPORT void JNICALL
+Java_jd2xx_JD2XXPool_nativeOpen(JNIEnv *env, jclass cls, jlong ptr, jobject jd,
+	jstring name, jint location, jint flags) {
+	pool_t *p = pool_get(env, ptr);
+	pool_entry key;
+	FT_HANDLE ft = NULL;
+	FT_STATUS st;
+	ULONG modem;
+	DWORD rx;
+	int i, pooled;
+
+	if (p == NULL) return;
+	if (get_handle(env, jd) != (jlong)INVALID_HANDLE_VALUE) {
+		io_exception(env, "device already opened");
+		return;
+	}
+	pooled = pool_key(env, &key, name, location, flags);
+	pool_expire(p);
+
+	while (pooled) {
+		mutex_lock(&p->lock);
+		for (i = p->count - 1; i >= 0; --i)
+			if (pool_match(p->entries + i, &key)) break;
+		ft = (i >= 0) ? pool_take(p, i) : NULL;
+		mutex_unlock(&p->lock);
+		if (ft == NULL) break;
+
+		// still there, and quiet since it was released?
+		if (FT_SUCCESS(FT_GetModemStatus(ft, &modem))
+			&& FT_SUCCESS(FT_GetQueueStatus(ft, &rx))
+			&& (rx == 0 || FT_SUCCESS(FT_Purge(ft, FT_PURGE_RX))))
+			break;
+
+		FT_Close(ft);
+		ft = NULL;
+		mutex_lock(&p->lock);
+		p->stale++;
+		mutex_unlock(&p->lock);
+	}
+
+	mutex_lock(&p->lock);
+	if (ft != NULL) p->hits++;
+	else p->misses++;
+	mutex_unlock(&p->lock);
+
+	if (ft == NULL) {
+		if (flags == FT_OPEN_BY_LOCATION)
+			st = FT_OpenEx((PVOID)(size_t)location, (DWORD)flags, &ft);
+		else {
+			const char *s = (*env)->GetStringUTFChars(env, name, 0);
+			if (s == NULL) return;
+			st = FT_OpenEx((PVOID)s, (DWORD)flags, &ft);
+			(*env)->ReleaseStringUTFChars(env, name, s);
+		}
+		if (!FT_SUCCESS(st)) {
+			io_exception_status(env, st);
+			return;
+		}
+	}
+
+	open_handle(env, jd, ft);
+}
+
+/** Take the driver handle of an open JD2XX object into the pool; the
+	object is left closed */
+JNIEXPORT void JNICALL
+Java_jd2xx_JD2XXPool_nativeRelease(JNIEnv *env, jclass cls, jlong ptr, jobject jd,
+	jstring name, jint location, jint flags) {
+	pool_t *p = pool_get(env, ptr);
+	pool_entry key;
+	FT_HANDLE ft, old = NULL;
+
+	if (p == NULL) return;
+	if ((ft = detach_handle(env, jd)) == NULL) return;
+
+	// the state a new user must not inherit
+	if (!pool_key(env, &key, name, location, flags)
+		|| !FT_SUCCESS(FT_Purge(ft, FT_PURGE_RX | FT_PURGE_TX))
+		|| !FT_SUCCESS(FT_SetBitMode(ft, 0, FT_BITMODE_RESET))
+		|| !FT_SUCCESS(FT_SetBaudRate(ft, FT_BAUD_9600))) {
+		FT_Close(ft);
+		return;
+	}
+	key.ft = ft;
+	key.since = monotonic_ns();
+
+	pool_expire(p);
+	mutex_lock(&p->lock);
+	if (p->count == p->capacity) old = pool_take(p, 0);
+	p->entries[p->count++] = key;
+	mutex_unlock(&p->lock);
+	if (old != NULL) FT_Close(old);
+}
+
+/** @return hits, misses, stale handles closed on checkout, idle handles */
+JNIEXPORT jlongArray JNICALL
+Java_jd2xx_JD2XXPool_nativeGetStatistics(JNIEnv *env, jclass cls, jlong ptr) {
+	pool_t *p = pool_get(env, ptr);
+	jlong s[4];
+	jlongArray arr;
+
+	if (p == NULL) return NULL;
+	mutex_lock(&p->lock);
+	s[0] = p->hits;
+	s[1] = p->misses;
+	s[2] = p->stale;
+	s[3] = p->count;
+	mutex_unlock(&p->lock);
+
+	if ((arr = (*env)->NewLongArray(env, 4)) != NULL)
+		(*env)->SetLongArrayRegion(env, arr, 0, 4, s);
+	return arr;
+}
@@ -0,0 +1,306 @@
+/*
+	Copyright (c) 2004 Pablo Bleyer Kocik.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	1. Redistributions of source code must retain the above copyright notice, this
+	list of conditions and the following disclaimer.
+
+	2. Redistributions in binary form must reproduce the above copyright notice,
+	this list of conditions and the following disclaimer in the documentation
+	and/or other materials provided with the distribution.
+
+	3. The name of the author may not be used to endorse or promote products
+	derived from this software without specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR IMPLIED
+	WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+	MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+	EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+	SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+	PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+	BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+	IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+	Timestamped receiver
+
+	A native thread per device polls FT_GetQueueStatus at a fixed period
+	and drains whatever has arrived with one FT_Read straight into a ring
+	buffer, as a record [timestamp, length, bytes]. The timestamp is the
+	monotonic clock (CLOCK_MONOTONIC, the clock behind System.nanoTime on
+	Linux) at the poll that saw the bytes, so it does not depend on when
+	Java gets to them and records of several devices can be merged by
+	time. Java takes whole records in batches: receive() copies as many as
+	fit into its direct buffer under one lock round trip.
+
+	The ring has one producer and one consumer: the reader reserves space
+	under the lock, reads into it without the lock and publishes the
+	record; the consumer copies records out and then releases their space.
+	A record never wraps; the space left at the end of the ring is skipped
+	(with a padding record when there is room for a header). When the ring
+	is full the reader waits for Java and the bytes stay queued in the
+	driver, to be stamped late; such waits are counted as stalls.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "jd2xx.h"
+#include "jd2xx_JD2XXReceiver.h"
+
+#define HEADER jd2xx_JD2XXReceiver_HEADER // timestamp (8 bytes), length (4 bytes)
+#define MIN_RECORD 64 // shorter tail space is skipped rather than split into
+
+/** Receiver state, one per JD2XXReceiver object */
+typedef struct {
+	jlong tok; // JD2XX handle token
+	unsigned long long period; // poll period (ns)
+	size_t max; // longest record payload
+
+	mutex_t lock; // guards everything below
+	cond_t cond;
+	unsigned char *ring;
+	size_t size;
+	unsigned long long head, tail; // bytes written, bytes released
+	int running;
+	FT_STATUS error; // driver error that stopped the reader
+	jlong records, bytes, stalls;
+	thread_t reader;
+} receiver_t;
+
+/** Write a record header */
+static void
+put_header(unsigned char *p, jlong ts, jint len) {
+	memcpy(p, &ts, sizeof(ts));
+	memcpy(p + 8, &len, sizeof(len));
+}
+
+/** Reserve ring space for a record of up to n bytes (lock held), skipping
+	the end of the ring when the record does not fit there
+	@return payload size that fits, 0 if the ring is full
+*/
+static size_t
+rx_reserve(receiver_t *r, size_t n) {
+	size_t free, off, contig, avail;
+
+	for (;;) {
+		free = r->size - (size_t)(r->head - r->tail);
+		off = (size_t)(r->head % r->size);
+		contig = r->size - off;
+		avail = contig < free ? contig : free;
+
+		if (contig < HEADER + (n < MIN_RECORD ? n : MIN_RECORD) && free >= contig) {
+			if (contig >= HEADER) put_header(r->ring + off, 0, -1); // padding
+			r->head += contig;
+			continue;
+		}
+		if (avail < HEADER + 1) return 0;
+		return n < avail - HEADER ? n : avail - HEADER;
+	}
+}
+
+static void
+rx_reader(void *arg) {
+	receiver_t *r = (receiver_t*)arg;
+	unsigned long long next = monotonic_ns(), ts;
+	DWORD queued, got;
+	FT_HANDLE h;
+	FT_STATUS st;
+	size_t n, off;
+	unsigned char *p;
+
+	mutex_lock(&r->lock);
+	while (r->running) {
+		mutex_unlock(&r->lock);
+
+		queued = 0;
+		if ((h = handle_acquire(r->tok)) == NULL) st = FT_INVALID_HANDLE;
+		else {
+			st = FT_GetQueueStatus(h, &queued);
+			handle_release(r->tok);
+		}
+		ts = monotonic_ns();
+
+		mutex_lock(&r->lock);
+		if (!FT_SUCCESS(st)) break;
+		if (queued == 0) { // nothing yet, poll again one period later
+			mutex_unlock(&r->lock);
+			next += r->period;
+			if (next < ts) next = ts; // overrun, do not catch up
+			sleep_until_ns(next);
+			mutex_lock(&r->lock);
+			continue;
+		}
+
+		n = queued < r->max ? queued : r->max;
+		if ((n = rx_reserve(r, n)) == 0) { // full, wait for receive()
+			r->stalls++;
+			cond_timedwait_ms(&r->cond, &r->lock, 100);
+			continue;
+		}
+		off = (size_t)(r->head % r->size);
+		p = r->ring + off;
+		mutex_unlock(&r->lock);
+
+		got = 0;
+		if ((h = handle_acquire(r->tok)) == NULL) st = FT_INVALID_HANDLE;
+		else {
+			st = FT_Read(h, p + HEADER, (DWORD)n, &got);
+			capture_io(r->tok, CAPTURE_READ, p + HEADER, got);
+			handle_release(r->tok);
+		}
+
+		mutex_lock(&r->lock);
+		if (got > 0) {
+			put_header(p, (jlong)ts, (jint)got);
+			r->head += HEADER + got;
+			r->records++;
+			r->bytes += got;
+			cond_broadcast(&r->cond);
+		}
+		if (!FT_SUCCESS(st)) break;
+		next = ts;
+	}
+	if (r->running) { // stopped by an error
+		r->error = st;
+		r->running = 0;
+	}
+	cond_broadcast(&r->cond);
+	mutex_unlock(&r->lock);
+}
+
+/** Get receiver state, throw if closed */
+static receiver_t *
+rx_get(JNIEnv *env, jlong ptr) {
+	receiver_t *r = (receiver_t*)(size_t)ptr;
+	if (r == NULL) io_exception(env, "receiver closed");
+	return r;
+}
+
+JNIEXPORT jlong JNICALL
+Java_jd2xx_JD2XXReceiver_nativeOpen(JNIEnv *env, jclass cls, jobject jd,
+	jint size, jint batch, jint period) {
+	jlong tok = get_handle(env, jd);
+	receiver_t *r;
+
+	if (size < 4 * (HEADER + MIN_RECORD) || batch < HEADER + MIN_RECORD || period <= 0) {
+		throw_new(env, "java/lang/IllegalArgumentException", "receiver buffer size or period");
+		return 0;
+	}
+	if ((r = (receiver_t*)calloc(1, sizeof(receiver_t))) == NULL
+		|| (r->ring = (unsigned char*)malloc(size)) == NULL) {
+		free(r);
+		io_exception_status(env, FT_INSUFFICIENT_RESOURCES);
+		return 0;
+	}
+
+	r->tok = tok;
+	r->period = (unsigned long long)period * 1000ULL;
+	r->size = size;
+	// a record must fit into a batch and leave room for others in the ring
+	r->max = (size_t)(batch - HEADER) < (size_t)size / 4 ? (size_t)(batch - HEADER) : (size_t)size / 4;
+	r->running = 1;
+	mutex_init(&r->lock);
+	cond_init(&r->cond);
+
+	if (thread_start(&r->reader, rx_reader, r) != 0) {
+		cond_destroy(&r->cond);
+		mutex_destroy(&r->lock);
+		free(r->ring);
+		free(r);
+		io_exception_status(env, FT_INSUFFICIENT_RESOURCES);
+		return 0;
+	}
+	return (jlong)(size_t)r;
+}
+
+JNIEXPORT void JNICALL
+Java_jd2xx_JD2XXReceiver_dispose(JNIEnv *env, jclass cls, jlong ptr) {
+	receiver_t *r = (receiver_t*)(size_t)ptr;
+
+	if (r == NULL) return;
+	mutex_lock(&r->lock);
+	r->running = 0;
+	cond_broadcast(&r->cond);
+	mutex_unlock(&r->lock);
+	thread_join(r->reader);
+
+	cond_destroy(&r->cond);
+	mutex_destroy(&r->lock);
+	free(r->ring);
+	free(r);
+}
+
+/** Copy whole records into the batch buffer
+	@return records << 32 | bytes
+*/
+JNIEXPORT jlong JNICALL
+Java_jd2xx_JD2XXReceiver_nativeReceive(JNIEnv *env, jclass cls, jlong ptr,
+	jobject data, jint timeout) {
+	receiver_t *r = rx_get(env, ptr);
+	unsigned char *out = (unsigned char*)(*env)->GetDirectBufferAddress(env, data);
+	size_t cap = (size_t)(*env)->GetDirectBufferCapacity(env, data);
+	unsigned long long end, now, head, tail;
+	size_t pos = 0, off, rest, n;
+	jint len = 0, count = 0;
+	FT_STATUS st;
+
+	if (r == NULL) return 0;
+	end = monotonic_ns() + (unsigned long long)(timeout > 0 ? timeout : 0) * 1000000ULL;
+	mutex_lock(&r->lock);
+	while (r->head == r->tail && r->running && (now = monotonic_ns()) < end)
+		cond_timedwait_ms(&r->cond, &r->lock, (unsigned long)((end - now + 999999) / 1000000));
+	head = r->head;
+	tail = r->tail;
+	st = r->error;
+	mutex_unlock(&r->lock);
+
+	// records between tail and head belong to us until tail is moved
+	while (tail < head) {
+		off = (size_t)(tail % r->size);
+		rest = r->size - off;
+		if (rest >= HEADER) memcpy(&len, r->ring + off + 8, sizeof(len));
+		if (rest < HEADER || len < 0) { // skipped end of the ring
+			tail += rest;
+			continue;
+		}
+		n = HEADER + len;
+		if (pos + n > cap) break;
+		memcpy(out + pos, r->ring + off, n);
+		pos += n;
+		tail += n;
+		++count;
+	}
+
+	mutex_lock(&r->lock);
+	r->tail = tail;
+	cond_broadcast(&r->cond);
+	mutex_unlock(&r->lock);
+
+	if (count == 0 && head == tail && !FT_SUCCESS(st)) io_exception_status(env, st);
+	return (jlong)count << 32 | (jlong)pos;
+}
+
+JNIEXPORT jlongArray JNICALL
+Java_jd2xx_JD2XXReceiver_nativeGetStatistics(JNIEnv *env, jclass cls, jlong ptr) {
+	receiver_t *r = rx_get(env, ptr);
+	jlong s[4];
+	jlongArray arr;
+
+	if (r == NULL) return NULL;
+	mutex_lock(&r->lock);
+	s[0] = r->records;
+	s[1] = r->bytes;
+	s[2] = r->stalls;
+	s[3] = (jlong)(r->head - r->tail);
+	mutex_unlock(&r->lock);
+
+	if ((arr = (*env)->NewLongArray(env, 4)) != NULL)
+		(*env)->SetLongArrayRegion(env, arr, 0, 4, s);
+	return arr;
+}
@@ -0,0 +1,162 @@
+/*
+	Copyright (c) 2004 Pablo Bleyer Kocik.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	1. Redistributions of source code must retain the above copyright notice, this
+	list of conditions and the following disclaimer.
+
+	2. Redistributions in binary form must reproduce the above copyright notice,
+	this list of conditions and the following disclaimer in the documentation
+	and/or other materials provided with the distribution.
+
+	3. The name of the author may not be used to endorse or promote products
+	derived from this software without specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR IMPLIED
+	WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+	MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+	EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+	SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+	PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+	BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+	IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/* Portable thread primitives for the native worker threads */
+
+#include <stdlib.h>
+
+#include "jd2xx.h"
+
+#ifndef WIN32
+#include <errno.h>
+#include <time.h>
+#endif
+
+/** Thread start trampoline argument */
+typedef struct {
+	void (*fn)(void *);
+	void *arg;
+} thread_arg_t;
+
+#ifdef WIN32
+
+static DWORD __stdcall
+thread_main(LPVOID p) {
+	thread_arg_t a = *(thread_arg_t*)p;
+	free(p);
+	a.fn(a.arg);
+	return 0;
+}
+
+int
+thread_start(thread_t *t, void (*fn)(void *), void *arg) {
+	thread_arg_t *a = (thread_arg_t*)malloc(sizeof(thread_arg_t));
+
+	if (a == NULL) return -1;
+	a->fn = fn;
+	a->arg = arg;
+	if ((*t = CreateThread(NULL, 0, thread_main, a, 0, NULL)) == NULL) {
+		free(a);
+		return -1;
+	}
+	return 0;
+}
+
+void
+thread_join(thread_t t) {
+	WaitForSingleObject(t, INFINITE);
+	CloseHandle(t);
+}
+
+int
+cond_timedwait_ms(cond_t *c, mutex_t *m, unsigned long ms) {
+	return !SleepConditionVariableCS(c, m, ms);
+}
+
+unsigned long long
+monotonic_ns(void) {
+	static LARGE_INTEGER freq;
+	LARGE_INTEGER now;
+
+	if (freq.QuadPart == 0) QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&now);
+	return (unsigned long long)(now.QuadPart / freq.QuadPart) * 1000000000ULL
+		+ (unsigned long long)(now.QuadPart % freq.QuadPart) * 1000000000ULL / freq.QuadPart;
+}
+
+void
+sleep_until_ns(unsigned long long t) {
+	unsigned long long now = monotonic_ns();
+	if (t > now) Sleep((DWORD)((t - now + 999999) / 1000000));
+}
+
+#else
+
+static void*
+thread_main(void *p) {
+	thread_arg_t a = *(thread_arg_t*)p;
+	free(p);
+	a.fn(a.arg);
+	return NULL;
+}
+
+int
+thread_start(thread_t *t, void (*fn)(void *), void *arg) {
+	thread_arg_t *a = (thread_arg_t*)malloc(sizeof(thread_arg_t));
+
+	if (a == NULL) return -1;
+	a->fn = fn;
+	a->arg = arg;
+	if (pthread_create(t, NULL, thread_main, a) != 0) {
+		free(a);
+		return -1;
+	}
+	return 0;
+}
+
+void
+thread_join(thread_t t) {
+	pthread_join(t, NULL);
+}
+
+int
+cond_timedwait_ms(cond_t *c, mutex_t *m, unsigned long ms) {
+	// condition variables wait on CLOCK_REALTIME by default
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_sec += ms / 1000;
+	ts.tv_nsec += (ms % 1000) * 1000000L;
+	if (ts.tv_nsec >= 1000000000L) {
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000L;
+	}
+	return pthread_cond_timedwait(c, m, &ts) == ETIMEDOUT;
+}
+
+unsigned long long
+monotonic_ns(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void
+sleep_until_ns(unsigned long long t) {
+	unsigned long long now = monotonic_ns();
+	struct timespec ts;
+
+	if (t <= now) return;
+	t -= now;
+	ts.tv_sec = t / 1000000000ULL;
+	ts.tv_nsec = t % 1000000000ULL;
+	while (nanosleep(&ts, &ts) == -1 && errno == EINTR) ;
+}
+
+#endif
@@ -0,0 +1,370 @@
+/*
+	Copyright (c) 2004 Pablo Bleyer Kocik.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	1. Redistributions of source code must retain the above copyright notice, this
+	list of conditions and the following disclaimer.
+
+	2. Redistributions in binary form must reproduce the above copyright notice,
+	this list of conditions and the following disclaimer in the documentation
+	and/or other materials provided with the distribution.
+
+	3. The name of the author may not be used to endorse or promote products
+	derived from this software without specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR IMPLIED
+	WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+	MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+	EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+	SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+	PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+	BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+	IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+	Latency timer and transfer size tuner
+
+	A native thread per device samples the receive queue every period and
+	the read calls counted by the I/O paths (handle_count_read), and once
+	per window of samples derives the arrival rate, how often data was
+	waiting, the deepest queue and the longest idle gap. From these it
+	picks a latency timer and an IN transfer size within the bounds given
+	by the application:
+
+	LATENCY: the lowest latency timer, and transfers about the size of
+		the data arriving in one latency period, so the host gets bytes as
+		soon as the chip flushes them.
+	THROUGHPUT: the highest latency timer for a continuous stream (data
+		waiting in 9 of 10 samples), otherwise twice the time a 64-byte
+		packet takes to fill at the observed rate, so that packets go out
+		full; transfers hold about 4 ms of data.
+
+	With both goals transfers are also kept above 4/3 of the deepest
+	queue seen; a queue reaching 3/4 of the current transfer size raises
+	it at once, as the reader is falling behind. Other changes
+	take effect only when two windows in a row ask for them, since every
+	change is a control transfer to the chip; windows without traffic
+	change nothing. The decisions are counted and their reasons kept for
+	getStatistics().
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "jd2xx.h"
+#include "jd2xx_JD2XXTuner.h"
+
+#define GOAL_LATENCY jd2xx_JD2XXTuner_LATENCY
+#define GOAL_THROUGHPUT jd2xx_JD2XXTuner_THROUGHPUT
+#define PACKET 64 // USB full speed packet, the unit the latency timer flushes
+
+/** Tuner state, one per JD2XXTuner object */
+typedef struct {
+	jlong tok; // JD2XX handle token
+	int goal;
+	int lat_min, lat_max; // latency timer bounds (ms)
+	int xfer_min, xfer_max; // transfer size bounds (bytes, multiples of 64)
+	unsigned long long period; // sample period (ns)
+	int window; // samples per decision
+
+	mutex_t lock; // guards everything below
+	cond_t cond;
+	int running;
+	FT_STATUS error; // driver error that stopped the tuner
+	int latency, transfer; // settings applied
+	int lat_pending, xfer_pending, lat_votes, xfer_votes; // hysteresis
+	jlong stats[jd2xx_JD2XXTuner_STATISTICS];
+	thread_t worker;
+} tuner_t;
+
+/** Smallest multiple of 64 that is a power of two and at least n, within bounds */
+static int
+transfer_size(tuner_t *t, double n) {
+	int x = PACKET;
+
+	while (x < n && x < t->xfer_max) x <<= 1;
+	if (x < t->xfer_min) x = t->xfer_min;
+	if (x > t->xfer_max) x = t->xfer_max;
+	return x;
+}
+
+/** Count a vote for a new value
+	@return true when it has been asked for by two windows in a row
+*/
+static int
+vote(int target, int current, int *pending, int *votes) {
+	if (target == current) {
+		*votes = 0;
+		return 0;
+	}
+	if (target != *pending) {
+		*pending = target;
+		*votes = 0;
+	}
+	return ++*votes >= 2;
+}
+
+/** Decide the settings after a window (lock held)
+	@param rate bytes per second read during the window
+	@param busy samples that saw data waiting or read
+	@param peak deepest receive queue
+*/
+static void
+decide(tuner_t *t, double rate, int busy, int samples, jlong peak, int *lat, int *xfer) {
+	int l, x, lr, xr = jd2xx_JD2XXTuner_REASON_RATE;
+	double need;
+
+	*lat = t->latency;
+	*xfer = t->transfer;
+	if (busy == 0) return; // idle window, nothing to learn from
+
+	if (t->goal == GOAL_LATENCY) {
+		l = t->lat_min;
+		lr = jd2xx_JD2XXTuner_REASON_GOAL;
+		need = rate * t->lat_min / 1000.0;
+	}
+	else {
+		if (busy * 10 >= samples * 9) {
+			l = t->lat_max;
+			lr = jd2xx_JD2XXTuner_REASON_STREAM;
+		}
+		else {
+			double fill = rate > 0 ? 2000.0 * PACKET / rate : t->lat_max; // ms
+			l = fill > t->lat_max ? t->lat_max : fill < t->lat_min ? t->lat_min : (int)(fill + 0.5);
+			lr = jd2xx_JD2XXTuner_REASON_FILL;
+		}
+		need = rate * 0.004;
+	}
+	if (peak * 4.0 / 3 > need) { // keep the deepest queue under 3/4 of a transfer
+		need = peak * 4.0 / 3;
+		xr = jd2xx_JD2XXTuner_REASON_BACKLOG;
+	}
+	x = transfer_size(t, need);
+	if (x > t->transfer && peak * 4 >= (jlong)t->transfer * 3) {
+		t->xfer_votes = 1; // falling behind, applies now
+		t->xfer_pending = x;
+	}
+
+	if (vote(l, t->latency, &t->lat_pending, &t->lat_votes)) {
+		*lat = l;
+		t->stats[jd2xx_JD2XXTuner_LATENCY_REASON] = lr;
+	}
+	if (vote(x, t->transfer, &t->xfer_pending, &t->xfer_votes)) {
+		*xfer = x;
+		t->stats[jd2xx_JD2XXTuner_TRANSFER_REASON] = xr;
+	}
+}
+
+/** Apply settings (lock not held); the OUT transfer size is left as the
+	application set it, the driver ignores an OUT size of 0 */
+static FT_STATUS
+apply(tuner_t *t, jint lat, jint xfer, int set_lat, int set_xfer) {
+	FT_HANDLE h;
+	FT_STATUS st = FT_OK;
+
+	if ((h = handle_acquire(t->tok)) == NULL) return FT_INVALID_HANDLE;
+	if (set_lat) {
+		st = FT_SetLatencyTimer(h, (UCHAR)lat);
+		config_record(t->tok, st, CONFIG_LATENCY_TIMER, 1, &lat);
+	}
+	if (FT_SUCCESS(st) && set_xfer) {
+		st = FT_SetUSBParameters(h, (ULONG)xfer, 0);
+		config_record(t->tok, st, CONFIG_IN_TRANSFER_SIZE, 1, &xfer);
+	}
+	handle_release(t->tok);
+	return st;
+}
+
+static void
+tuner_worker(void *arg) {
+	tuner_t *t = (tuner_t*)arg;
+	unsigned long long next = monotonic_ns(), start = next, now;
+	jlong reads0, bytes0, reads, bytes, last, peak = 0;
+	int samples = 0, busy = 0, gap = 0, gap_max = 0, lat, xfer;
+	double rate;
+	DWORD queued;
+	FT_HANDLE h;
+	FT_STATUS st = FT_OK;
+
+	handle_read_counts(t->tok, &reads0, &bytes0);
+	last = bytes0;
+
+	mutex_lock(&t->lock);
+	while (t->running) {
+		mutex_unlock(&t->lock);
+
+		next += t->period;
+		now = monotonic_ns();
+		if (next < now) next = now; // overrun, do not catch up
+		sleep_until_ns(next);
+
+		queued = 0;
+		if ((h = handle_acquire(t->tok)) == NULL) st = FT_INVALID_HANDLE;
+		else {
+			st = FT_GetQueueStatus(h, &queued);
+			handle_release(t->tok);
+		}
+		handle_read_counts(t->tok, &reads, &bytes);
+
+		mutex_lock(&t->lock);
+		if (!FT_SUCCESS(st)) break;
+		++samples;
+		if (queued > 0 || bytes != last) {
+			++busy;
+			gap = 0;
+		}
+		else if (++gap > gap_max) gap_max = gap;
+		if ((jlong)queued > peak) peak = queued;
+		last = bytes;
+		if (samples < t->window) continue;
+
+		now = monotonic_ns();
+		rate = (double)(bytes - bytes0) * 1e9 / (double)(now - start);
+		decide(t, rate, busy, samples, peak, &lat, &xfer);
+		t->stats[jd2xx_JD2XXTuner_RATE] = (jlong)rate;
+		t->stats[jd2xx_JD2XXTuner_AVERAGE_READ] = reads > reads0 ? (bytes - bytes0) / (reads - reads0) : 0;
+		t->stats[jd2xx_JD2XXTuner_PEAK_QUEUE] = peak;
+		t->stats[jd2xx_JD2XXTuner_BUSY] = busy * 1000 / samples;
+		t->stats[jd2xx_JD2XXTuner_IDLE_GAP] = (jlong)(gap_max * t->period / 1000);
+		t->stats[jd2xx_JD2XXTuner_WINDOWS]++;
+		samples = busy = gap_max = 0;
+		peak = 0;
+		reads0 = reads;
+		bytes0 = bytes;
+		start = now;
+
+		if (lat == t->latency && xfer == t->transfer) continue;
+		mutex_unlock(&t->lock);
+		st = apply(t, lat, xfer, lat != t->latency, xfer != t->transfer);
+		mutex_lock(&t->lock);
+		if (!FT_SUCCESS(st)) break;
+		if (lat != t->latency) t->stats[jd2xx_JD2XXTuner_LATENCY_CHANGES]++;
+		if (xfer != t->transfer) t->stats[jd2xx_JD2XXTuner_TRANSFER_CHANGES]++;
+		t->latency = lat;
+		t->transfer = xfer;
+		t->lat_votes = t->xfer_votes = 0;
+	}
+	if (t->running) { // stopped by an error
+		t->error = st;
+		t->running = 0;
+	}
+	cond_broadcast(&t->cond);
+	mutex_unlock(&t->lock);
+}
+
+/** Get tuner state, throw if closed */
+static tuner_t *
+tuner_get(JNIEnv *env, jlong ptr) {
+	tuner_t *t = (tuner_t*)(size_t)ptr;
+	if (t == NULL) throw_new(env, "java/lang/IllegalStateException", "tuner closed");
+	return t;
+}
+
+JNIEXPORT jlong JNICALL
+Java_jd2xx_JD2XXTuner_nativeOpen(JNIEnv *env, jclass cls, jobject jd, jint goal,
+	jint lat_min, jint lat_max, jint xfer_min, jint xfer_max, jint period, jint window) {
+	jlong tok = get_handle(env, jd);
+	FT_HANDLE h;
+	FT_STATUS st;
+	UCHAR cur = 16;
+	tuner_t *t;
+	jint lat, xfer;
+
+	if ((goal != GOAL_LATENCY && goal != GOAL_THROUGHPUT)
+		|| lat_min < 1 || lat_max > 255 || lat_min > lat_max
+		|| xfer_min < 64 || xfer_max > 65536 || xfer_min > xfer_max
+		|| xfer_min % 64 != 0 || xfer_max % 64 != 0
+		|| period <= 0 || window < 2) {
+		throw_new(env, "java/lang/IllegalArgumentException", "tuner goal, bounds or period");
+		return 0;
+	}
+	if ((h = acquire_handle(env, tok)) == NULL) return 0;
+
+	// start from the current latency timer and the smallest transfers
+	FT_GetLatencyTimer(h, &cur);
+	lat = cur < lat_min ? lat_min : cur > lat_max ? lat_max : cur;
+	xfer = xfer_min;
+	st = FT_SetLatencyTimer(h, (UCHAR)lat);
+	config_record(tok, st, CONFIG_LATENCY_TIMER, 1, &lat);
+	if (FT_SUCCESS(st)) {
+		st = FT_SetUSBParameters(h, (ULONG)xfer, 0);
+		config_record(tok, st, CONFIG_IN_TRANSFER_SIZE, 1, &xfer);
+	}
+	handle_release(tok);
+	if (!FT_SUCCESS(st)) {
+		io_exception_status(env, st);
+		return 0;
+	}
+
+	if ((t = (tuner_t*)calloc(1, sizeof(tuner_t))) == NULL) {
+		io_exception_status(env, FT_INSUFFICIENT_RESOURCES);
+		return 0;
+	}
+	t->tok = tok;
+	t->goal = goal;
+	t->lat_min = lat_min;
+	t->lat_max = lat_max;
+	t->xfer_min = xfer_min;
+	t->xfer_max = xfer_max;
+	t->period = (unsigned long long)period * 1000ULL;
+	t->window = window;
+	t->latency = t->lat_pending = lat;
+	t->transfer = t->xfer_pending = xfer;
+	t->running = 1;
+	mutex_init(&t->lock);
+	cond_init(&t->cond);
+
+	if (thread_start(&t->worker, tuner_worker, t) != 0) {
+		cond_destroy(&t->cond);
+		mutex_destroy(&t->lock);
+		free(t);
+		io_exception_status(env, FT_INSUFFICIENT_RESOURCES);
+		return 0;
+	}
+	return (jlong)(size_t)t;
+}
+
+JNIEXPORT void JNICALL
+Java_jd2xx_JD2XXTuner_dispose(JNIEnv *env, jclass cls, jlong ptr) {
+	tuner_t *t = (tuner_t*)(size_t)ptr;
+
+	if (t == NULL) return;
+	mutex_lock(&t->lock);
+	t->running = 0;
+	cond_broadcast(&t->cond);
+	mutex_unlock(&t->lock);
+	thread_join(t->worker);
+
+	cond_destroy(&t->cond);
+	mutex_destroy(&t->lock);
+	free(t);
+}
+
+JNIEXPORT jlongArray JNICALL
+Java_jd2xx_JD2XXTuner_nativeGetStatistics(JNIEnv *env, jclass cls, jlong ptr) {
+	tuner_t *t = tuner_get(env, ptr);
+	jlong s[jd2xx_JD2XXTuner_STATISTICS];
+	FT_STATUS st;
+	jlongArray arr;
+
+	if (t == NULL) return NULL;
+	mutex_lock(&t->lock);
+	memcpy(s, t->stats, sizeof(s));
+	s[jd2xx_JD2XXTuner_LATENCY_TIMER] = t->latency;
+	s[jd2xx_JD2XXTuner_TRANSFER_SIZE] = t->transfer;
+	st = t->error;
+	mutex_unlock(&t->lock);
+
+	if (!FT_SUCCESS(st)) {
+		io_exception_status(env, st);
+		return NULL;
+	}
+	if ((arr = (*env)->NewLongArray(env, jd2xx_JD2XXTuner_STATISTICS)) != NULL)
+		(*env)->SetLongArrayRegion(env, arr, 0, jd2xx_JD2XXTuner_STATISTICS, s);
+	return arr;
+}
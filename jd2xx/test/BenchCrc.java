@@ -0,0 +1,91 @@
+// package test;
+
+import java.nio.ByteBuffer;
+import java.util.Random;
+import java.util.zip.CRC32;
+
+import jd2xx.JD2XX;
+import jd2xx.JD2XXCrc;
+
+/** Compares JD2XXCrc with java.util.zip.CRC32 over arrays and direct
+	buffers of growing size, and times the CRC-16 variants. Needs the JNI
+	library but no device. */
+public class BenchCrc {
+
+	static void report(String name, int size, long bytes, long t) {
+		System.out.println(name + " " + size + " bytes: " + (bytes * 1000 / t) + " MB/s");
+	}
+
+	public static void main(String[] args) {
+		long total = args.length > 0 ? Long.parseLong(args[0]) : 1L << 30;
+		byte[] b = new byte[1 << 20];
+		new Random(1).nextBytes(b);
+		ByteBuffer direct = ByteBuffer.allocateDirect(b.length);
+		direct.put(b);
+
+		System.out.println("library variant: " + JD2XX.nativeVariant);
+
+		for (int size = 16; size <= b.length; size *= 8) {
+			int n = (int)(total / size);
+			CRC32 z = new CRC32();
+			JD2XXCrc c = new JD2XXCrc(JD2XXCrc.CRC32);
+
+			z.update(b, 0, size);
+			c.update(b, 0, size);
+			if ((int)z.getValue() != c.getValue()) throw new AssertionError("CRC-32 mismatch");
+
+			for (int pass = 0; pass < 2; ++pass) { // the first pass warms up
+				long t = System.nanoTime();
+				for (int i = 0; i < n; ++i) {
+					z.reset();
+					z.update(b, 0, size);
+				}
+				if (pass > 0) report("java.util.zip.CRC32 byte[]", size, (long)n * size, System.nanoTime() - t);
+
+				t = System.nanoTime();
+				for (int i = 0; i < n; ++i) {
+					c.reset();
+					c.update(b, 0, size);
+				}
+				if (pass > 0) report("JD2XXCrc CRC32 byte[]", size, (long)n * size, System.nanoTime() - t);
+
+				t = System.nanoTime();
+				for (int i = 0; i < n; ++i) {
+					direct.limit(size).position(0);
+					z.reset();
+					z.update(direct);
+				}
+				if (pass > 0) report("java.util.zip.CRC32 direct", size, (long)n * size, System.nanoTime() - t);
+
+				t = System.nanoTime();
+				for (int i = 0; i < n; ++i) {
+					direct.limit(size).position(0);
+					c.reset();
+					c.update(direct);
+				}
+				if (pass > 0) report("JD2XXCrc CRC32 direct", size, (long)n * size, System.nanoTime() - t);
+			}
+		}
+
+		int[] kinds = { JD2XXCrc.CRC16_MODBUS, JD2XXCrc.CRC_CCITT };
+		String[] names = { "CRC16_MODBUS", "CRC_CCITT" };
+		for (int k = 0; k < kinds.length; ++k) {
+			JD2XXCrc c = new JD2XXCrc(kinds[k]);
+			int n = (int)(total / b.length);
+			long t = System.nanoTime();
+			for (int i = 0; i < n; ++i) {
+				c.reset();
+				c.update(b);
+			}
+			report("JD2XXCrc " + names[k], b.length, (long)n * b.length, System.nanoTime() - t);
+		}
+
+		// check values of the catalogue ("123456789")
+		byte[] check = "123456789".getBytes();
+		if (JD2XXCrc.compute(JD2XXCrc.CRC16_MODBUS, check, 0, 9) != 0x4b37
+			|| JD2XXCrc.compute(JD2XXCrc.CRC_CCITT, check, 0, 9) != 0x29b1
+			|| JD2XXCrc.compute(JD2XXCrc.CRC32, check, 0, 9) != 0xcbf43926)
+			throw new AssertionError("check value mismatch");
+		System.out.println("check values ok");
+	}
+}
@@ -0,0 +1,46 @@
+// package test;
+
+import java.io.IOException;
+
+import jd2xx.JD2XX;
+import jd2xx.JD2XXEeprom;
+
+/** Compares EEPROM read-modify-write through ProgramData (eeRead/eeProgram)
+	with the chip specific structures (eepromRead/eepromProgram). Programs
+	the EEPROM of device 0 only when started with "write"; against the mock
+	driver (-Djd2xx.library=...) this measures the marshalling cost alone. */
+public class BenchEeprom {
+
+	static void report(String name, int n, long t) {
+		System.out.println(name + ": " + (t / n / 1000) + " us/cycle");
+	}
+
+	public static void main(String[] args) throws IOException {
+		boolean write = args.length > 0 && args[0].equals("write");
+		int n = args.length > 1 ? Integer.parseInt(args[1]) : 1000;
+
+		JD2XX jd = new JD2XX();
+		jd.open(0);
+		JD2XXEeprom ee = JD2XXEeprom.forDevice(jd.getDeviceInfo().type);
+
+		long t = System.nanoTime();
+		for (int i = 0; i < n; ++i) {
+			JD2XX.ProgramData pd = jd.eeRead();
+			pd.maxPower = 100;
+			if (write) jd.eeProgram(pd);
+		}
+		report("eeRead/eeProgram", n, System.nanoTime() - t);
+
+		t = System.nanoTime();
+		for (int i = 0; i < n; ++i) {
+			jd.eepromRead(ee);
+			ee.set(JD2XXEeprom.MAX_POWER, 100);
+			if (write) jd.eepromProgram(ee);
+		}
+		report("eepromRead/eepromProgram", n, System.nanoTime() - t);
+
+		System.out.println(ee.getDescription() + " " + ee.getSerialNumber()
+			+ ", maxPower " + ee.get(JD2XXEeprom.MAX_POWER));
+		jd.close();
+	}
+}
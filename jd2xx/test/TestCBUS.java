@@ -3,6 +3,7 @@
 import java.io.IOException;
 
 import jd2xx.JD2XX;
+import jd2xx.JD2XXCbus;
 
 public class TestCBUS extends Thread {
 
@@ -27,5 +28,19 @@ public class TestCBUS extends Thread {
 		sleep(250);
 
 		jd.setBitMode(0, 0);
+
+		/* Same with shadow state: toggles issued within 1 ms go out together */
+		JD2XXCbus cbus = new JD2XXCbus(jd);
+		cbus.setDirection(0x3, 0x3);
+		cbus.setWindow(1000);
+		for (int i=0; i<10; ++i) {
+			cbus.set(0, (i & 1) != 0);
+			cbus.set(1, (i & 1) == 0);
+			sleep(250);
+		}
+		for (int i=0; i<1000; ++i) cbus.set(0x3, i);
+		cbus.flush();
+		System.out.println(cbus.getTransfers() + " transfers for 1020 changes");
+		cbus.close();
 	}
 }
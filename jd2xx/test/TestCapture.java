@@ -0,0 +1,61 @@
+// package test;
+
+import java.io.IOException;
+import java.util.Arrays;
+
+import jd2xx.JD2XX;
+import jd2xx.JD2XXReplay;
+
+/** Captures loopback traffic of device 0 into a file, then replays it at
+	the original speed, twice as fast and without delays, checking that the
+	same bytes come back and that the replay takes as long as the capture
+	divided by the speed. Needs TX wired to RX, or the mock driver in
+	loopback mode (see TestCapture.sh). Arguments: capture file (default
+	test.cap), bursts (default 1000). */
+public class TestCapture {
+
+	public static void main(String[] args) throws Exception {
+		String path = args.length > 0 ? args[0] : "test.cap";
+		int bursts = args.length > 1 ? Integer.parseInt(args[1]) : 1000;
+
+		JD2XX jd = new JD2XX();
+		jd.open(0);
+		jd.setTimeouts(1000, 1000);
+		jd.startCapture(path);
+
+		byte[] b = new byte[256], received = new byte[bursts * b.length];
+		long t = System.nanoTime();
+		int got = 0;
+		for (int i = 0; i < bursts; ++i) {
+			for (int k = 0; k < b.length; ++k) b[k] = (byte)(i * 7 + k);
+			jd.write(b);
+			while (got < (i + 1) * b.length) got += jd.read(received, got, (i + 1) * b.length - got);
+			if (i % 100 == 0) jd.getModemStatus();
+			Thread.sleep(0, 200000);
+		}
+		long captured = System.nanoTime() - t;
+		jd.stopCapture();
+		long[] s = jd.getCaptureStatistics();
+		jd.close();
+		System.out.println("captured " + s[0] + " records, " + s[1] + " bytes in " + (captured / 1000000)
+			+ " ms, dropped " + s[2] + ", file " + s[3] + " bytes");
+		if (s[2] != 0) throw new IOException("records dropped");
+
+		for (double speed : new double[] { 1, 2, 0 }) {
+			JD2XXReplay replay = new JD2XXReplay(path, speed);
+			byte[] r = new byte[received.length];
+			int n = 0;
+			t = System.nanoTime();
+			while (n < r.length) {
+				int k = replay.read(r, n, Math.min(4096, r.length - n));
+				if (k == 0) break;
+				n += k;
+			}
+			long took = System.nanoTime() - t;
+			if (!replay.isFinished()) throw new IOException("records left after the last read");
+			replay.close();
+			if (n != r.length || !Arrays.equals(r, received)) throw new IOException("replay differs after " + n + " bytes");
+			System.out.println("replay at speed " + speed + ": " + n + " bytes in " + (took / 1000000) + " ms");
+		}
+	}
+}
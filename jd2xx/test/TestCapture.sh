@@ -0,0 +1,5 @@
+#!/bin/bash
+# Runs TestCapture against the mock driver (build it with "make jni-mock")
+# in loopback mode at about 1 MB/s
+MOCK="$(cd .. && pwd)/libjd2xx_mock.so"
+java -Xcheck:jni -Djd2xx.library=$MOCK -cp ../jd2xx.jar:. TestCapture /tmp/TestCapture.cap 1000
@@ -0,0 +1,72 @@
+// package test;
+
+import java.io.IOException;
+
+import jd2xx.JD2XX;
+import jd2xx.JD2XX.DeviceConfig;
+import jd2xx.JD2XX.DeviceInfo;
+
+/** Loads a device configuration from an ftd2xx.cfg style file, applies it
+	with configure() and checks that only changed settings reach the
+	driver and that values applied by set calls are kept, then times
+	switching between two test step configurations with configure() and
+	with the equivalent set calls. Runs on the mock
+	driver (see TestConfig.sh) or any device.
+	Arguments: configuration file (default TestConfig.cfg), device number
+	(default 0), rounds (default 10000). */
+public class TestConfig {
+
+	public static void main(String[] args) throws Exception {
+		String path = args.length > 0 ? args[0] : "TestConfig.cfg";
+		int number = args.length > 1 ? Integer.parseInt(args[1]) : 0;
+		int rounds = args.length > 2 ? Integer.parseInt(args[2]) : 10000;
+
+		JD2XX jd = new JD2XX(number);
+		DeviceInfo di = jd.getDeviceInfo();
+		DeviceConfig a = DeviceConfig.load(path, di);
+		System.out.println(di.serial + ": " + a);
+
+		System.out.println("first configure: " + jd.configure(a) + " driver calls");
+		int n = jd.configure(a);
+		if (n != 0) throw new IOException("unchanged configuration made " + n + " calls");
+
+		// the next test step only changes the read timeout
+		DeviceConfig b = new DeviceConfig();
+		b.readTimeout = 100;
+		b = a.merge(b);
+		if ((n = jd.configure(b)) != 1) throw new IOException("one change made " + n + " calls");
+		jd.setLatencyTimer(a.latencyTimer == 2 ? 3 : 2);
+		if ((n = jd.configure(b)) != 1) throw new IOException("setLatencyTimer not noticed");
+
+		// a set call is remembered: changing one timeout keeps the other
+		jd.setTimeouts(500, 1000);
+		DeviceConfig r = new DeviceConfig();
+		r.readTimeout = 100;
+		if ((n = jd.configure(r)) != 1) throw new IOException("read timeout made " + n + " calls");
+		r.writeTimeout = 1000;
+		if ((n = jd.configure(r)) != 0) throw new IOException("write timeout not kept by configure");
+		jd.configure(a);
+
+		long t = System.nanoTime();
+		for (int i = 0; i < rounds; ++i) jd.configure((i & 1) == 0 ? a : b);
+		long configure = (System.nanoTime() - t) / rounds;
+
+		t = System.nanoTime();
+		for (int i = 0; i < rounds; ++i) {
+			DeviceConfig c = (i & 1) == 0 ? a : b;
+			jd.setBaudRate(c.baudRate);
+			jd.setDataCharacteristics(c.wordLength, c.stopBits, c.parity);
+			jd.setFlowControl(c.flowControl, 0x11, 0x13);
+			jd.setTimeouts(c.readTimeout, c.writeTimeout);
+			jd.setLatencyTimer(c.latencyTimer);
+			jd.setUSBParameters(c.inTransferSize, c.outTransferSize);
+			jd.setChars(c.eventChar, c.eventCharEnabled != 0, 0, false);
+			jd.setBitMode(c.bitMask, c.bitMode);
+		}
+		long calls = (System.nanoTime() - t) / rounds;
+		jd.close();
+
+		System.out.println("switching test steps: configure " + (configure / 1000.0)
+			+ " us, set calls " + (calls / 1000.0) + " us");
+	}
+}
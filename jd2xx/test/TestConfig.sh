@@ -0,0 +1,5 @@
+#!/bin/bash
+# Runs TestConfig against the mock driver (build it with "make jni-mock")
+# with the settings in TestConfig.cfg
+MOCK="$(cd .. && pwd)/libjd2xx_mock.so"
+java -Xcheck:jni -Djd2xx.library=$MOCK -cp ../jd2xx.jar:. TestConfig TestConfig.cfg 0 10000
@@ -0,0 +1,33 @@
+// package test;
+
+import java.io.IOException;
+
+import jd2xx.JD2XX;
+
+/** Dumps the raw EEPROM of device 0 (first argument: number of words,
+	default 64). With "update" as second argument, changes the last word
+	with updateEE and restores it, showing that only one word is written. */
+public class TestEEImage {
+
+	public static void main(String[] args) throws IOException {
+		int n = args.length > 0 ? Integer.parseInt(args[0]) : 64;
+		JD2XX jd = new JD2XX();
+		jd.open(0);
+
+		short[] image = jd.dumpEE(0, n);
+		for (int i = 0; i < n; ++i) {
+			if (i % 8 == 0) System.out.printf("%n%04x:", i);
+			System.out.printf(" %04x", image[i] & 0xffff);
+		}
+		System.out.println();
+
+		if (args.length > 1 && args[1].equals("update")) {
+			short[] changed = image.clone();
+			changed[n - 1] ^= 0x5a5a;
+			System.out.println("update: " + jd.updateEE(0, changed, image) + " word(s) written");
+			System.out.println("restore: " + jd.updateEE(0, image) + " word(s) written");
+		}
+
+		jd.close();
+	}
+}
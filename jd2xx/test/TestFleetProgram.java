@@ -0,0 +1,28 @@
+// package test;
+
+import java.io.IOException;
+
+import jd2xx.JD2XX;
+import jd2xx.JD2XXFleetProgrammer;
+
+/** Programs every FT232R found with the EEPROM of device 0 and new serial
+	numbers (TST00001, TST00002, ...), then prints the report. */
+public class TestFleetProgram {
+
+	public static void main(String[] args) throws IOException {
+		JD2XX jd = new JD2XX();
+		jd.open(0);
+		JD2XX.ProgramData template = jd.eeRead();
+		jd.close();
+
+		JD2XXFleetProgrammer fp = new JD2XXFleetProgrammer(args.length > 0 ? Integer.parseInt(args[0]) : 8);
+		JD2XXFleetProgrammer.Report r = fp.program(
+			di -> di.type == JD2XX.DEVICE_232R,
+			template,
+			JD2XXFleetProgrammer.sequence("TST", 1, 5)
+		);
+
+		System.out.println(r);
+		System.exit(r.allOk() ? 0 : 1);
+	}
+}
@@ -0,0 +1,70 @@
+// package test;
+
+import java.io.IOException;
+import java.util.Arrays;
+import java.util.Random;
+
+import jd2xx.JD2XX;
+import jd2xx.JD2XXFramer;
+
+/** Sends random COBS and SLIP frames (payloads rich in delimiter and escape
+	bytes) and checks that JD2XXFramer delivers them unchanged, then prints
+	the frame rate. Needs TX wired to RX, or the mock driver in loopback
+	mode (JD2XX_MOCK_RATE=0 for an unthrottled rate). Argument: frames per
+	mode (default 100000). */
+public class TestFramer {
+
+	static void run(JD2XX jd, int mode, int n) throws Exception {
+		Random rnd = new Random(mode);
+		byte[][] frames = new byte[1000][];
+		for (int i = 0; i < frames.length; ++i) {
+			frames[i] = new byte[1 + rnd.nextInt(i % 100 == 0 ? 1000 : 60)];
+			rnd.nextBytes(frames[i]);
+			for (int k = 0; k < frames[i].length; k += 7) frames[i][k] = (byte)(k % 3 == 0 ? 0 : 0xc0);
+		}
+
+		JD2XXFramer fr = new JD2XXFramer(jd, mode);
+		Thread writer = new Thread(() -> {
+			try {
+				for (int i = 0; i < n; ++i) {
+					byte[] b = JD2XXFramer.encode(mode, frames[i % frames.length]);
+					for (int o = 0; o < b.length; ) o += jd.write(b, o, b.length - o);
+				}
+			}
+			catch (IOException e) {
+				e.printStackTrace();
+			}
+		});
+
+		byte[] buf = new byte[1000];
+		long t = System.nanoTime();
+		writer.start();
+		int got = 0;
+		while (got < n) {
+			int c = fr.receive();
+			if (c == 0) throw new IOException("timeout after " + got + " frames");
+			for (int i = 0; i < c; ++i, ++got) {
+				int len = fr.frame(i, buf);
+				byte[] f = frames[got % frames.length];
+				if (!Arrays.equals(f, Arrays.copyOf(buf, len)))
+					throw new IOException("frame " + got + " differs");
+			}
+		}
+		t = System.nanoTime() - t;
+		writer.join();
+
+		System.out.println((mode == JD2XXFramer.COBS ? "COBS" : "SLIP") + ": " + n + " frames ok, "
+			+ (n * 1000000000L / t) + " frames/s, errors " + fr.getErrors());
+		fr.close();
+	}
+
+	public static void main(String[] args) throws Exception {
+		int n = args.length > 0 ? Integer.parseInt(args[0]) : 100000;
+		JD2XX jd = new JD2XX();
+		jd.open(0);
+		jd.setTimeouts(1000, 1000);
+		run(jd, JD2XXFramer.COBS, n);
+		run(jd, JD2XXFramer.SLIP, n);
+		jd.close();
+	}
+}
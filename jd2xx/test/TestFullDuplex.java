@@ -0,0 +1,185 @@
+// package test;
+
+import java.io.IOException;
+import java.nio.ByteBuffer;
+import java.util.Random;
+
+import jd2xx.JD2XX;
+import jd2xx.JD2XXInputStream;
+import jd2xx.JD2XXOutputStream;
+
+/** Full-duplex stress and throughput test
+
+	"loopback [bytes]": a writer thread sends a counting pattern in random
+	sized chunks while a reader thread checks it comes back in order and a
+	third thread polls the queue and modem status. Needs TX wired to RX, or
+	the mock driver in its default loopback mode.
+
+	"throughput [seconds]": measures read-only, write-only and simultaneous
+	read+write rates. Needs the mock driver in stream mode; with independent
+	read and write paths the simultaneous rates match the one-way ones.
+
+	See TestFullDuplex.sh for running both against the mock driver.
+*/
+public class TestFullDuplex {
+
+	static volatile boolean running;
+	static volatile Throwable failure;
+	static long readCount, writeCount;
+
+	static void fail(Throwable t) {
+		if (failure == null) failure = t;
+		running = false;
+	}
+
+	static Thread reader(final JD2XX jd, final long total) {
+		return new Thread() {
+			public void run() {
+				try {
+					JD2XXInputStream in = new JD2XXInputStream(jd);
+					byte[] b = new byte[4096];
+					int c = 0;
+					long n = 0;
+					while (running && n < total) {
+						int r = in.read(b, 0, (int)Math.min(b.length, total - n));
+						if (r == 0) throw new IOException("read timeout after " + n + " bytes");
+						for (int i = 0; i < r; ++i, ++c)
+							if (b[i] != (byte)c) throw new IOException("data mismatch at byte " + (n + i));
+						n += r;
+					}
+					readCount = n;
+				}
+				catch (Throwable t) { fail(t); }
+			}
+		};
+	}
+
+	static Thread writer(final JD2XX jd, final long total) {
+		return new Thread() {
+			public void run() {
+				try {
+					JD2XXOutputStream out = new JD2XXOutputStream(jd);
+					Random rnd = new Random(1);
+					byte[] b = new byte[8192];
+					int c = 0;
+					long n = 0;
+					while (running && n < total) {
+						int l = (int)Math.min(1 + rnd.nextInt(b.length), total - n);
+						for (int i = 0; i < l; ++i) b[i] = (byte)c++;
+						out.write(b, 0, l);
+						n += l;
+					}
+					writeCount = n;
+				}
+				catch (Throwable t) { fail(t); }
+			}
+		};
+	}
+
+	static void loopback(JD2XX jd, long total) throws Exception {
+		jd.setTimeouts(2000, 2000);
+		jd.purge(JD2XX.PURGE_RX | JD2XX.PURGE_TX);
+
+		running = true;
+		Thread r = reader(jd, total), w = writer(jd, total);
+		Thread poll = new Thread() {
+			public void run() {
+				try {
+					while (running) {
+						jd.getQueueStatus();
+						jd.getModemStatus();
+						Thread.sleep(1);
+					}
+				}
+				catch (InterruptedException e) { }
+				catch (Throwable t) { fail(t); }
+			}
+		};
+
+		long t0 = System.nanoTime();
+		r.start(); w.start(); poll.start();
+		r.join(); w.join();
+		double s = (System.nanoTime() - t0) / 1e9;
+		running = false;
+		poll.join();
+
+		if (failure != null) throw new Exception(failure);
+		System.out.printf("loopback: %d bytes verified in %.2f s, %.0f bytes/s%n",
+			readCount, s, readCount / s);
+
+		// close while a read is blocked: the read must fail, not crash
+		jd.setTimeouts(5000, 5000);
+		final JD2XX j = jd;
+		Thread blocked = new Thread() {
+			public void run() {
+				try { j.read(new byte[16]); }
+				catch (IOException e) { }
+			}
+		};
+		blocked.start();
+		Thread.sleep(100);
+		jd.close();
+		blocked.join();
+		try {
+			jd.read(new byte[1]);
+			throw new Exception("read after close did not fail");
+		}
+		catch (IOException e) {
+			System.out.println("close during read: ok");
+		}
+	}
+
+	/** Transfer for the given time in the selected directions
+		@return bytes per second {read, write}
+	*/
+	static double[] rate(final JD2XX jd, double seconds, boolean rd, boolean wr) throws Exception {
+		final long end = System.nanoTime() + (long)(seconds * 1e9);
+		final long[] count = new long[2];
+		Thread[] t = new Thread[2];
+
+		for (int d = 0; d < 2; ++d) {
+			if (d == 0 ? !rd : !wr) continue;
+			final int dir = d;
+			t[d] = new Thread() {
+				public void run() {
+					try {
+						ByteBuffer b = ByteBuffer.allocateDirect(65536);
+						while (System.nanoTime() < end) {
+							b.clear();
+							count[dir] += (dir == 0) ? jd.read(b) : jd.write(b);
+						}
+					}
+					catch (Throwable e) { fail(e); }
+				}
+			};
+			t[d].start();
+		}
+		for (Thread x : t) if (x != null) x.join();
+		if (failure != null) throw new Exception(failure);
+
+		return new double[] { count[0] / seconds, count[1] / seconds };
+	}
+
+	static void throughput(JD2XX jd, double seconds) throws Exception {
+		double r = rate(jd, seconds, true, false)[0];
+		double w = rate(jd, seconds, false, true)[1];
+		double[] rw = rate(jd, seconds, true, true);
+
+		System.out.printf("read only:  %.0f bytes/s%n", r);
+		System.out.printf("write only: %.0f bytes/s%n", w);
+		System.out.printf("read+write: %.0f + %.0f bytes/s (%.0f%% / %.0f%% of one-way)%n",
+			rw[0], rw[1], 100 * rw[0] / r, 100 * rw[1] / w);
+		jd.close();
+	}
+
+	public static void main(String[] args) throws Exception {
+		String mode = args.length > 0 ? args[0] : "loopback";
+		JD2XX jd = new JD2XX();
+		jd.open(0);
+
+		if (mode.equals("throughput"))
+			throughput(jd, args.length > 1 ? Double.parseDouble(args[1]) : 2);
+		else
+			loopback(jd, args.length > 1 ? Long.parseLong(args[1]) : 4 << 20);
+	}
+}
@@ -0,0 +1,6 @@
+#!/bin/bash
+# Runs TestFullDuplex against the mock driver (build it with "make jni-mock")
+MOCK="$(cd .. && pwd)/libjd2xx_mock.so"
+JAVA="java -Xcheck:jni -Djd2xx.library=$MOCK -cp ../jd2xx.jar:."
+JD2XX_MOCK_MODE=loopback $JAVA TestFullDuplex loopback && \
+JD2XX_MOCK_MODE=stream $JAVA TestFullDuplex throughput
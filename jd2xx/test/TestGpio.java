@@ -0,0 +1,51 @@
+// package test;
+
+import jd2xx.JD2XX;
+import jd2xx.JD2XXGpio;
+import jd2xx.JD2XXGpioEvent;
+import jd2xx.JD2XXGpioListener;
+
+/** MPSSE GPIO test: pulses ADBUS4-7 in one batch and watches all pins.
+	Wire ADBUS4-7 to ADBUS0-3 (or use the mock driver, whose pins read back
+	their outputs) to see the changes reported. */
+public class TestGpio implements JD2XXGpioListener {
+
+	public void gpioChanged(JD2XXGpioEvent ev) {
+		System.out.println(ev.getTimestamp() + ": changed "
+			+ Integer.toHexString(ev.getChanged()) + " now "
+			+ Integer.toHexString(ev.getValue()));
+	}
+
+	public static void main(String[] args) throws Exception {
+		JD2XX jd = new JD2XX();
+		jd.open(0);
+
+		JD2XXGpio gpio = new JD2XXGpio(jd);
+		gpio.setDirection(0xf0, 0xf0); // ADBUS4-7 outputs
+		gpio.addGpioListener(new TestGpio());
+		System.out.println("start: " + Integer.toHexString(gpio.startPolling(0xffff, 500)));
+
+		for (int i = 0; i < 8; ++i) {
+			// walk a bit over ADBUS4-7, one USB transfer per step
+			gpio.begin();
+			gpio.set(0xf0, 0);
+			gpio.set(4 + (i & 3), true);
+			gpio.commit();
+			Thread.sleep(20);
+		}
+
+		long t = System.nanoTime();
+		int n = 1000;
+		for (int i = 0; i < n; ++i) gpio.set(0x10, i << 4);
+		System.out.println("single set: " + (System.nanoTime() - t) / n / 1000 + " us");
+
+		t = System.nanoTime();
+		gpio.begin();
+		for (int i = 0; i < n; ++i) gpio.set(0x10, i << 4);
+		gpio.commit();
+		System.out.println("batched set: " + (System.nanoTime() - t) / n + " ns");
+
+		gpio.close();
+		jd.close();
+	}
+}
@@ -0,0 +1,59 @@
+// package test;
+
+import java.io.IOException;
+
+import jd2xx.JD2XX;
+import jd2xx.JD2XXModbus;
+
+/** Modbus RTU master test: writes and reads back holding registers of
+	slave 1, then polls 10 input registers of slaves 1-4 round-robin for a
+	few seconds on every device given (default: device 0) and prints the
+	poll rate per bus. Needs slaves on the bus, or the mock driver in
+	modbus mode (see TestModbus.sh). Arguments: baud rate, device numbers. */
+public class TestModbus {
+
+	public static void main(String[] args) throws Exception {
+		int baud = args.length > 0 ? Integer.parseInt(args[0]) : 115200;
+		int buses = Math.max(1, args.length - 1);
+		JD2XX[] jd = new JD2XX[buses];
+		JD2XXModbus[] mb = new JD2XXModbus[buses];
+
+		for (int b = 0; b < buses; ++b) {
+			jd[b] = new JD2XX();
+			jd[b].open(args.length > 1 ? Integer.parseInt(args[b + 1]) : 0);
+			mb[b] = new JD2XXModbus(jd[b], baud, JD2XX.PARITY_EVEN);
+			mb[b].setTimeout(100);
+		}
+
+		mb[0].writeRegisters(1, 10, new short[] { 1234, -2 });
+		short[] v = mb[0].readHoldingRegisters(1, 10, 2);
+		if (v[0] != 1234 || v[1] != -2) throw new IOException("read back " + v[0] + ", " + v[1]);
+		System.out.println("write/read back ok");
+
+		for (int b = 0; b < buses; ++b) {
+			for (int s = 1; s <= 4; ++s) mb[b].addPoll(s, JD2XXModbus.READ_INPUT_REGISTERS, 100 * s, 10);
+			mb[b].startPolling(0);
+		}
+
+		long end = System.currentTimeMillis() + 3000;
+		int errors = 0;
+		short[] r = new short[10];
+		while (System.currentTimeMillis() < end) {
+			for (int b = 0; b < buses; ++b) {
+				int[] ids = mb[b].waitResults(100);
+				if (ids == null) continue;
+				for (int id : ids)
+					if (mb[b].getValues(id, r) != JD2XXModbus.OK) ++errors;
+			}
+		}
+
+		for (int b = 0; b < buses; ++b) {
+			mb[b].stopPolling();
+			System.out.println("bus " + b + ": " + (mb[b].getTransactions() / 3) + " polls/s");
+			mb[b].close();
+			jd[b].close();
+		}
+		System.out.println(errors == 0 ? "ok" : errors + " failed reads");
+		System.exit(errors == 0 ? 0 : 1);
+	}
+}
@@ -0,0 +1,6 @@
+#!/bin/bash
+# Runs TestModbus against the mock driver (build it with "make jni-mock"):
+# two buses at 115200 baud, the mock paced at the same line rate
+MOCK="$(cd .. && pwd)/libjd2xx_mock.so"
+JD2XX_MOCK_MODE=modbus JD2XX_MOCK_DEVICES=2 JD2XX_MOCK_RATE=10472 \
+java -Xcheck:jni -Djd2xx.library=$MOCK -cp ../jd2xx.jar:. TestModbus 115200 0 1
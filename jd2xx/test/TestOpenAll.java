@@ -0,0 +1,67 @@
+// package test;
+
+import java.io.IOException;
+import java.util.ArrayList;
+import java.util.List;
+
+import jd2xx.JD2XX;
+import jd2xx.JD2XX.DeviceConfig;
+import jd2xx.JD2XX.OpenResult;
+
+/** Brings up a rig of devices with JD2XX.openAll() and compares the time
+	with opening and configuring them one after the other. One serial
+	number that does not exist is added to show a per-device failure.
+	Arguments: serial number prefix (default MOCK), number of devices
+	(default 32); serial numbers are the prefix and a 4 digit index, as on
+	the mock driver (see TestOpenAll.sh). */
+public class TestOpenAll {
+
+	public static void main(String[] args) throws Exception {
+		String prefix = args.length > 0 ? args[0] : "MOCK";
+		int count = args.length > 1 ? Integer.parseInt(args[1]) : 32;
+
+		List<String> serials = new ArrayList<String>();
+		for (int i = 0; i < count; ++i) serials.add(prefix + String.format("%04d", i));
+
+		DeviceConfig config = new DeviceConfig();
+		config.baudRate = 115200;
+		config.readTimeout = 500;
+		config.writeTimeout = 500;
+		config.latencyTimer = 2;
+		config.bitMask = 0xff;
+		config.bitMode = JD2XX.BITMODE_ASYNC_BITBANG;
+
+		long t = System.nanoTime();
+		for (String serial : serials) {
+			JD2XX jd = new JD2XX();
+			jd.openBySerialNumber(serial);
+			jd.setBaudRate(config.baudRate);
+			jd.setTimeouts(config.readTimeout, config.writeTimeout);
+			jd.setLatencyTimer(config.latencyTimer);
+			jd.setBitMode(config.bitMask, config.bitMode);
+			jd.close();
+		}
+		long sequential = (System.nanoTime() - t) / 1000000;
+
+		serials.add(prefix + "-missing");
+		t = System.nanoTime();
+		List<OpenResult> results = JD2XX.openAll(serials, config);
+		long parallel = (System.nanoTime() - t) / 1000000;
+
+		int ok = 0;
+		for (OpenResult r : results) {
+			if (!r.ok()) {
+				System.out.println(r);
+				continue;
+			}
+			if (r.device.getLatencyTimer() != config.latencyTimer)
+				throw new IOException(r.serial + ": latency timer not set");
+			r.device.close();
+			++ok;
+		}
+		if (ok != count) throw new IOException(ok + " of " + count + " devices opened");
+
+		System.out.println(count + " devices: one by one " + sequential
+			+ " ms, openAll " + parallel + " ms");
+	}
+}
@@ -0,0 +1,6 @@
+#!/bin/bash
+# Runs TestOpenAll against the mock driver (build it with "make jni-mock")
+# with 32 devices whose opens take 20 ms as on real hardware
+MOCK="$(cd .. && pwd)/libjd2xx_mock.so"
+JD2XX_MOCK_DEVICES=32 JD2XX_MOCK_OPEN_MS=20 \
+java -Xcheck:jni -Djd2xx.library=$MOCK -cp ../jd2xx.jar:. TestOpenAll MOCK 32
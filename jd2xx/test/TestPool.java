@@ -0,0 +1,51 @@
+// package test;
+
+import java.io.IOException;
+
+import jd2xx.JD2XX;
+import jd2xx.JD2XXPool;
+
+/** Compares openBySerialNumber()/close() with a JD2XXPool checkout and
+	release of the same device, and checks that a pooled device comes back
+	in a clean state: bit mode reset and nothing left to read. Needs TX
+	wired to RX, or the mock driver in loopback mode (see TestPool.sh).
+	Arguments: serial number (default MOCK0000), rounds (default 50). */
+public class TestPool {
+
+	public static void main(String[] args) throws Exception {
+		String serial = args.length > 0 ? args[0] : "MOCK0000";
+		int rounds = args.length > 1 ? Integer.parseInt(args[1]) : 50;
+
+		long t = System.nanoTime();
+		for (int i = 0; i < rounds; ++i) {
+			JD2XX jd = new JD2XX();
+			jd.openBySerialNumber(serial);
+			jd.close();
+		}
+		long open = (System.nanoTime() - t) / rounds;
+
+		JD2XXPool pool = new JD2XXPool();
+		long checkout = 0;
+		for (int i = 0; i < rounds; ++i) {
+			t = System.nanoTime();
+			JD2XX jd = pool.openBySerialNumber(serial);
+			checkout += System.nanoTime() - t;
+
+			if (jd.getBitMode() != 0) throw new IOException("bit mode not reset");
+			if (jd.getQueueStatus() != 0) throw new IOException("stale bytes after checkout");
+			// leave state behind for the next user
+			jd.setBitMode(0xff, JD2XX.BITMODE_ASYNC_BITBANG);
+			jd.setBitMode(0, JD2XX.BITMODE_RESET);
+			jd.write(new byte[] { 1, 2, 3 });
+			jd.setBitMode(0xff, JD2XX.BITMODE_ASYNC_BITBANG);
+			pool.release(jd);
+		}
+		checkout /= rounds;
+
+		long[] s = pool.getStatistics();
+		System.out.println("open " + (open / 1000) + " us, pooled checkout "
+			+ (checkout / 1000.0) + " us (first one opens the device)");
+		System.out.println("hits " + s[0] + ", misses " + s[1] + ", stale " + s[2] + ", idle " + s[3]);
+		pool.close();
+	}
+}
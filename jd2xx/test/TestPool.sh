@@ -0,0 +1,6 @@
+#!/bin/bash
+# Runs TestPool against the mock driver (build it with "make jni-mock")
+# in loopback mode, with opens taking 20 ms as on real hardware
+MOCK="$(cd .. && pwd)/libjd2xx_mock.so"
+JD2XX_MOCK_OPEN_MS=20 \
+java -Xcheck:jni -Djd2xx.library=$MOCK -cp ../jd2xx.jar:. TestPool MOCK0000 50
@@ -0,0 +1,83 @@
+// package test;
+
+import java.io.IOException;
+
+import jd2xx.JD2XX;
+import jd2xx.JD2XXReceiver;
+
+/** Writes bursts to each device, stamped with System.nanoTime(), and checks
+	that JD2XXReceiver returns the bytes unchanged with arrival times after
+	the write; prints the delay between write and arrival time. Needs TX
+	wired to RX on every device, or the mock driver in loopback mode
+	(see TestReceiver.sh). Arguments: number of devices (default 1), bursts
+	per device (default 2000). */
+public class TestReceiver {
+
+	public static void main(String[] args) throws Exception {
+		int devices = args.length > 0 ? Integer.parseInt(args[0]) : 1;
+		int bursts = args.length > 1 ? Integer.parseInt(args[1]) : 2000;
+
+		JD2XX[] jd = new JD2XX[devices];
+		JD2XXReceiver[] rx = new JD2XXReceiver[devices];
+		long[][] sent = new long[devices][bursts];
+		Thread[] writers = new Thread[devices];
+
+		for (int d = 0; d < devices; ++d) {
+			jd[d] = new JD2XX();
+			jd[d].open(d);
+			jd[d].setLatencyTimer(1);
+			rx[d] = new JD2XXReceiver(jd[d]);
+		}
+		for (int d = 0; d < devices; ++d) {
+			final JD2XX j = jd[d];
+			final long[] s = sent[d];
+			writers[d] = new Thread(() -> {
+				byte[] b = new byte[64];
+				try {
+					for (int i = 0; i < bursts; ++i) {
+						for (int k = 0; k < b.length; ++k) b[k] = (byte)(i * b.length + k);
+						s[i] = System.nanoTime();
+						j.write(b);
+						Thread.sleep(0, 500000);
+					}
+				}
+				catch (Exception e) {
+					e.printStackTrace();
+				}
+			});
+			writers[d].start();
+		}
+
+		long total = (long)bursts * 64;
+		for (int d = 0; d < devices; ++d) {
+			long got = 0, lag = 0, maxLag = 0, last = 0;
+			int records = 0;
+			byte[] buf = new byte[65536];
+			while (got < total) {
+				if (rx[d].receive(1000) == 0) throw new IOException("timeout after " + got + " bytes");
+				while (rx[d].next()) {
+					long ts = rx[d].timestamp(), burst = got / 64;
+					if (ts < last) throw new IOException("time going backwards");
+					if (ts < sent[d][(int)burst]) throw new IOException("arrival before write");
+					lag += ts - sent[d][(int)burst];
+					maxLag = Math.max(maxLag, ts - sent[d][(int)burst]);
+					last = ts;
+					int n = rx[d].get(buf);
+					for (int k = 0; k < n; ++k)
+						if (buf[k] != (byte)(got + k)) throw new IOException("byte " + (got + k) + " differs");
+					got += n;
+					++records;
+				}
+			}
+			long[] s = rx[d].getStatistics();
+			System.out.println("device " + d + ": " + got + " bytes in " + records + " records, delay avg "
+				+ (lag / records / 1000) + " us, max " + (maxLag / 1000) + " us, stalls " + s[2]);
+		}
+
+		for (int d = 0; d < devices; ++d) {
+			writers[d].join();
+			rx[d].close();
+			jd[d].close();
+		}
+	}
+}
@@ -0,0 +1,6 @@
+#!/bin/bash
+# Runs TestReceiver against the mock driver (build it with "make jni-mock"):
+# two devices in loopback mode at about 1 MB/s
+MOCK="$(cd .. && pwd)/libjd2xx_mock.so"
+JD2XX_MOCK_DEVICES=2 \
+java -Xcheck:jni -Djd2xx.library=$MOCK -cp ../jd2xx.jar:. TestReceiver 2 2000
@@ -0,0 +1,59 @@
+// package test;
+
+import jd2xx.JD2XX;
+import jd2xx.JD2XXTuner;
+
+/** Runs JD2XXTuner on device 0 for each goal with two traffic patterns,
+	sparse 20-byte messages and a stream of 4 KB writes, and prints the
+	settings it chose and why. Needs TX wired to RX, or the mock driver in
+	loopback mode (see TestTuner.sh). Argument: seconds per run (default 2). */
+public class TestTuner {
+
+	static final String[] REASONS = { "none", "goal", "stream", "fill time", "rate", "backlog" };
+
+	static void run(JD2XX jd, int goal, int size, int pause, long nanos) throws Exception {
+		JD2XXTuner tuner = new JD2XXTuner(jd, goal);
+		Thread writer = new Thread(() -> {
+			byte[] b = new byte[size];
+			try {
+				for (long end = System.nanoTime() + nanos; System.nanoTime() < end; ) {
+					jd.write(b);
+					if (pause > 0) Thread.sleep(pause);
+				}
+			}
+			catch (Exception e) {
+				e.printStackTrace();
+			}
+		});
+		writer.start();
+		byte[] r = new byte[65536];
+		while (writer.isAlive()) jd.read(r, 0, size);
+		writer.join();
+		jd.purge(JD2XX.PURGE_RX);
+
+		long[] s = tuner.getStatistics();
+		tuner.close();
+		System.out.println((goal == JD2XXTuner.LATENCY ? "latency" : "throughput")
+			+ (pause > 0 ? ", sparse: " : ", stream: ")
+			+ "latency timer " + s[JD2XXTuner.LATENCY_TIMER] + " ms ("
+			+ REASONS[(int)s[JD2XXTuner.LATENCY_REASON]] + "), transfer "
+			+ s[JD2XXTuner.TRANSFER_SIZE] + " (" + REASONS[(int)s[JD2XXTuner.TRANSFER_REASON]] + "), "
+			+ s[JD2XXTuner.RATE] + " B/s, queue " + s[JD2XXTuner.PEAK_QUEUE] + ", busy "
+			+ s[JD2XXTuner.BUSY] / 10 + "%, gap " + s[JD2XXTuner.IDLE_GAP] + " us, "
+			+ s[JD2XXTuner.LATENCY_CHANGES] + "+" + s[JD2XXTuner.TRANSFER_CHANGES] + " changes in "
+			+ s[JD2XXTuner.WINDOWS] + " windows");
+	}
+
+	public static void main(String[] args) throws Exception {
+		long nanos = (args.length > 0 ? Long.parseLong(args[0]) : 2) * 1000000000L;
+
+		JD2XX jd = new JD2XX();
+		jd.open(0);
+		jd.setTimeouts(5, 1000);
+		for (int goal : new int[] { JD2XXTuner.LATENCY, JD2XXTuner.THROUGHPUT }) {
+			run(jd, goal, 20, 5, nanos);
+			run(jd, goal, 4096, 0, nanos);
+		}
+		jd.close();
+	}
+}
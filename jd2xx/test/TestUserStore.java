@@ -0,0 +1,36 @@
+// package test;
+
+import java.io.IOException;
+
+import jd2xx.JD2XX;
+import jd2xx.JD2XXUserStore;
+
+/** Stores calibration values in the EEPROM user area of device 0 with
+	JD2XXUserStore, committing in batches, and checks them after reloading.
+	Overwrites the user area; run it on the mock driver or a spare device. */
+public class TestUserStore {
+
+	public static void main(String[] args) throws IOException {
+		int n = args.length > 0 ? Integer.parseInt(args[0]) : 100;
+		JD2XX jd = new JD2XX();
+		jd.open(0);
+
+		JD2XXUserStore us = new JD2XXUserStore(jd);
+		System.out.println("keys: " + us.keys());
+		for (int i = 0; i < n; ++i) {
+			us.putInt("offset", i);
+			us.putInt("gain", 1000 + i % 7);
+			if (i % 10 == 9) us.commit();
+		}
+		us.remove("unused");
+		us.commit();
+
+		JD2XXUserStore check = new JD2XXUserStore(jd);
+		boolean ok = check.getInt("offset", -1) == n - 1 && check.getInt("gain", -1) == 1000 + (n - 1) % 7;
+		System.out.println("offset " + check.getInt("offset", -1) + ", gain " + check.getInt("gain", -1)
+			+ (ok ? ": ok" : ": FAILED"));
+
+		jd.close();
+		System.exit(ok ? 0 : 1);
+	}
+}
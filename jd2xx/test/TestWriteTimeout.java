@@ -0,0 +1,36 @@
+// package test;
+
+import java.io.IOException;
+import java.io.InterruptedIOException;
+
+import jd2xx.JD2XX;
+import jd2xx.JD2XXOutputStream;
+
+/** Checks that JD2XXOutputStream gives up when a write timeout expires with
+	nothing sent, instead of retrying forever. Nothing reads the device, so
+	the mock driver in loopback mode (see TestWriteTimeout.sh) accepts 64 KB
+	and then times out. Argument: serial number (default MOCK0000). */
+public class TestWriteTimeout {
+
+	public static void main(String[] args) throws Exception {
+		String serial = args.length > 0 ? args[0] : "MOCK0000";
+		JD2XX jd = new JD2XX(serial, JD2XX.OPEN_BY_SERIAL_NUMBER);
+		jd.setTimeouts(100, 100);
+		JD2XXOutputStream os = new JD2XXOutputStream(jd);
+
+		long t = System.nanoTime();
+		try {
+			os.write(new byte[256 * 1024]);
+			throw new IOException("write did not time out");
+		}
+		catch (InterruptedIOException e) {
+			System.out.println(e.getMessage() + " after " + e.bytesTransferred + " bytes, "
+				+ (System.nanoTime() - t) / 1000000 + " ms");
+			if (e.bytesTransferred <= 0 || e.bytesTransferred >= 256 * 1024)
+				throw new IOException("bytesTransferred " + e.bytesTransferred);
+		}
+		finally {
+			jd.close();
+		}
+	}
+}
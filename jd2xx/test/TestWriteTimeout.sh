@@ -0,0 +1,6 @@
+#!/bin/bash
+# Runs TestWriteTimeout against the mock driver (build it with "make jni-mock")
+# in loopback mode, where nothing reads the written bytes back
+MOCK="$(cd .. && pwd)/libjd2xx_mock.so"
+JD2XX_MOCK_MODE=loopback JD2XX_MOCK_RATE=0 \
+java -Xcheck:jni -Djd2xx.library=$MOCK -cp ../jd2xx.jar:. TestWriteTimeout MOCK0000
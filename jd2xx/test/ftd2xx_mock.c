@@ -0,0 +1,701 @@
+/*
+	Copyright (c) 2004 Pablo Bleyer Kocik.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	1. Redistributions of source code must retain the above copyright notice, this
+	list of conditions and the following disclaimer.
+
+	2. Redistributions in binary form must reproduce the above copyright notice,
+	this list of conditions and the following disclaimer in the documentation
+	and/or other materials provided with the distribution.
+
+	3. The name of the author may not be used to endorse or promote products
+	derived from this software without specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR IMPLIED
+	WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+	MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+	EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+	SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+	PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+	BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+	IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+	Simulated D2XX driver for exercising JD2XX without hardware.
+
+	Linked instead of libftd2xx by "make jni-mock" into libjd2xx_mock.so,
+	which JD2XX loads when started with -Djd2xx.library=<path>. Only the
+	calls needed for data transfer and basic configuration are simulated;
+	the rest are left unresolved and must not be called.
+
+	Environment:
+	JD2XX_MOCK_DEVICES  number of devices (default 1)
+	JD2XX_MOCK_MODE     "loopback" (default): written bytes are read back,
+	                    "stream": reads return a counting byte pattern and
+	                    writes are discarded,
+	                    "modbus": each write is a Modbus RTU request that
+	                    slaves 1-200 answer (input register n reads n,
+	                    holding registers 0-255 are writable, coil n is n & 1)
+	JD2XX_MOCK_RATE     bytes per second per direction (default 1000000,
+	                    0 for unlimited); each direction is paced
+	                    independently, like the two bulk pipes of a device
+	JD2XX_MOCK_OPEN_MS  time an open takes (default 0); the real driver
+	                    claims the interface, resets the chip and reads
+	                    its EEPROM, 10 to 100 ms
+
+	In MPSSE bit mode written bytes are executed as MPSSE GPIO commands
+	instead; every pin reads back its output latch.
+
+	EEPROM contents are kept in memory per device index for the lifetime of
+	the process, so they survive closing and reopening the device.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "jd2xx.h"
+
+#define MOCK_RING_SIZE 65536 // loopback buffer, like the device FIFO plus driver queue
+#define MOCK_MAX_DEVICES 16 // devices with simulated EEPROM
+#define MOCK_EE_STRING 64 // EEPROM string length including terminator
+#define MOCK_EE_WORDS 128 // raw EEPROM size (93C56)
+#define MOCK_UA_SIZE 96 // user area bytes
+
+typedef struct {
+	pthread_mutex_t lock;
+	unsigned long long next; // pacing clock, ns
+} pipe_t;
+
+typedef struct {
+	int index;
+	int stream, modbus;
+	unsigned long long rate;
+	ULONG rtimeout, wtimeout; // ms, 0 = infinite
+	UCHAR latency, bitmode, bitmask;
+	pipe_t in, out;
+	pthread_cond_t cond; // loopback ring changed
+	unsigned char ring[MOCK_RING_SIZE];
+	DWORD head, count; // ring state, guarded by in.lock
+	unsigned char seq; // stream pattern
+	unsigned char pins[2]; // MPSSE ADBUS/ACBUS output latch
+	unsigned short regs[256]; // Modbus holding registers
+} mock_t;
+
+/** Simulated EEPROM of one device */
+typedef struct {
+	FT_PROGRAM_DATA pd; // FT_EE_Program image, string pointers unused
+	unsigned char ee[64]; // FT_EEPROM_Program image
+	char str[4][MOCK_EE_STRING]; // manufacturer, id, description, serial
+	WORD words[MOCK_EE_WORDS]; // raw word access, addresses wrap like a 93C56
+	UCHAR ua[MOCK_UA_SIZE]; // user area
+} eeprom_t;
+
+static pthread_mutex_t eeprom_lock = PTHREAD_MUTEX_INITIALIZER;
+static eeprom_t eeprom[MOCK_MAX_DEVICES];
+
+static int
+env_int(const char *name, int def) {
+	const char *v = getenv(name);
+	return (v != NULL && *v != 0) ? atoi(v) : def;
+}
+
+static unsigned long long
+now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void
+sleep_until(unsigned long long t) {
+	struct timespec ts;
+	ts.tv_sec = t / 1000000000ULL;
+	ts.tv_nsec = t % 1000000000ULL;
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) ;
+}
+
+/** Account n bytes on a pipe, sleep until they would have been transferred */
+static void
+pace(mock_t *m, pipe_t *p, DWORD n) {
+	unsigned long long t = now_ns();
+	if (m->rate == 0 || n == 0) return;
+	if (p->next < t) p->next = t;
+	p->next += (unsigned long long)n * 1000000000ULL / m->rate;
+	sleep_until(p->next);
+}
+
+/** Absolute CLOCK_MONOTONIC deadline for a timeout in ms */
+static void
+deadline(struct timespec *ts, ULONG ms) {
+	unsigned long long t = now_ns() + (unsigned long long)ms * 1000000ULL;
+	ts->tv_sec = t / 1000000000ULL;
+	ts->tv_nsec = t % 1000000000ULL;
+}
+
+static FT_STATUS
+mock_open(int index, FT_HANDLE *ph) {
+	pthread_condattr_t ca;
+	mock_t *m;
+	int i;
+
+	if (index < 0 || index >= env_int("JD2XX_MOCK_DEVICES", 1))
+		return FT_DEVICE_NOT_FOUND;
+	if (env_int("JD2XX_MOCK_OPEN_MS", 0) > 0)
+		sleep_until(now_ns() + env_int("JD2XX_MOCK_OPEN_MS", 0) * 1000000ULL);
+	if ((m = calloc(1, sizeof(mock_t))) == NULL)
+		return FT_INSUFFICIENT_RESOURCES;
+
+	m->index = index;
+	m->stream = (getenv("JD2XX_MOCK_MODE") != NULL
+		&& strcmp(getenv("JD2XX_MOCK_MODE"), "stream") == 0);
+	m->modbus = (getenv("JD2XX_MOCK_MODE") != NULL
+		&& strcmp(getenv("JD2XX_MOCK_MODE"), "modbus") == 0);
+	for (i = 0; i < 256; ++i) m->regs[i] = i;
+	m->rate = env_int("JD2XX_MOCK_RATE", 1000000);
+	m->latency = 16;
+	pthread_mutex_init(&m->in.lock, NULL);
+	pthread_mutex_init(&m->out.lock, NULL);
+	pthread_condattr_init(&ca);
+	pthread_condattr_setclock(&ca, CLOCK_MONOTONIC);
+	pthread_cond_init(&m->cond, &ca);
+	pthread_condattr_destroy(&ca);
+
+	*ph = (FT_HANDLE)m;
+	return FT_OK;
+}
+
+FT_STATUS WINAPI
+FT_Open(int deviceNumber, FT_HANDLE *pHandle) {
+	return mock_open(deviceNumber, pHandle);
+}
+
+FT_STATUS WINAPI
+FT_OpenEx(PVOID pArg1, DWORD Flags, FT_HANDLE *pHandle) {
+	int index;
+
+	if (Flags == FT_OPEN_BY_SERIAL_NUMBER) {
+		if (sscanf((const char*)pArg1, "MOCK%d", &index) != 1)
+			return FT_DEVICE_NOT_FOUND;
+	}
+	else if (Flags == FT_OPEN_BY_DESCRIPTION) {
+		if (sscanf((const char*)pArg1, "JD2XX mock %d", &index) != 1)
+			return FT_DEVICE_NOT_FOUND;
+	}
+	else
+		index = (int)(long)pArg1; // location is the device index
+
+	return mock_open(index, pHandle);
+}
+
+FT_STATUS WINAPI
+FT_Close(FT_HANDLE ftHandle) {
+	mock_t *m = (mock_t*)ftHandle;
+
+	pthread_cond_destroy(&m->cond);
+	pthread_mutex_destroy(&m->in.lock);
+	pthread_mutex_destroy(&m->out.lock);
+	free(m);
+	return FT_OK;
+}
+
+FT_STATUS WINAPI
+FT_Read(FT_HANDLE ftHandle, LPVOID lpBuffer, DWORD nBufferSize, LPDWORD lpBytesReturned) {
+	mock_t *m = (mock_t*)ftHandle;
+	unsigned char *buf = (unsigned char*)lpBuffer;
+	struct timespec ts;
+	DWORD i, n = 0;
+
+	pthread_mutex_lock(&m->in.lock);
+	if (m->stream && m->bitmode != FT_BITMODE_MPSSE) {
+		for (n = 0; n < nBufferSize; ++n) buf[n] = m->seq++;
+		pace(m, &m->in, n);
+	}
+	else {
+		// like the driver: block until the request is satisfied or timeout
+		deadline(&ts, m->rtimeout);
+		while (n < nBufferSize) {
+			DWORD c = m->count < nBufferSize - n ? m->count : nBufferSize - n;
+			for (i = 0; i < c; ++i)
+				buf[n++] = m->ring[(m->head + i) % MOCK_RING_SIZE];
+			m->head = (m->head + c) % MOCK_RING_SIZE;
+			m->count -= c;
+			if (c > 0) pthread_cond_broadcast(&m->cond);
+			if (n == nBufferSize) break;
+			if (m->rtimeout == 0)
+				pthread_cond_wait(&m->cond, &m->in.lock);
+			else if (pthread_cond_timedwait(&m->cond, &m->in.lock, &ts) == ETIMEDOUT
+				&& m->count == 0)
+				break;
+		}
+	}
+	pthread_mutex_unlock(&m->in.lock);
+
+	*lpBytesReturned = n;
+	return FT_OK;
+}
+
+/** Append reply bytes to the loopback ring (in.lock held) */
+static void
+reply(mock_t *m, const unsigned char *buf, DWORD n) {
+	DWORD i;
+	for (i = 0; i < n && m->count < MOCK_RING_SIZE; ++i, ++m->count)
+		m->ring[(m->head + m->count) % MOCK_RING_SIZE] = buf[i];
+	pthread_cond_broadcast(&m->cond);
+}
+
+/** Execute MPSSE GPIO commands (in.lock held) */
+static DWORD
+mpsse(mock_t *m, const unsigned char *buf, DWORD n) {
+	static const unsigned char bad[] = { 0xFA, 0xAA };
+	DWORD i = 0;
+
+	while (i < n) {
+		switch (buf[i]) {
+		case 0x80: case 0x82: // set data bits: value, direction
+			if (i + 2 >= n) return n;
+			m->pins[buf[i] == 0x82] = buf[i + 1];
+			i += 3;
+			break;
+		case 0x81: case 0x83: // read data bits
+			reply(m, &m->pins[buf[i] == 0x83], 1);
+			i++;
+			break;
+		case 0x85: case 0x87: // loopback off, send immediate
+			i++;
+			break;
+		default:
+			reply(m, bad, 1);
+			reply(m, &buf[i++], 1);
+		}
+	}
+	return n;
+}
+
+static unsigned
+crc16(const unsigned char *p, DWORD n) {
+	unsigned crc = 0xffff;
+	int i;
+
+	while (n-- > 0)
+		for (crc ^= *p++, i = 0; i < 8; ++i)
+			crc = (crc & 1) ? (crc >> 1) ^ 0xa001 : crc >> 1;
+	return crc;
+}
+
+/** Answer a Modbus RTU request (in.lock held) */
+static void
+modbus(mock_t *m, const unsigned char *q, DWORD n) {
+	unsigned char r[256];
+	unsigned addr, count, i, v, ex = 0;
+	DWORD k = 3;
+
+	if (n < 8 || crc16(q, n) != 0 || q[0] == 0 || q[0] > 200) return; // no answer
+	addr = q[2] << 8 | q[3];
+	count = q[4] << 8 | q[5];
+	r[0] = q[0];
+	r[1] = q[1];
+
+	switch (q[1]) {
+	case 1: case 2: // read coils, discrete inputs
+		if (count < 1 || count > 2000) {
+			ex = 3; // illegal data value
+			break;
+		}
+		r[2] = (count + 7) / 8;
+		memset(r + 3, 0, r[2]);
+		for (i = 0; i < count; ++i)
+			if ((addr + i) & 1) r[3 + i / 8] |= 1 << (i % 8);
+		k += r[2];
+		break;
+	case 3: case 4: // read holding, input registers
+		if (count < 1 || count > 125) {
+			ex = 3;
+			break;
+		}
+		r[2] = 2 * count;
+		for (i = 0; i < count; ++i) {
+			v = q[1] == 3 ? m->regs[(addr + i) & 0xff] : addr + i;
+			r[k++] = v >> 8;
+			r[k++] = v;
+		}
+		break;
+	case 5: // write single coil
+		memcpy(r + 2, q + 2, 4);
+		k = 6;
+		break;
+	case 6: // write single register
+		m->regs[addr & 0xff] = count;
+		memcpy(r + 2, q + 2, 4);
+		k = 6;
+		break;
+	case 15: case 16: // write multiple coils, registers
+		if (q[1] == 16)
+			for (i = 0; i < count && 7 + 2 * i + 1 < n - 2; ++i)
+				m->regs[(addr + i) & 0xff] = q[7 + 2 * i] << 8 | q[8 + 2 * i];
+		memcpy(r + 2, q + 2, 4);
+		k = 6;
+		break;
+	default:
+		ex = 1; // illegal function
+	}
+
+	if (ex != 0) {
+		r[1] |= 0x80;
+		r[2] = ex;
+		k = 3;
+	}
+	v = crc16(r, k);
+	r[k++] = v;
+	r[k++] = v >> 8;
+	reply(m, r, k);
+}
+
+FT_STATUS WINAPI
+FT_Write(FT_HANDLE ftHandle, LPVOID lpBuffer, DWORD nBufferSize, LPDWORD lpBytesWritten) {
+	mock_t *m = (mock_t*)ftHandle;
+	const unsigned char *buf = (const unsigned char*)lpBuffer;
+	struct timespec ts;
+	DWORD n = 0;
+
+	pthread_mutex_lock(&m->out.lock);
+	pace(m, &m->out, nBufferSize);
+	pthread_mutex_unlock(&m->out.lock);
+
+	if (m->bitmode == FT_BITMODE_MPSSE) {
+		pthread_mutex_lock(&m->in.lock);
+		n = mpsse(m, buf, nBufferSize);
+		pthread_mutex_unlock(&m->in.lock);
+	}
+	else if (m->stream) n = nBufferSize;
+	else if (m->modbus) {
+		pthread_mutex_lock(&m->in.lock);
+		modbus(m, buf, nBufferSize);
+		pthread_mutex_unlock(&m->in.lock);
+		n = nBufferSize;
+	}
+	else {
+		pthread_mutex_lock(&m->in.lock);
+		deadline(&ts, m->wtimeout);
+		while (n < nBufferSize) {
+			while (n < nBufferSize && m->count < MOCK_RING_SIZE) {
+				m->ring[(m->head + m->count) % MOCK_RING_SIZE] = buf[n++];
+				m->count++;
+			}
+			pthread_cond_broadcast(&m->cond);
+			if (n == nBufferSize) break;
+			if (m->wtimeout == 0)
+				pthread_cond_wait(&m->cond, &m->in.lock);
+			else if (pthread_cond_timedwait(&m->cond, &m->in.lock, &ts) == ETIMEDOUT
+				&& m->count == MOCK_RING_SIZE)
+				break;
+		}
+		pthread_mutex_unlock(&m->in.lock);
+	}
+
+	*lpBytesWritten = n;
+	return FT_OK;
+}
+
+FT_STATUS WINAPI
+FT_GetQueueStatus(FT_HANDLE ftHandle, DWORD *dwRxBytes) {
+	mock_t *m = (mock_t*)ftHandle;
+
+	pthread_mutex_lock(&m->in.lock);
+	*dwRxBytes = m->stream ? MOCK_RING_SIZE : m->count;
+	pthread_mutex_unlock(&m->in.lock);
+	return FT_OK;
+}
+
+FT_STATUS WINAPI
+FT_GetStatus(FT_HANDLE ftHandle, DWORD *dwRxBytes, DWORD *dwTxBytes, DWORD *dwEventDWord) {
+	*dwTxBytes = 0;
+	*dwEventDWord = 0;
+	return FT_GetQueueStatus(ftHandle, dwRxBytes);
+}
+
+FT_STATUS WINAPI
+FT_SetTimeouts(FT_HANDLE ftHandle, ULONG ReadTimeout, ULONG WriteTimeout) {
+	mock_t *m = (mock_t*)ftHandle;
+
+	pthread_mutex_lock(&m->in.lock);
+	m->rtimeout = ReadTimeout;
+	m->wtimeout = WriteTimeout;
+	pthread_mutex_unlock(&m->in.lock);
+	return FT_OK;
+}
+
+FT_STATUS WINAPI
+FT_Purge(FT_HANDLE ftHandle, ULONG Mask) {
+	mock_t *m = (mock_t*)ftHandle;
+
+	if (Mask & FT_PURGE_RX) {
+		pthread_mutex_lock(&m->in.lock);
+		m->head = m->count = 0;
+		pthread_cond_broadcast(&m->cond);
+		pthread_mutex_unlock(&m->in.lock);
+	}
+	return FT_OK;
+}
+
+FT_STATUS WINAPI
+FT_ResetDevice(FT_HANDLE ftHandle) {
+	return FT_Purge(ftHandle, FT_PURGE_RX | FT_PURGE_TX);
+}
+
+FT_STATUS WINAPI
+FT_SetLatencyTimer(FT_HANDLE ftHandle, UCHAR ucLatency) {
+	if (ucLatency < 2) return FT_INVALID_PARAMETER;
+	((mock_t*)ftHandle)->latency = ucLatency;
+	return FT_OK;
+}
+
+FT_STATUS WINAPI
+FT_GetLatencyTimer(FT_HANDLE ftHandle, PUCHAR pucLatency) {
+	*pucLatency = ((mock_t*)ftHandle)->latency;
+	return FT_OK;
+}
+
+FT_STATUS WINAPI
+FT_SetBitMode(FT_HANDLE ftHandle, UCHAR ucMask, UCHAR ucEnable) {
+	((mock_t*)ftHandle)->bitmask = ucMask;
+	((mock_t*)ftHandle)->bitmode = ucEnable;
+	return FT_OK;
+}
+
+FT_STATUS WINAPI
+FT_GetBitMode(FT_HANDLE ftHandle, PUCHAR pucMode) {
+	*pucMode = ((mock_t*)ftHandle)->bitmask; // pins read back as driven
+	return FT_OK;
+}
+
+FT_STATUS WINAPI
+FT_GetModemStatus(FT_HANDLE ftHandle, ULONG *pModemStatus) {
+	*pModemStatus = 0x6000; // THRE | TEMT
+	return FT_OK;
+}
+
+FT_STATUS WINAPI
+FT_GetDeviceInfo(FT_HANDLE ftHandle, FT_DEVICE *lpftDevice, LPDWORD lpdwID,
+	PCHAR SerialNumber, PCHAR Description, LPVOID Dummy) {
+	mock_t *m = (mock_t*)ftHandle;
+
+	*lpftDevice = FT_DEVICE_232R;
+	*lpdwID = 0x04036001;
+	sprintf(SerialNumber, "MOCK%04d", m->index);
+	sprintf(Description, "JD2XX mock %d", m->index);
+	return FT_OK;
+}
+
+FT_STATUS WINAPI
+FT_CreateDeviceInfoList(LPDWORD lpdwNumDevs) {
+	*lpdwNumDevs = env_int("JD2XX_MOCK_DEVICES", 1);
+	return FT_OK;
+}
+
+/* Line settings have no effect on the simulation */
+
+FT_STATUS WINAPI
+FT_SetBaudRate(FT_HANDLE ftHandle, ULONG BaudRate) {
+	return BaudRate == 0 ? FT_INVALID_BAUD_RATE : FT_OK;
+}
+
+FT_STATUS WINAPI
+FT_SetDataCharacteristics(FT_HANDLE ftHandle, UCHAR WordLength, UCHAR StopBits, UCHAR Parity) {
+	return FT_OK;
+}
+
+FT_STATUS WINAPI
+FT_SetFlowControl(FT_HANDLE ftHandle, USHORT FlowControl, UCHAR XonChar, UCHAR XoffChar) {
+	return FT_OK;
+}
+
+FT_STATUS WINAPI
+FT_SetUSBParameters(FT_HANDLE ftHandle, ULONG ulInTransferSize, ULONG ulOutTransferSize) {
+	return FT_OK;
+}
+
+FT_STATUS WINAPI
+FT_SetChars(FT_HANDLE ftHandle, UCHAR EventChar, UCHAR EventCharEnabled,
+	UCHAR ErrorChar, UCHAR ErrorCharEnabled) {
+	return FT_OK;
+}
+
+FT_STATUS WINAPI FT_SetDtr(FT_HANDLE ftHandle) { return FT_OK; }
+FT_STATUS WINAPI FT_ClrDtr(FT_HANDLE ftHandle) { return FT_OK; }
+FT_STATUS WINAPI FT_SetRts(FT_HANDLE ftHandle) { return FT_OK; }
+FT_STATUS WINAPI FT_ClrRts(FT_HANDLE ftHandle) { return FT_OK; }
+FT_STATUS WINAPI FT_SetBreakOn(FT_HANDLE ftHandle) { return FT_OK; }
+FT_STATUS WINAPI FT_SetBreakOff(FT_HANDLE ftHandle) { return FT_OK; }
+
+/* EEPROM */
+
+static void
+copy_string(char *dst, const char *src) {
+	if (dst == NULL) return;
+	if (src == NULL) src = "";
+	strncpy(dst, src, MOCK_EE_STRING - 1);
+	dst[MOCK_EE_STRING - 1] = 0;
+}
+
+static eeprom_t *
+mock_eeprom(FT_HANDLE ftHandle) {
+	int index = ((mock_t*)ftHandle)->index;
+	return index < MOCK_MAX_DEVICES ? &eeprom[index] : NULL;
+}
+
+FT_STATUS WINAPI
+FT_ReadEE(FT_HANDLE ftHandle, DWORD dwWordOffset, LPWORD lpwValue) {
+	eeprom_t *e = mock_eeprom(ftHandle);
+
+	if (e == NULL) return FT_EEPROM_NOT_PRESENT;
+	pthread_mutex_lock(&eeprom_lock);
+	*lpwValue = e->words[dwWordOffset % MOCK_EE_WORDS];
+	pthread_mutex_unlock(&eeprom_lock);
+	return FT_OK;
+}
+
+FT_STATUS WINAPI
+FT_WriteEE(FT_HANDLE ftHandle, DWORD dwWordOffset, WORD wValue) {
+	eeprom_t *e = mock_eeprom(ftHandle);
+
+	if (e == NULL) return FT_EEPROM_NOT_PRESENT;
+	pthread_mutex_lock(&eeprom_lock);
+	e->words[dwWordOffset % MOCK_EE_WORDS] = wValue;
+	pthread_mutex_unlock(&eeprom_lock);
+	return FT_OK;
+}
+
+FT_STATUS WINAPI
+FT_EraseEE(FT_HANDLE ftHandle) {
+	eeprom_t *e = mock_eeprom(ftHandle);
+
+	if (e == NULL) return FT_EEPROM_NOT_PRESENT;
+	pthread_mutex_lock(&eeprom_lock);
+	memset(e->words, 0xff, sizeof(e->words));
+	pthread_mutex_unlock(&eeprom_lock);
+	return FT_OK;
+}
+
+FT_STATUS WINAPI
+FT_EE_Read(FT_HANDLE ftHandle, PFT_PROGRAM_DATA pData) {
+	eeprom_t *e = mock_eeprom(ftHandle);
+	FT_PROGRAM_DATA pd = *pData;
+
+	if (e == NULL) return FT_EEPROM_NOT_PRESENT;
+	pthread_mutex_lock(&eeprom_lock);
+	*pData = e->pd;
+	pData->Signature1 = pd.Signature1;
+	pData->Signature2 = pd.Signature2;
+	pData->Version = pd.Version;
+	pData->Manufacturer = pd.Manufacturer;
+	pData->ManufacturerId = pd.ManufacturerId;
+	pData->Description = pd.Description;
+	pData->SerialNumber = pd.SerialNumber;
+	copy_string(pd.Manufacturer, e->str[0]);
+	copy_string(pd.ManufacturerId, e->str[1]);
+	copy_string(pd.Description, e->str[2]);
+	copy_string(pd.SerialNumber, e->str[3]);
+	pthread_mutex_unlock(&eeprom_lock);
+	return FT_OK;
+}
+
+FT_STATUS WINAPI
+FT_EE_Program(FT_HANDLE ftHandle, PFT_PROGRAM_DATA pData) {
+	eeprom_t *e = mock_eeprom(ftHandle);
+
+	if (e == NULL) return FT_EEPROM_NOT_PRESENT;
+	pthread_mutex_lock(&eeprom_lock);
+	e->pd = *pData;
+	e->pd.Manufacturer = e->pd.ManufacturerId = NULL;
+	e->pd.Description = e->pd.SerialNumber = NULL;
+	copy_string(e->str[0], pData->Manufacturer);
+	copy_string(e->str[1], pData->ManufacturerId);
+	copy_string(e->str[2], pData->Description);
+	copy_string(e->str[3], pData->SerialNumber);
+	pthread_mutex_unlock(&eeprom_lock);
+	return FT_OK;
+}
+
+FT_STATUS WINAPI
+FT_EE_UASize(FT_HANDLE ftHandle, LPDWORD lpdwSize) {
+	if (mock_eeprom(ftHandle) == NULL) return FT_EEPROM_NOT_PRESENT;
+	*lpdwSize = MOCK_UA_SIZE;
+	return FT_OK;
+}
+
+FT_STATUS WINAPI
+FT_EE_UAWrite(FT_HANDLE ftHandle, PUCHAR pucData, DWORD dwDataLen) {
+	eeprom_t *e = mock_eeprom(ftHandle);
+
+	if (e == NULL) return FT_EEPROM_NOT_PRESENT;
+	if (dwDataLen > MOCK_UA_SIZE) return FT_INVALID_PARAMETER;
+	pthread_mutex_lock(&eeprom_lock);
+	memcpy(e->ua, pucData, dwDataLen);
+	pthread_mutex_unlock(&eeprom_lock);
+	return FT_OK;
+}
+
+FT_STATUS WINAPI
+FT_EE_UARead(FT_HANDLE ftHandle, PUCHAR pucData, DWORD dwDataLen, LPDWORD lpdwBytesRead) {
+	eeprom_t *e = mock_eeprom(ftHandle);
+
+	if (e == NULL) return FT_EEPROM_NOT_PRESENT;
+	if (dwDataLen > MOCK_UA_SIZE) dwDataLen = MOCK_UA_SIZE;
+	pthread_mutex_lock(&eeprom_lock);
+	memcpy(pucData, e->ua, dwDataLen);
+	pthread_mutex_unlock(&eeprom_lock);
+	*lpdwBytesRead = dwDataLen;
+	return FT_OK;
+}
+
+#ifdef FT_DRIVER_TYPE_D2XX
+FT_STATUS WINAPI
+FT_EEPROM_Read(FT_HANDLE ftHandle, void *eepromData, DWORD eepromDataSize,
+	char *Manufacturer, char *ManufacturerId, char *Description, char *SerialNumber) {
+	eeprom_t *e = mock_eeprom(ftHandle);
+	FT_EEPROM_HEADER h;
+
+	if (e == NULL) return FT_EEPROM_NOT_PRESENT;
+	if (eepromData == NULL || eepromDataSize < sizeof(h) || eepromDataSize > sizeof(e->ee))
+		return FT_INVALID_PARAMETER;
+	memcpy(&h, eepromData, sizeof(h));
+	pthread_mutex_lock(&eeprom_lock);
+	memcpy(eepromData, e->ee, eepromDataSize);
+	((FT_EEPROM_HEADER*)eepromData)->deviceType = h.deviceType; // caller selects the layout
+	copy_string(Manufacturer, e->str[0]);
+	copy_string(ManufacturerId, e->str[1]);
+	copy_string(Description, e->str[2]);
+	copy_string(SerialNumber, e->str[3]);
+	pthread_mutex_unlock(&eeprom_lock);
+	return FT_OK;
+}
+
+FT_STATUS WINAPI
+FT_EEPROM_Program(FT_HANDLE ftHandle, void *eepromData, DWORD eepromDataSize,
+	char *Manufacturer, char *ManufacturerId, char *Description, char *SerialNumber) {
+	eeprom_t *e = mock_eeprom(ftHandle);
+
+	if (e == NULL) return FT_EEPROM_NOT_PRESENT;
+	if (eepromData == NULL || eepromDataSize < sizeof(FT_EEPROM_HEADER)
+		|| eepromDataSize > sizeof(e->ee))
+		return FT_INVALID_PARAMETER;
+	pthread_mutex_lock(&eeprom_lock);
+	memcpy(e->ee, eepromData, eepromDataSize);
+	copy_string(e->str[0], Manufacturer);
+	copy_string(e->str[1], ManufacturerId);
+	copy_string(e->str[2], Description);
+	copy_string(e->str[3], SerialNumber);
+	pthread_mutex_unlock(&eeprom_lock);
+	return FT_OK;
+}
+#endif